@@ -265,7 +265,7 @@ ClassRecognition::move_token_to_node(ClassToken token,
     Decoder::Node &node = d->m_nodes[node_idx];
 
     if (token.node_idx == node_idx) {
-        token.dur++;
+        token.dur += m_frame_skip;
         if (token.dur > m_max_state_duration && node.hmm_state > m_last_sil_idx) {
             m_max_state_duration_pruned_count++;
             return;
@@ -276,7 +276,7 @@ ClassRecognition::move_token_to_node(ClassToken token,
         if (m_duration_model_in_use && d->m_nodes[token.node_idx].hmm_state != -1)
             token.apply_duration_model();
         token.node_idx = node_idx;
-        token.dur = 1;
+        token.dur = m_frame_skip;
     }
 
     // HMM node
@@ -5,6 +5,7 @@
 #include <list>
 #include <sstream>
 #include <map>
+#include <thread>
 
 #include "ClassLookahead.hh"
 
@@ -50,7 +51,9 @@ ClassBigramLookahead::ClassBigramLookahead(
     Decoder &decoder,
     string carpafname,
     string cmempfname,
-    bool quantization)
+    bool quantization,
+    int num_threads,
+    string cachefname)
     : m_class_la(carpafname,
                  cmempfname,
                  decoder.m_text_units,
@@ -60,6 +63,25 @@ ClassBigramLookahead::ClassBigramLookahead(
 {
     this->decoder = &decoder;
 
+    vector<string> model_fnames;
+    model_fnames.push_back(carpafname);
+    model_fnames.push_back(cmempfname);
+    string la_type = quantization ? "class-bigram-quantized" : "class-bigram";
+    LookaheadCache cache(la_type, decoder, model_fnames);
+    if (cache.read(cachefname)) {
+        cache.get_value("la_state_count", m_la_state_count);
+        cache.get("node_la_states", m_node_la_states);
+        if (quantization) {
+            cache.get_value("min_la_score", m_min_la_score);
+            m_quant_log_probs.setMinLogProb(m_min_la_score * ln_to_log10);
+            cache.get("la_scores", m_quant_bigram_lookup);
+        }
+        else
+            cache.get("la_scores", m_la_scores);
+        cache.get_graph(decoder);
+        return;
+    }
+
     time_t t1,t2;
     t1 = time(0);
     cerr << "Setting look-ahead state indices" << endl;
@@ -70,10 +92,24 @@ ClassBigramLookahead::ClassBigramLookahead(
     cerr << "Number of look-ahead states: " << m_la_state_count << endl;
     t1 = time(0);
     cerr << "Setting look-ahead scores" << endl;
-    set_la_scores();
+    set_la_scores(num_threads);
     t2 = time(0);
     cerr << "elapsed time for setting scores: " << (t2-t1) << endl;
     set_arc_la_updates();
+
+    if (cachefname.length() > 0) {
+        cache.create(cachefname);
+        cache.set_value("la_state_count", m_la_state_count);
+        cache.set("node_la_states", m_node_la_states);
+        if (quantization) {
+            cache.set_value("min_la_score", m_min_la_score);
+            cache.set("la_scores", m_quant_bigram_lookup);
+        }
+        else
+            cache.set("la_scores", m_la_scores);
+        cache.set_graph(decoder);
+        cache.close();
+    }
 }
 
 
@@ -256,8 +292,10 @@ ClassBigramLookahead::set_la_score(
 
 
 void
-ClassBigramLookahead::set_la_scores()
+ClassBigramLookahead::set_la_scores(int num_threads)
 {
+    num_threads = max(1, num_threads);
+
     vector<vector<float> > cbgProbs;
     cbgProbs.resize(m_class_la.m_num_classes);
     for (int i=0; i<(int)cbgProbs.size(); i++) {
@@ -271,13 +309,37 @@ ClassBigramLookahead::set_la_scores()
                                        cbgProbs[i][cbgProbs[i].size()-1]);
     }
 
-    map<int,int> la_state_nodes;
+    vector<int> la_state_nodes(m_la_state_count, -1);
     for (int i=0; i<(int)m_node_la_states.size(); i++)
-        la_state_nodes[m_node_la_states[i]] = i;
+        if (m_node_la_states[i] != -1)
+            la_state_nodes[m_node_la_states[i]] = i;
 
     init_la_scores();
 
-    for (int i=0; i<m_la_state_count; i++) {
+    // Look-ahead states are divided between the threads,
+    // each thread sets only the scores of its own states
+    vector<std::thread*> threads;
+    for (int t=0; t<num_threads; t++) {
+        std::thread *thr = new std::thread(&ClassBigramLookahead::set_la_state_scores,
+                                           this, std::cref(cbgProbs), std::cref(la_state_nodes),
+                                           t, num_threads);
+        threads.push_back(thr);
+    }
+    for (int t=0; t<num_threads; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+}
+
+
+void
+ClassBigramLookahead::set_la_state_scores(
+    const vector<vector<float> > &cbgProbs,
+    const vector<int> &la_state_nodes,
+    int thread_idx,
+    int num_threads)
+{
+    for (int i=thread_idx; i<m_la_state_count; i += num_threads) {
         int node_idx = la_state_nodes[i];
         vector<int> successor_words;
         find_successor_words(node_idx, successor_words);
@@ -26,7 +26,9 @@ public:
     ClassBigramLookahead(Decoder &decoder,
                          std::string carpafname,
                          std::string classmfname,
-                         bool quantization=false);
+                         bool quantization=false,
+                         int num_threads=1,
+                         std::string cachefname="");
     ~ClassBigramLookahead() {};
     float get_lookahead_score(int node_idx, int word_id);
     void readStates(std::string ifname);
@@ -38,7 +40,11 @@ private:
     float set_arc_la_updates();
     void init_la_scores();
     void set_la_score(int la_state, int class_idx, float la_prob);
-    void set_la_scores();
+    void set_la_scores(int num_threads);
+    void set_la_state_scores(const std::vector<std::vector<float> > &cbgProbs,
+                             const std::vector<int> &la_state_nodes,
+                             int thread_idx,
+                             int num_threads);
     std::vector<int> m_node_la_states;
     int m_la_state_count;
 
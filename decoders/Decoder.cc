@@ -1,15 +1,13 @@
 #include <algorithm>
-#include <list>
 #include <sstream>
 #include <ctime>
 
+#include "NodeOrder.hh"
 #include "NowayHmmReader.hh"
 #include "Decoder.hh"
 
 using namespace std;
 
-int NBEST_MAX_NUM_RECOMBINATIONS = 3;
-
 Decoder::Decoder()
 {
     m_stats = 0;
@@ -28,6 +26,8 @@ Decoder::Decoder()
     m_node_beam = 0.0;
     m_token_limit = 500000;
     m_history_clean_frame_interval = 10;
+    m_frame_skip = 1;
+    m_frame_skip_combination = FrameSkipAcoustics::MEAN;
     m_max_state_duration = 80;
     m_decode_start_node = -1;
     m_last_sil_idx = -1;
@@ -156,6 +156,54 @@ Decoder::read_dgraph(string fname)
 }
 
 
+void
+Decoder::write_dgraph(string fname) const
+{
+    SimpleFileOutput outf(fname);
+    outf << (unsigned int)m_nodes.size() << "\n";
+    for (unsigned int i=0; i<m_nodes.size(); i++) {
+        const Node &node = m_nodes[i];
+        outf << "n " << i << " " << node.hmm_state << " " << node.word_id << " "
+             << (unsigned int)node.arcs.size() << " " << node.flags << "\n";
+    }
+    for (unsigned int i=0; i<m_nodes.size(); i++)
+        for (auto ait = m_nodes[i].arcs.begin(); ait != m_nodes[i].arcs.end(); ++ait)
+            outf << "a " << i << " " << ait->target_node << "\n";
+}
+
+
+vector<int>
+Decoder::order_nodes_for_locality()
+{
+    if (m_la != nullptr) throw string("Nodes ordered after setting the look-ahead.");
+
+    vector<int> arc_offsets(1, 0);
+    vector<int> arc_targets;
+    vector<int> flags;
+    for (auto nit = m_nodes.begin(); nit != m_nodes.end(); ++nit) {
+        for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
+            arc_targets.push_back(ait->target_node);
+        arc_offsets.push_back(arc_targets.size());
+        flags.push_back(nit->flags);
+    }
+    vector<int> order = locality_node_order(arc_offsets, arc_targets, flags);
+    vector<int> new_indices = invert_node_order(order);
+
+    // Arcs are copied to allocate them in the new order
+    vector<Node> ordered_nodes(m_nodes.size());
+    for (int i=0; i<(int)order.size(); i++) {
+        ordered_nodes[i] = m_nodes[order[i]];
+        for (auto ait = ordered_nodes[i].arcs.begin(); ait != ordered_nodes[i].arcs.end(); ++ait)
+            ait->target_node = new_indices[ait->target_node];
+    }
+    m_nodes.swap(ordered_nodes);
+    if (m_decode_start_node != -1)
+        m_decode_start_node = new_indices[m_decode_start_node];
+
+    return new_indices;
+}
+
+
 void
 Decoder::set_hmm_transition_probs()
 {
@@ -282,6 +330,10 @@ Decoder::print_config(ostream &outf)
     outf << "word end beam: " << m_word_end_beam << endl;
     outf << "node beam: " << m_node_beam << endl;
     outf << "history clean frame interval: " << m_history_clean_frame_interval << endl;
+    outf << "frame skip: " << m_frame_skip << endl;
+    if (m_frame_skip > 1)
+        outf << "frame skip combination: "
+             << FrameSkipAcoustics::get_combination_name(m_frame_skip_combination) << endl;
 }
 
 
@@ -291,25 +343,45 @@ Recognition::recognize_lna_file(
     RecognitionResult &res,
     bool write_nbest,
     double nbest_beam,
-    int nbest_max_num_hypotheses)
+    int nbest_max_num_hypotheses,
+    bool write_lattice)
 {
     m_lna_reader.open_file(lnafname, 1024);
-    m_acoustics = &m_lna_reader;
+    recognize(m_lna_reader, res, write_nbest, nbest_beam, nbest_max_num_hypotheses, write_lattice);
+    m_lna_reader.close();
+}
+
+
+void
+Recognition::recognize(
+    Acoustics &acoustics,
+    RecognitionResult &res,
+    bool write_nbest,
+    double nbest_beam,
+    int nbest_max_num_hypotheses,
+    bool write_lattice)
+{
+    bool collect_links = write_nbest || write_lattice;
+    FrameSkipAcoustics frame_skip_acoustics(acoustics, m_frame_skip, d->m_frame_skip_combination);
+    if (m_frame_skip > 1)
+        m_acoustics = &frame_skip_acoustics;
+    else
+        m_acoustics = &acoustics;
 
     time_t start_time, end_time;
     time(&start_time);
     m_frame_idx = 0;
-    while (m_lna_reader.go_to(m_frame_idx)) {
+    while (m_acoustics->go_to(m_frame_idx)) {
 
         reset_frame_variables();
         propagate_tokens();
 
-        if (!write_nbest && m_frame_idx % d->m_history_clean_frame_interval == 0) {
+        if (!collect_links && m_frame_idx % d->m_history_clean_frame_interval == 0) {
             prune_tokens(true, false);
             prune_word_history();
             //print_certain_word_history();
         }
-        else prune_tokens(false, write_nbest);
+        else prune_tokens(false, collect_links);
 
         if (m_stats) {
             cerr << endl << "recognized frame: " << m_frame_idx << endl;
@@ -335,7 +407,7 @@ Recognition::recognize_lna_file(
     for (auto tit = tokens.begin(); tit != tokens.end(); ++tit) {
         Token *tok = *tit;
         if (m_duration_model_in_use && tok->dur > 1)
-            tok->apply_duration_model();
+            tok->apply_duration_model(get_node(tok->node_idx).hmm_state);
         tok->update_lookahead_prob(0.0);
         tok->update_total_log_prob();
     }
@@ -348,7 +420,7 @@ Recognition::recognize_lna_file(
         best_token = get_best_token(tokens);
     }
 
-    res.total_frames = m_frame_idx;
+    res.total_frames = m_frame_skip > 1 ? frame_skip_acoustics.num_source_frames() : m_frame_idx;
     res.total_time = difftime(end_time, start_time);
     res.total_token_count = m_total_token_count;
     res.set_best_result(
@@ -357,36 +429,26 @@ Recognition::recognize_lna_file(
         best_token->am_log_prob,
         best_token->lm_log_prob);
 
-    if (write_nbest) {
+    if (collect_links) {
         vector<Token*> hypo_tokens = get_best_hypo_tokens(tokens);
-        if (find(hypo_tokens.begin(), hypo_tokens.end(), best_token) == hypo_tokens.end()) {
-            hypo_tokens.insert(hypo_tokens.begin(), best_token);
-        }
-
-        NbestStorage nbest_storage(nbest_max_num_hypotheses, nbest_beam);
-        for (int i=0; i<(int)hypo_tokens.size(); i++) {
-            Token *hypo_token = hypo_tokens[i];
-            if (hypo_token->total_log_prob >= (best_token->total_log_prob-nbest_beam))
-                get_nbest_results(
-                        hypo_token->history,
-                        {hypo_token->total_log_prob, hypo_token->am_log_prob, hypo_token->lm_log_prob},
-                        best_token->total_log_prob,
-                        nbest_beam,
-                        nbest_storage);
-        }
-
-        vector<pair<string, array<float, 3> > > nbest_results = nbest_storage.get_results(m_text_units);
-        for (int n=0; n<(int)nbest_results.size(); n++) {
-            res.add_nbest_result(
-                nbest_results[n].first,
-                nbest_results[n].second[0],
-                nbest_results[n].second[1],
-                nbest_results[n].second[2]);
+        Lattice &lattice = res.lattice;
+        build_lattice(hypo_tokens, lattice);
+        lattice.prune(d->m_lm_scale, nbest_beam);
+
+        if (write_nbest) {
+            vector<Lattice::Hypothesis> nbest_results
+                = lattice.get_nbest(d->m_lm_scale, nbest_max_num_hypotheses, nbest_beam);
+            for (auto hit = nbest_results.begin(); hit != nbest_results.end(); ++hit) {
+                string result;
+                for (auto wit = hit->word_ids.begin(); wit != hit->word_ids.end(); ++wit)
+                    result += " " + m_text_units->at(*wit);
+                res.add_nbest_result(result, hit->total_lp, hit->total_am_lp, hit->total_lm_lp);
+            }
         }
+        if (!write_lattice) lattice.clear();
     }
 
     clear_word_history();
-    m_lna_reader.close();
 }
 
 
@@ -399,9 +461,16 @@ Recognition::Token::update_total_log_prob()
 
 void
 Recognition::Token::apply_duration_model()
+{
+    apply_duration_model(d->m_nodes[node_idx].hmm_state);
+}
+
+
+void
+Recognition::Token::apply_duration_model(int hmm_state)
 {
     am_log_prob += d->m_duration_scale
-                   * d->m_hmm_states[d->m_nodes[node_idx].hmm_state].duration.get_log_prob(dur);
+                   * d->m_hmm_states[hmm_state].duration.get_log_prob(dur);
 }
 
 
@@ -422,6 +491,7 @@ Recognition::Recognition(Decoder &decoder) :
     m_word_end_beam(decoder.m_word_end_beam),
     m_duration_model_in_use(decoder.m_duration_model_in_use),
     m_max_state_duration(decoder.m_max_state_duration),
+    m_frame_skip(max(1, decoder.m_frame_skip)),
     m_last_sil_idx(decoder.m_last_sil_idx),
     m_use_word_boundary_symbol(decoder.m_use_word_boundary_symbol),
     m_word_boundary_symbol_idx(decoder.m_word_boundary_symbol_idx),
@@ -511,17 +581,158 @@ void
 Recognition::advance_in_word_history(Token *token, int word_id)
 {
     auto next_history = token->history->next.find(word_id);
-    if (next_history != token->history->next.end())
+    int end_frame = (m_frame_idx + 1) * m_frame_skip;
+    if (next_history != token->history->next.end()) {
         token->history = next_history->second;
+        WordHistory *wh = token->history;
+        if (wh->end_frame == end_frame
+            && token->total_log_prob > wh->am_log_prob + d->m_lm_scale * wh->lm_log_prob)
+        {
+            wh->am_log_prob = token->am_log_prob;
+            wh->lm_log_prob = token->lm_log_prob;
+        }
+    }
     else {
         token->history = new WordHistory(word_id, token->history);
         token->history->previous->next[word_id] = token->history;
+        token->history->end_frame = end_frame;
+        token->history->am_log_prob = token->am_log_prob;
+        token->history->lm_log_prob = token->lm_log_prob;
         m_word_history_leafs.erase(token->history->previous);
         m_word_history_leafs.insert(token->history);
     }
 }
 
 
+void
+Recognition::build_lattice(vector<Token*> &hypo_tokens,
+                           Lattice &lattice)
+{
+    lattice.clear();
+    map<pair<WordHistory*, int>, int> lattice_nodes;
+    vector<pair<WordHistory*, int> > unexpanded_nodes;
+    map<WordHistory*, int> max_link_frames;
+    lattice.m_initial_node = lattice.add_node(0);
+    lattice.m_final_node = lattice.add_node(m_frame_idx * m_frame_skip);
+    for (auto tit = hypo_tokens.begin(); tit != hypo_tokens.end(); ++tit) {
+        Token *tok = *tit;
+        WordHistory *wh = tok->history;
+        int node_idx = get_lattice_node(wh, m_frame_idx, lattice, lattice_nodes,
+                                        unexpanded_nodes, max_link_frames);
+        lattice.add_arc(node_idx, lattice.m_final_node, -1,
+                        tok->am_log_prob - wh->am_log_prob,
+                        tok->lm_log_prob - wh->lm_log_prob);
+    }
+
+    // Arcs to the new nodes, expanded from a stack instead of recursion
+    // as the histories are as deep as the utterance
+    while (unexpanded_nodes.size() > 0) {
+        WordHistory *history = unexpanded_nodes.back().first;
+        int frame_limit = unexpanded_nodes.back().second;
+        unexpanded_nodes.pop_back();
+        int node_idx = lattice_nodes[make_pair(history, frame_limit)];
+
+        WordHistory *previous = history->previous;
+        int previous_node_idx = get_lattice_node(previous, frame_limit, lattice, lattice_nodes,
+                                                 unexpanded_nodes, max_link_frames);
+        lattice.add_arc(previous_node_idx, node_idx, history->word_id,
+                        history->am_log_prob - previous->am_log_prob,
+                        history->lm_log_prob - previous->lm_log_prob);
+
+        for (auto rlit = history->recombination_links.begin();
+             rlit != history->recombination_links.end(); ++rlit)
+        {
+            const RecombinationLink &link = rlit->second;
+            if (link.m_frame_idx >= frame_limit) continue;
+            WordHistory *recombined = rlit->first;
+            int recombined_node_idx = get_lattice_node(recombined, link.m_frame_idx, lattice, lattice_nodes,
+                                                       unexpanded_nodes, max_link_frames);
+            lattice.add_arc(recombined_node_idx, node_idx, -1,
+                            link.m_am_lp_penalty + history->am_log_prob - recombined->am_log_prob,
+                            link.m_lm_lp_penalty + history->lm_log_prob - recombined->lm_log_prob);
+        }
+    }
+}
+
+
+// Lattice nodes are word histories with a limit for the frames
+// of the recombination links followed further back,
+// which keeps the lattice acyclic.
+// A recombination link to a history with a worse score at the frame
+// becomes a null arc with the score difference of the paths.
+// New nodes are added to the unexpanded nodes for setting their arcs.
+int
+Recognition::get_lattice_node(WordHistory *history,
+                              int frame_limit,
+                              Lattice &lattice,
+                              map<pair<WordHistory*, int>, int> &lattice_nodes,
+                              vector<pair<WordHistory*, int> > &unexpanded_nodes,
+                              map<WordHistory*, int> &max_link_frames)
+{
+    if (history->previous == nullptr) return lattice.m_initial_node;
+
+    frame_limit = lattice_frame_limit(history, frame_limit, max_link_frames);
+    auto lnit = lattice_nodes.find(make_pair(history, frame_limit));
+    if (lnit != lattice_nodes.end()) return lnit->second;
+    int node_idx = lattice.add_node(history->end_frame);
+    lattice_nodes[make_pair(history, frame_limit)] = node_idx;
+    unexpanded_nodes.push_back(make_pair(history, frame_limit));
+
+    return node_idx;
+}
+
+
+// Smallest frame limit which follows the same recombination links
+// from the history and its predecessors as the given limit.
+// Limits without links between them share the node and its ancestry.
+int
+Recognition::lattice_frame_limit(WordHistory *history,
+                                 int frame_limit,
+                                 map<WordHistory*, int> &max_link_frames)
+{
+    int max_frame = -1;
+    for (WordHistory *wh = history; wh != nullptr; wh = wh->previous) {
+        int max_previous_frame = max_link_frame(wh, max_link_frames);
+        if (max_previous_frame < frame_limit) {
+            max_frame = max(max_frame, max_previous_frame);
+            break;
+        }
+        for (auto rlit = wh->recombination_links.begin();
+             rlit != wh->recombination_links.end(); ++rlit)
+        {
+            int link_frame = rlit->second.m_frame_idx;
+            if (link_frame < frame_limit) max_frame = max(max_frame, link_frame);
+        }
+    }
+    return max_frame + 1;
+}
+
+
+// Last frame of the recombination links of the history and its predecessors
+int
+Recognition::max_link_frame(WordHistory *history,
+                            map<WordHistory*, int> &max_link_frames)
+{
+    vector<WordHistory*> histories;
+    int max_frame = -1;
+    for (WordHistory *wh = history; wh != nullptr; wh = wh->previous) {
+        auto mlit = max_link_frames.find(wh);
+        if (mlit != max_link_frames.end()) {
+            max_frame = mlit->second;
+            break;
+        }
+        histories.push_back(wh);
+    }
+    for (auto hit = histories.rbegin(); hit != histories.rend(); ++hit) {
+        for (auto rlit = (*hit)->recombination_links.begin();
+             rlit != (*hit)->recombination_links.end(); ++rlit)
+            max_frame = max(max_frame, rlit->second.m_frame_idx);
+        max_link_frames[*hit] = max_frame;
+    }
+    return max_frame;
+}
+
+
 Recognition::Token*
 Recognition::get_best_token(vector<Token*> &tokens)
 {
@@ -556,7 +767,7 @@ Recognition::get_end_tokens(vector<Token*> &tokens)
     vector<Token*> end_tokens;
     for (auto tit = tokens.begin(); tit != tokens.end(); ++tit) {
         //if (tit->lm_node != m_ngram_state_sentence_begin) continue;
-        Decoder::Node &node = d->m_nodes[(*tit)->node_idx];
+        const Decoder::Node &node = get_node((*tit)->node_idx);
         if (node.flags & NODE_SILENCE)
             end_tokens.push_back(*tit);
     }
@@ -610,148 +821,12 @@ Recognition::get_result(WordHistory *history)
 }
 
 
-NbestStorage::NbestStorage(int max_num_hypotheses, float beam) {
-    m_max_num_hypotheses = max_num_hypotheses;
-    m_beam = beam;
-    m_best_prob = TINY_FLOAT;
-};
-
-
-void
-NbestStorage::add_hypothesis(array<float, 3> probs, vector<int> words) {
-    if (probs[0] < (m_best_prob-m_beam)) return;
-
-    pair<float, vector<int> > curr_pair = make_pair(probs[0], words);
-    auto hypo_it = m_hypotheses.find(words);
-    if (hypo_it != m_hypotheses.end() && hypo_it->second[0] < probs[0]) {
-        remove_hypothesis(probs[0], words);
-        m_hypotheses_by_prob.insert(curr_pair);
-        m_hypotheses[words] = probs;
-        m_best_prob = max(m_best_prob, probs[0]);
-    }
-    else if (hypo_it == m_hypotheses.end() && m_hypotheses.size() < m_max_num_hypotheses) {
-        m_hypotheses[words] = probs;
-        m_hypotheses_by_prob.insert(curr_pair);
-        m_best_prob = max(m_best_prob, probs[0]);
-    }
-    else if (hypo_it == m_hypotheses.end() && probs[0] > m_hypotheses_by_prob.begin()->first) {
-        remove_hypothesis(m_hypotheses_by_prob.begin()->first, m_hypotheses_by_prob.begin()->second);
-        m_hypotheses_by_prob.insert(curr_pair);
-        m_hypotheses[words] = probs;
-        m_best_prob = max(m_best_prob, probs[0]);
-    }
-}
-
-
-void
-NbestStorage::remove_hypothesis(float prob, vector<int> words) {
-    auto equal_probs = m_hypotheses_by_prob.equal_range(prob);
-    for (auto mit = equal_probs.first; mit != equal_probs.second; mit++) {
-        if (mit->second == words) {
-            m_hypotheses_by_prob.erase(mit);
-            break;
-        }
-    }
-    m_hypotheses.erase(words);
-}
-
-
-vector<pair<string, array<float, 3> > >
-NbestStorage::get_results(const vector<string> *text_units) {
-    vector<pair<string, array<float, 3> > > results;
-    for (auto hypo_it = m_hypotheses.begin(); hypo_it != m_hypotheses.end(); ++hypo_it) {
-        const vector<int> &word_ids = hypo_it->first;
-        string result = "";
-        for (auto word_it = word_ids.rbegin(); word_it != word_ids.rend(); ++word_it)
-            if (*word_it >= 0) result += " " + text_units->at(*word_it);
-        results.push_back(make_pair(result, hypo_it->second));
-    }
-    return results;
-}
-
-
-void
-Recognition::get_nbest_results(
-    WordHistory *history,
-    array<float, 3> curr_hypo_probs,
-    float best_hypo_log_prob,
-    float beam,
-    NbestStorage &nbest_storage)
-{
-    class PartialHypo {
-    public:
-        PartialHypo() {
-            history = nullptr;
-            weight = { 0.0, 0.0, 0.0 };
-            last_step_was_recombination = false;
-            last_recombination_frame_idx = 1000000;
-            num_recombinations = 0;
-        }
-        PartialHypo(const PartialHypo &hypo) {
-            history = hypo.history;
-            partial_result = hypo.partial_result;
-            weight = hypo.weight;
-            last_step_was_recombination = hypo.last_step_was_recombination;
-            last_recombination_frame_idx = hypo.last_recombination_frame_idx;
-            num_recombinations = hypo.num_recombinations;
-        }
-        WordHistory *history;
-        vector<int> partial_result;
-        array<float, 3> weight;
-        bool last_step_was_recombination;
-        int num_recombinations;
-        int last_recombination_frame_idx;
-    };
-
-    PartialHypo initial_hypo;
-    initial_hypo.history = history;
-    initial_hypo.weight = curr_hypo_probs;
-    list<PartialHypo> hypos_to_process;
-    hypos_to_process.push_back(initial_hypo);
-    beam = best_hypo_log_prob - beam;
-
-    while (hypos_to_process.size()) {
-        PartialHypo curr_hypo = hypos_to_process.front();
-        hypos_to_process.pop_front();
-
-        if (curr_hypo.history->previous == nullptr) {
-            nbest_storage.add_hypothesis(curr_hypo.weight, curr_hypo.partial_result);
-        } else {
-            PartialHypo new_hypo(curr_hypo);
-            new_hypo.last_step_was_recombination = false;
-            new_hypo.partial_result.push_back(curr_hypo.history->word_id);
-            new_hypo.history = curr_hypo.history->previous;
-            hypos_to_process.push_back(new_hypo);
-
-//            if (!curr_hypo.last_step_was_recombination && curr_hypo.num_recombinations < NBEST_MAX_NUM_RECOMBINATIONS) {
-            if (curr_hypo.num_recombinations < NBEST_MAX_NUM_RECOMBINATIONS) {
-                for (auto blit = curr_hypo.history->recombination_links.begin();
-                        blit != curr_hypo.history->recombination_links.end(); ++blit)
-                {
-                    if (blit->second.m_frame_idx > curr_hypo.last_recombination_frame_idx) continue;
-                    PartialHypo new_hypo(curr_hypo);
-                    new_hypo.weight[0] += blit->second.m_lp_penalty;
-                    if (new_hypo.weight[0] > beam) {
-                        new_hypo.last_step_was_recombination = true;
-                        new_hypo.num_recombinations += 1;
-                        new_hypo.last_recombination_frame_idx = blit->second.m_frame_idx;
-                        new_hypo.weight[1] += blit->second.m_am_lp_penalty;
-                        new_hypo.weight[2] += blit->second.m_lm_lp_penalty;
-                        new_hypo.history = blit->first;
-                        hypos_to_process.push_back(new_hypo);
-                    }
-                }
-            }
-        }
-    }
-}
-
-
 RecognitionResult::RecognitionResult()
 {
     total_frames = 0;
     total_time = 0.0;
     total_token_count = 0.0;
+    io_wait_time = -1.0;
 }
 
 
@@ -819,6 +894,8 @@ RecognitionResult::print_file_stats(ostream &statsf) const
            << "\tAM: " << best_result.total_am_lp
            << "\tLM: " << best_result.total_lm_lp << endl;
     statsf << "\tMean token count: " << total_token_count / (double)total_frames << endl;
+    if (io_wait_time >= 0.0)
+        statsf << "\tLNA I/O wait: " << io_wait_time << " seconds" << endl;
 }
 
 
@@ -832,6 +909,10 @@ TotalRecognitionStats::accumulate(RecognitionResult &acc)
     total_lp += acc.best_result.total_lp;
     total_am_lp += acc.best_result.total_am_lp;
     total_lm_lp += acc.best_result.total_lm_lp;
+    if (acc.io_wait_time >= 0.0) {
+        num_io_wait_files++;
+        total_io_wait_time += acc.io_wait_time;
+    }
 }
 
 
@@ -847,4 +928,6 @@ TotalRecognitionStats::print_stats(ostream &statsf)
     statsf << "total LM likelihood: " << total_lm_lp << endl;
     statsf << "total AM likelihood: " << total_am_lp << endl;
     statsf << "total mean token count: " << total_token_count / (double)total_frames << endl;
+    if (num_io_wait_files > 0)
+        statsf << "total LNA I/O wait: " << total_io_wait_time << " seconds" << endl;
 }
@@ -10,7 +10,9 @@
 #include "defs.hh"
 #include "Hmm.hh"
 #include "Ngram.hh"
-#include "LnaReaderCircular.hh"
+#include "LnaReaderMapped.hh"
+#include "FrameSkipAcoustics.hh"
+#include "Lattice.hh"
 
 #define HISTOGRAM_BIN_COUNT 100
 
@@ -37,6 +39,10 @@ public:
     class Lookahead {
     public:
         virtual float get_lookahead_score(int node_idx, int word_id) = 0;
+        // Two word history, defaults to the bigram score
+        virtual float get_lookahead_score(int node_idx, int prev_word_id, int word_id) {
+            return get_lookahead_score(node_idx, word_id);
+        }
         void set_text_unit_id_la_ngram_symbol_mapping();
         void find_successor_words(int node_idx, std::vector<int> &word_ids);
         void find_successor_words(int node_idx, std::set<int> &word_ids, bool start_node=true);
@@ -62,6 +68,11 @@ public:
     void read_duration_model(std::string durfname);
     void read_noway_lexicon(std::string lexfname);
     void read_dgraph(std::string graphfname);
+    // Arcs are written in the stored order
+    void write_dgraph(std::string graphfname) const;
+    // Renumbers the nodes for memory locality keeping the arc order,
+    // call before setting the look-ahead. Returns the new index of each node.
+    std::vector<int> order_nodes_for_locality();
     void set_hmm_transition_probs();
     void get_reverse_arcs(std::vector<std::vector<Arc> > &reverse_arcs);
     void mark_initial_nodes(int max_depth, int curr_depth=0, int node=START_NODE);
@@ -111,27 +122,14 @@ public:
     float m_word_end_beam;
 
     int m_history_clean_frame_interval;
+    // Decode every k-th frame, durations are counted in the original frames
+    int m_frame_skip;
+    FrameSkipAcoustics::Combination m_frame_skip_combination;
     int m_decode_start_node;
     int m_last_sil_idx;
 };
 
 
-class NbestStorage {
-public:
-    NbestStorage(int max_num_hypotheses, float beam);
-    void add_hypothesis(std::array<float, 3> probs, std::vector<int> words);
-    std::vector<std::pair<std::string, std::array<float, 3> > > get_results(const std::vector<std::string> *m_text_units);
-private:
-    void remove_hypothesis(float prob, std::vector<int> words);
-
-    int m_max_num_hypotheses;
-    float m_beam;
-    float m_best_prob;
-    std::multimap<float, std::vector<int> > m_hypotheses_by_prob;
-    std::map<std::vector<int>, std::array<float, 3> > m_hypotheses;
-};
-
-
 class RecognitionResult {
 public:
     class Result {
@@ -158,7 +156,11 @@ public:
     long long int total_frames;
     double total_time;
     double total_token_count;
+    // Time spent waiting for the LNA file to be read, negative if not measured
+    double io_wait_time;
     Result best_result;
+    // Set if lattice generation was requested
+    Lattice lattice;
 private:
     std::vector<Result> nbest_results;
 };
@@ -168,7 +170,8 @@ public:
     TotalRecognitionStats() :
         num_files(0),
         total_frames(0), total_time(0.0), total_token_count(0.0),
-        total_lp(0.0), total_am_lp(0.0), total_lm_lp(0.0) { };
+        total_lp(0.0), total_am_lp(0.0), total_lm_lp(0.0),
+        num_io_wait_files(0), total_io_wait_time(0.0) { };
     void accumulate(RecognitionResult &res);
     void print_stats(std::ostream &statsf);
 
@@ -179,6 +182,8 @@ public:
     double total_lp;
     double total_am_lp;
     double total_lm_lp;
+    int num_io_wait_files;
+    double total_io_wait_time;
 };
 
 // For backtracking recombined hypotheses
@@ -202,11 +207,17 @@ public:
     class WordHistory {
     public:
         WordHistory()
-            : word_id(-1), previous(nullptr) { }
+            : word_id(-1), previous(nullptr),
+              end_frame(0), am_log_prob(0.0), lm_log_prob(0.0) { }
         WordHistory(int word_id, WordHistory *previous)
-            : word_id(word_id), previous(previous) { }
+            : word_id(word_id), previous(previous),
+              end_frame(0), am_log_prob(0.0), lm_log_prob(0.0) { }
         int word_id;
         WordHistory *previous;
+        // Word end frame and scores of the best token creating the history
+        int end_frame;
+        float am_log_prob;
+        float lm_log_prob;
         std::map<int, WordHistory*> next;
         std::map<WordHistory*, RecombinationLink> recombination_links;
     };
@@ -219,6 +230,7 @@ public:
         float lookahead_log_prob;
         float total_log_prob;
         int last_word_id;
+        int second_last_word_id;
         WordHistory *history;
         unsigned short int dur;
         bool word_end;
@@ -232,6 +244,7 @@ public:
             lookahead_log_prob(0.0f),
             total_log_prob(-1e20),
             last_word_id(-1),
+            second_last_word_id(-1),
             history(nullptr),
             dur(0),
             word_end(false),
@@ -240,6 +253,7 @@ public:
         { }
         void update_total_log_prob();
         void apply_duration_model();
+        void apply_duration_model(int hmm_state);
         void update_lookahead_prob(float lookahead_prob);
     };
 
@@ -249,7 +263,14 @@ public:
                             RecognitionResult &res,
                             bool write_nbest=false,
                             double nbest_beam=1000.0,
-                            int nbest_max_num_hypotheses=20000);
+                            int nbest_max_num_hypotheses=20000,
+                            bool write_lattice=false);
+    void recognize(Acoustics &acoustics,
+                   RecognitionResult &res,
+                   bool write_nbest=false,
+                   double nbest_beam=1000.0,
+                   int nbest_max_num_hypotheses=20000,
+                   bool write_lattice=false);
     void prune_word_history();
     void clear_word_history();
     void print_certain_word_history(std::ostream &outf=std::cout);
@@ -260,22 +281,34 @@ public:
     Token* get_best_end_token(std::vector<Token*> &tokens);
     std::vector<Token*> get_end_tokens(std::vector<Token*> &tokens);
     std::vector<Token*> get_best_hypo_tokens(std::vector<Token*> &tokens);
+    const std::vector<std::string>* text_units() const { return m_text_units; }
 
 protected:
+    // Node of the search network, the network is the decoder graph by default
+    virtual const Decoder::Node& get_node(int node_idx) const { return d->m_nodes[node_idx]; }
     virtual void reset_frame_variables() = 0;
     virtual void propagate_tokens() = 0;
     std::string get_best_result();
     virtual std::string get_result(WordHistory *history);
-    void get_nbest_results(
-            WordHistory *history,
-            std::array<float, 3> curr_hypo_probs,
-            float best_hypo_log_prob,
-            float beam,
-            NbestStorage &nbest_storage);
+    // Lattice from the word histories and recombination links
+    // of the final hypotheses
+    void build_lattice(std::vector<Token*> &hypo_tokens,
+                       Lattice &lattice);
+    int get_lattice_node(WordHistory *history,
+                         int frame_limit,
+                         Lattice &lattice,
+                         std::map<std::pair<WordHistory*, int>, int> &lattice_nodes,
+                         std::vector<std::pair<WordHistory*, int> > &unexpanded_nodes,
+                         std::map<WordHistory*, int> &max_link_frames);
+    int lattice_frame_limit(WordHistory *history,
+                            int frame_limit,
+                            std::map<WordHistory*, int> &max_link_frames);
+    int max_link_frame(WordHistory *history,
+                       std::map<WordHistory*, int> &max_link_frames);
     virtual void prune_tokens(bool collect_active_histories=false,
                               bool nbest=false) = 0;
 
-    LnaReaderCircular m_lna_reader;
+    LnaReaderMapped m_lna_reader;
     Acoustics *m_acoustics;
 
     WordHistory* m_history_root;
@@ -293,6 +326,7 @@ protected:
     float m_word_end_beam;
     bool m_duration_model_in_use;
     int m_max_state_duration;
+    int m_frame_skip;
     int m_last_sil_idx;
     bool m_use_word_boundary_symbol;
     int m_word_boundary_symbol_idx;
@@ -0,0 +1,532 @@
+#include <algorithm>
+#include <sstream>
+
+#include "DecoderGraph.hh"
+#include "DynamicDecoder.hh"
+
+using namespace std;
+
+
+DynamicDecoder::DynamicDecoder()
+{
+    m_silence_phone = -1;
+    m_best_unigram_la_score = 0.0;
+    m_tree_cache_budget = 0;
+}
+
+
+void
+DynamicDecoder::set_lexical_tree()
+{
+    set<string> words(m_text_units.begin(), m_text_units.end());
+    set_lexical_tree(words);
+}
+
+
+void
+DynamicDecoder::set_lexical_tree(const set<string> &words)
+{
+    if (m_use_word_boundary_symbol)
+        throw string("Word boundary symbol is not supported in the dynamic search.");
+    if (m_sentence_end_symbol_idx == -1)
+        throw string("Sentence end symbol not in the lexicon.");
+    if (m_hmm_map.find("_") == m_hmm_map.end() || m_hmm_map.find("__") == m_hmm_map.end())
+        throw string("Silence models not in the phone model.");
+
+    m_dg.m_hmms = m_hmms;
+    m_dg.m_hmm_map = m_hmm_map;
+    m_dg.set_phone_tables();
+    m_silence_phone = phone_idx(SIL_CTXT);
+    int phone_count = m_dg.m_phones.size();
+
+    m_hmm_state_chains.assign(m_hmms.size(), vector<int>());
+    for (int i=0; i<(int)m_hmms.size(); i++) {
+        vector<TriphoneNode> triphones(1, TriphoneNode(-1, i));
+        vector<DecoderGraph::Node> chain;
+        m_dg.triphones_to_state_chain(triphones, chain);
+        for (auto nit = chain.begin(); nit != chain.end(); ++nit)
+            m_hmm_state_chains[i].push_back(nit->hmm_state);
+    }
+
+    vector<pair<vector<int>, int> > tree_words;
+    int skipped_count = 0;
+    for (auto wit = words.begin(); wit != words.end(); ++wit) {
+        auto uit = m_text_unit_map.find(*wit);
+        if (uit == m_text_unit_map.end())
+            throw string("Word not in the lexicon: " + *wit);
+        if (uit->second == m_sentence_begin_symbol_idx
+            || uit->second == m_sentence_end_symbol_idx) continue;
+
+        const vector<string> &triphones = m_lexicon.at(*wit);
+        vector<int> phones;
+        for (auto tit = triphones.begin(); tit != triphones.end(); ++tit) {
+            if (!DecoderGraph::is_triphone(*tit)) break;
+            phones.push_back(phone_idx(DecoderGraph::tphone(*tit)));
+        }
+        if (phones.size() == 0 || phones.size() != triphones.size()) {
+            skipped_count++;
+            continue;
+        }
+        if (phones.size() > 255) throw string("Too long pronunciation: " + *wit);
+        tree_words.push_back(make_pair(phones, uit->second));
+    }
+    if (skipped_count > 0)
+        cerr << skipped_count << " units without a triphone pronunciation were left out of the tree" << endl;
+    if (tree_words.size() == 0) throw string("No words for the lexical tree.");
+    sort(tree_words.begin(), tree_words.end());
+
+    m_tree_word_phones.clear();
+    m_tree_word_ids.clear();
+    m_first_phone_ranges.assign(phone_count, make_pair(-1, -1));
+    for (int i=0; i<(int)tree_words.size(); i++) {
+        m_tree_word_phones.push_back(tree_words[i].first);
+        m_tree_word_ids.push_back(tree_words[i].second);
+        pair<int, int> &range = m_first_phone_ranges[tree_words[i].first[0]];
+        if (range.first == -1) range.first = i;
+        range.second = i+1;
+    }
+
+    m_right_contexts.assign(1, m_silence_phone);
+    for (int i=0; i<phone_count; i++)
+        if (m_first_phone_ranges[i].first != -1) m_right_contexts.push_back(i);
+
+    // All the triphones in any context must be in the model
+    for (int i=0; i<(int)m_tree_word_phones.size(); i++) {
+        const vector<int> &phones = m_tree_word_phones[i];
+        for (int p=0; p<(int)phones.size(); p++) {
+            vector<int> left_ctxts(1, p > 0 ? phones[p-1] : m_silence_phone);
+            vector<int> right_ctxts(1, p+1 < (int)phones.size() ? phones[p+1] : m_silence_phone);
+            if (p == 0) {
+                left_ctxts.clear();
+                for (int l=0; l<phone_count; l++) left_ctxts.push_back(l);
+            }
+            if (p+1 == (int)phones.size()) right_ctxts = m_right_contexts;
+            for (auto lit = left_ctxts.begin(); lit != left_ctxts.end(); ++lit)
+                for (auto rit = right_ctxts.begin(); rit != right_ctxts.end(); ++rit)
+                    if (triphone_hmm(*lit, phones[p], *rit) == -1)
+                        throw string("Triphone not in the phone model: "
+                                     + DecoderGraph::construct_triphone(m_dg.m_phones[*lit], m_dg.m_phones[phones[p]], m_dg.m_phones[*rit]));
+        }
+    }
+}
+
+
+void
+DynamicDecoder::read_lookahead_lm(string lafname)
+{
+    Ngram la_lm;
+    la_lm.read_arpa(lafname);
+
+    m_unigram_la_scores.assign(m_text_units.size(), 0.0);
+    m_best_unigram_la_score = TINY_FLOAT;
+    for (int i=0; i<(int)m_text_units.size(); i++) {
+        float la_prob = 0.0;
+        la_lm.score(la_lm.root_node, la_lm.vocabulary_lookup[m_text_units[i]], la_prob);
+        m_unigram_la_scores[i] = la_prob;
+        m_best_unigram_la_score = max(m_best_unigram_la_score, la_prob);
+    }
+}
+
+
+void
+DynamicDecoder::print_config(ostream &outf)
+{
+    NgramDecoder::print_config(outf);
+    outf << "unigram look-ahead: " << (m_unigram_la_scores.size() > 0) << endl;
+    outf << "tree cache budget: " << m_tree_cache_budget << endl;
+}
+
+
+DynamicGraph::DynamicGraph(const DynamicDecoder &decoder)
+    : m_decoder(decoder),
+      m_decode_start_node(-1),
+      m_cache_bytes(0),
+      m_peak_cache_bytes(0),
+      m_expansion_count(0),
+      m_eviction_count(0)
+{
+    if (decoder.m_tree_word_ids.size() == 0) throw string("Lexical tree not set.");
+
+    float best_la_score = decoder.m_unigram_la_scores.size() > 0 ? decoder.m_best_unigram_la_score : 0.0;
+    new_node(-1, -1, -1, best_la_score);
+    new_node(-1, -1, -1, best_la_score);
+
+    int node_idx = new_node(-1, -1, decoder.m_sentence_end_symbol_idx, best_la_score);
+    add_arc(END_NODE, node_idx);
+    m_decode_start_node = num_nodes();
+    node_idx = add_hmm_chain(-1, node_idx, decoder.m_hmm_map.at("__"), best_la_score, NODE_SILENCE);
+    add_arc(node_idx, START_NODE);
+    m_nodes[m_decode_start_node].flags |= NODE_DECODE_START;
+
+    node_idx = add_hmm_chain(-1, END_NODE, decoder.m_hmm_map.at("_"), best_la_score, NODE_SILENCE);
+    add_arc(node_idx, START_NODE);
+
+    for (auto rit = decoder.m_right_contexts.begin(); rit != decoder.m_right_contexts.end(); ++rit) {
+        if (*rit == decoder.m_silence_phone) continue;
+        link_state(-1, START_NODE, get_state(decoder.m_silence_phone, 1, decoder.m_first_phone_ranges[*rit].first));
+    }
+}
+
+
+void
+DynamicGraph::expand(int node_idx,
+                     int frame_idx)
+{
+    int state_idx = m_node_states[node_idx];
+    if (state_idx == -1) return;
+    if (!m_states[state_idx].expanded) expand_state(state_idx);
+    TreeState &state = m_states[state_idx];
+    if (state.last_used != frame_idx) {
+        state.last_used = frame_idx;
+        m_lru.splice(m_lru.begin(), m_lru, state.lru_pos);
+    }
+}
+
+
+void
+DynamicGraph::touch(int node_idx,
+                    int frame_idx)
+{
+    int state_idx = m_node_regions[node_idx];
+    if (state_idx == -1) return;
+    TreeState &state = m_states[state_idx];
+    if (state.last_used == frame_idx) return;
+    state.last_used = frame_idx;
+    m_lru.splice(m_lru.begin(), m_lru, state.lru_pos);
+}
+
+
+void
+DynamicGraph::evict(int frame_idx)
+{
+    if (m_decoder.m_tree_cache_budget <= 0) return;
+    while (m_cache_bytes > m_decoder.m_tree_cache_budget && m_lru.size() > 0) {
+        int state_idx = m_lru.back();
+        if (m_states[state_idx].last_used >= frame_idx) break;
+        collapse_state(state_idx);
+    }
+}
+
+
+void
+DynamicGraph::expand_all()
+{
+    vector<int> states_to_expand;
+    for (int i=0; i<(int)m_states.size(); i++)
+        if (m_states[i].entry_node != -1 && !m_states[i].expanded)
+            states_to_expand.push_back(i);
+
+    while (states_to_expand.size() > 0) {
+        int state_idx = states_to_expand.back();
+        states_to_expand.pop_back();
+        if (m_states[state_idx].expanded) continue;
+        expand_state(state_idx);
+        const vector<int> &children = m_states[state_idx].children;
+        for (auto cit = children.begin(); cit != children.end(); ++cit)
+            if (!m_states[*cit].expanded) states_to_expand.push_back(*cit);
+    }
+}
+
+
+int
+DynamicGraph::new_node(int region,
+                       int hmm_state,
+                       int word_id,
+                       float la_score)
+{
+    int node_idx;
+    if (m_free_nodes.size() > 0) {
+        node_idx = m_free_nodes.back();
+        m_free_nodes.pop_back();
+    } else {
+        node_idx = m_nodes.size();
+        m_nodes.emplace_back();
+        m_la_scores.push_back(0.0);
+        m_node_states.push_back(-1);
+        m_node_regions.push_back(-1);
+    }
+    m_nodes[node_idx].hmm_state = hmm_state;
+    m_nodes[node_idx].word_id = word_id;
+    m_la_scores[node_idx] = la_score;
+    m_node_regions[node_idx] = region;
+    if (region != -1) m_states[region].nodes.push_back(node_idx);
+    return node_idx;
+}
+
+
+void
+DynamicGraph::free_node(int node_idx)
+{
+    m_nodes[node_idx] = Decoder::Node();
+    m_la_scores[node_idx] = 0.0;
+    m_node_states[node_idx] = -1;
+    m_node_regions[node_idx] = -1;
+    m_free_nodes.push_back(node_idx);
+}
+
+
+long long int
+DynamicGraph::node_bytes(int node_idx) const
+{
+    return sizeof(Decoder::Node) + sizeof(float) + 2 * sizeof(int)
+           + m_nodes[node_idx].arcs.capacity() * sizeof(Decoder::Arc);
+}
+
+
+// Look-ahead is updated when entering an acoustic or a word node
+// unless the token comes from an acoustic node with the same score
+void
+DynamicGraph::add_arc(int src_node,
+                      int tgt_node)
+{
+    Decoder::Node &src = m_nodes[src_node];
+    const Decoder::Node &tgt = m_nodes[tgt_node];
+    src.arcs.resize(src.arcs.size()+1);
+    Decoder::Arc &arc = src.arcs.back();
+    arc.target_node = tgt_node;
+    if (src.hmm_state != -1) {
+        const HmmState &state = m_decoder.m_hmm_states[src.hmm_state];
+        arc.log_prob = src_node == tgt_node ? state.transitions[0].log_prob : state.transitions[1].log_prob;
+    }
+    if (m_decoder.m_unigram_la_scores.size() > 0 && src_node != tgt_node
+        && (tgt.hmm_state != -1 || tgt.word_id != -1))
+        arc.update_lookahead = src.hmm_state == -1 || m_la_scores[src_node] != m_la_scores[tgt_node];
+}
+
+
+int
+DynamicGraph::get_state(int left_ctxt,
+                        int depth,
+                        int word_idx)
+{
+    if (depth > 1) left_ctxt = -1;
+    long long int key = ((((long long int)left_ctxt + 1) << 8 | depth) << 32) | word_idx;
+    auto sit = m_state_idxs.find(key);
+    if (sit != m_state_idxs.end()) return sit->second;
+
+    int state_idx;
+    if (m_free_states.size() > 0) {
+        state_idx = m_free_states.back();
+        m_free_states.pop_back();
+    } else {
+        state_idx = m_states.size();
+        m_states.resize(state_idx+1);
+    }
+    m_state_idxs[key] = state_idx;
+
+    const vector<vector<int> > &word_phones = m_decoder.m_tree_word_phones;
+    const vector<int> &phones = word_phones[word_idx];
+    int last_word = word_idx + 1;
+    while (last_word < (int)word_phones.size()
+           && (int)word_phones[last_word].size() >= depth
+           && equal(phones.begin(), phones.begin() + depth, word_phones[last_word].begin()))
+        last_word++;
+
+    TreeState &state = m_states[state_idx];
+    state.left_ctxt = left_ctxt;
+    state.depth = depth;
+    state.first_word = word_idx;
+    state.last_word = last_word;
+    state.entry_node = new_node(-1, -1, -1, range_la_score(word_idx, last_word));
+    m_node_states[state.entry_node] = state_idx;
+    return state_idx;
+}
+
+
+void
+DynamicGraph::link_state(int region,
+                         int src_node,
+                         int state_idx)
+{
+    add_arc(src_node, m_states[state_idx].entry_node);
+    m_states[state_idx].refs++;
+    if (region != -1) m_states[region].children.push_back(state_idx);
+}
+
+
+void
+DynamicGraph::release_state(int state_idx)
+{
+    TreeState &state = m_states[state_idx];
+    state.refs--;
+    if (state.refs == 0 && !state.expanded) remove_state(state_idx);
+}
+
+
+void
+DynamicGraph::remove_state(int state_idx)
+{
+    TreeState &state = m_states[state_idx];
+    long long int key = ((((long long int)state.left_ctxt + 1) << 8 | state.depth) << 32) | state.first_word;
+    m_state_idxs.erase(key);
+    free_node(state.entry_node);
+    state = TreeState();
+    m_free_states.push_back(state_idx);
+}
+
+
+// The words ending at the phone of the state are fanned out to the right
+// contexts, the other words continue to the states of the next phone
+void
+DynamicGraph::expand_state(int state_idx)
+{
+    int left_ctxt = m_states[state_idx].left_ctxt;
+    int depth = m_states[state_idx].depth;
+    int first_word = m_states[state_idx].first_word;
+    int last_word = m_states[state_idx].last_word;
+    int entry_node = m_states[state_idx].entry_node;
+    m_states[state_idx].expanded = true;
+    m_states[state_idx].lru_pos = m_lru.insert(m_lru.begin(), state_idx);
+
+    const vector<vector<int> > &word_phones = m_decoder.m_tree_word_phones;
+    const vector<int> &phones = word_phones[first_word];
+    int phone = phones[depth-1];
+    int prev_phone = depth > 1 ? phones[depth-2] : left_ctxt;
+
+    int word_end_limit = first_word;
+    while (word_end_limit < last_word && (int)word_phones[word_end_limit].size() == depth)
+        word_end_limit++;
+
+    if (word_end_limit > first_word) {
+        float la_score = range_la_score(first_word, word_end_limit);
+        const vector<int> &right_contexts = m_decoder.m_right_contexts;
+        for (auto rit = right_contexts.begin(); rit != right_contexts.end(); ++rit) {
+            int chain_end = add_hmm_chain(state_idx, entry_node,
+                                          m_decoder.triphone_hmm(prev_phone, phone, *rit), la_score);
+            int next_state = -1;
+            float next_la_score = m_la_scores[END_NODE];
+            if (*rit != m_decoder.m_silence_phone) {
+                next_state = get_state(phone, 1, m_decoder.m_first_phone_ranges[*rit].first);
+                next_la_score = m_la_scores[m_states[next_state].entry_node];
+            }
+            for (int w=first_word; w<word_end_limit; w++) {
+                int word_node = new_node(state_idx, -1, m_decoder.m_tree_word_ids[w], next_la_score);
+                add_arc(chain_end, word_node);
+                if (next_state == -1) add_arc(word_node, END_NODE);
+                else link_state(state_idx, word_node, next_state);
+            }
+        }
+    }
+
+    for (int w=word_end_limit; w<last_word;) {
+        int next_phone = word_phones[w][depth];
+        int next_state = get_state(-1, depth+1, w);
+        int chain_end = add_hmm_chain(state_idx, entry_node,
+                                      m_decoder.triphone_hmm(prev_phone, phone, next_phone),
+                                      m_la_scores[m_states[next_state].entry_node]);
+        link_state(state_idx, chain_end, next_state);
+        w = m_states[next_state].last_word;
+    }
+
+    TreeState &state = m_states[state_idx];
+    state.bytes = m_nodes[entry_node].arcs.capacity() * sizeof(Decoder::Arc);
+    for (auto nit = state.nodes.begin(); nit != state.nodes.end(); ++nit)
+        state.bytes += node_bytes(*nit);
+    state.bytes += (state.nodes.capacity() + state.children.capacity()) * sizeof(int);
+    m_cache_bytes += state.bytes;
+    m_peak_cache_bytes = max(m_peak_cache_bytes, m_cache_bytes);
+    m_expansion_count++;
+}
+
+
+void
+DynamicGraph::collapse_state(int state_idx)
+{
+    TreeState &state = m_states[state_idx];
+    for (auto nit = state.nodes.begin(); nit != state.nodes.end(); ++nit)
+        free_node(*nit);
+    vector<int>().swap(state.nodes);
+    vector<Decoder::Arc>().swap(m_nodes[state.entry_node].arcs);
+    m_cache_bytes -= state.bytes;
+    state.bytes = 0;
+    state.expanded = false;
+    m_lru.erase(state.lru_pos);
+    m_eviction_count++;
+
+    // The state may link to itself
+    vector<int> children;
+    children.swap(state.children);
+    for (auto cit = children.begin(); cit != children.end(); ++cit)
+        release_state(*cit);
+    if (m_states[state_idx].entry_node != -1 && m_states[state_idx].refs == 0)
+        remove_state(state_idx);
+}
+
+
+int
+DynamicGraph::add_hmm_chain(int region,
+                            int src_node,
+                            int hmm_idx,
+                            float la_score,
+                            int flags)
+{
+    const vector<int> &states = m_decoder.m_hmm_state_chains[hmm_idx];
+    for (auto sit = states.begin(); sit != states.end(); ++sit) {
+        int node_idx = new_node(region, *sit, -1, la_score);
+        m_nodes[node_idx].flags = flags;
+        add_arc(node_idx, node_idx);
+        add_arc(src_node, node_idx);
+        src_node = node_idx;
+    }
+    return src_node;
+}
+
+
+float
+DynamicGraph::range_la_score(int first_word,
+                             int last_word) const
+{
+    if (m_decoder.m_unigram_la_scores.size() == 0) return 0.0;
+    float la_score = TINY_FLOAT;
+    for (int w=first_word; w<last_word; w++)
+        la_score = max(la_score, m_decoder.m_unigram_la_scores[m_decoder.m_tree_word_ids[w]]);
+    return la_score;
+}
+
+
+DynamicRecognition::DynamicRecognition(DynamicDecoder &decoder)
+    : DynamicRecognition(decoder, new DynamicGraph(decoder))
+{
+}
+
+
+DynamicRecognition::DynamicRecognition(DynamicDecoder &decoder,
+                                       DynamicGraph *graph)
+    : NgramRecognition(decoder, graph->num_nodes(), graph->decode_start_node()),
+      m_graph(graph)
+{
+}
+
+
+DynamicRecognition::~DynamicRecognition()
+{
+    delete m_graph;
+}
+
+
+void
+DynamicRecognition::DynamicNetwork::expand(int node_idx)
+{
+    r.m_graph->expand(node_idx, r.m_frame_idx);
+    if ((int)r.m_best_node_scores.size() < r.m_graph->num_nodes())
+        r.m_best_node_scores.resize(r.m_graph->num_nodes(), -1e20);
+}
+
+
+void
+DynamicRecognition::propagate_tokens()
+{
+    DynamicNetwork network(*this);
+    NgramRecognition::propagate_tokens(network);
+}
+
+
+// Regions with tokens are kept
+void
+DynamicRecognition::nodes_pruned()
+{
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
+        m_graph->touch(*nit, m_frame_idx);
+    m_graph->evict(m_frame_idx);
+    if (m_stats) cerr << "tree cache bytes: " << m_graph->cache_bytes() << endl;
+}
@@ -0,0 +1,181 @@
+#ifndef DYNAMIC_DECODER_HH
+#define DYNAMIC_DECODER_HH
+
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "defs.hh"
+#include "DecoderGraph.hh"
+#include "NgramDecoder.hh"
+
+
+// N-gram decoder without a precompiled graph. The lexical prefix tree and
+// the cross-word contexts are expanded from the lexicon and the HMMs during
+// the search. Only the first triphone of a word depends on the left context,
+// so the tree is copied by the left context only at the first phone. The last
+// triphone of a word is fanned out to each right context and followed by the
+// word node, which connects to the first phones of the following words.
+// Words may be followed by a short or a long silence with the sentence end.
+class DynamicDecoder : public NgramDecoder {
+public:
+    DynamicDecoder();
+    // Triphonizes the vocabulary units for the tree, call after reading
+    // the phone model, the lexicon and the configuration
+    void set_lexical_tree();
+    void set_lexical_tree(const std::set<std::string> &words);
+    // Unigram look-ahead scores for the tree nodes
+    void read_lookahead_lm(std::string lafname);
+    void print_config(std::ostream &outf) override;
+
+    int phone_idx(char phone) const { return m_dg.m_phone_ids[(unsigned char)phone]; }
+    // HMM index of the triphone from phone indices, -1 if not in the model
+    int triphone_hmm(int left_ctxt, int phone, int right_ctxt) const {
+        return m_dg.m_triphone_hmms[m_dg.phone_ids_to_triphone_id(left_ctxt, phone, right_ctxt)];
+    }
+
+    // Phone and triphone tables as in the graph builders
+    DecoderGraph m_dg;
+    // Phone index of the silence context
+    int m_silence_phone;
+    // HMM state indices of each HMM without the entry and exit states
+    std::vector<std::vector<int> > m_hmm_state_chains;
+    // Vocabulary units with a pronunciation sorted by the phone indices
+    std::vector<std::vector<int> > m_tree_word_phones;
+    std::vector<int> m_tree_word_ids;
+    // First and one past the last tree word with the first phone
+    std::vector<std::pair<int, int> > m_first_phone_ranges;
+    // Silence and the first phones of the tree words
+    std::vector<int> m_right_contexts;
+    // Unigram look-ahead log probabilities by the text unit id, empty if not in use
+    std::vector<float> m_unigram_la_scores;
+    float m_best_unigram_la_score;
+    // Bytes for the expanded tree regions in one recognition, 0 for no limit
+    long long int m_tree_cache_budget;
+};
+
+
+// Search network of one recognition. Each tree state, the words sharing
+// a phone prefix after a left context, has an entry node. The nodes after
+// the entry node, the region of the state, are created when a token first
+// enters the state and evicted in least recently used order if the regions
+// take more memory than the budget. Entry nodes are kept while some region
+// links to them. Node indices of the freed nodes are reused.
+class DynamicGraph {
+public:
+    DynamicGraph(const DynamicDecoder &decoder);
+
+    const Decoder::Node& node(int node_idx) const { return m_nodes[node_idx]; }
+    float la_score(int node_idx) const { return m_la_scores[node_idx]; }
+    int num_nodes() const { return m_nodes.size(); }
+    int decode_start_node() const { return m_decode_start_node; }
+    // Creates the region of an entry node if it is not cached
+    // and marks it used in the frame, other nodes are ignored
+    void expand(int node_idx, int frame_idx);
+    // Marks the region of a node used in the frame
+    void touch(int node_idx, int frame_idx);
+    // Evicts the least recently used regions until they fit in the budget,
+    // regions used in the frame are kept
+    void evict(int frame_idx);
+    // Creates the regions of all states reachable from the start node
+    void expand_all();
+    long long int cache_bytes() const { return m_cache_bytes; }
+    long long int peak_cache_bytes() const { return m_peak_cache_bytes; }
+    int expansion_count() const { return m_expansion_count; }
+    int eviction_count() const { return m_eviction_count; }
+
+private:
+    class TreeState {
+    public:
+        TreeState() : left_ctxt(-1), depth(0), first_word(-1), last_word(-1),
+                      entry_node(-1), refs(0), expanded(false), last_used(-1), bytes(0) { }
+        int left_ctxt;
+        int depth;
+        // Tree words sharing the first depth phones
+        int first_word;
+        int last_word;
+        int entry_node;
+        // Links from the regions and the start node
+        int refs;
+        bool expanded;
+        int last_used;
+        // Memory of the region nodes and the entry node arcs
+        long long int bytes;
+        std::vector<int> nodes;
+        std::vector<int> children;
+        std::list<int>::iterator lru_pos;
+    };
+
+    int new_node(int region, int hmm_state, int word_id, float la_score);
+    void free_node(int node_idx);
+    long long int node_bytes(int node_idx) const;
+    void add_arc(int src_node, int tgt_node);
+    // State after the left context with the words starting as the tree word
+    int get_state(int left_ctxt, int depth, int word_idx);
+    void link_state(int region, int src_node, int state_idx);
+    void release_state(int state_idx);
+    void remove_state(int state_idx);
+    void expand_state(int state_idx);
+    void collapse_state(int state_idx);
+    // Appends the HMM state chain after the node, returns the last node
+    int add_hmm_chain(int region, int src_node, int hmm_idx, float la_score, int flags=0);
+    float range_la_score(int first_word, int last_word) const;
+
+    const DynamicDecoder &m_decoder;
+    std::deque<Decoder::Node> m_nodes;
+    std::vector<float> m_la_scores;
+    // Tree state of an entry node, -1 for other nodes
+    std::vector<int> m_node_states;
+    // Tree state of the region of a node, -1 for the fixed nodes and entry nodes
+    std::vector<int> m_node_regions;
+    std::vector<int> m_free_nodes;
+
+    std::vector<TreeState> m_states;
+    std::unordered_map<long long int, int> m_state_idxs;
+    std::vector<int> m_free_states;
+    // Expanded states, the most recently used first
+    std::list<int> m_lru;
+
+    int m_decode_start_node;
+    long long int m_cache_bytes;
+    long long int m_peak_cache_bytes;
+    int m_expansion_count;
+    int m_eviction_count;
+};
+
+
+// N-gram search in the dynamic network, the network is expanded when
+// tokens enter the tree states and evicted after the pruning
+class DynamicRecognition : public NgramRecognition {
+public:
+    DynamicRecognition(DynamicDecoder &decoder);
+    ~DynamicRecognition();
+    const DynamicGraph& graph() const { return *m_graph; }
+
+private:
+    // Dynamic graph as the search network of the token passing
+    class DynamicNetwork {
+    public:
+        DynamicNetwork(DynamicRecognition &recognition) : r(recognition) { }
+        const Decoder::Node& node(int node_idx) const { return r.m_graph->node(node_idx); }
+        float lookahead_score(int node_idx, int prev_word_id, int word_id) const {
+            return r.m_graph->la_score(node_idx);
+        }
+        // Creates the region of an entry node
+        void expand(int node_idx);
+        DynamicRecognition &r;
+    };
+
+    DynamicRecognition(DynamicDecoder &decoder, DynamicGraph *graph);
+    const Decoder::Node& get_node(int node_idx) const override { return m_graph->node(node_idx); }
+    void propagate_tokens() override;
+    void nodes_pruned() override;
+
+    DynamicGraph *m_graph;
+};
+
+#endif /* DYNAMIC_DECODER_HH */
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <queue>
+#include <set>
+#include <sstream>
+
+#include "Lattice.hh"
+
+using namespace std;
+
+static const double no_path = -1e20;
+
+
+Lattice::Lattice()
+{
+    clear();
+}
+
+
+void
+Lattice::clear()
+{
+    m_nodes.clear();
+    m_arcs.clear();
+    m_initial_node = -1;
+    m_final_node = -1;
+}
+
+
+int
+Lattice::add_node(int frame)
+{
+    m_nodes.resize(m_nodes.size()+1);
+    m_nodes.back().frame = frame;
+    return m_nodes.size()-1;
+}
+
+
+int
+Lattice::add_arc(int source_node,
+                 int target_node,
+                 int word_id,
+                 float am_log_prob,
+                 float lm_log_prob)
+{
+    Arc arc;
+    arc.source_node = source_node;
+    arc.target_node = target_node;
+    arc.word_id = word_id;
+    arc.am_log_prob = am_log_prob;
+    arc.lm_log_prob = lm_log_prob;
+    m_arcs.push_back(arc);
+    m_nodes[source_node].arcs.push_back(m_arcs.size()-1);
+    return m_arcs.size()-1;
+}
+
+
+vector<int>
+Lattice::topological_order() const
+{
+    vector<int> in_degree(m_nodes.size(), 0);
+    for (auto ait = m_arcs.begin(); ait != m_arcs.end(); ++ait)
+        in_degree[ait->target_node]++;
+
+    vector<int> order;
+    order.reserve(m_nodes.size());
+    for (int i=0; i<(int)m_nodes.size(); i++)
+        if (in_degree[i] == 0) order.push_back(i);
+    for (int i=0; i<(int)order.size(); i++) {
+        const Node &node = m_nodes[order[i]];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+            if (--in_degree[m_arcs[*ait].target_node] == 0)
+                order.push_back(m_arcs[*ait].target_node);
+    }
+    if (order.size() != m_nodes.size())
+        throw string("Lattice: cycle in the lattice");
+    return order;
+}
+
+
+vector<double>
+Lattice::best_scores_to_final(float lm_scale,
+                              const vector<int> &order) const
+{
+    vector<double> scores(m_nodes.size(), no_path);
+    if (m_final_node < 0) return scores;
+    scores[m_final_node] = 0.0;
+    for (auto nit = order.rbegin(); nit != order.rend(); ++nit) {
+        const Node &node = m_nodes[*nit];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+            const Arc &arc = m_arcs[*ait];
+            if (scores[arc.target_node] == no_path) continue;
+            double score = scores[arc.target_node] + arc.am_log_prob + lm_scale * arc.lm_log_prob;
+            scores[*nit] = max(scores[*nit], score);
+        }
+    }
+    return scores;
+}
+
+
+void
+Lattice::prune(float lm_scale,
+               float beam)
+{
+    if (m_initial_node < 0 || m_final_node < 0) return;
+
+    vector<int> order = topological_order();
+    vector<double> bw_scores = best_scores_to_final(lm_scale, order);
+    vector<double> fw_scores(m_nodes.size(), no_path);
+    fw_scores[m_initial_node] = 0.0;
+    for (auto nit = order.begin(); nit != order.end(); ++nit) {
+        if (fw_scores[*nit] == no_path) continue;
+        const Node &node = m_nodes[*nit];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+            const Arc &arc = m_arcs[*ait];
+            double score = fw_scores[*nit] + arc.am_log_prob + lm_scale * arc.lm_log_prob;
+            fw_scores[arc.target_node] = max(fw_scores[arc.target_node], score);
+        }
+    }
+
+    double limit = bw_scores[m_initial_node] - beam;
+    vector<bool> keep_arc(m_arcs.size(), false);
+    vector<bool> keep_node(m_nodes.size(), false);
+    keep_node[m_initial_node] = true;
+    keep_node[m_final_node] = true;
+    if (bw_scores[m_initial_node] != no_path) {
+        for (int i=0; i<(int)m_arcs.size(); i++) {
+            const Arc &arc = m_arcs[i];
+            if (fw_scores[arc.source_node] == no_path || bw_scores[arc.target_node] == no_path)
+                continue;
+            double score = fw_scores[arc.source_node] + arc.am_log_prob
+                           + lm_scale * arc.lm_log_prob + bw_scores[arc.target_node];
+            if (score < limit) continue;
+            keep_arc[i] = true;
+            keep_node[arc.source_node] = true;
+            keep_node[arc.target_node] = true;
+        }
+    }
+
+    vector<int> node_map(m_nodes.size(), -1);
+    vector<Node> nodes;
+    for (auto nit = order.begin(); nit != order.end(); ++nit) {
+        if (!keep_node[*nit]) continue;
+        node_map[*nit] = nodes.size();
+        nodes.push_back(Node());
+        nodes.back().frame = m_nodes[*nit].frame;
+    }
+    vector<Arc> arcs;
+    for (auto nit = order.begin(); nit != order.end(); ++nit) {
+        const Node &node = m_nodes[*nit];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+            if (!keep_arc[*ait]) continue;
+            Arc arc = m_arcs[*ait];
+            arc.source_node = node_map[arc.source_node];
+            arc.target_node = node_map[arc.target_node];
+            nodes[arc.source_node].arcs.push_back(arcs.size());
+            arcs.push_back(arc);
+        }
+    }
+
+    m_initial_node = node_map[m_initial_node];
+    m_final_node = node_map[m_final_node];
+    m_nodes.swap(nodes);
+    m_arcs.swap(arcs);
+}
+
+
+vector<Lattice::Hypothesis>
+Lattice::get_nbest(float lm_scale,
+                   int max_num_hypotheses,
+                   float beam) const
+{
+    vector<Hypothesis> hypotheses;
+    if (m_initial_node < 0 || m_final_node < 0) return hypotheses;
+
+    vector<double> bw_scores = best_scores_to_final(lm_scale, topological_order());
+    if (bw_scores[m_initial_node] == no_path) return hypotheses;
+    double limit = bw_scores[m_initial_node] - beam;
+
+    // Partial paths share their prefixes through the previous path index
+    class PartialPath {
+    public:
+        PartialPath(int node, int arc, int previous, double am_lp, double lm_lp)
+            : node(node), arc(arc), previous(previous), am_lp(am_lp), lm_lp(lm_lp) { }
+        int node;
+        int arc;
+        int previous;
+        double am_lp;
+        double lm_lp;
+    };
+
+    vector<PartialPath> paths;
+    priority_queue<pair<double, int> > queue;
+    paths.push_back(PartialPath(m_initial_node, -1, -1, 0.0, 0.0));
+    queue.push(make_pair(bw_scores[m_initial_node], 0));
+    set<vector<int> > found_word_sequences;
+
+    while (!queue.empty() && (int)hypotheses.size() < max_num_hypotheses) {
+        double estimate = queue.top().first;
+        int path_idx = queue.top().second;
+        queue.pop();
+        if (estimate < limit) break;
+
+        PartialPath path = paths[path_idx];
+        if (path.node == m_final_node) {
+            Hypothesis hypo;
+            for (int p=path_idx; p>=0; p=paths[p].previous) {
+                int arc_idx = paths[p].arc;
+                if (arc_idx >= 0 && m_arcs[arc_idx].word_id >= 0)
+                    hypo.word_ids.push_back(m_arcs[arc_idx].word_id);
+            }
+            reverse(hypo.word_ids.begin(), hypo.word_ids.end());
+            if (!found_word_sequences.insert(hypo.word_ids).second) continue;
+            hypo.total_am_lp = path.am_lp;
+            hypo.total_lm_lp = path.lm_lp;
+            hypo.total_lp = path.am_lp + lm_scale * path.lm_lp;
+            hypotheses.push_back(hypo);
+            continue;
+        }
+
+        const Node &node = m_nodes[path.node];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+            const Arc &arc = m_arcs[*ait];
+            if (bw_scores[arc.target_node] == no_path) continue;
+            double am_lp = path.am_lp + arc.am_log_prob;
+            double lm_lp = path.lm_lp + arc.lm_log_prob;
+            double arc_estimate = am_lp + lm_scale * lm_lp + bw_scores[arc.target_node];
+            if (arc_estimate < limit) continue;
+            paths.push_back(PartialPath(arc.target_node, *ait, path_idx, am_lp, lm_lp));
+            queue.push(make_pair(arc_estimate, paths.size()-1));
+        }
+    }
+
+    return hypotheses;
+}
+
+
+void
+Lattice::write_htk(ostream &outf,
+                   const vector<string> &text_units,
+                   string utterance,
+                   float lm_scale,
+                   double frame_rate) const
+{
+    outf << "VERSION=1.0" << endl;
+    outf << "UTTERANCE=" << utterance << endl;
+    outf << "lmscale=" << lm_scale << endl;
+    outf << "wdpenalty=0.0" << endl;
+    outf << "start=" << m_initial_node << endl;
+    outf << "end=" << m_final_node << endl;
+    outf << "N=" << m_nodes.size() << "\tL=" << m_arcs.size() << endl;
+
+    outf << fixed;
+    for (int i=0; i<(int)m_nodes.size(); i++)
+        outf << "I=" << i << "\tt=" << setprecision(3) << m_nodes[i].frame / frame_rate << endl;
+    for (int i=0; i<(int)m_arcs.size(); i++) {
+        const Arc &arc = m_arcs[i];
+        outf << "J=" << i
+             << "\tS=" << arc.source_node
+             << "\tE=" << arc.target_node
+             << "\tW=" << (arc.word_id >= 0 ? text_units.at(arc.word_id) : string("!NULL"))
+             << "\ta=" << setprecision(4) << arc.am_log_prob
+             << "\tl=" << arc.lm_log_prob << endl;
+    }
+    outf.unsetf(ios_base::floatfield);
+}
+
+
+void
+Lattice::read_htk(istream &latticef,
+                  vector<string> &text_units,
+                  map<string, int> &text_unit_map,
+                  string &utterance,
+                  float &lm_scale,
+                  double frame_rate)
+{
+    clear();
+    int num_nodes = -1;
+    int num_arcs = -1;
+    int start_node = -1;
+    int end_node = -1;
+    vector<int> node_words;
+    vector<bool> arc_has_word;
+
+    string line;
+    while (getline(latticef, line)) {
+        if (line.length() == 0 || line[0] == '#') continue;
+        map<string, string> fields;
+        stringstream ss(line);
+        string field;
+        while (ss >> field) {
+            size_t eq_pos = field.find('=');
+            if (eq_pos == string::npos) throw string("Lattice: problem parsing line: " + line);
+            fields[field.substr(0, eq_pos)] = field.substr(eq_pos + 1);
+        }
+
+        if (fields.count("I")) {
+            int node_idx = stoi(fields["I"]);
+            if (node_idx < 0 || node_idx >= num_nodes)
+                throw string("Lattice: invalid node index: " + line);
+            if (fields.count("t"))
+                m_nodes[node_idx].frame = (int)round(stod(fields["t"]) * frame_rate);
+            if (fields.count("W") && fields["W"] != "!NULL") {
+                string word = fields["W"];
+                if (text_unit_map.find(word) == text_unit_map.end()) {
+                    text_unit_map[word] = text_units.size();
+                    text_units.push_back(word);
+                }
+                node_words[node_idx] = text_unit_map[word];
+            }
+        }
+        else if (fields.count("J")) {
+            if (!fields.count("S") || !fields.count("E"))
+                throw string("Lattice: arc without start or end node: " + line);
+            int source_node = stoi(fields["S"]);
+            int target_node = stoi(fields["E"]);
+            if (source_node < 0 || source_node >= num_nodes || target_node < 0 || target_node >= num_nodes)
+                throw string("Lattice: invalid node index: " + line);
+            int word_id = -1;
+            if (fields.count("W") && fields["W"] != "!NULL") {
+                string word = fields["W"];
+                if (text_unit_map.find(word) == text_unit_map.end()) {
+                    text_unit_map[word] = text_units.size();
+                    text_units.push_back(word);
+                }
+                word_id = text_unit_map[word];
+            }
+            float am_log_prob = fields.count("a") ? stof(fields["a"]) : 0.0;
+            float lm_log_prob = fields.count("l") ? stof(fields["l"]) : 0.0;
+            add_arc(source_node, target_node, word_id, am_log_prob, lm_log_prob);
+            arc_has_word.push_back(fields.count("W") > 0);
+        }
+        else {
+            if (fields.count("UTTERANCE")) utterance = fields["UTTERANCE"];
+            if (fields.count("lmscale")) lm_scale = stof(fields["lmscale"]);
+            if (fields.count("start")) start_node = stoi(fields["start"]);
+            if (fields.count("end")) end_node = stoi(fields["end"]);
+            if (fields.count("N")) {
+                num_nodes = stoi(fields["N"]);
+                m_nodes.resize(num_nodes);
+                node_words.resize(num_nodes, -1);
+            }
+            if (fields.count("L")) {
+                num_arcs = stoi(fields["L"]);
+                m_arcs.reserve(num_arcs);
+            }
+        }
+    }
+    if (num_nodes < 0 || num_arcs != (int)m_arcs.size())
+        throw string("Lattice: problem reading lattice " + utterance);
+
+    // Words on nodes
+    for (int i=0; i<(int)m_arcs.size(); i++)
+        if (!arc_has_word[i]) m_arcs[i].word_id = node_words[m_arcs[i].target_node];
+
+    vector<int> in_degree(m_nodes.size(), 0);
+    for (auto ait = m_arcs.begin(); ait != m_arcs.end(); ++ait)
+        in_degree[ait->target_node]++;
+    if (start_node < 0) {
+        for (int i=0; i<(int)m_nodes.size() && start_node < 0; i++)
+            if (in_degree[i] == 0) start_node = i;
+    }
+    if (end_node < 0) {
+        vector<int> end_nodes;
+        for (int i=0; i<(int)m_nodes.size(); i++)
+            if (m_nodes[i].arcs.size() == 0) end_nodes.push_back(i);
+        if (end_nodes.size() == 1) end_node = end_nodes[0];
+        else if (end_nodes.size() > 1) {
+            int frame = 0;
+            for (auto nit = end_nodes.begin(); nit != end_nodes.end(); ++nit)
+                frame = max(frame, m_nodes[*nit].frame);
+            end_node = add_node(frame);
+            for (auto nit = end_nodes.begin(); nit != end_nodes.end(); ++nit)
+                add_arc(*nit, end_node, -1, 0.0, 0.0);
+        }
+    }
+    if (start_node < 0 || end_node < 0)
+        throw string("Lattice: start or end node not found in lattice " + utterance);
+    m_initial_node = start_node;
+    m_final_node = end_node;
+}
@@ -0,0 +1,88 @@
+#ifndef LATTICE_HH
+#define LATTICE_HH
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Word lattice with the words, acoustic and language model scores on arcs.
+// Arcs with word id -1 are null arcs (!NULL in HTK SLF).
+// Node frames are the word end frames, the lattice is acyclic.
+class Lattice {
+public:
+    class Arc {
+    public:
+        Arc() : source_node(-1), target_node(-1), word_id(-1),
+            am_log_prob(0.0), lm_log_prob(0.0) { }
+        int source_node;
+        int target_node;
+        int word_id;
+        float am_log_prob;
+        float lm_log_prob;
+    };
+
+    class Node {
+    public:
+        Node() : frame(0) { }
+        int frame;
+        std::vector<int> arcs;
+    };
+
+    class Hypothesis {
+    public:
+        Hypothesis() : total_lp(0.0), total_am_lp(0.0), total_lm_lp(0.0) { }
+        std::vector<int> word_ids;
+        double total_lp;
+        double total_am_lp;
+        double total_lm_lp;
+    };
+
+    Lattice();
+    void clear();
+    int add_node(int frame);
+    int add_arc(int source_node, int target_node, int word_id,
+                float am_log_prob, float lm_log_prob);
+    int num_nodes() const { return m_nodes.size(); }
+    int num_arcs() const { return m_arcs.size(); }
+
+    // Removes nodes and arcs not on any path within beam from the best path,
+    // renumbers the nodes in topological order
+    void prune(float lm_scale, float beam);
+
+    // Best paths in decreasing order by A* search,
+    // paths with the same word sequence are returned once
+    std::vector<Hypothesis> get_nbest(float lm_scale,
+                                      int max_num_hypotheses,
+                                      float beam) const;
+
+    // HTK standard lattice format, words on arcs
+    void write_htk(std::ostream &outf,
+                   const std::vector<std::string> &text_units,
+                   std::string utterance,
+                   float lm_scale,
+                   double frame_rate=125.0) const;
+    // Reads words on arcs or on nodes, new words are added to the vocabulary.
+    // Multiple end nodes are joined with null arcs to one final node.
+    void read_htk(std::istream &latticef,
+                  std::vector<std::string> &text_units,
+                  std::map<std::string, int> &text_unit_map,
+                  std::string &utterance,
+                  float &lm_scale,
+                  double frame_rate=125.0);
+
+    std::vector<int> topological_order() const;
+
+    std::vector<Node> m_nodes;
+    std::vector<Arc> m_arcs;
+    int m_initial_node;
+    int m_final_node;
+
+private:
+    // Best scores from each node to the final node
+    std::vector<double> best_scores_to_final(float lm_scale,
+                                             const std::vector<int> &order) const;
+};
+
+#endif /* LATTICE_HH */
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <sstream>
+
+#include "LatticeRescorer.hh"
+#include "io.hh"
+
+using namespace std;
+
+
+NgramRescoringLM::NgramRescoringLM(string arpafname,
+                                   bool natural_log)
+{
+    m_lm = natural_log ? new LNNgram() : new Ngram();
+    m_lm->read_arpa(arpafname);
+}
+
+
+NgramRescoringLM::~NgramRescoringLM()
+{
+    delete m_lm;
+}
+
+
+int
+NgramRescoringLM::score(int node_idx,
+                        int word_id,
+                        float &log_prob) const
+{
+    log_prob = 0.0;
+    int next_node_idx = m_lm->score(node_idx, word_id, log_prob);
+    if (word_id == m_lm->sentence_end_symbol_idx) return m_lm->sentence_start_node;
+    return next_node_idx;
+}
+
+
+int
+NgramRescoringLM::word_id(const string &word) const
+{
+    auto wit = m_lm->vocabulary_lookup.find(word);
+    if (wit == m_lm->vocabulary_lookup.end()) return -1;
+    return wit->second;
+}
+
+
+ClassNgramRescoringLM::ClassNgramRescoringLM(string carpafname,
+                                             string cmempfname)
+{
+    m_words.push_back("<s>");
+    m_words.push_back("</s>");
+    SimpleFileInput wcf(cmempfname);
+    string line;
+    while (wcf.getline(line)) {
+        stringstream ss(line);
+        string word;
+        ss >> word;
+        if (word.length() > 0 && word != "<s>" && word != "</s>")
+            m_words.push_back(word);
+    }
+    for (int i=0; i<(int)m_words.size(); i++)
+        m_word_map[m_words[i]] = i;
+    m_lm = new ClassNgram(carpafname, cmempfname, m_words, m_word_map);
+}
+
+
+ClassNgramRescoringLM::~ClassNgramRescoringLM()
+{
+    delete m_lm;
+}
+
+
+int
+ClassNgramRescoringLM::score(int node_idx,
+                             int word_id,
+                             float &log_prob) const
+{
+    log_prob = 0.0;
+    return m_lm->score(node_idx, word_id, log_prob);
+}
+
+
+int
+ClassNgramRescoringLM::word_id(const string &word) const
+{
+    auto wit = m_word_map.find(word);
+    if (wit == m_word_map.end()) return -1;
+    return wit->second;
+}
+
+
+LatticeRescorer::LatticeRescorer(const RescoringLM &lm,
+                                 float lm_scale,
+                                 int history_length)
+    : m_lm(lm),
+      m_lm_scale(lm_scale),
+      m_history_length(history_length)
+{
+    const Ngram &ngram = m_lm.ngram();
+    m_node_history_lengths.resize(ngram.nodes.size(), 0);
+    vector<int> nodes_to_process(1, ngram.root_node);
+    for (int i=0; i<(int)nodes_to_process.size(); i++) {
+        const Ngram::Node &node = ngram.nodes[nodes_to_process[i]];
+        if (node.first_arc == -1) continue;
+        for (int a=node.first_arc; a<=node.last_arc; a++) {
+            int target_node = ngram.arc_target_nodes[a];
+            m_node_history_lengths[target_node] = m_node_history_lengths[nodes_to_process[i]] + 1;
+            nodes_to_process.push_back(target_node);
+        }
+    }
+}
+
+
+vector<int>
+LatticeRescorer::get_word_map(const vector<string> &text_units) const
+{
+    vector<int> word_map(text_units.size(), -1);
+    int unk_id = m_lm.word_id(m_lm.ngram().unk_symbol);
+    for (int i=0; i<(int)text_units.size(); i++) {
+        word_map[i] = m_lm.word_id(text_units[i]);
+        if (word_map[i] >= 0) continue;
+        if (unk_id < 0) throw string("Word not found in the language model: " + text_units[i]);
+        word_map[i] = unk_id;
+    }
+    return word_map;
+}
+
+
+int
+LatticeRescorer::shorten_history(int node_idx) const
+{
+    if (m_history_length < 0) return node_idx;
+    const Ngram &ngram = m_lm.ngram();
+    while (node_idx != ngram.root_node && m_node_history_lengths[node_idx] > m_history_length)
+        node_idx = ngram.nodes[node_idx].backoff_node;
+    return node_idx;
+}
+
+
+Lattice::Hypothesis
+LatticeRescorer::rescore(const Lattice &lattice,
+                         const vector<int> &word_map,
+                         Lattice &rescored) const
+{
+    class State {
+    public:
+        State() : lm_node(-1), node(-1), score(-1e20),
+            am_log_prob(0.0), lm_log_prob(0.0), previous_state(-1), word_id(-1) { }
+        int lm_node;
+        int node;
+        double score;
+        double am_log_prob;
+        double lm_log_prob;
+        int previous_state;
+        int word_id;
+    };
+
+    rescored.clear();
+    Lattice::Hypothesis best_hypo;
+    if (lattice.m_initial_node < 0 || lattice.m_final_node < 0) return best_hypo;
+
+    vector<State> states;
+    // States of each original node by the shortened model history
+    vector<map<int, int> > node_states(lattice.m_nodes.size());
+
+    State initial_state;
+    initial_state.lm_node = m_lm.initial_node();
+    initial_state.node = rescored.add_node(lattice.m_nodes[lattice.m_initial_node].frame);
+    initial_state.score = 0.0;
+    rescored.m_initial_node = initial_state.node;
+    states.push_back(initial_state);
+    node_states[lattice.m_initial_node][shorten_history(initial_state.lm_node)] = 0;
+
+    vector<int> order = lattice.topological_order();
+    for (auto nit = order.begin(); nit != order.end(); ++nit) {
+        const Lattice::Node &node = lattice.m_nodes[*nit];
+        for (auto sit = node_states[*nit].begin(); sit != node_states[*nit].end(); ++sit) {
+            for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+                const Lattice::Arc &arc = lattice.m_arcs[*ait];
+                const State &state = states[sit->second];
+                int lm_node = state.lm_node;
+                float lm_log_prob = 0.0;
+                if (arc.word_id >= 0)
+                    lm_node = m_lm.score(lm_node, word_map[arc.word_id], lm_log_prob);
+                double score = state.score + arc.am_log_prob + m_lm_scale * lm_log_prob;
+
+                int history = shorten_history(lm_node);
+                auto tsit = node_states[arc.target_node].find(history);
+                int target_state_idx;
+                if (tsit == node_states[arc.target_node].end()) {
+                    target_state_idx = states.size();
+                    node_states[arc.target_node][history] = target_state_idx;
+                    State target_state;
+                    target_state.node = rescored.add_node(lattice.m_nodes[arc.target_node].frame);
+                    states.push_back(target_state);
+                }
+                else target_state_idx = tsit->second;
+
+                State &source_state = states[sit->second];
+                State &target_state = states[target_state_idx];
+                rescored.add_arc(source_state.node, target_state.node, arc.word_id,
+                                 arc.am_log_prob, lm_log_prob);
+                if (score > target_state.score) {
+                    target_state.lm_node = lm_node;
+                    target_state.score = score;
+                    target_state.am_log_prob = source_state.am_log_prob + arc.am_log_prob;
+                    target_state.lm_log_prob = source_state.lm_log_prob + lm_log_prob;
+                    target_state.previous_state = sit->second;
+                    target_state.word_id = arc.word_id;
+                }
+            }
+        }
+    }
+
+    const map<int, int> &final_states = node_states[lattice.m_final_node];
+    if (final_states.size() == 0) return best_hypo;
+    rescored.m_final_node = rescored.add_node(lattice.m_nodes[lattice.m_final_node].frame);
+    int best_state_idx = -1;
+    for (auto sit = final_states.begin(); sit != final_states.end(); ++sit) {
+        rescored.add_arc(states[sit->second].node, rescored.m_final_node, -1, 0.0, 0.0);
+        if (best_state_idx < 0 || states[sit->second].score > states[best_state_idx].score)
+            best_state_idx = sit->second;
+    }
+
+    best_hypo.total_lp = states[best_state_idx].score;
+    best_hypo.total_am_lp = states[best_state_idx].am_log_prob;
+    best_hypo.total_lm_lp = states[best_state_idx].lm_log_prob;
+    for (int s=best_state_idx; s>=0; s=states[s].previous_state)
+        if (states[s].word_id >= 0) best_hypo.word_ids.push_back(states[s].word_id);
+    reverse(best_hypo.word_ids.begin(), best_hypo.word_ids.end());
+    return best_hypo;
+}
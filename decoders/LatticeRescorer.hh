@@ -0,0 +1,88 @@
+#ifndef LATTICE_RESCORER_HH
+#define LATTICE_RESCORER_HH
+
+#include <string>
+#include <vector>
+
+#include "ClassNgram.hh"
+#include "Lattice.hh"
+#include "Ngram.hh"
+
+
+// Language model interface for lattice rescoring
+class RescoringLM {
+public:
+    virtual ~RescoringLM() { }
+    virtual int initial_node() const = 0;
+    // Returns the next node, the sentence end returns the initial node
+    virtual int score(int node_idx, int word_id, float &log_prob) const = 0;
+    // Model word id, -1 if not found
+    virtual int word_id(const std::string &word) const = 0;
+    // N-gram model for the history lengths of the nodes
+    virtual const Ngram& ngram() const = 0;
+};
+
+
+// Ngram in log10 or LNNgram in natural logarithm
+class NgramRescoringLM : public RescoringLM {
+public:
+    NgramRescoringLM(std::string arpafname, bool natural_log=false);
+    ~NgramRescoringLM();
+    int initial_node() const { return m_lm->sentence_start_node; }
+    int score(int node_idx, int word_id, float &log_prob) const;
+    int word_id(const std::string &word) const;
+    const Ngram& ngram() const { return *m_lm; }
+private:
+    NgramRescoringLM(const NgramRescoringLM&);
+    NgramRescoringLM& operator=(const NgramRescoringLM&);
+    Ngram *m_lm;
+};
+
+
+// Class n-gram, the words are the words in the class memberships
+class ClassNgramRescoringLM : public RescoringLM {
+public:
+    ClassNgramRescoringLM(std::string carpafname, std::string cmempfname);
+    ~ClassNgramRescoringLM();
+    int initial_node() const { return m_lm->m_class_ngram.sentence_start_node; }
+    int score(int node_idx, int word_id, float &log_prob) const;
+    int word_id(const std::string &word) const;
+    const Ngram& ngram() const { return m_lm->m_class_ngram; }
+private:
+    ClassNgramRescoringLM(const ClassNgramRescoringLM&);
+    ClassNgramRescoringLM& operator=(const ClassNgramRescoringLM&);
+    std::vector<std::string> m_words;
+    std::map<std::string, int> m_word_map;
+    ClassNgram *m_lm;
+};
+
+
+// Expands lattices with a language model.
+// Lattice states are merged by the model history,
+// histories longer than the history length are shortened by backing off.
+class LatticeRescorer {
+public:
+    LatticeRescorer(const RescoringLM &lm,
+                    float lm_scale,
+                    int history_length=-1);
+
+    // Model word ids for the lattice words, unknown words map to <unk>,
+    // throws if <unk> is not in the model
+    std::vector<int> get_word_map(const std::vector<std::string> &text_units) const;
+
+    // Replaces the LM scores, returns the best path of the rescored lattice
+    Lattice::Hypothesis rescore(const Lattice &lattice,
+                                const std::vector<int> &word_map,
+                                Lattice &rescored) const;
+
+private:
+    int shorten_history(int node_idx) const;
+
+    const RescoringLM &m_lm;
+    float m_lm_scale;
+    int m_history_length;
+    // History length of the model nodes
+    std::vector<int> m_node_history_lengths;
+};
+
+#endif /* LATTICE_RESCORER_HH */
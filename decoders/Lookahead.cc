@@ -5,6 +5,8 @@
 #include <list>
 #include <sstream>
 #include <map>
+#include <cstring>
+#include <thread>
 
 #include "Lookahead.hh"
 
@@ -99,13 +101,29 @@ Decoder::Lookahead::detect_one_predecessor_node(int node_idx,
 
 
 UnigramLookahead::UnigramLookahead(Decoder &decoder,
-                                   string lafname)
+                                   string lafname,
+                                   string cachefname)
 {
     m_la_lm.read_arpa(lafname);
     this->decoder = &decoder;
     set_text_unit_id_la_ngram_symbol_mapping();
+
+    LookaheadCache cache("unigram", decoder, vector<string>(1, lafname));
+    if (cache.read(cachefname)) {
+        cache.get("la_scores", m_la_scores);
+        cache.get_graph(decoder);
+        return;
+    }
+
     set_unigram_la_scores();
     set_arc_la_updates();
+
+    if (cachefname.length() > 0) {
+        cache.create(cachefname);
+        cache.set("la_scores", m_la_scores);
+        cache.set_graph(decoder);
+        cache.close();
+    }
 }
 
 
@@ -255,15 +273,18 @@ BigramLookahead::convert_reverse_bigram_idxs(map<int, vector<int> > &reverse_big
     int maxidx = 0;
     for (int i=0; i<(int)m_text_unit_id_to_la_ngram_symbol.size(); i++)
         maxidx = max(maxidx, m_text_unit_id_to_la_ngram_symbol[i]);
-    la_ngram_symbol_to_text_unit_id.resize(maxidx+1);
+    // Symbols without a text unit are -1 and not in the graph
+    la_ngram_symbol_to_text_unit_id.resize(maxidx+1, -1);
     for (int i=0; i<(int)m_text_unit_id_to_la_ngram_symbol.size(); i++)
         la_ngram_symbol_to_text_unit_id[m_text_unit_id_to_la_ngram_symbol[i]] = i;
 
     map<int, vector<int> > new_rev_bigrams;
     for (auto rbgit = reverse_bigrams.begin(); rbgit != reverse_bigrams.end(); ++rbgit) {
+        if (rbgit->first > maxidx) continue;
         int new_idx = la_ngram_symbol_to_text_unit_id[rbgit->first];
         if (words_in_graph.find(new_idx) == words_in_graph.end()) continue;
         for (int i=0; i<(int)rbgit->second.size(); i++) {
+            if (rbgit->second[i] > maxidx) continue;
             int new_second_idx = la_ngram_symbol_to_text_unit_id[rbgit->second[i]];
             if (words_in_graph.find(new_second_idx) != words_in_graph.end())
                 new_rev_bigrams[new_idx].push_back(new_second_idx);
@@ -279,9 +300,16 @@ LookaheadStateCount::LookaheadStateCount(Decoder &decoder,
         bool true_count)
 {
     this->decoder = &decoder;
+    init_la_states(successor_lists, true_count);
+}
 
+
+void
+LookaheadStateCount::init_la_states(bool successor_lists,
+                                    bool true_count)
+{
     cerr << "Setting lookahead state indices" << endl;
-    m_node_la_states.resize(decoder.m_nodes.size(), -1);
+    m_node_la_states.resize(decoder->m_nodes.size(), -1);
     m_la_state_count = set_la_state_indices_to_nodes();
     cerr << "Number of lookahead states: " << m_la_state_count << endl;
 
@@ -412,20 +440,39 @@ LookaheadStateCount::set_arc_la_updates()
 FullTableBigramLookahead::FullTableBigramLookahead(Decoder &decoder,
         string lafname,
         bool successor_lists,
-        bool quantization)
-    : LookaheadStateCount(decoder,
-                          successor_lists)
+        bool quantization,
+        string cachefname)
 {
+    this->decoder = &decoder;
     m_la_lm.read_arpa(lafname);
     set_text_unit_id_la_ngram_symbol_mapping();
 
+    LookaheadCache cache("bigram-full", decoder, vector<string>(1, lafname));
+    if (cache.read(cachefname)) {
+        cache.get_value("la_state_count", m_la_state_count);
+        cache.get("node_la_states", m_node_la_states);
+        cache.get("successor_words", m_la_state_successor_words);
+        cache.get_graph(decoder);
+    }
+    else {
+        init_la_states(successor_lists, false);
+        set_arc_la_updates();
+
+        if (cachefname.length() > 0) {
+            cache.create(cachefname);
+            cache.set_value("la_state_count", m_la_state_count);
+            cache.set("node_la_states", m_node_la_states);
+            cache.set("successor_words", m_la_state_successor_words);
+            cache.set_graph(decoder);
+            cache.close();
+        }
+    }
+
     if (!quantization) {
         m_bigram_la_scores.resize(m_la_state_count);
         for (auto blsit = m_bigram_la_scores.begin(); blsit != m_bigram_la_scores.end(); ++blsit)
             (*blsit).resize(decoder.m_text_units.size(), TINY_FLOAT);
     }
-
-    set_arc_la_updates();
 }
 
 
@@ -452,10 +499,70 @@ PrecomputedFullTableBigramLookahead
 ::PrecomputedFullTableBigramLookahead(
     Decoder &decoder,
     string lafname,
-    bool quantization)
-    : FullTableBigramLookahead(decoder, lafname, false, quantization)
+    bool quantization,
+    int num_threads,
+    string cachefname,
+    bool sparse)
+    : m_sparse_offset_ptr(nullptr),
+      m_sparse_word_id_ptr(nullptr),
+      m_sparse_score_ptr(nullptr),
+      m_quant_sparse_score_ptr(nullptr)
 {
+    this->decoder = &decoder;
+    m_la_lm.read_arpa(lafname);
+    set_text_unit_id_la_ngram_symbol_mapping();
+    set_word_id_la_states();
     m_quantization = quantization;
+    m_sparse = sparse;
+
+    if (sparse) {
+        m_word_backoff_scores.resize(m_word_id_la_state_lookup.size());
+        for (int w=0; w<(int)m_word_backoff_scores.size(); w++)
+            m_word_backoff_scores[w] = m_la_lm.nodes[m_word_id_la_state_lookup[w]].backoff_prob;
+    }
+
+    string la_type = sparse ? "bigram-precomputed-sparse" : "bigram-precomputed-full";
+    if (quantization) la_type += "-quantized";
+    LookaheadCache cache(la_type, decoder, vector<string>(1, lafname));
+    if (cache.read(cachefname)) {
+        cache.get_value("la_state_count", m_la_state_count);
+        cache.get("node_la_states", m_node_la_states);
+        if (quantization) {
+            cache.get_value("min_la_score", m_min_la_score);
+            m_quant_log_probs.setMinLogProb(m_min_la_score);
+        }
+        if (sparse) {
+            cache.get("la_state_unigram_scores", m_la_state_unigram_scores);
+            long long int offset_count, word_id_count, score_count;
+            m_sparse_offset_ptr = cache.get_mapped<long long int>("sparse_offsets", offset_count);
+            m_sparse_word_id_ptr = cache.get_mapped<int>("sparse_word_ids", word_id_count);
+            if (quantization)
+                m_quant_sparse_score_ptr = cache.get_mapped<unsigned short int>("sparse_scores", score_count);
+            else
+                m_sparse_score_ptr = cache.get_mapped<float>("sparse_scores", score_count);
+            if (offset_count != m_la_state_count + 1 || word_id_count != score_count
+                || m_sparse_offset_ptr[m_la_state_count] != score_count)
+            {
+                throw string("Invalid look-ahead cache: " + cachefname);
+            }
+        }
+        else if (quantization)
+            cache.get("bigram_la_scores", m_quant_bigram_lookup);
+        else
+            cache.get("bigram_la_scores", m_bigram_la_scores);
+        cache.get_graph(decoder);
+        cache.release_mapping(m_cache_file);
+        return;
+    }
+
+    init_la_states(false, false);
+    if (!quantization && !sparse) {
+        m_bigram_la_scores.resize(m_la_state_count);
+        for (auto blsit = m_bigram_la_scores.begin(); blsit != m_bigram_la_scores.end(); ++blsit)
+            (*blsit).resize(decoder.m_text_units.size(), TINY_FLOAT);
+    }
+    set_arc_la_updates();
+
     if (quantization) {
         double min_backoff_prob = 0.0;
         for (int i=0; i<(int)m_la_lm.nodes.size(); i++)
@@ -470,14 +577,47 @@ PrecomputedFullTableBigramLookahead
         }
         m_min_la_score = min_backoff_prob + min_root_word_prob;
         m_quant_log_probs.setMinLogProb(m_min_la_score);
-        m_quant_bigram_lookup.resize(m_la_state_count);
-        for (auto blsit = m_quant_bigram_lookup.begin(); blsit != m_quant_bigram_lookup.end(); ++blsit)
-            (*blsit).resize(decoder.m_text_units.size(), USHRT_MAX);
+        if (!sparse) {
+            m_quant_bigram_lookup.resize(m_la_state_count);
+            for (auto blsit = m_quant_bigram_lookup.begin(); blsit != m_quant_bigram_lookup.end(); ++blsit)
+                (*blsit).resize(decoder.m_text_units.size(), USHRT_MAX);
+        }
     }
 
-    set_word_id_la_states();
     set_unigram_la_scores();
-    set_bigram_la_scores();
+    set_bigram_la_scores(num_threads);
+
+    if (sparse) {
+        m_sparse_offset_ptr = m_sparse_offsets.data();
+        m_sparse_word_id_ptr = m_sparse_word_ids.data();
+        m_sparse_score_ptr = m_sparse_scores.data();
+        m_quant_sparse_score_ptr = m_quant_sparse_scores.data();
+        cerr << "Sparse bigram look-ahead scores: " << m_sparse_word_ids.size() << " / "
+             << (long long int)m_la_state_count * m_word_backoff_scores.size() << endl;
+    }
+
+    if (cachefname.length() > 0) {
+        cache.create(cachefname);
+        cache.set_value("la_state_count", m_la_state_count);
+        cache.set("node_la_states", m_node_la_states);
+        if (quantization)
+            cache.set_value("min_la_score", m_min_la_score);
+        if (sparse) {
+            cache.set("la_state_unigram_scores", m_la_state_unigram_scores);
+            cache.set("sparse_offsets", m_sparse_offsets);
+            cache.set("sparse_word_ids", m_sparse_word_ids);
+            if (quantization)
+                cache.set("sparse_scores", m_quant_sparse_scores);
+            else
+                cache.set("sparse_scores", m_sparse_scores);
+        }
+        else if (quantization)
+            cache.set("bigram_la_scores", m_quant_bigram_lookup);
+        else
+            cache.set("bigram_la_scores", m_bigram_la_scores);
+        cache.set_graph(decoder);
+        cache.close();
+    }
 }
 
 
@@ -485,7 +625,22 @@ float
 PrecomputedFullTableBigramLookahead::get_lookahead_score(int node_idx, int word_id)
 {
     int la_state_idx = m_node_la_states[node_idx];
-    if (m_quantization) {
+    if (m_sparse) {
+        long long int first = m_sparse_offset_ptr[la_state_idx];
+        long long int last = m_sparse_offset_ptr[la_state_idx+1];
+        const int *wit = lower_bound(m_sparse_word_id_ptr + first,
+                                     m_sparse_word_id_ptr + last,
+                                     word_id);
+        long long int score_idx = wit - m_sparse_word_id_ptr;
+        if (score_idx != last && *wit == word_id) {
+            if (m_quantization)
+                return m_quant_log_probs.getQuantizedLogProb(m_quant_sparse_score_ptr[score_idx]);
+            else
+                return m_sparse_score_ptr[score_idx];
+        }
+        return m_word_backoff_scores[word_id] + m_la_state_unigram_scores[la_state_idx];
+    }
+    else if (m_quantization) {
         return m_quant_log_probs.getQuantizedLogProb(m_quant_bigram_lookup[la_state_idx][word_id]);
     } else {
         return m_bigram_la_scores[la_state_idx][word_id];
@@ -513,52 +668,32 @@ PrecomputedFullTableBigramLookahead::set_lookahead_score(
 }
 
 
-void
-PrecomputedFullTableBigramLookahead::find_preceeding_la_states(int node_idx,
-        set<int> &la_states,
-        const vector<vector<Decoder::Arc> > &reverse_arcs,
-        bool first_node,
-        bool state_change)
-{
-    if (!first_node) {
-        if (state_change) {
-            int la_state = m_node_la_states[node_idx];
-            la_states.insert(la_state);
-        }
-        if (node_idx == END_NODE || decoder->m_nodes[node_idx].word_id != -1)
-            return;
-    }
-
-    for (auto ait = reverse_arcs[node_idx].begin(); ait != reverse_arcs[node_idx].end(); ++ait) {
-        int target_node = ait->target_node;
-        if (target_node == node_idx) continue;
-        find_preceeding_la_states(target_node, la_states, reverse_arcs, false, ait->update_lookahead);
-    }
-}
-
-
 void
 PrecomputedFullTableBigramLookahead::propagate_unigram_la_score(int node_idx,
         float score,
         int word_id,
-        vector<vector<Decoder::Arc> > &reverse_arcs,
-        vector<pair<int, float> > &unigram_la_scores,
-        bool start_node)
+        const vector<vector<Decoder::Arc> > &reverse_arcs,
+        vector<pair<int, float> > &unigram_la_scores)
 {
-    Decoder::Node &node = decoder->m_nodes[node_idx];
-    if (!start_node) {
-        int la_state = m_node_la_states[node_idx];
-        if (unigram_la_scores[la_state].second > score) return;
-        unigram_la_scores[la_state].second = score;
-        unigram_la_scores[la_state].first = word_id;
-        if (node.word_id != -1) return;
-    }
-
-    for (auto rait = reverse_arcs[node_idx].begin(); rait != reverse_arcs[node_idx].end(); ++rait)
-    {
-        if (rait->target_node == node_idx) continue;
-        propagate_unigram_la_score(rait->target_node, score, word_id,
-                                   reverse_arcs, unigram_la_scores, false);
+    vector<int> node_stack(1, node_idx);
+    set<int> expanded_nodes;
+    expanded_nodes.insert(node_idx);
+
+    while (node_stack.size() > 0) {
+        int curr_node_idx = node_stack.back();
+        node_stack.pop_back();
+        for (auto rait = reverse_arcs[curr_node_idx].begin(); rait != reverse_arcs[curr_node_idx].end(); ++rait)
+        {
+            int target_node = rait->target_node;
+            if (target_node == curr_node_idx) continue;
+            int la_state = m_node_la_states[target_node];
+            if (unigram_la_scores[la_state].second > score) continue;
+            unigram_la_scores[la_state].second = score;
+            unigram_la_scores[la_state].first = word_id;
+            if (decoder->m_nodes[target_node].word_id != -1) continue;
+            if (expanded_nodes.insert(target_node).second)
+                node_stack.push_back(target_node);
+        }
     }
 }
 
@@ -573,7 +708,7 @@ void
 PrecomputedFullTableBigramLookahead::set_unigram_la_scores()
 {
     std::vector<std::pair<int, float> > unigram_la_scores;
-    unigram_la_scores.resize(decoder->m_text_units.size(), make_pair(-1,TINY_FLOAT));
+    unigram_la_scores.resize(m_la_state_count, make_pair(-1,TINY_FLOAT));
 
     // Collect all LM nodes and compute unigram la score
     vector<pair<unsigned int, pair<int, float> > > sorted_nodes;
@@ -591,7 +726,14 @@ PrecomputedFullTableBigramLookahead::set_unigram_la_scores()
     sort(sorted_nodes.begin(), sorted_nodes.end(), descending_node_unigram_la_lp_sort_5);
     for (auto snit = sorted_nodes.begin(); snit != sorted_nodes.end(); ++snit)
         propagate_unigram_la_score(snit->first, snit->second.second, snit->second.first,
-                                   reverse_arcs, unigram_la_scores, true);
+                                   reverse_arcs, unigram_la_scores);
+
+    if (m_sparse) {
+        m_la_state_unigram_scores.resize(m_la_state_count);
+        for (int l=0; l<m_la_state_count; l++)
+            m_la_state_unigram_scores[l] = unigram_la_scores[l].second;
+        return;
+    }
 
     // Set best unigram values for each la state/word pair
     for (int l=0; l<m_la_state_count; l++) {
@@ -605,54 +747,249 @@ PrecomputedFullTableBigramLookahead::set_unigram_la_scores()
 
 
 void
-PrecomputedFullTableBigramLookahead::set_bigram_la_scores()
+PrecomputedFullTableBigramLookahead::set_bigram_la_scores(int num_threads)
 {
+    num_threads = max(1, num_threads);
+
     map<int, vector<int> > reverse_bigrams;
     m_la_lm.get_reverse_bigrams(reverse_bigrams);
     convert_reverse_bigram_idxs(reverse_bigrams);
 
-    vector<vector<Decoder::Arc> > reverse_arcs;
-    decoder->get_reverse_arcs(reverse_arcs);
-
-    for (unsigned int i=0; i<decoder->m_nodes.size(); i++) {
-        int word_id = decoder->m_nodes[i].word_id;
-        if (word_id == -1) continue;
+    vector<vector<pair<int, float> > > word_bigram_scores(decoder->m_text_units.size());
+    vector<std::thread*> threads;
+    for (int t=0; t<num_threads; t++) {
+        std::thread *thr = new std::thread(&PrecomputedFullTableBigramLookahead::set_word_bigram_scores,
+                                           this, std::cref(reverse_bigrams),
+                                           std::ref(word_bigram_scores), t, num_threads);
+        threads.push_back(thr);
+    }
+    for (int t=0; t<num_threads; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+    threads.clear();
 
-        set<int> la_states;
-        find_preceeding_la_states(i, la_states, reverse_arcs);
+    vector<vector<int> > la_state_nodes(m_la_state_count);
+    for (int i=0; i<(int)decoder->m_nodes.size(); i++)
+        la_state_nodes[m_node_la_states[i]].push_back(i);
+
+    if (m_sparse) {
+        m_sparse_offsets.resize(m_la_state_count+1);
+        m_sparse_word_ids.clear();
+        m_sparse_scores.clear();
+        m_quant_sparse_scores.clear();
+    }
+
+    // Each thread sets the scores of its own range of look-ahead states.
+    // Sparse rows of the first thread are set directly to the table,
+    // the rows of the other threads are appended after the threads are joined
+    vector<int> first_la_states(num_threads+1);
+    for (int t=0; t<=num_threads; t++)
+        first_la_states[t] = (long long int)m_la_state_count * t / num_threads;
+    vector<vector<int> > thread_word_ids(num_threads);
+    vector<vector<float> > thread_scores(num_threads);
+    vector<vector<unsigned short int> > thread_quant_scores(num_threads);
+    for (int t=0; t<num_threads; t++) {
+        std::thread *thr = new std::thread(&PrecomputedFullTableBigramLookahead::set_la_state_bigram_scores,
+                                           this, std::cref(word_bigram_scores), std::cref(la_state_nodes),
+                                           first_la_states[t], first_la_states[t+1],
+                                           std::ref(t == 0 ? m_sparse_word_ids : thread_word_ids[t]),
+                                           std::ref(t == 0 ? m_sparse_scores : thread_scores[t]),
+                                           std::ref(t == 0 ? m_quant_sparse_scores : thread_quant_scores[t]));
+        threads.push_back(thr);
+    }
+    for (int t=0; t<num_threads; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+
+    if (!m_sparse) return;
+
+    for (int t=1; t<num_threads; t++) {
+        long long int offset = m_sparse_word_ids.size();
+        for (int l=first_la_states[t]; l<first_la_states[t+1]; l++)
+            m_sparse_offsets[l] += offset;
+        m_sparse_word_ids.insert(m_sparse_word_ids.end(),
+                                 thread_word_ids[t].begin(), thread_word_ids[t].end());
+        m_sparse_scores.insert(m_sparse_scores.end(),
+                               thread_scores[t].begin(), thread_scores[t].end());
+        m_quant_sparse_scores.insert(m_quant_sparse_scores.end(),
+                                     thread_quant_scores[t].begin(), thread_quant_scores[t].end());
+        vector<int>().swap(thread_word_ids[t]);
+        vector<float>().swap(thread_scores[t]);
+        vector<unsigned short int>().swap(thread_quant_scores[t]);
+    }
+    m_sparse_offsets[m_la_state_count] = m_sparse_word_ids.size();
+}
 
-        vector<int> &pred_words = reverse_bigrams[word_id];
 
+void
+PrecomputedFullTableBigramLookahead::set_word_bigram_scores(
+    const map<int, vector<int> > &reverse_bigrams,
+    vector<vector<pair<int, float> > > &word_bigram_scores,
+    int thread_idx,
+    int num_threads) const
+{
+    int i = 0;
+    for (auto rbit = reverse_bigrams.begin(); rbit != reverse_bigrams.end(); ++rbit, ++i) {
+        if (i % num_threads != thread_idx) continue;
+        int word_id = rbit->first;
+        const vector<int> &pred_words = rbit->second;
+        vector<pair<int, float> > &scores = word_bigram_scores[word_id];
+        scores.reserve(pred_words.size());
         for (auto pwit = pred_words.begin(); pwit != pred_words.end(); ++pwit) {
             float la_prob = 0.0;
             int nd = m_la_lm.advance(m_la_lm.root_node, m_text_unit_id_to_la_ngram_symbol[*pwit]);
             m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[word_id], la_prob);
+            scores.push_back(make_pair(*pwit, la_prob));
+        }
+    }
+}
 
-            for (auto lasit = la_states.begin(); lasit != la_states.end(); ++lasit)
-                set_lookahead_score(*lasit, *pwit, la_prob);
+
+void
+PrecomputedFullTableBigramLookahead::set_la_state_bigram_scores(
+    const vector<vector<pair<int, float> > > &word_bigram_scores,
+    const vector<vector<int> > &la_state_nodes,
+    int first_la_state,
+    int last_la_state,
+    vector<int> &sparse_word_ids,
+    vector<float> &sparse_scores,
+    vector<unsigned short int> &quant_sparse_scores)
+{
+    const float no_score = TINY_FLOAT;
+    vector<int> visited_la_state(decoder->m_nodes.size(), -1);
+    vector<int> words;
+    vector<float> pred_word_scores(decoder->m_text_units.size(), no_score);
+    vector<int> pred_words;
+
+    for (int l=first_la_state; l<last_la_state; l++) {
+        find_la_state_words(l, la_state_nodes, visited_la_state, words);
+        for (auto wit = words.begin(); wit != words.end(); ++wit) {
+            const vector<pair<int, float> > &scores = word_bigram_scores[*wit];
+            for (auto sit = scores.begin(); sit != scores.end(); ++sit) {
+                float &score = pred_word_scores[sit->first];
+                if (score == no_score) pred_words.push_back(sit->first);
+                score = max(score, sit->second);
+            }
+        }
+
+        if (!m_sparse) {
+            for (auto pwit = pred_words.begin(); pwit != pred_words.end(); ++pwit) {
+                set_lookahead_score(l, *pwit, pred_word_scores[*pwit]);
+                pred_word_scores[*pwit] = no_score;
+            }
+            pred_words.clear();
+            continue;
         }
+
+        // Store only the scores exceeding the backoff bound
+        sort(pred_words.begin(), pred_words.end());
+        m_sparse_offsets[l] = sparse_word_ids.size();
+        float ug_score = m_la_state_unigram_scores[l];
+        for (auto pwit = pred_words.begin(); pwit != pred_words.end(); ++pwit) {
+            float score = pred_word_scores[*pwit];
+            pred_word_scores[*pwit] = no_score;
+            float backoff_score = m_word_backoff_scores[*pwit] + ug_score;
+            if (score <= backoff_score) continue;
+            sparse_word_ids.push_back(*pwit);
+            if (m_quantization)
+                quant_sparse_scores.push_back(m_quant_log_probs.getQuantIndex(score));
+            else
+                sparse_scores.push_back(score);
+        }
+        pred_words.clear();
+    }
+}
+
+
+// Words reachable from the look-ahead state, the same words for which
+// the state is found when traversing backward from the word nodes.
+// The state is traversed forward from its look-ahead update arcs
+// to the first word nodes.
+void
+PrecomputedFullTableBigramLookahead::find_la_state_words(
+    int la_state_idx,
+    const vector<vector<int> > &la_state_nodes,
+    vector<int> &visited_la_state,
+    vector<int> &words) const
+{
+    words.clear();
+    vector<int> node_stack;
+    const vector<int> &nodes = la_state_nodes[la_state_idx];
+    for (auto nit = nodes.begin(); nit != nodes.end(); ++nit) {
+        const Decoder::Node &node = decoder->m_nodes[*nit];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+            if (ait->update_lookahead && ait->target_node != *nit)
+                node_stack.push_back(ait->target_node);
+    }
+
+    while (node_stack.size() > 0) {
+        int node_idx = node_stack.back();
+        node_stack.pop_back();
+        if (visited_la_state[node_idx] == la_state_idx) continue;
+        visited_la_state[node_idx] = la_state_idx;
+        const Decoder::Node &node = decoder->m_nodes[node_idx];
+        if (node.word_id != -1) {
+            words.push_back(node.word_id);
+            continue;
+        }
+        if (node_idx == END_NODE) continue;
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+            if (ait->target_node != node_idx)
+                node_stack.push_back(ait->target_node);
     }
 }
 
 
 HybridBigramLookahead::HybridBigramLookahead(Decoder &decoder,
-        string lafname)
+        string lafname,
+        string cachefname)
 {
     m_la_lm.read_arpa(lafname);
     this->decoder = &decoder;
     set_text_unit_id_la_ngram_symbol_mapping();
 
-    decoder.mark_initial_nodes(1000);
-    m_node_la_states.resize(decoder.m_nodes.size(), -1);
+    LookaheadCache cache("bigram-hybrid", decoder, vector<string>(1, lafname));
+    if (cache.read(cachefname)) {
+        cache.get("node_la_states", m_node_la_states);
+        cache.get("successor_words", m_la_state_successor_words);
+        read_inner_bigram_scores(cache);
+        cache.get_graph(decoder);
+
+        m_bigram_la_scores.resize(m_la_state_successor_words.size());
+        for (auto blsit = m_bigram_la_scores.begin(); blsit != m_bigram_la_scores.end(); ++blsit)
+            (*blsit).resize(decoder.m_text_units.size(), TINY_FLOAT);
+        return;
+    }
+
+    init_la_states();
+
+    if (cachefname.length() > 0) {
+        cache.create(cachefname);
+        cache.set("node_la_states", m_node_la_states);
+        cache.set("successor_words", m_la_state_successor_words);
+        write_inner_bigram_scores(cache);
+        cache.set_graph(decoder);
+        cache.close();
+    }
+}
+
+
+void
+HybridBigramLookahead::init_la_states()
+{
+    decoder->mark_initial_nodes(1000);
+    m_node_la_states.resize(decoder->m_nodes.size(), -1);
     int la_state_count = set_la_state_indices_to_nodes();
     cerr << "Number of lookahead states: " << la_state_count << endl;
     set_la_state_successor_lists();
 
     m_bigram_la_scores.resize(m_la_state_successor_words.size());
     for (auto blsit = m_bigram_la_scores.begin(); blsit != m_bigram_la_scores.end(); ++blsit)
-        (*blsit).resize(decoder.m_text_units.size(), TINY_FLOAT);
+        (*blsit).resize(decoder->m_text_units.size(), TINY_FLOAT);
 
-    m_bigram_la_maps.resize(decoder.m_nodes.size());
+    m_bigram_la_maps.resize(decoder->m_nodes.size());
     int map_count = set_bigram_la_maps();
     cerr << "Nodes with a bigram lookahead map: " << map_count << endl;
 
@@ -660,6 +997,29 @@ HybridBigramLookahead::HybridBigramLookahead(Decoder &decoder,
 }
 
 
+void
+HybridBigramLookahead::write_inner_bigram_scores(LookaheadCache &cache) const
+{
+    vector<char> single_inner_bigram_score(m_single_inner_bigram_score.begin(),
+                                           m_single_inner_bigram_score.end());
+    cache.set("inner_bigram_score_idxs", m_inner_bigram_score_idxs);
+    cache.set("inner_bigram_scores", m_inner_bigram_scores);
+    cache.set("single_inner_bigram_score", single_inner_bigram_score);
+}
+
+
+void
+HybridBigramLookahead::read_inner_bigram_scores(const LookaheadCache &cache)
+{
+    vector<char> single_inner_bigram_score;
+    cache.get("inner_bigram_score_idxs", m_inner_bigram_score_idxs);
+    cache.get("inner_bigram_scores", m_inner_bigram_scores);
+    cache.get("single_inner_bigram_score", single_inner_bigram_score);
+    m_single_inner_bigram_score.assign(single_inner_bigram_score.begin(),
+                                       single_inner_bigram_score.end());
+}
+
+
 int
 HybridBigramLookahead::set_la_state_indices_to_nodes()
 {
@@ -833,14 +1193,39 @@ HybridBigramLookahead::set_arc_la_updates()
 
 
 PrecomputedHybridBigramLookahead
-::PrecomputedHybridBigramLookahead(Decoder &decoder, string lafname)
-    : HybridBigramLookahead(decoder, lafname)
+::PrecomputedHybridBigramLookahead(Decoder &decoder,
+                                   string lafname,
+                                   int num_threads,
+                                   string cachefname)
 {
-    m_la_state_successor_words.clear();
+    m_la_lm.read_arpa(lafname);
+    this->decoder = &decoder;
+    set_text_unit_id_la_ngram_symbol_mapping();
     set_word_id_la_states();
+
+    LookaheadCache cache("bigram-precomputed-hybrid", decoder, vector<string>(1, lafname));
+    if (cache.read(cachefname)) {
+        cache.get("node_la_states", m_node_la_states);
+        cache.get("bigram_la_scores", m_bigram_la_scores);
+        read_inner_bigram_scores(cache);
+        cache.get_graph(decoder);
+        return;
+    }
+
+    init_la_states();
+    m_la_state_successor_words.clear();
     set_unigram_la_scores();
-    set_bigram_la_scores();
+    set_bigram_la_scores(num_threads);
     m_bigram_la_maps.clear();
+
+    if (cachefname.length() > 0) {
+        cache.create(cachefname);
+        cache.set("node_la_states", m_node_la_states);
+        cache.set("bigram_la_scores", m_bigram_la_scores);
+        write_inner_bigram_scores(cache);
+        cache.set_graph(decoder);
+        cache.close();
+    }
 }
 
 
@@ -864,25 +1249,26 @@ PrecomputedHybridBigramLookahead::get_lookahead_score(int node_idx, int word_id)
 void
 PrecomputedHybridBigramLookahead::find_preceeding_la_states(int node_idx,
         set<int> &la_states,
-        const vector<vector<Decoder::Arc> > &reverse_arcs,
-        bool first_node,
-        bool state_change)
+        const vector<vector<Decoder::Arc> > &reverse_arcs) const
 {
-    Decoder::Node &node = decoder->m_nodes[node_idx];
-
-    if (!first_node) {
-        if (!(node.flags & NODE_BIGRAM_LA_TABLE)) return;
-        if (state_change) {
-            int la_state = m_node_la_states[node_idx];
-            la_states.insert(la_state);
+    vector<int> node_stack(1, node_idx);
+    set<int> expanded_nodes;
+    expanded_nodes.insert(node_idx);
+
+    while (node_stack.size() > 0) {
+        int curr_node_idx = node_stack.back();
+        node_stack.pop_back();
+        for (auto ait = reverse_arcs[curr_node_idx].begin(); ait != reverse_arcs[curr_node_idx].end(); ++ait) {
+            int target_node = ait->target_node;
+            if (target_node == curr_node_idx) continue;
+            Decoder::Node &node = decoder->m_nodes[target_node];
+            if (!(node.flags & NODE_BIGRAM_LA_TABLE)) continue;
+            if (ait->update_lookahead)
+                la_states.insert(m_node_la_states[target_node]);
+            if (node.word_id != -1) continue;
+            if (expanded_nodes.insert(target_node).second)
+                node_stack.push_back(target_node);
         }
-        if (node.word_id != -1) return;
-    }
-
-    for (auto ait = reverse_arcs[node_idx].begin(); ait != reverse_arcs[node_idx].end(); ++ait) {
-        int target_node = ait->target_node;
-        if (target_node == node_idx) continue;
-        find_preceeding_la_states(target_node, la_states, reverse_arcs, false, ait->update_lookahead);
     }
 }
 
@@ -933,26 +1319,30 @@ void
 PrecomputedHybridBigramLookahead::propagate_unigram_la_score(int node_idx,
         float score,
         int word_id,
-        vector<vector<Decoder::Arc> > &reverse_arcs,
-        vector<pair<int, float> > &unigram_la_scores,
-        bool start_node)
+        const vector<vector<Decoder::Arc> > &reverse_arcs,
+        vector<pair<int, float> > &unigram_la_scores)
 {
-    Decoder::Node &node = decoder->m_nodes[node_idx];
-
-    if (!start_node) {
-        if (!(node.flags & NODE_BIGRAM_LA_TABLE)) return;
-        int la_state = m_node_la_states[node_idx];
-        if (unigram_la_scores[la_state].second > score) return;
-        unigram_la_scores[la_state].second = score;
-        unigram_la_scores[la_state].first = word_id;
-        if (node.word_id != -1) return;
-    }
-
-    for (auto rait = reverse_arcs[node_idx].begin(); rait != reverse_arcs[node_idx].end(); ++rait)
-    {
-        if (rait->target_node == node_idx) continue;
-        propagate_unigram_la_score(rait->target_node, score, word_id,
-                                   reverse_arcs, unigram_la_scores, false);
+    vector<int> node_stack(1, node_idx);
+    set<int> expanded_nodes;
+    expanded_nodes.insert(node_idx);
+
+    while (node_stack.size() > 0) {
+        int curr_node_idx = node_stack.back();
+        node_stack.pop_back();
+        for (auto rait = reverse_arcs[curr_node_idx].begin(); rait != reverse_arcs[curr_node_idx].end(); ++rait)
+        {
+            int target_node = rait->target_node;
+            if (target_node == curr_node_idx) continue;
+            Decoder::Node &node = decoder->m_nodes[target_node];
+            if (!(node.flags & NODE_BIGRAM_LA_TABLE)) continue;
+            int la_state = m_node_la_states[target_node];
+            if (unigram_la_scores[la_state].second > score) continue;
+            unigram_la_scores[la_state].second = score;
+            unigram_la_scores[la_state].first = word_id;
+            if (node.word_id != -1) continue;
+            if (expanded_nodes.insert(target_node).second)
+                node_stack.push_back(target_node);
+        }
     }
 }
 
@@ -983,7 +1373,7 @@ PrecomputedHybridBigramLookahead::set_unigram_la_scores()
     sort(sorted_nodes.begin(), sorted_nodes.end(), descending_node_unigram_la_lp_sort_5);
     for (auto snit = sorted_nodes.begin(); snit != sorted_nodes.end(); ++snit)
         propagate_unigram_la_score(snit->first, snit->second.second, snit->second.first,
-                                   reverse_arcs, unigram_la_scores, true);
+                                   reverse_arcs, unigram_la_scores);
 
     // Set best unigram values for each la state/predecessor word pair
     for (int l=0; l<(int)m_bigram_la_scores.size(); l++) {
@@ -997,8 +1387,10 @@ PrecomputedHybridBigramLookahead::set_unigram_la_scores()
 
 
 void
-PrecomputedHybridBigramLookahead::set_bigram_la_scores()
+PrecomputedHybridBigramLookahead::set_bigram_la_scores(int num_threads)
 {
+    num_threads = max(1, num_threads);
+
     map<int, vector<int> > reverse_bigrams;
     m_la_lm.get_reverse_bigrams(reverse_bigrams);
     convert_reverse_bigram_idxs(reverse_bigrams);
@@ -1006,40 +1398,116 @@ PrecomputedHybridBigramLookahead::set_bigram_la_scores()
     vector<vector<Decoder::Arc> > reverse_arcs;
     decoder->get_reverse_arcs(reverse_arcs);
 
-    set<int> lm_nodes;
-    find_first_lm_nodes(lm_nodes);
-    find_cw_lm_nodes(lm_nodes);
-    find_sentence_end_lm_node(lm_nodes);
+    set<int> lm_node_set;
+    find_first_lm_nodes(lm_node_set);
+    find_cw_lm_nodes(lm_node_set);
+    find_sentence_end_lm_node(lm_node_set);
+    vector<int> lm_nodes(lm_node_set.begin(), lm_node_set.end());
+
+    // Each thread collects the maxima for its own share of the LM nodes.
+    // The first thread sets its scores directly to the table,
+    // the other threads to their own maps which are merged afterwards
+    vector<vector<map<int, float> > > thread_la_scores(num_threads);
+    vector<std::thread*> threads;
+    for (int t=0; t<num_threads; t++) {
+        if (t > 0) thread_la_scores[t].resize(m_bigram_la_scores.size());
+        vector<map<int, float> > *la_scores = t == 0 ? nullptr : &thread_la_scores[t];
+        std::thread *thr = new std::thread(&PrecomputedHybridBigramLookahead::collect_bigram_la_scores,
+                                           this, std::cref(reverse_bigrams), std::cref(reverse_arcs),
+                                           std::cref(lm_nodes), la_scores, t, num_threads);
+        threads.push_back(thr);
+    }
+    for (int t=0; t<num_threads; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+
+    for (int t=1; t<num_threads; t++) {
+        for (int l=0; l<(int)m_bigram_la_scores.size(); l++)
+            for (auto lsit = thread_la_scores[t][l].begin(); lsit != thread_la_scores[t][l].end(); ++lsit)
+                if (lsit->second > m_bigram_la_scores[l][lsit->first])
+                    m_bigram_la_scores[l][lsit->first] = lsit->second;
+        vector<map<int, float> >().swap(thread_la_scores[t]);
+    }
+}
 
-    for (auto nit=lm_nodes.begin(); nit != lm_nodes.end(); ++nit) {
-        int word_id = decoder->m_nodes[*nit].word_id;
+
+void
+PrecomputedHybridBigramLookahead::collect_bigram_la_scores(
+    const map<int, vector<int> > &reverse_bigrams,
+    const vector<vector<Decoder::Arc> > &reverse_arcs,
+    const vector<int> &lm_nodes,
+    vector<map<int, float> > *la_scores,
+    int thread_idx,
+    int num_threads)
+{
+    for (int i=thread_idx; i<(int)lm_nodes.size(); i += num_threads) {
+        int word_id = decoder->m_nodes[lm_nodes[i]].word_id;
         if (word_id == -1) continue;
+        auto rbit = reverse_bigrams.find(word_id);
+        if (rbit == reverse_bigrams.end()) continue;
 
         set<int> la_states;
-        find_preceeding_la_states(*nit, la_states, reverse_arcs);
+        find_preceeding_la_states(lm_nodes[i], la_states, reverse_arcs);
 
-        vector<int> &pred_words = reverse_bigrams[word_id];
+        const vector<int> &pred_words = rbit->second;
 
         for (auto pwit = pred_words.begin(); pwit != pred_words.end(); ++pwit) {
             int nd = m_la_lm.advance(m_la_lm.root_node, m_text_unit_id_to_la_ngram_symbol[*pwit]);
             float la_prob = 0.0;
             m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[word_id], la_prob);
 
-            for (auto lasit = la_states.begin(); lasit != la_states.end(); ++lasit)
-                if (la_prob > m_bigram_la_scores[*lasit][*pwit])
-                    m_bigram_la_scores[*lasit][*pwit] = la_prob;
+            for (auto lasit = la_states.begin(); lasit != la_states.end(); ++lasit) {
+                if (la_scores == nullptr) {
+                    if (la_prob > m_bigram_la_scores[*lasit][*pwit])
+                        m_bigram_la_scores[*lasit][*pwit] = la_prob;
+                    continue;
+                }
+                auto lsit = (*la_scores)[*lasit].find(*pwit);
+                if (lsit == (*la_scores)[*lasit].end())
+                    (*la_scores)[*lasit][*pwit] = la_prob;
+                else
+                    lsit->second = max(lsit->second, la_prob);
+            }
         }
     }
 }
 
 
 LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
-        string lafname)
+        string lafname,
+        int num_threads,
+        string cachefname)
+    : m_la_state_count(0),
+      m_la_state_ptr(nullptr),
+      m_bigram_offset_ptr(nullptr),
+      m_bigram_word_id_ptr(nullptr),
+      m_bigram_score_ptr(nullptr)
 {
     m_la_lm.read_arpa(lafname);
     this->decoder = &decoder;
     set_text_unit_id_la_ngram_symbol_mapping();
 
+    LookaheadCache cache("large-bigram", decoder, vector<string>(1, lafname));
+    if (cache.read(cachefname)) {
+        cache.get("node_la_states", m_node_la_states);
+        long long int state_count, offset_count, word_id_count, score_count;
+        m_la_state_ptr = cache.get_mapped<LookaheadState>("lookahead_states", state_count);
+        m_bigram_offset_ptr = cache.get_mapped<long long int>("bigram_offsets", offset_count);
+        m_bigram_word_id_ptr = cache.get_mapped<int>("bigram_word_ids", word_id_count);
+        m_bigram_score_ptr = cache.get_mapped<float>("bigram_scores", score_count);
+        if (offset_count != state_count + 1 || word_id_count != score_count
+            || m_bigram_offset_ptr[state_count] != score_count)
+        {
+            throw string("Invalid look-ahead cache: " + cachefname);
+        }
+        m_la_state_count = state_count;
+        cache.get_graph(decoder);
+        set_word_id_la_states();
+        cache.release_mapping(m_states_file);
+        return;
+    }
+
     vector<vector<Decoder::Arc> > reverse_arcs;
     decoder.get_reverse_arcs(reverse_arcs);
     decoder.mark_initial_nodes(1000);
@@ -1062,6 +1530,7 @@ LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
     m_node_la_states.resize(decoder.m_nodes.size(), -1);
     int la_count = set_la_state_indices_to_nodes();
     m_lookahead_states.resize(la_count);
+    m_bigram_score_maps.resize(la_count);
     cerr << "Number of lookahead states: " << la_count << endl;
 
     set_word_id_la_states();
@@ -1076,22 +1545,40 @@ LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
     time(&rawtime);
     cerr << "time: " << ctime(&rawtime);
     cerr << "Propagating bigram scores" << endl;
-    int bigram_score_count = set_bigram_la_scores_2();
+    int bigram_score_count = set_bigram_la_scores_2(num_threads);
 
     time(&rawtime);
     cerr << "time: " << ctime(&rawtime);
     cerr << "Bigram scores set: " << bigram_score_count << endl;
     int bigram_score_la_state_count = 0;
-    for (unsigned int i=0; i<m_lookahead_states.size(); i++)
-        if (m_lookahead_states[i].m_scores.size() > 0)
+    for (unsigned int i=0; i<m_bigram_score_maps.size(); i++)
+        if (m_bigram_score_maps[i].size() > 0)
             bigram_score_la_state_count++;
     cerr << "La states with bigram scores: " << bigram_score_la_state_count << "/" << m_lookahead_states.size() << endl;
+
+    set_bigram_la_score_arrays();
+
+    if (cachefname.length() > 0) {
+        cache.create(cachefname);
+        cache.set("node_la_states", m_node_la_states);
+        cache.set("lookahead_states", m_lookahead_states);
+        cache.set("bigram_offsets", m_bigram_offsets);
+        cache.set("bigram_word_ids", m_bigram_word_ids);
+        cache.set("bigram_scores", m_bigram_scores);
+        cache.set_graph(decoder);
+        cache.close();
+    }
 }
 
 
 LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
         string lafname,
         string statesfname)
+    : m_la_state_count(0),
+      m_la_state_ptr(nullptr),
+      m_bigram_offset_ptr(nullptr),
+      m_bigram_word_id_ptr(nullptr),
+      m_bigram_score_ptr(nullptr)
 {
     m_la_lm.read_arpa(lafname);
     this->decoder = &decoder;
@@ -1118,7 +1605,6 @@ LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
 
     m_node_la_states.resize(decoder.m_nodes.size(), -1);
     int la_count = set_la_state_indices_to_nodes();
-    m_lookahead_states.resize(la_count);
     cerr << "Number of lookahead states: " << la_count << endl;
 
     set_word_id_la_states();
@@ -1127,6 +1613,115 @@ LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
 
     cerr << "Reading look-ahead states from file: " << statesfname << endl;
     read(statesfname);
+    if (m_la_state_count != la_count)
+        throw string("Look-ahead state count mismatch in file: " + statesfname);
+}
+
+
+LargeBigramLookahead::LargeBigramLookahead(Decoder &decoder,
+        string lafname,
+        const LargeBigramLookahead &previous,
+        const vector<int> &previous_node_new_idxs)
+    : m_la_state_count(0),
+      m_la_state_ptr(nullptr),
+      m_bigram_offset_ptr(nullptr),
+      m_bigram_word_id_ptr(nullptr),
+      m_bigram_score_ptr(nullptr)
+{
+    const Decoder &previous_decoder = *(previous.decoder);
+    if (previous_decoder.m_text_units.size() > decoder.m_text_units.size()
+        || !equal(previous_decoder.m_text_units.begin(), previous_decoder.m_text_units.end(),
+                  decoder.m_text_units.begin()))
+        throw string("Text units of the previous look-ahead changed.");
+    if (previous_node_new_idxs.size() != previous_decoder.m_nodes.size())
+        throw string("Node indices not for the previous look-ahead graph.");
+
+    m_la_lm.read_arpa(lafname);
+    this->decoder = &decoder;
+    set_text_unit_id_la_ngram_symbol_mapping();
+
+    vector<vector<Decoder::Arc> > reverse_arcs;
+    decoder.get_reverse_arcs(reverse_arcs);
+    decoder.mark_initial_nodes(1000);
+    decoder.mark_tail_nodes(1000, reverse_arcs);
+
+    m_node_la_states.resize(decoder.m_nodes.size(), -1);
+    int la_count = set_la_state_indices_to_nodes();
+    m_lookahead_states.resize(la_count);
+    m_bigram_score_maps.resize(la_count);
+    m_la_state_count = la_count;
+    cerr << "Number of lookahead states: " << la_count << endl;
+
+    set_word_id_la_states();
+    set_arc_la_updates();
+    set_unigram_la_scores();
+
+    vector<set<int> > la_state_words, previous_la_state_words;
+    collect_la_state_words(la_state_words);
+    previous.collect_la_state_words(previous_la_state_words);
+
+    set<int> previous_words;
+    for (auto nit = previous_decoder.m_nodes.begin(); nit != previous_decoder.m_nodes.end(); ++nit)
+        if (nit->word_id != -1) previous_words.insert(nit->word_id);
+    set<int> new_words;
+    for (auto nit = decoder.m_nodes.begin(); nit != decoder.m_nodes.end(); ++nit)
+        if (nit->word_id != -1 && previous_words.find(nit->word_id) == previous_words.end())
+            new_words.insert(nit->word_id);
+
+    vector<int> previous_la_states(la_count, -1);
+    for (int i=0; i<(int)previous_node_new_idxs.size(); i++)
+        if (previous_node_new_idxs[i] != -1)
+            previous_la_states[m_node_la_states[previous_node_new_idxs[i]]] = previous.m_node_la_states[i];
+
+    // States to score for each word with all predecessors
+    // and with only the new words as predecessors
+    map<int, set<int> > all_pred_la_states;
+    map<int, set<int> > new_pred_la_states;
+    int copied_count = 0;
+    for (int l=0; l<la_count; l++) {
+        const set<int> &words = la_state_words[l];
+        int pl = previous_la_states[l];
+        if (pl == -1
+            || previous.m_la_state_ptr[pl].m_best_unigram_word_id != m_lookahead_states[l].m_best_unigram_word_id
+            || !includes(words.begin(), words.end(),
+                         previous_la_state_words[pl].begin(), previous_la_state_words[pl].end()))
+        {
+            for (auto wit = words.begin(); wit != words.end(); ++wit)
+                all_pred_la_states[*wit].insert(l);
+            continue;
+        }
+
+        map<int, float> &la_scores = m_bigram_score_maps[l];
+        for (long long int b=previous.m_bigram_offset_ptr[pl]; b<previous.m_bigram_offset_ptr[pl+1]; b++)
+            la_scores[previous.m_bigram_word_id_ptr[b]] = previous.m_bigram_score_ptr[b];
+        for (auto wit = words.begin(); wit != words.end(); ++wit)
+            if (previous_la_state_words[pl].find(*wit) == previous_la_state_words[pl].end())
+                all_pred_la_states[*wit].insert(l);
+            else if (new_words.size() > 0)
+                new_pred_la_states[*wit].insert(l);
+        copied_count++;
+    }
+    cerr << "La states copied from the previous look-ahead: " << copied_count << "/" << la_count << endl;
+
+    map<int, vector<int> > reverse_bigrams;
+    m_la_lm.get_reverse_bigrams(reverse_bigrams);
+    convert_reverse_bigram_idxs(reverse_bigrams);
+
+    for (auto rbit = reverse_bigrams.begin(); rbit != reverse_bigrams.end(); ++rbit) {
+        auto apit = all_pred_la_states.find(rbit->first);
+        if (apit != all_pred_la_states.end())
+            add_bigram_la_scores(rbit->first, rbit->second, apit->second, m_bigram_score_maps);
+
+        auto npit = new_pred_la_states.find(rbit->first);
+        if (npit == new_pred_la_states.end()) continue;
+        vector<int> new_pred_words;
+        for (auto pwit = rbit->second.begin(); pwit != rbit->second.end(); ++pwit)
+            if (new_words.find(*pwit) != new_words.end())
+                new_pred_words.push_back(*pwit);
+        add_bigram_la_scores(rbit->first, new_pred_words, npit->second, m_bigram_score_maps);
+    }
+
+    set_bigram_la_score_arrays();
 }
 
 
@@ -1160,11 +1755,20 @@ LargeBigramLookahead::set_la_state_indices_to_nodes()
 float
 LargeBigramLookahead::get_lookahead_score(int node_idx, int word_id)
 {
-    int la_state = m_node_la_states[node_idx];
-    LookaheadState &state = m_lookahead_states[la_state];
+    return get_la_state_score(m_node_la_states[node_idx], word_id);
+}
+
 
-    if (state.m_scores.find(word_id) != state.m_scores.end())
-        return state.m_scores[word_id];
+float
+LargeBigramLookahead::get_la_state_score(int la_state, int word_id)
+{
+    const LookaheadState &state = m_la_state_ptr[la_state];
+
+    const int *first = m_bigram_word_id_ptr + m_bigram_offset_ptr[la_state];
+    const int *last = m_bigram_word_id_ptr + m_bigram_offset_ptr[la_state+1];
+    const int *bsit = lower_bound(first, last, word_id);
+    if (bsit != last && *bsit == word_id)
+        return m_bigram_score_ptr[bsit - m_bigram_word_id_ptr];
     else {
         /*
         float prob = 0.0;
@@ -1248,23 +1852,25 @@ LargeBigramLookahead::propagate_la_state_idx(int node_idx,
 void
 LargeBigramLookahead::find_preceeding_la_states(int node_idx,
         set<int> &la_states,
-        const vector<vector<Decoder::Arc> > &reverse_arcs,
-        bool first_node,
-        bool state_change)
+        const vector<vector<Decoder::Arc> > &reverse_arcs) const
 {
-    if (!first_node) {
-        if (state_change) {
-            int la_state = m_node_la_states[node_idx];
-            la_states.insert(la_state);
+    vector<int> node_stack(1, node_idx);
+    set<int> expanded_nodes;
+    expanded_nodes.insert(node_idx);
+
+    while (node_stack.size() > 0) {
+        int curr_node_idx = node_stack.back();
+        node_stack.pop_back();
+        for (auto ait = reverse_arcs[curr_node_idx].begin(); ait != reverse_arcs[curr_node_idx].end(); ++ait) {
+            int target_node = ait->target_node;
+            if (target_node == curr_node_idx) continue;
+            if (ait->update_lookahead)
+                la_states.insert(m_node_la_states[target_node]);
+            if (target_node == END_NODE || decoder->m_nodes[target_node].word_id != -1)
+                continue;
+            if (expanded_nodes.insert(target_node).second)
+                node_stack.push_back(target_node);
         }
-        if (node_idx == END_NODE || decoder->m_nodes[node_idx].word_id != -1)
-            return;
-    }
-
-    for (auto ait = reverse_arcs[node_idx].begin(); ait != reverse_arcs[node_idx].end(); ++ait) {
-        int target_node = ait->target_node;
-        if (target_node == node_idx) continue;
-        find_preceeding_la_states(target_node, la_states, reverse_arcs, false, ait->update_lookahead);
     }
 }
 
@@ -1273,22 +1879,27 @@ void
 LargeBigramLookahead::propagate_unigram_la_score(int node_idx,
         float score,
         int word_id,
-        vector<vector<Decoder::Arc> > &reverse_arcs,
-        bool start_node)
+        const vector<vector<Decoder::Arc> > &reverse_arcs)
 {
-    Decoder::Node &node = decoder->m_nodes[node_idx];
-    if (!start_node) {
-        LookaheadState &la_state = m_lookahead_states[m_node_la_states[node_idx]];
-        if (la_state.m_best_unigram_score > score) return;
-        la_state.m_best_unigram_score = score;
-        la_state.m_best_unigram_word_id = word_id;
-        if (node.word_id != -1) return;
-    }
-
-    for (auto rait = reverse_arcs[node_idx].begin(); rait != reverse_arcs[node_idx].end(); ++rait)
-    {
-        if (rait->target_node == node_idx) continue;
-        propagate_unigram_la_score(rait->target_node, score, word_id, reverse_arcs, false);
+    vector<int> node_stack(1, node_idx);
+    set<int> expanded_nodes;
+    expanded_nodes.insert(node_idx);
+
+    while (node_stack.size() > 0) {
+        int curr_node_idx = node_stack.back();
+        node_stack.pop_back();
+        for (auto rait = reverse_arcs[curr_node_idx].begin(); rait != reverse_arcs[curr_node_idx].end(); ++rait)
+        {
+            int target_node = rait->target_node;
+            if (target_node == curr_node_idx) continue;
+            LookaheadState &la_state = m_lookahead_states[m_node_la_states[target_node]];
+            if (la_state.m_best_unigram_score > score) continue;
+            la_state.m_best_unigram_score = score;
+            la_state.m_best_unigram_word_id = word_id;
+            if (decoder->m_nodes[target_node].word_id != -1) continue;
+            if (expanded_nodes.insert(target_node).second)
+                node_stack.push_back(target_node);
+        }
     }
 }
 
@@ -1316,7 +1927,7 @@ LargeBigramLookahead::set_unigram_la_scores()
     sort(sorted_nodes.begin(), sorted_nodes.end(), descending_node_unigram_la_lp_sort_2);
     for (auto snit = sorted_nodes.begin(); snit != sorted_nodes.end(); ++snit)
         propagate_unigram_la_score(snit->first, snit->second.second, snit->second.first,
-                                   reverse_arcs, true);
+                                   reverse_arcs);
 }
 
 
@@ -1334,23 +1945,20 @@ LargeBigramLookahead::set_bigram_la_scores()
 
         if (i % 10000 == 0) {
             int bsc = 0;
-            for (auto lasit=m_lookahead_states.begin(); lasit != m_lookahead_states.end(); ++lasit)
-                bsc += lasit->m_scores.size();
+            for (auto lasit=m_bigram_score_maps.begin(); lasit != m_bigram_score_maps.end(); ++lasit)
+                bsc += lasit->size();
             cerr << "node " << i << " / " << decoder->m_nodes.size()
                  << ", bigram scores: " << bsc << endl;
         }
 
         if (decoder->m_nodes[i].word_id == -1) continue;
         int word_id = decoder->m_nodes[i].word_id;
-        vector<int> pred_words = reverse_bigrams[word_id];
-        set<int> processed_la_states;
-        propagate_bigram_la_scores(i, word_id, pred_words, reverse_arcs,
-                                   processed_la_states, true, false);
+        propagate_bigram_la_scores(i, word_id, reverse_bigrams[word_id], reverse_arcs);
     }
 
     int bigram_score_count = 0;
-    for (auto lasit=m_lookahead_states.begin(); lasit != m_lookahead_states.end(); ++lasit)
-        bigram_score_count += lasit->m_scores.size();
+    for (auto lasit=m_bigram_score_maps.begin(); lasit != m_bigram_score_maps.end(); ++lasit)
+        bigram_score_count += lasit->size();
 
     return bigram_score_count;
 }
@@ -1359,70 +1967,81 @@ LargeBigramLookahead::set_bigram_la_scores()
 void
 LargeBigramLookahead::propagate_bigram_la_scores(int node_idx,
         int word_id,
-        vector<int> predecessor_words,
-        vector<vector<Decoder::Arc> > &reverse_arcs,
-        set<int> &processed_la_states,
-        bool start_node,
-        bool la_state_change)
+        const vector<int> &predecessor_words,
+        const vector<vector<Decoder::Arc> > &reverse_arcs)
 {
-    int la_state = m_node_la_states[node_idx];
-    if (!start_node && la_state_change)
-//        && processed_la_states.find(la_state) == processed_la_states.end())
+    // Node, look-ahead state change and remaining predecessor words
+    vector<pair<pair<int, bool>, vector<int> > > node_stack;
+    for (auto rait = reverse_arcs[node_idx].begin(); rait != reverse_arcs[node_idx].end(); ++rait)
     {
-        int best_unigram_word_id = m_lookahead_states[la_state].m_best_unigram_word_id;
+        if (rait->target_node == node_idx) continue;
+        node_stack.push_back(make_pair(make_pair(rait->target_node, rait->update_lookahead),
+                                       predecessor_words));
+    }
 
-        for (auto pwit = predecessor_words.begin(); pwit != predecessor_words.end(); )
-        {
-            if (word_id == best_unigram_word_id) {
-                ++pwit;
-                continue;
-            }
+    while (node_stack.size() > 0) {
+        int curr_node_idx = node_stack.back().first.first;
+        bool la_state_change = node_stack.back().first.second;
+        vector<int> curr_pred_words;
+        curr_pred_words.swap(node_stack.back().second);
+        node_stack.pop_back();
 
-            float la_prob = 0.0;
-            int nd = m_la_lm.advance(m_la_lm.root_node, m_text_unit_id_to_la_ngram_symbol[*pwit]);
-            m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[word_id], la_prob);
-
-            float unigram_prob = 0.0;
-            m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[best_unigram_word_id], unigram_prob);
+        if (la_state_change) {
+            int la_state = m_node_la_states[curr_node_idx];
+            int best_unigram_word_id = m_lookahead_states[la_state].m_best_unigram_word_id;
 
-            if (unigram_prob > la_prob)
-                pwit = predecessor_words.erase(pwit);
-            else {
-                map<int, float> &la_scores = m_lookahead_states[la_state].m_scores;
-                if (la_scores.find(*pwit) == la_scores.end()) {
-                    la_scores[*pwit] = la_prob;
+            for (auto pwit = curr_pred_words.begin(); pwit != curr_pred_words.end(); )
+            {
+                if (word_id == best_unigram_word_id) {
                     ++pwit;
+                    continue;
                 }
+
+                float la_prob = 0.0;
+                int nd = m_la_lm.advance(m_la_lm.root_node, m_text_unit_id_to_la_ngram_symbol[*pwit]);
+                m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[word_id], la_prob);
+
+                float unigram_prob = 0.0;
+                m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[best_unigram_word_id], unigram_prob);
+
+                if (unigram_prob > la_prob)
+                    pwit = curr_pred_words.erase(pwit);
                 else {
-                    if (la_scores[*pwit] > la_prob)
-                        pwit = predecessor_words.erase(pwit);
-                    else {
+                    map<int, float> &la_scores = m_bigram_score_maps[la_state];
+                    if (la_scores.find(*pwit) == la_scores.end()) {
                         la_scores[*pwit] = la_prob;
                         ++pwit;
                     }
+                    else {
+                        if (la_scores[*pwit] > la_prob)
+                            pwit = curr_pred_words.erase(pwit);
+                        else {
+                            la_scores[*pwit] = la_prob;
+                            ++pwit;
+                        }
+                    }
                 }
             }
-        }
 
-        //processed_la_states.insert(la_state);
-        if (predecessor_words.size() == 0) return;
-    }
+            if (curr_pred_words.size() == 0) continue;
+        }
 
-    if (!start_node && decoder->m_nodes[node_idx].word_id != -1) return;
+        if (decoder->m_nodes[curr_node_idx].word_id != -1) continue;
 
-    for (auto rait = reverse_arcs[node_idx].begin(); rait != reverse_arcs[node_idx].end(); ++rait)
-    {
-        if (rait->target_node == node_idx) continue;
-        propagate_bigram_la_scores(rait->target_node, word_id, predecessor_words,
-                                   reverse_arcs, processed_la_states, false, rait->update_lookahead);
+        for (auto rait = reverse_arcs[curr_node_idx].begin(); rait != reverse_arcs[curr_node_idx].end(); ++rait)
+        {
+            if (rait->target_node == curr_node_idx) continue;
+            node_stack.push_back(make_pair(make_pair(rait->target_node, rait->update_lookahead),
+                                           curr_pred_words));
+        }
     }
 }
 
 
 int
-LargeBigramLookahead::set_bigram_la_scores_2()
+LargeBigramLookahead::set_bigram_la_scores_2(int num_threads)
 {
-    int bigram_score_count = 0;
+    num_threads = max(1, num_threads);
 
     map<int, vector<int> > reverse_bigrams;
     m_la_lm.get_reverse_bigrams(reverse_bigrams);
@@ -1431,73 +2050,244 @@ LargeBigramLookahead::set_bigram_la_scores_2()
     vector<vector<Decoder::Arc> > reverse_arcs;
     decoder->get_reverse_arcs(reverse_arcs);
 
-    for (unsigned int i=0; i<decoder->m_nodes.size(); i++) {
-
-        if (decoder->m_nodes.size() > 50000 && i % 10000 == 0) {
-            int bsc = 0;
-            for (auto lasit=m_lookahead_states.begin(); lasit != m_lookahead_states.end(); ++lasit)
-                bsc += lasit->m_scores.size();
-            cerr << "node " << i << " / " << decoder->m_nodes.size()
-                 << ", bigram scores: " << bsc << endl;
+    // The first thread collects directly to the member maps,
+    // the other threads to their own maps which are merged afterwards
+    vector<vector<map<int, float> > > thread_la_scores(num_threads);
+    vector<std::thread*> threads;
+    for (int t=0; t<num_threads; t++) {
+        if (t > 0) thread_la_scores[t].resize(m_bigram_score_maps.size());
+        vector<map<int, float> > &la_scores = t == 0 ? m_bigram_score_maps : thread_la_scores[t];
+        std::thread *thr = new std::thread(&LargeBigramLookahead::collect_bigram_la_scores,
+                                           this, std::cref(reverse_bigrams), std::cref(reverse_arcs),
+                                           std::ref(la_scores), t, num_threads);
+        threads.push_back(thr);
+    }
+    for (int t=0; t<num_threads; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+
+    for (int t=1; t<num_threads; t++) {
+        for (int l=0; l<(int)m_bigram_score_maps.size(); l++) {
+            map<int, float> &la_scores = m_bigram_score_maps[l];
+            for (auto lsit = thread_la_scores[t][l].begin(); lsit != thread_la_scores[t][l].end(); ++lsit) {
+                auto bsit = la_scores.find(lsit->first);
+                if (bsit == la_scores.end())
+                    la_scores[lsit->first] = lsit->second;
+                else
+                    bsit->second = max(bsit->second, lsit->second);
+            }
         }
+        vector<map<int, float> >().swap(thread_la_scores[t]);
+    }
+
+    int bigram_score_count = 0;
+    for (auto lasit=m_bigram_score_maps.begin(); lasit != m_bigram_score_maps.end(); ++lasit)
+        bigram_score_count += lasit->size();
+
+    return bigram_score_count;
+}
+
+
+void
+LargeBigramLookahead::collect_bigram_la_scores(
+    const map<int, vector<int> > &reverse_bigrams,
+    const vector<vector<Decoder::Arc> > &reverse_arcs,
+    vector<map<int, float> > &la_scores,
+    int thread_idx,
+    int num_threads) const
+{
+    for (int i=thread_idx; i<(int)decoder->m_nodes.size(); i += num_threads) {
+
+        if (thread_idx == 0 && decoder->m_nodes.size() > 50000 && i % (10000*num_threads) == 0)
+            cerr << "node " << i << " / " << decoder->m_nodes.size() << endl;
 
         int word_id = decoder->m_nodes[i].word_id;
         if (word_id == -1) continue;
+        auto rbit = reverse_bigrams.find(word_id);
+        if (rbit == reverse_bigrams.end()) continue;
+
         set<int> la_states;
         find_preceeding_la_states(i, la_states, reverse_arcs);
+        add_bigram_la_scores(word_id, rbit->second, la_states, la_scores);
+    }
+}
 
-        vector<int> &pred_words = reverse_bigrams[word_id];
 
-        for (auto pwit = pred_words.begin(); pwit != pred_words.end(); ++pwit) {
-            float la_prob = 0.0;
-            int nd = m_la_lm.advance(m_la_lm.root_node, m_text_unit_id_to_la_ngram_symbol[*pwit]);
-            m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[word_id], la_prob);
+void
+LargeBigramLookahead::add_bigram_la_scores(int word_id,
+        const vector<int> &pred_words,
+        const set<int> &la_states,
+        vector<map<int, float> > &la_scores) const
+{
+    for (auto pwit = pred_words.begin(); pwit != pred_words.end(); ++pwit) {
+        float la_prob = 0.0;
+        int nd = m_la_lm.advance(m_la_lm.root_node, m_text_unit_id_to_la_ngram_symbol[*pwit]);
+        m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[word_id], la_prob);
 
-            for (auto lasit = la_states.begin(); lasit != la_states.end(); ++lasit) {
+        for (auto lasit = la_states.begin(); lasit != la_states.end(); ++lasit) {
 
-                float unigram_prob = 0.0;
-                m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[m_lookahead_states[*lasit].m_best_unigram_word_id], unigram_prob);
-                // if (unigram_prob >= la_prob) continue;
-                // OPTION 2: takes more memory, faster
-                if (unigram_prob > la_prob) continue;
-
-                map<int, float> &la_scores = m_lookahead_states[*lasit].m_scores;
-                if (la_scores.find(*pwit) == la_scores.end()) {
-                    la_scores[*pwit] = la_prob;
-                    bigram_score_count++;
-                }
-                else
-                    la_scores[*pwit] = max(la_prob, la_scores[*pwit]);
+            float unigram_prob = 0.0;
+            m_la_lm.score(nd, m_text_unit_id_to_la_ngram_symbol[m_lookahead_states[*lasit].m_best_unigram_word_id], unigram_prob);
+            // if (unigram_prob >= la_prob) continue;
+            // OPTION 2: takes more memory, faster
+            if (unigram_prob > la_prob) continue;
+
+            auto lsit = la_scores[*lasit].find(*pwit);
+            if (lsit == la_scores[*lasit].end())
+                la_scores[*lasit][*pwit] = la_prob;
+            else
+                lsit->second = max(lsit->second, la_prob);
+        }
+    }
+}
+
+
+// Words reachable from each look-ahead state, the same words for which
+// find_preceeding_la_states finds the state. Each state is traversed forward
+// from its look-ahead update arcs to the first word nodes.
+void
+LargeBigramLookahead::collect_la_state_words(vector<set<int> > &la_state_words) const
+{
+    vector<vector<int> > la_state_nodes(m_la_state_count);
+    for (int i=0; i<(int)decoder->m_nodes.size(); i++)
+        la_state_nodes[m_node_la_states[i]].push_back(i);
+
+    la_state_words.clear();
+    la_state_words.resize(m_la_state_count);
+    vector<int> visited_la_state(decoder->m_nodes.size(), -1);
+    vector<int> node_stack;
+    for (int l=0; l<m_la_state_count; l++) {
+        for (auto nit = la_state_nodes[l].begin(); nit != la_state_nodes[l].end(); ++nit) {
+            const Decoder::Node &node = decoder->m_nodes[*nit];
+            for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+                if (ait->update_lookahead && ait->target_node != *nit)
+                    node_stack.push_back(ait->target_node);
+        }
+
+        while (node_stack.size() > 0) {
+            int node_idx = node_stack.back();
+            node_stack.pop_back();
+            if (visited_la_state[node_idx] == l) continue;
+            visited_la_state[node_idx] = l;
+            const Decoder::Node &node = decoder->m_nodes[node_idx];
+            if (node.word_id != -1) {
+                la_state_words[l].insert(node.word_id);
+                continue;
             }
+            if (node_idx == END_NODE) continue;
+            for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+                if (ait->target_node != node_idx)
+                    node_stack.push_back(ait->target_node);
         }
     }
+}
 
-    return bigram_score_count;
+
+void
+LargeBigramLookahead::set_bigram_la_score_arrays()
+{
+    long long int bigram_score_count = 0;
+    for (auto bsmit = m_bigram_score_maps.begin(); bsmit != m_bigram_score_maps.end(); ++bsmit)
+        bigram_score_count += bsmit->size();
+
+    m_bigram_offsets.resize(m_bigram_score_maps.size()+1);
+    m_bigram_word_ids.resize(bigram_score_count);
+    m_bigram_scores.resize(bigram_score_count);
+
+    long long int offset = 0;
+    for (int i=0; i<(int)m_bigram_score_maps.size(); i++) {
+        m_bigram_offsets[i] = offset;
+        for (auto bsit = m_bigram_score_maps[i].begin(); bsit != m_bigram_score_maps[i].end(); ++bsit) {
+            m_bigram_word_ids[offset] = bsit->first;
+            m_bigram_scores[offset] = bsit->second;
+            offset++;
+        }
+    }
+    m_bigram_offsets.back() = offset;
+
+    vector<map<int, float> >().swap(m_bigram_score_maps);
+    set_la_state_pointers();
+}
+
+
+void
+LargeBigramLookahead::set_la_state_pointers()
+{
+    m_la_state_count = m_lookahead_states.size();
+    m_la_state_ptr = m_lookahead_states.data();
+    m_bigram_offset_ptr = m_bigram_offsets.data();
+    m_bigram_word_id_ptr = m_bigram_word_ids.data();
+    m_bigram_score_ptr = m_bigram_scores.data();
 }
 
 
+// Binary states file layout:
+// magic, state count, bigram score count,
+// states, offsets (state count + 1), word ids, scores
+static const char la_states_magic[8] = { 'L', 'B', 'L', 'A', 'S', 'T', '0', '1' };
+
 void
 LargeBigramLookahead::write(string ofname)
 {
-    ofstream olafile(ofname);
+    ofstream olafile(ofname, ios::binary);
     if (!olafile) throw string("Problem opening file: " + ofname);
 
-    olafile << m_lookahead_states.size() << endl;
-    for (int i=0; i<(int)m_lookahead_states.size(); i++) {
-        LookaheadState &la_state = m_lookahead_states[i];
-        olafile << i
-                << " " << la_state.m_best_unigram_word_id
-                << " " << la_state.m_best_unigram_score
-                << " " << la_state.m_scores.size();
-        for (auto bsit = la_state.m_scores.begin(); bsit != la_state.m_scores.end(); ++bsit)
-            olafile << " " << bsit->first << " " << bsit->second;
-        olafile << endl;
-    }
+    long long int state_count = m_la_state_count;
+    long long int bigram_score_count = m_bigram_offset_ptr[m_la_state_count];
+
+    olafile.write(la_states_magic, sizeof(la_states_magic));
+    olafile.write((const char*)&state_count, sizeof(state_count));
+    olafile.write((const char*)&bigram_score_count, sizeof(bigram_score_count));
+    olafile.write((const char*)m_la_state_ptr, state_count * sizeof(LookaheadState));
+    olafile.write((const char*)m_bigram_offset_ptr, (state_count+1) * sizeof(long long int));
+    olafile.write((const char*)m_bigram_word_id_ptr, bigram_score_count * sizeof(int));
+    olafile.write((const char*)m_bigram_score_ptr, bigram_score_count * sizeof(float));
+    if (!olafile) throw string("Problem writing file: " + ofname);
 }
 
 
 void
 LargeBigramLookahead::read(string ifname)
+{
+    m_states_file.open(ifname);
+
+    const char *data = m_states_file.data();
+    size_t header_size = sizeof(la_states_magic) + 2 * sizeof(long long int);
+    if (m_states_file.size() < header_size
+        || memcmp(data, la_states_magic, sizeof(la_states_magic)) != 0)
+    {
+        m_states_file.close();
+        read_text(ifname);
+        return;
+    }
+
+    long long int state_count, bigram_score_count;
+    memcpy(&state_count, data + sizeof(la_states_magic), sizeof(state_count));
+    memcpy(&bigram_score_count, data + sizeof(la_states_magic) + sizeof(state_count),
+           sizeof(bigram_score_count));
+
+    size_t expected_size = header_size
+                           + state_count * sizeof(LookaheadState)
+                           + (state_count+1) * sizeof(long long int)
+                           + bigram_score_count * (sizeof(int) + sizeof(float));
+    if (m_states_file.size() != expected_size)
+        throw string("Problem reading look-ahead states file: " + ifname);
+
+    const char *ptr = data + header_size;
+    m_la_state_count = state_count;
+    m_la_state_ptr = reinterpret_cast<const LookaheadState*>(ptr);
+    ptr += state_count * sizeof(LookaheadState);
+    m_bigram_offset_ptr = reinterpret_cast<const long long int*>(ptr);
+    ptr += (state_count+1) * sizeof(long long int);
+    m_bigram_word_id_ptr = reinterpret_cast<const int*>(ptr);
+    ptr += bigram_score_count * sizeof(int);
+    m_bigram_score_ptr = reinterpret_cast<const float*>(ptr);
+}
+
+
+void
+LargeBigramLookahead::read_text(string ifname)
 {
     ifstream ilafile(ifname);
     if (!ilafile) throw string("Problem opening file: " + ifname);
@@ -1512,6 +2302,7 @@ LargeBigramLookahead::read(string ifname)
     ssline >> la_state_count;
     if (ssline.fail()) cerr << "Problem parsing header line: " + line;
     m_lookahead_states.resize(la_state_count);
+    m_bigram_score_maps.resize(la_state_count);
 
     for (int i=0; i<la_state_count; i++) {
 
@@ -1533,9 +2324,157 @@ LargeBigramLookahead::read(string ifname)
             int id;
             float score;
             ssline >>id >>score;
-            la_state.m_scores[id] = score;
+            m_bigram_score_maps[i][id] = score;
         }
 
         if (ssline.fail()) cerr << "Problem parsing line: " + line;
     }
+
+    set_bigram_la_score_arrays();
+}
+
+
+static const int max_context_shards = 64;
+
+TrigramLookahead::TrigramLookahead(Decoder &decoder,
+        string lafname,
+        int max_cached_contexts)
+    : LargeBigramLookahead(decoder, lafname),
+      m_max_cached_contexts(max_cached_contexts),
+      m_context_shards(min(max_context_shards, max(1, max_cached_contexts)))
+{
+    if (m_la_lm.order() < 3)
+        cerr << "Warning, look-ahead model order is " << m_la_lm.order()
+             << ", using bigram scores" << endl;
+    m_max_shard_contexts = max(1, m_max_cached_contexts / (int)m_context_shards.size());
+    set_word_la_states();
+}
+
+
+TrigramLookahead::TrigramLookahead(Decoder &decoder,
+        string lafname,
+        string statesfname,
+        int max_cached_contexts)
+    : LargeBigramLookahead(decoder, lafname, statesfname),
+      m_max_cached_contexts(max_cached_contexts),
+      m_context_shards(min(max_context_shards, max(1, max_cached_contexts)))
+{
+    if (m_la_lm.order() < 3)
+        cerr << "Warning, look-ahead model order is " << m_la_lm.order()
+             << ", using bigram scores" << endl;
+    m_max_shard_contexts = max(1, m_max_cached_contexts / (int)m_context_shards.size());
+    set_word_la_states();
+}
+
+
+void
+TrigramLookahead::set_word_la_states()
+{
+    m_la_ngram_symbol_to_text_unit_id.resize(m_la_lm.vocabulary.size(), -1);
+    for (int i=0; i<(int)m_text_unit_id_to_la_ngram_symbol.size(); i++) {
+        int la_symbol = m_text_unit_id_to_la_ngram_symbol[i];
+        if (la_symbol >= 0 && la_symbol < (int)m_la_ngram_symbol_to_text_unit_id.size())
+            m_la_ngram_symbol_to_text_unit_id[la_symbol] = i;
+    }
+
+    vector<vector<Decoder::Arc> > reverse_arcs;
+    decoder->get_reverse_arcs(reverse_arcs);
+
+    vector<set<int> > word_la_states(decoder->m_text_units.size());
+    for (int i=0; i<(int)decoder->m_nodes.size(); i++) {
+        int word_id = decoder->m_nodes[i].word_id;
+        if (word_id == -1) continue;
+        find_preceeding_la_states(i, word_la_states[word_id], reverse_arcs);
+    }
+
+    long int la_state_count = 0;
+    m_word_la_states.resize(word_la_states.size());
+    for (int i=0; i<(int)word_la_states.size(); i++) {
+        m_word_la_states[i].assign(word_la_states[i].begin(), word_la_states[i].end());
+        la_state_count += m_word_la_states[i].size();
+    }
+    cerr << "Word look-ahead state references: " << la_state_count << endl;
+}
+
+
+float
+TrigramLookahead::get_lookahead_score(int node_idx, int prev_word_id, int word_id)
+{
+    int la_state = m_node_la_states[node_idx];
+    float bigram_score = get_la_state_score(la_state, word_id);
+    if (prev_word_id == -1) return bigram_score;
+
+    int context_node = m_la_lm.find_node(m_la_lm.root_node,
+                                         m_text_unit_id_to_la_ngram_symbol[prev_word_id]);
+    if (context_node == -1 || m_la_lm.nodes[context_node].first_arc == -1)
+        return bigram_score;
+    context_node = m_la_lm.find_node(context_node, m_text_unit_id_to_la_ngram_symbol[word_id]);
+    if (context_node == -1) return bigram_score;
+
+    float backoff_bound = m_la_lm.nodes[context_node].backoff_prob + bigram_score;
+    if (m_la_lm.nodes[context_node].first_arc == -1) return backoff_bound;
+
+    ContextShard &shard = m_context_shards[context_node % m_context_shards.size()];
+    lock_guard<mutex> lock(shard.mutex);
+    auto csit = shard.context_scores.find(context_node);
+    if (csit == shard.context_scores.end()) {
+        if ((int)shard.context_scores.size() >= m_max_shard_contexts) {
+            shard.context_scores.erase(shard.context_order.front());
+            shard.context_order.pop_front();
+        }
+        csit = shard.context_scores.insert(
+                   make_pair(context_node, vector<pair<int, float> >())).first;
+        shard.context_order.push_back(context_node);
+        set_context_scores(context_node, word_id, csit->second);
+    }
+
+    const vector<pair<int, float> > &la_state_scores = csit->second;
+    auto lower = lower_bound(la_state_scores.begin(), la_state_scores.end(),
+                             make_pair(la_state, (float)TINY_FLOAT));
+    if (lower != la_state_scores.end() && lower->first == la_state)
+        return lower->second;
+    return backoff_bound;
+}
+
+
+void
+TrigramLookahead::set_context_scores(int context_node,
+                                     int word_id,
+                                     vector<pair<int, float> > &la_state_scores)
+{
+    map<int, float> scores;
+    Ngram::Node &context = m_la_lm.nodes[context_node];
+
+    for (int arc_idx=context.first_arc; arc_idx<=context.last_arc; arc_idx++) {
+        int la_symbol = m_la_lm.arc_words[arc_idx];
+        if (la_symbol >= (int)m_la_ngram_symbol_to_text_unit_id.size()) continue;
+        int next_word_id = m_la_ngram_symbol_to_text_unit_id[la_symbol];
+        if (next_word_id == -1) continue;
+        float trigram_prob = m_la_lm.nodes[m_la_lm.arc_target_nodes[arc_idx]].prob;
+
+        vector<int> &la_states = m_word_la_states[next_word_id];
+        for (auto lasit = la_states.begin(); lasit != la_states.end(); ++lasit) {
+            float backoff_bound = context.backoff_prob + get_la_state_score(*lasit, word_id);
+            if (trigram_prob <= backoff_bound) continue;
+            auto sit = scores.find(*lasit);
+            if (sit == scores.end())
+                scores[*lasit] = trigram_prob;
+            else
+                sit->second = max(sit->second, trigram_prob);
+        }
+    }
+
+    la_state_scores.assign(scores.begin(), scores.end());
+}
+
+
+int
+TrigramLookahead::cached_context_count()
+{
+    int context_count = 0;
+    for (auto csit = m_context_shards.begin(); csit != m_context_shards.end(); ++csit) {
+        lock_guard<mutex> lock(csit->mutex);
+        context_count += csit->context_scores.size();
+    }
+    return context_count;
 }
@@ -3,17 +3,23 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
+#include <unordered_map>
+#include <deque>
 
 #include "Decoder.hh"
 #include "ClassNgram.hh"
 #include "DynamicBitset.hh"
 #include "QuantizedLogProb.hh"
+#include "MappedFile.hh"
+#include "LookaheadCache.hh"
 
 
 class UnigramLookahead : public Decoder::Lookahead {
 public:
     UnigramLookahead(Decoder &decoder,
-                     std::string lafname);
+                     std::string lafname,
+                     std::string cachefname="");
     ~UnigramLookahead() {};
     float get_lookahead_score(int node_idx, int word_id);
 
@@ -61,6 +67,8 @@ public:
         return m_la_state_count;
     }
 protected:
+    LookaheadStateCount() : m_la_state_count(0) { };
+    void init_la_states(bool successor_lists, bool true_count);
     int set_la_state_indices_to_nodes();
     void propagate_la_state_idx(int node_idx,
                                 std::map<int, int> &la_state_changes,
@@ -81,11 +89,14 @@ public:
     FullTableBigramLookahead(Decoder &decoder,
                              std::string lafname,
                              bool successor_lists=true,
-                             bool quantization=false);
+                             bool quantization=false,
+                             std::string cachefname="");
     ~FullTableBigramLookahead() {};
     virtual float get_lookahead_score(int node_idx, int word_id);
 
 protected:
+    FullTableBigramLookahead() { };
+
     std::vector<std::vector<float> > m_bigram_la_scores;
 };
 
@@ -94,31 +105,62 @@ class PrecomputedFullTableBigramLookahead : public FullTableBigramLookahead {
 public:
     PrecomputedFullTableBigramLookahead(Decoder &decoder,
                                         std::string lafname,
-                                        bool quantization=false);
+                                        bool quantization=false,
+                                        int num_threads=1,
+                                        std::string cachefname="",
+                                        bool sparse=false);
     ~PrecomputedFullTableBigramLookahead() {};
     virtual float get_lookahead_score(int node_idx, int word_id);
 
 private:
-    void find_preceeding_la_states(int node_idx,
-                                   std::set<int> &la_states,
-                                   const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                   bool first_node=true,
-                                   bool state_change=true);
-
     void set_unigram_la_scores();
     void propagate_unigram_la_score(int node_idx,
                                     float score,
                                     int word_id,
-                                    std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                    std::vector<std::pair<int, float> > &unigram_la_scores,
-                                    bool start_node);
-    void set_bigram_la_scores();
+                                    const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
+                                    std::vector<std::pair<int, float> > &unigram_la_scores);
+    void set_bigram_la_scores(int num_threads);
+    // Scores of each word after its predecessor words
+    void set_word_bigram_scores(const std::map<int, std::vector<int> > &reverse_bigrams,
+                                std::vector<std::vector<std::pair<int, float> > > &word_bigram_scores,
+                                int thread_idx,
+                                int num_threads) const;
+    // Sets the scores of the look-ahead states [first_la_state, last_la_state).
+    // Sparse rows are added to the given vectors with offsets relative to them.
+    void set_la_state_bigram_scores(const std::vector<std::vector<std::pair<int, float> > > &word_bigram_scores,
+                                    const std::vector<std::vector<int> > &la_state_nodes,
+                                    int first_la_state,
+                                    int last_la_state,
+                                    std::vector<int> &sparse_word_ids,
+                                    std::vector<float> &sparse_scores,
+                                    std::vector<unsigned short int> &quant_sparse_scores);
+    void find_la_state_words(int la_state_idx,
+                             const std::vector<std::vector<int> > &la_state_nodes,
+                             std::vector<int> &visited_la_state,
+                             std::vector<int> &words) const;
     void set_lookahead_score(int la_state_idx, int word_id, float la_score);
 
     bool m_quantization;
     QuantizedLogProb m_quant_log_probs;
     std::vector<std::vector<unsigned short int> > m_quant_bigram_lookup;
     double m_min_la_score;
+
+    // Sparse tables store only the scores exceeding the backoff bound,
+    // backoff of the predecessor word + best unigram score in the state.
+    // Scores for state i are in [m_sparse_offsets[i], m_sparse_offsets[i+1])
+    bool m_sparse;
+    std::vector<double> m_word_backoff_scores;
+    std::vector<float> m_la_state_unigram_scores;
+    std::vector<long long int> m_sparse_offsets;
+    std::vector<int> m_sparse_word_ids;
+    std::vector<float> m_sparse_scores;
+    std::vector<unsigned short int> m_quant_sparse_scores;
+    // Point either to the vectors above or to the memory mapped cache file
+    const long long int *m_sparse_offset_ptr;
+    const int *m_sparse_word_id_ptr;
+    const float *m_sparse_score_ptr;
+    const unsigned short int *m_quant_sparse_score_ptr;
+    MappedFile m_cache_file;
 };
 
 
@@ -127,11 +169,16 @@ private:
 class HybridBigramLookahead : public BigramLookahead {
 public:
     HybridBigramLookahead(Decoder &decoder,
-                          std::string lafname);
+                          std::string lafname,
+                          std::string cachefname="");
     ~HybridBigramLookahead() {};
     float get_lookahead_score(int node_idx, int word_id);
 
 protected:
+    HybridBigramLookahead() { };
+    void init_la_states();
+    void write_inner_bigram_scores(LookaheadCache &cache) const;
+    void read_inner_bigram_scores(const LookaheadCache &cache);
     int set_la_state_indices_to_nodes();
     void propagate_la_state_idx(int node_idx,
                                 int la_state_idx,
@@ -155,16 +202,16 @@ protected:
 class PrecomputedHybridBigramLookahead : public HybridBigramLookahead {
 public:
     PrecomputedHybridBigramLookahead(Decoder &decoder,
-                                     std::string lafname);
+                                     std::string lafname,
+                                     int num_threads=1,
+                                     std::string cachefname="");
     ~PrecomputedHybridBigramLookahead() {};
     float get_lookahead_score(int node_idx, int word_id);
 
 private:
     void find_preceeding_la_states(int node_idx,
                                    std::set<int> &la_states,
-                                   const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                   bool first_node=true,
-                                   bool state_change=true);
+                                   const std::vector<std::vector<Decoder::Arc> > &reverse_arcs) const;
     void find_first_lm_nodes(std::set<int> &lm_nodes,
                              int node_idx=START_NODE);
     void find_cw_lm_nodes(std::set<int> &lm_nodes);
@@ -174,26 +221,44 @@ private:
     void propagate_unigram_la_score(int node_idx,
                                     float score,
                                     int word_id,
-                                    std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                    std::vector<std::pair<int, float> > &unigram_la_scores,
-                                    bool start_node);
-    void set_bigram_la_scores();
+                                    const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
+                                    std::vector<std::pair<int, float> > &unigram_la_scores);
+    void set_bigram_la_scores(int num_threads);
+    // Scores are set directly to the table if la_scores is nullptr
+    void collect_bigram_la_scores(const std::map<int, std::vector<int> > &reverse_bigrams,
+                                  const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
+                                  const std::vector<int> &lm_nodes,
+                                  std::vector<std::map<int, float> > *la_scores,
+                                  int thread_idx,
+                                  int num_threads);
 };
 
 
 class LargeBigramLookahead : public BigramLookahead {
 public:
     LargeBigramLookahead(Decoder &decoder,
-                         std::string lafname);
+                         std::string lafname,
+                         int num_threads=1,
+                         std::string cachefname="");
     LargeBigramLookahead(Decoder &decoder,
                          std::string lafname,
                          std::string statesfname);
+    // Look-ahead for a graph with words added to the graph of the previous
+    // look-ahead. The bigram scores of a state depend only on the words reachable
+    // from it and its best unigram word, so the scores of the matching previous
+    // state are copied and only the added words and predecessors are scored.
+    // The text units of the previous decoder must be a prefix of the new ones.
+    LargeBigramLookahead(Decoder &decoder,
+                         std::string lafname,
+                         const LargeBigramLookahead &previous,
+                         const std::vector<int> &previous_node_new_idxs);
     ~LargeBigramLookahead() {};
     float get_lookahead_score(int node_idx, int word_id);
     void write(std::string ofname);
     void read(std::string ifname);
 
-private:
+protected:
+    float get_la_state_score(int la_state, int word_id);
     int set_la_state_indices_to_nodes();
     float set_arc_la_updates();
     void propagate_la_state_idx(int node_idx,
@@ -202,38 +267,102 @@ private:
                                 bool first_node=true);
     void find_preceeding_la_states(int node_idx,
                                    std::set<int> &la_states,
-                                   const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                   bool first_node=true,
-                                   bool state_change=true);
+                                   const std::vector<std::vector<Decoder::Arc> > &reverse_arcs) const;
 
     void set_unigram_la_scores();
     void propagate_unigram_la_score(int node_idx,
                                     float score,
                                     int word_id,
-                                    std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                    bool start_node);
+                                    const std::vector<std::vector<Decoder::Arc> > &reverse_arcs);
 
     int set_bigram_la_scores();
     void propagate_bigram_la_scores(int node_idx,
                                     int word_id,
-                                    std::vector<int> predecessor_words,
-                                    std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
-                                    std::set<int> &processed_la_states,
-                                    bool start_node,
-                                    bool la_state_change);
-    int set_bigram_la_scores_2();
+                                    const std::vector<int> &predecessor_words,
+                                    const std::vector<std::vector<Decoder::Arc> > &reverse_arcs);
+    int set_bigram_la_scores_2(int num_threads=1);
+    void collect_bigram_la_scores(const std::map<int, std::vector<int> > &reverse_bigrams,
+                                  const std::vector<std::vector<Decoder::Arc> > &reverse_arcs,
+                                  std::vector<std::map<int, float> > &la_scores,
+                                  int thread_idx,
+                                  int num_threads) const;
+    void add_bigram_la_scores(int word_id,
+                              const std::vector<int> &pred_words,
+                              const std::set<int> &la_states,
+                              std::vector<std::map<int, float> > &la_scores) const;
+    void collect_la_state_words(std::vector<std::set<int> > &la_state_words) const;
+    void set_bigram_la_score_arrays();
+    void set_la_state_pointers();
+    void read_text(std::string ifname);
 
     class LookaheadState {
     public:
         LookaheadState() : m_best_unigram_word_id(-1),
             m_best_unigram_score(-1e20) { }
-        std::map<int, float> m_scores;
         int m_best_unigram_word_id;
         float m_best_unigram_score;
     };
 
     std::vector<int> m_node_la_states;
     std::vector<LookaheadState> m_lookahead_states;
+    // Bigram scores per look-ahead state, used only in construction
+    std::vector<std::map<int, float> > m_bigram_score_maps;
+
+    // Bigram scores as flat arrays sorted by word id within each state
+    // Scores for state i are in [m_bigram_offsets[i], m_bigram_offsets[i+1])
+    std::vector<long long int> m_bigram_offsets;
+    std::vector<int> m_bigram_word_ids;
+    std::vector<float> m_bigram_scores;
+
+    // Point either to the vectors above or to the memory mapped states or cache file
+    int m_la_state_count;
+    const LookaheadState *m_la_state_ptr;
+    const long long int *m_bigram_offset_ptr;
+    const int *m_bigram_word_id_ptr;
+    const float *m_bigram_score_ptr;
+    MappedFile m_states_file;
+};
+
+
+// Bigram look-ahead states, trigram scores computed per two word context
+// on demand. Only scores exceeding the bigram backoff bound are stored.
+class TrigramLookahead : public LargeBigramLookahead {
+public:
+    TrigramLookahead(Decoder &decoder,
+                     std::string lafname,
+                     int max_cached_contexts=100000);
+    TrigramLookahead(Decoder &decoder,
+                     std::string lafname,
+                     std::string statesfname,
+                     int max_cached_contexts=100000);
+    ~TrigramLookahead() {};
+    using LargeBigramLookahead::get_lookahead_score;
+    float get_lookahead_score(int node_idx, int prev_word_id, int word_id);
+    int cached_context_count();
+
+private:
+    void set_word_la_states();
+    void set_context_scores(int context_node,
+                            int word_id,
+                            std::vector<std::pair<int, float> > &la_state_scores);
+
+    // The cached contexts are divided into shards by the context node,
+    // each shard has its own lock and evicts its oldest context when full
+    class ContextShard {
+    public:
+        // Trigram context node -> look-ahead state, score pairs sorted by state
+        std::unordered_map<int, std::vector<std::pair<int, float> > > context_scores;
+        // Context nodes in the order they were cached
+        std::deque<int> context_order;
+        std::mutex mutex;
+    };
+
+    std::vector<int> m_la_ngram_symbol_to_text_unit_id;
+    // Look-ahead states preceding each word in the graph
+    std::vector<std::vector<int> > m_word_la_states;
+    int m_max_cached_contexts;
+    int m_max_shard_contexts;
+    std::vector<ContextShard> m_context_shards;
 };
 
 #endif /* LOOKAHEAD_HH */
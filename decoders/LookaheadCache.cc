@@ -0,0 +1,280 @@
+#include <cstdio>
+#include <iostream>
+
+#include "LookaheadCache.hh"
+
+using namespace std;
+
+
+static const char la_cache_magic[8] = { 'L', 'A', 'C', 'A', 'C', 'H', 'E', '1' };
+static const unsigned long long int fnv_offset_basis = 14695981039346656037ULL;
+static const unsigned long long int fnv_prime = 1099511628211ULL;
+
+// 64 bit FNV-1a
+static unsigned long long int
+hash_bytes(const void *data,
+           size_t size,
+           unsigned long long int hash)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i=0; i<size; i++) {
+        hash ^= bytes[i];
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+static unsigned long long int
+hash_int(int val,
+         unsigned long long int hash)
+{
+    return hash_bytes(&val, sizeof(val), hash);
+}
+
+static unsigned long long int
+hash_string(const string &str,
+            unsigned long long int hash)
+{
+    return hash_bytes(str.c_str(), str.length()+1, hash);
+}
+
+
+LookaheadCache::LookaheadCache(string la_type,
+                               const Decoder &decoder,
+                               const vector<string> &model_fnames)
+    : m_la_type(la_type),
+      m_decoder(&decoder),
+      m_model_fnames(model_fnames),
+      m_content_hash(0),
+      m_content_hash_set(false)
+{
+}
+
+
+unsigned long long int
+LookaheadCache::content_hash()
+{
+    if (m_content_hash_set) return m_content_hash;
+
+    unsigned long long int hash = hash_string(m_la_type, fnv_offset_basis);
+
+    // Flags set by the look-ahead construction are not part of the graph
+    int la_flags = NODE_INITIAL | NODE_TAIL | NODE_BIGRAM_LA_TABLE;
+    hash = hash_int(m_decoder->m_nodes.size(), hash);
+    for (auto nit = m_decoder->m_nodes.begin(); nit != m_decoder->m_nodes.end(); ++nit) {
+        hash = hash_int(nit->word_id, hash);
+        hash = hash_int(nit->hmm_state, hash);
+        hash = hash_int(nit->flags & ~la_flags, hash);
+        hash = hash_int(nit->arcs.size(), hash);
+        for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
+            hash = hash_int(ait->target_node, hash);
+    }
+
+    hash = hash_int(m_decoder->m_text_units.size(), hash);
+    for (auto tuit = m_decoder->m_text_units.begin(); tuit != m_decoder->m_text_units.end(); ++tuit)
+        hash = hash_string(*tuit, hash);
+    for (auto lit = m_decoder->m_lexicon.begin(); lit != m_decoder->m_lexicon.end(); ++lit) {
+        hash = hash_string(lit->first, hash);
+        for (auto pit = lit->second.begin(); pit != lit->second.end(); ++pit)
+            hash = hash_string(*pit, hash);
+    }
+
+    vector<char> buffer(1 << 20);
+    for (auto fnit = m_model_fnames.begin(); fnit != m_model_fnames.end(); ++fnit) {
+        ifstream modelf(*fnit, ios::binary);
+        if (!modelf) throw string("Problem opening file: " + *fnit);
+        while (modelf) {
+            modelf.read(buffer.data(), buffer.size());
+            hash = hash_bytes(buffer.data(), modelf.gcount(), hash);
+        }
+    }
+
+    m_content_hash = hash;
+    m_content_hash_set = true;
+    return m_content_hash;
+}
+
+
+bool
+LookaheadCache::read(string fname)
+{
+    m_file.close();
+    m_tables.clear();
+    if (fname.length() == 0) return false;
+
+    ifstream cachef(fname);
+    if (!cachef) return false;
+    cachef.close();
+
+    m_file.open(fname);
+    const char *data = m_file.data();
+    size_t size = m_file.size();
+    string read_error("Problem reading look-ahead cache: " + fname);
+
+    size_t pos = sizeof(la_cache_magic) + sizeof(unsigned long long int) + sizeof(unsigned int);
+    if (size < pos || memcmp(data, la_cache_magic, sizeof(la_cache_magic)) != 0)
+        throw read_error;
+
+    unsigned long long int file_hash;
+    memcpy(&file_hash, data + sizeof(la_cache_magic), sizeof(file_hash));
+    unsigned int type_len;
+    memcpy(&type_len, data + sizeof(la_cache_magic) + sizeof(file_hash), sizeof(type_len));
+    if (pos + type_len > size) throw read_error;
+    string la_type(data + pos, type_len);
+    pos += type_len;
+
+    if (la_type != m_la_type || file_hash != content_hash()) {
+        cerr << "Look-ahead cache " << fname << " is for another look-ahead setup" << endl;
+        m_file.close();
+        return false;
+    }
+
+    while (true) {
+        unsigned int name_len;
+        if (pos + sizeof(name_len) > size) throw read_error;
+        memcpy(&name_len, data + pos, sizeof(name_len));
+        pos += sizeof(name_len);
+        if (name_len == 0) break;
+
+        if (pos + name_len + sizeof(unsigned int) + sizeof(long long int) > size)
+            throw read_error;
+        string name(data + pos, name_len);
+        pos += name_len;
+
+        Table table;
+        memcpy(&table.elem_size, data + pos, sizeof(table.elem_size));
+        pos += sizeof(table.elem_size);
+        memcpy(&table.count, data + pos, sizeof(table.count));
+        pos += sizeof(table.count);
+        pos = (pos + 7) & ~(size_t)7;
+
+        size_t table_size = table.elem_size * table.count;
+        if (table.count < 0 || pos + table_size > size) throw read_error;
+        table.data = data + pos;
+        pos += table_size;
+
+        m_tables[name] = table;
+    }
+
+    return true;
+}
+
+
+void
+LookaheadCache::create(string fname)
+{
+    m_ofname = fname;
+    m_ofile.open(fname + ".tmp", ios::binary);
+    if (!m_ofile) throw string("Problem opening file: " + fname + ".tmp");
+
+    unsigned long long int hash = content_hash();
+    unsigned int type_len = m_la_type.length();
+    m_ofile.write(la_cache_magic, sizeof(la_cache_magic));
+    m_ofile.write((const char*)&hash, sizeof(hash));
+    m_ofile.write((const char*)&type_len, sizeof(type_len));
+    m_ofile.write(m_la_type.c_str(), type_len);
+}
+
+
+void
+LookaheadCache::close()
+{
+    if (!m_ofile.is_open()) return;
+
+    unsigned int terminator = 0;
+    m_ofile.write((const char*)&terminator, sizeof(terminator));
+    m_ofile.close();
+    if (m_ofile.fail()) throw string("Problem writing file: " + m_ofname + ".tmp");
+    if (rename((m_ofname + ".tmp").c_str(), m_ofname.c_str()) != 0)
+        throw string("Problem renaming file: " + m_ofname + ".tmp");
+}
+
+
+void
+LookaheadCache::release_mapping(MappedFile &file)
+{
+    file.swap(m_file);
+    m_file.close();
+    m_tables.clear();
+}
+
+
+void
+LookaheadCache::set_graph(const Decoder &decoder)
+{
+    vector<int> node_flags;
+    vector<char> arc_updates;
+    for (auto nit = decoder.m_nodes.begin(); nit != decoder.m_nodes.end(); ++nit) {
+        node_flags.push_back(nit->flags);
+        for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
+            arc_updates.push_back(ait->update_lookahead);
+    }
+    set("node_flags", node_flags);
+    set("arc_updates", arc_updates);
+}
+
+
+void
+LookaheadCache::get_graph(Decoder &decoder) const
+{
+    vector<int> node_flags;
+    vector<char> arc_updates;
+    get("node_flags", node_flags);
+    get("arc_updates", arc_updates);
+    if (node_flags.size() != decoder.m_nodes.size())
+        throw string("Look-ahead cache node count mismatch");
+
+    int arc_idx = 0;
+    for (int i=0; i<(int)decoder.m_nodes.size(); i++) {
+        Decoder::Node &node = decoder.m_nodes[i];
+        node.flags = node_flags[i];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+            if (arc_idx >= (int)arc_updates.size())
+                throw string("Look-ahead cache arc count mismatch");
+            ait->update_lookahead = arc_updates[arc_idx++];
+        }
+    }
+    if (arc_idx != (int)arc_updates.size())
+        throw string("Look-ahead cache arc count mismatch");
+}
+
+
+const LookaheadCache::Table&
+LookaheadCache::find_table(string name,
+                           unsigned int elem_size) const
+{
+    auto tit = m_tables.find(name);
+    if (tit == m_tables.end())
+        throw string("Table not found in look-ahead cache: " + name);
+    if (tit->second.elem_size != elem_size)
+        throw string("Invalid look-ahead cache table: " + name);
+    return tit->second;
+}
+
+
+void
+LookaheadCache::write_table_header(string name,
+                                   unsigned int elem_size,
+                                   long long int count)
+{
+    if (!m_ofile.is_open()) throw string("Look-ahead cache not open for writing");
+
+    unsigned int name_len = name.length();
+    m_ofile.write((const char*)&name_len, sizeof(name_len));
+    m_ofile.write(name.c_str(), name_len);
+    m_ofile.write((const char*)&elem_size, sizeof(elem_size));
+    m_ofile.write((const char*)&count, sizeof(count));
+
+    // Table data is aligned to eight bytes
+    long long int pos = m_ofile.tellp();
+    const char padding[8] = { 0 };
+    if (pos % 8 != 0) m_ofile.write(padding, 8 - pos % 8);
+}
+
+
+void
+LookaheadCache::write_data(const void *data,
+                           long long int size)
+{
+    if (size > 0) m_ofile.write(static_cast<const char*>(data), size);
+}
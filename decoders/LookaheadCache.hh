@@ -0,0 +1,158 @@
+#ifndef LOOKAHEAD_CACHE_HH
+#define LOOKAHEAD_CACHE_HH
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Decoder.hh"
+#include "MappedFile.hh"
+
+
+// Binary file of named precomputed look-ahead tables.
+// The file is valid only for the look-ahead type, graph, lexicon and
+// look-ahead model files it was computed with, this is checked with a hash.
+// Reading memory maps the file, writing streams the tables to a temporary
+// file which replaces the old cache when closed. Tables can be copied to
+// vectors or used directly from the mapped file.
+class LookaheadCache {
+public:
+    LookaheadCache(std::string la_type,
+                   const Decoder &decoder,
+                   const std::vector<std::string> &model_fnames);
+    ~LookaheadCache() {};
+
+    // Returns false if the file name is empty, the file does not exist
+    // or it was computed for another type, graph or model
+    bool read(std::string fname);
+    void create(std::string fname);
+    void close();
+
+    template<typename T> void set(std::string name, const std::vector<T> &vals);
+    template<typename T> void set(std::string name, const std::vector<std::vector<T> > &vals);
+    template<typename T> void set_value(std::string name, const T &val);
+    template<typename T> void get(std::string name, std::vector<T> &vals) const;
+    template<typename T> void get(std::string name, std::vector<std::vector<T> > &vals) const;
+    template<typename T> void get_value(std::string name, T &val) const;
+    // Points to the table in the mapped file, valid while the file is mapped
+    template<typename T> const T* get_mapped(std::string name, long long int &count) const;
+    // Moves the mapped file to the caller, keeping the mapped tables valid
+    void release_mapping(MappedFile &file);
+
+    // Node flags and arc look-ahead updates set by the look-ahead
+    void set_graph(const Decoder &decoder);
+    void get_graph(Decoder &decoder) const;
+
+    unsigned long long int content_hash();
+
+private:
+    class Table {
+    public:
+        Table() : elem_size(0), count(0), data(nullptr) { }
+        unsigned int elem_size;
+        long long int count;
+        const char *data;
+    };
+
+    const Table& find_table(std::string name, unsigned int elem_size) const;
+    void write_table_header(std::string name, unsigned int elem_size, long long int count);
+    void write_data(const void *data, long long int size);
+
+    std::string m_la_type;
+    const Decoder *m_decoder;
+    std::vector<std::string> m_model_fnames;
+    unsigned long long int m_content_hash;
+    bool m_content_hash_set;
+
+    MappedFile m_file;
+    std::map<std::string, Table> m_tables;
+
+    std::ofstream m_ofile;
+    std::string m_ofname;
+};
+
+
+template<typename T>
+void
+LookaheadCache::set(std::string name, const std::vector<T> &vals)
+{
+    write_table_header(name, sizeof(T), vals.size());
+    write_data(vals.data(), vals.size() * sizeof(T));
+}
+
+
+template<typename T>
+void
+LookaheadCache::set(std::string name, const std::vector<std::vector<T> > &vals)
+{
+    std::vector<long long int> offsets(1, 0);
+    for (auto vit = vals.begin(); vit != vals.end(); ++vit)
+        offsets.push_back(offsets.back() + vit->size());
+    set(name + ".offsets", offsets);
+
+    write_table_header(name, sizeof(T), offsets.back());
+    for (auto vit = vals.begin(); vit != vals.end(); ++vit)
+        write_data(vit->data(), vit->size() * sizeof(T));
+}
+
+
+template<typename T>
+void
+LookaheadCache::set_value(std::string name, const T &val)
+{
+    set(name, std::vector<T>(1, val));
+}
+
+
+template<typename T>
+void
+LookaheadCache::get(std::string name, std::vector<T> &vals) const
+{
+    const Table &table = find_table(name, sizeof(T));
+    vals.resize(table.count);
+    if (table.count > 0)
+        memcpy(vals.data(), table.data, table.count * sizeof(T));
+}
+
+
+template<typename T>
+void
+LookaheadCache::get(std::string name, std::vector<std::vector<T> > &vals) const
+{
+    std::vector<long long int> offsets;
+    get(name + ".offsets", offsets);
+    const Table &table = find_table(name, sizeof(T));
+    if (offsets.size() == 0 || offsets.back() != table.count)
+        throw std::string("Invalid look-ahead cache table: " + name);
+
+    const T *data = reinterpret_cast<const T*>(table.data);
+    vals.resize(offsets.size()-1);
+    for (int i=0; i<(int)vals.size(); i++)
+        vals[i].assign(data + offsets[i], data + offsets[i+1]);
+}
+
+
+template<typename T>
+const T*
+LookaheadCache::get_mapped(std::string name, long long int &count) const
+{
+    const Table &table = find_table(name, sizeof(T));
+    count = table.count;
+    return reinterpret_cast<const T*>(table.data);
+}
+
+
+template<typename T>
+void
+LookaheadCache::get_value(std::string name, T &val) const
+{
+    std::vector<T> vals;
+    get(name, vals);
+    if (vals.size() != 1)
+        throw std::string("Invalid look-ahead cache value: " + name);
+    val = vals[0];
+}
+
+#endif /* LOOKAHEAD_CACHE_HH */
@@ -46,6 +46,14 @@ NgramDecoder::set_text_unit_id_ngram_symbol_mapping()
 
 
 NgramRecognition::NgramRecognition(NgramDecoder &decoder)
+    : NgramRecognition(decoder, decoder.m_nodes.size(), decoder.m_decode_start_node)
+{
+}
+
+
+NgramRecognition::NgramRecognition(NgramDecoder &decoder,
+                                   int num_nodes,
+                                   int decode_start_node)
     : Recognition::Recognition(decoder),
       m_ngram_state_sentence_begin(decoder.m_ngram_state_sentence_begin)
 {
@@ -55,8 +63,8 @@ NgramRecognition::NgramRecognition(NgramDecoder &decoder)
     m_raw_tokens.clear();
     m_raw_tokens.reserve(1000000);
     m_recombined_tokens.clear();
-    m_recombined_tokens.resize(d->m_nodes.size());
-    m_best_node_scores.resize(d->m_nodes.size(), -1e20);
+    m_recombined_tokens.resize(num_nodes);
+    m_best_node_scores.resize(num_nodes, -1e20);
     m_active_nodes.clear();
     m_active_histories.clear();
     NgramToken tok;
@@ -66,15 +74,16 @@ NgramRecognition::NgramRecognition(NgramDecoder &decoder)
     tok.history = new WordHistory();
     tok.history->word_id = m_sentence_begin_symbol_idx;
     m_history_root = tok.history;
-    tok.node_idx = d->m_decode_start_node;
-    m_active_nodes.insert(d->m_decode_start_node);
+    tok.node_idx = decode_start_node;
+    m_active_nodes.insert(decode_start_node);
     m_word_history_leafs.insert(tok.history);
     if (m_use_word_boundary_symbol) {
         advance_in_word_history(&tok, m_word_boundary_symbol_idx);
+        tok.second_last_word_id = m_sentence_begin_symbol_idx;
         tok.last_word_id = m_word_boundary_symbol_idx;
     }
     m_active_histories.insert(tok.history);
-    m_recombined_tokens[d->m_decode_start_node][tok.lm_node] = tok;
+    m_recombined_tokens[decode_start_node][tok.lm_node] = tok;
     m_total_token_count = 0;
 }
 
@@ -100,30 +109,8 @@ NgramRecognition::reset_frame_variables()
 void
 NgramRecognition::propagate_tokens()
 {
-    int node_count = 0;
-    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit) {
-        Decoder::Node &node = d->m_nodes[*nit];
-        for (auto tit = m_recombined_tokens[*nit].begin(); tit != m_recombined_tokens[*nit].end(); ++tit) {
-
-            if (tit->second.histogram_bin < m_histogram_bin_limit) {
-                m_histogram_pruned_count++;
-                continue;
-            }
-
-            m_token_count++;
-            tit->second.word_end = false;
-
-            for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
-                move_token_to_node(tit->second, ait->target_node, ait->log_prob, ait->update_lookahead);
-        }
-        node_count++;
-    }
-
-    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
-        m_recombined_tokens[*nit].clear();
-
-    if (m_stats)
-        cerr << "token count before propagation: " << m_token_count << endl;
+    GraphNetwork network(d);
+    propagate_tokens(network);
 }
 
 
@@ -166,7 +153,10 @@ NgramRecognition::prune_tokens(
     }
     m_raw_tokens.clear();
 
-    // Recombine node/ngram state hypotheses
+    // Recombine node/ngram state hypotheses,
+    // nodes may have been added to the network in the propagation
+    if (m_recombined_tokens.size() < m_best_node_scores.size())
+        m_recombined_tokens.resize(m_best_node_scores.size());
     m_active_nodes.clear();
     vector<int> histogram(HISTOGRAM_BIN_COUNT, 0);
     for (auto tit = pruned_tokens.begin(); tit != pruned_tokens.end(); tit++) {
@@ -232,107 +222,13 @@ NgramRecognition::prune_tokens(
         }
     }
 
+    nodes_pruned();
+
     if (m_stats) cerr << "token count after pruning: " << m_token_count_after_pruning << endl;
     if (m_stats) cerr << "histogram index: " << m_histogram_bin_limit << endl;
 }
 
 
-void
-NgramRecognition::move_token_to_node(
-    NgramToken token,
-    int node_idx,
-    float transition_score,
-    bool update_lookahead)
-{
-    token.am_log_prob += m_transition_scale * transition_score;
-
-    Decoder::Node &node = d->m_nodes[node_idx];
-
-    if (token.node_idx == node_idx) {
-        token.dur++;
-        if (token.dur > m_max_state_duration && node.hmm_state > m_last_sil_idx) {
-            m_max_state_duration_pruned_count++;
-            return;
-        }
-    }
-    else {
-        // Apply duration model for previous state if moved out from a hmm state
-        if (m_duration_model_in_use && d->m_nodes[token.node_idx].hmm_state != -1)
-            token.apply_duration_model();
-        token.node_idx = node_idx;
-        token.dur = 1;
-    }
-
-    // HMM node
-    if (node.hmm_state != -1) {
-
-        if (update_lookahead)
-            token.update_lookahead_prob(d->m_la->get_lookahead_score(node_idx, token.last_word_id));
-
-        token.am_log_prob += m_acoustics->log_prob(node.hmm_state);
-
-        token.update_total_log_prob();
-        if (token.total_log_prob < (m_best_log_prob-m_global_beam)) {
-            m_global_beam_pruned_count++;
-            return;
-        }
-
-        m_best_log_prob = max(m_best_log_prob, token.total_log_prob);
-        if (token.word_end) {
-            float lp_wo_la = token.total_log_prob - d->m_lm_scale * token.lookahead_log_prob;
-            m_best_word_end_prob = max(m_best_word_end_prob, lp_wo_la);
-        }
-        m_best_node_scores[node_idx] = max(m_best_node_scores[node_idx], token.total_log_prob);
-        m_raw_tokens.push_back(token);
-        return;
-    }
-
-    // LM node
-    // Update LM score
-    // Update history
-    if (node.word_id != -1) {
-        token.lm_node = ngd->m_lm.score(
-                            token.lm_node,
-                            ngd->m_text_unit_id_to_ngram_symbol[node.word_id], token.lm_log_prob);
-        token.last_word_id = node.word_id;
-
-        if (update_lookahead) {
-            if ((node.word_id == m_sentence_end_symbol_idx) && m_use_word_boundary_symbol) {
-                token.update_lookahead_prob(d->m_la->get_lookahead_score(node_idx, m_word_boundary_symbol_idx));
-            }
-            else if (node.word_id == m_sentence_end_symbol_idx) {
-                token.update_lookahead_prob(d->m_la->get_lookahead_score(node_idx, m_sentence_begin_symbol_idx));
-            }
-            else {
-                token.update_lookahead_prob(d->m_la->get_lookahead_score(node_idx, token.last_word_id));
-            }
-        }
-        token.update_total_log_prob();
-        if (token.total_log_prob < (m_best_log_prob-m_global_beam)) {
-            m_global_beam_pruned_count++;
-            return;
-        }
-
-        advance_in_word_history(&token, node.word_id);
-        token.word_end = true;
-
-        if (node.word_id == m_sentence_end_symbol_idx) {
-            token.lm_node = m_ngram_state_sentence_begin;
-            if (m_use_word_boundary_symbol) {
-                advance_in_word_history(&token, m_word_boundary_symbol_idx);
-                token.last_word_id = m_word_boundary_symbol_idx;
-            }
-            else {
-                token.last_word_id = m_sentence_begin_symbol_idx;
-            }
-        }
-    }
-
-    for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
-        move_token_to_node(token, ait->target_node, ait->log_prob, ait->update_lookahead);
-}
-
-
 void
 NgramRecognition::get_tokens(vector<Token*> &tokens)
 {
@@ -1,6 +1,8 @@
 #ifndef NGRAM_DECODER_HH
 #define NGRAM_DECODER_HH
 
+#include <algorithm>
+#include <iostream>
 #include <map>
 #include <fstream>
 #include <vector>
@@ -36,15 +38,38 @@ public:
 
     NgramRecognition(NgramDecoder &decoder);
 
-private:
+protected:
+    // Starts the search in a network of num_nodes nodes
+    NgramRecognition(NgramDecoder &decoder,
+                     int num_nodes,
+                     int decode_start_node);
+    // Decoder graph as the search network of the token passing
+    class GraphNetwork {
+    public:
+        GraphNetwork(Decoder *decoder) : d(decoder) { }
+        const Decoder::Node& node(int node_idx) const { return d->m_nodes[node_idx]; }
+        float lookahead_score(int node_idx, int prev_word_id, int word_id) const {
+            return d->m_la->get_lookahead_score(node_idx, prev_word_id, word_id);
+        }
+        // Called before the tokens are moved from a node without acoustics
+        void expand(int node_idx) { }
+        Decoder *d;
+    };
+
+    // Called after the pruning with the active nodes set
+    virtual void nodes_pruned() { }
+
     void reset_frame_variables() override;
     void propagate_tokens() override;
     void prune_tokens(bool collect_active_histories=false,
                       bool write_nbest=false) override;
-    void move_token_to_node(NgramToken token,
-                            int node_idx,
-                            float transition_score,
-                            bool update_lookahead);
+    // Token passing in the network, a template to keep the node access inlined
+    template<typename Network> void propagate_tokens(Network &network);
+    template<typename Network> void move_token_to_node(Network &network,
+                                                      NgramToken token,
+                                                      int node_idx,
+                                                      float transition_score,
+                                                      bool update_lookahead);
     void get_tokens(std::vector<Token*> &tokens) override;
     void add_sentence_ends(std::vector<Token*> &tokens) override;
     std::string get_result(WordHistory *history) override;
@@ -55,4 +80,141 @@ private:
     NgramDecoder *ngd;
 };
 
+
+template<typename Network>
+void
+NgramRecognition::propagate_tokens(Network &network)
+{
+    int node_count = 0;
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit) {
+        const Decoder::Node &node = network.node(*nit);
+        for (auto tit = m_recombined_tokens[*nit].begin(); tit != m_recombined_tokens[*nit].end(); ++tit) {
+
+            if (tit->second.histogram_bin < m_histogram_bin_limit) {
+                m_histogram_pruned_count++;
+                continue;
+            }
+
+            m_token_count++;
+            tit->second.word_end = false;
+
+            for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+                move_token_to_node(network, tit->second, ait->target_node, ait->log_prob, ait->update_lookahead);
+        }
+        node_count++;
+    }
+
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
+        m_recombined_tokens[*nit].clear();
+
+    if (m_stats)
+        std::cerr << "token count before propagation: " << m_token_count << std::endl;
+}
+
+
+template<typename Network>
+void
+NgramRecognition::move_token_to_node(
+    Network &network,
+    NgramToken token,
+    int node_idx,
+    float transition_score,
+    bool update_lookahead)
+{
+    token.am_log_prob += m_transition_scale * transition_score;
+
+    const Decoder::Node &node = network.node(node_idx);
+
+    if (token.node_idx == node_idx) {
+        token.dur += m_frame_skip;
+        if (token.dur > m_max_state_duration && node.hmm_state > m_last_sil_idx) {
+            m_max_state_duration_pruned_count++;
+            return;
+        }
+    }
+    else {
+        // Apply duration model for previous state if moved out from a hmm state
+        if (m_duration_model_in_use && network.node(token.node_idx).hmm_state != -1)
+            token.apply_duration_model(network.node(token.node_idx).hmm_state);
+        token.node_idx = node_idx;
+        token.dur = m_frame_skip;
+    }
+
+    // HMM node
+    if (node.hmm_state != -1) {
+
+        if (update_lookahead)
+            token.update_lookahead_prob(
+                network.lookahead_score(node_idx, token.second_last_word_id, token.last_word_id));
+
+        token.am_log_prob += m_acoustics->log_prob(node.hmm_state);
+
+        token.update_total_log_prob();
+        if (token.total_log_prob < (m_best_log_prob-m_global_beam)) {
+            m_global_beam_pruned_count++;
+            return;
+        }
+
+        m_best_log_prob = std::max(m_best_log_prob, token.total_log_prob);
+        if (token.word_end) {
+            float lp_wo_la = token.total_log_prob - d->m_lm_scale * token.lookahead_log_prob;
+            m_best_word_end_prob = std::max(m_best_word_end_prob, lp_wo_la);
+        }
+        m_best_node_scores[node_idx] = std::max(m_best_node_scores[node_idx], token.total_log_prob);
+        m_raw_tokens.push_back(token);
+        return;
+    }
+
+    // LM node
+    // Update LM score
+    // Update history
+    if (node.word_id != -1) {
+        token.lm_node = ngd->m_lm.score(
+                            token.lm_node,
+                            ngd->m_text_unit_id_to_ngram_symbol[node.word_id], token.lm_log_prob);
+        token.second_last_word_id = token.last_word_id;
+        token.last_word_id = node.word_id;
+
+        if (update_lookahead) {
+            if ((node.word_id == m_sentence_end_symbol_idx) && m_use_word_boundary_symbol) {
+                token.update_lookahead_prob(network.lookahead_score(
+                    node_idx, m_sentence_begin_symbol_idx, m_word_boundary_symbol_idx));
+            }
+            else if (node.word_id == m_sentence_end_symbol_idx) {
+                token.update_lookahead_prob(network.lookahead_score(
+                    node_idx, -1, m_sentence_begin_symbol_idx));
+            }
+            else {
+                token.update_lookahead_prob(network.lookahead_score(
+                    node_idx, token.second_last_word_id, token.last_word_id));
+            }
+        }
+        token.update_total_log_prob();
+        if (token.total_log_prob < (m_best_log_prob-m_global_beam)) {
+            m_global_beam_pruned_count++;
+            return;
+        }
+
+        advance_in_word_history(&token, node.word_id);
+        token.word_end = true;
+
+        if (node.word_id == m_sentence_end_symbol_idx) {
+            token.lm_node = m_ngram_state_sentence_begin;
+            if (m_use_word_boundary_symbol) {
+                advance_in_word_history(&token, m_word_boundary_symbol_idx);
+                token.second_last_word_id = m_sentence_begin_symbol_idx;
+                token.last_word_id = m_word_boundary_symbol_idx;
+            }
+            else {
+                token.second_last_word_id = -1;
+                token.last_word_id = m_sentence_begin_symbol_idx;
+            }
+        }
+    }
+
+    network.expand(node_idx);
+    for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+        move_token_to_node(network, token, ait->target_node, ait->log_prob, ait->update_lookahead);
+}
+
 #endif /* NGRAM_DECODER_HH */
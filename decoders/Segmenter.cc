@@ -11,6 +11,11 @@ Segmenter::Segmenter()
     m_best_log_prob = 0.0;
     m_transition_scale = 1.0;
     m_duration_scale = 3.0;
+    m_histogram_bin_limit = 0;
+    m_histogram_pruned_count = 0;
+    m_checkpoint_interval = 100;
+    m_max_attempts = 1;
+    m_beam_growth = 2.0;
 }
 
 
@@ -19,8 +24,50 @@ Segmenter::initialize()
 {
     Token tok;
     tok.node_idx = m_decode_start_node;
-    m_recombined_tokens.clear();
+    m_state_histories.clear();
+    m_recombined_tokens.assign(m_nodes.size(), Token());
+    m_previous_recombined_tokens.assign(m_nodes.size(), Token());
+    m_active_nodes.clear();
+    m_previous_active_nodes.clear();
     m_recombined_tokens[m_decode_start_node] = tok;
+    m_active_nodes.insert(m_decode_start_node);
+    m_checkpoints.clear();
+    m_frame_idx = 0;
+    m_best_log_prob = 0.0;
+    m_histogram_bin_limit = 0;
+    m_histogram_pruned_count = 0;
+}
+
+
+void
+Segmenter::save_checkpoint()
+{
+    Checkpoint checkpoint;
+    checkpoint.frame_idx = m_frame_idx;
+    checkpoint.best_log_prob = m_best_log_prob;
+    checkpoint.num_state_histories = m_state_histories.size();
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
+        checkpoint.tokens.push_back(m_recombined_tokens[*nit]);
+    m_checkpoints.push_back(checkpoint);
+}
+
+
+void
+Segmenter::restore_checkpoint(const Checkpoint &checkpoint)
+{
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
+        m_recombined_tokens[*nit].node_idx = -1;
+    m_active_nodes.clear();
+    for (auto tit = checkpoint.tokens.begin(); tit != checkpoint.tokens.end(); ++tit) {
+        m_recombined_tokens[tit->node_idx] = *tit;
+        m_active_nodes.insert(tit->node_idx);
+    }
+    m_frame_idx = checkpoint.frame_idx;
+    m_best_log_prob = checkpoint.best_log_prob;
+    // The beam and the token limit may have been widened since saving
+    set_histogram_bin_limit();
+    // Histories are only appended, the restored tokens refer to earlier ones
+    m_state_histories.resize(checkpoint.num_state_histories);
 }
 
 
@@ -30,7 +77,23 @@ Segmenter::advance_in_state_history(Token &token)
     StateHistory sh(token.node_idx);
     sh.end_frame = m_frame_idx;
     sh.start_frame = m_frame_idx-token.dur;
-    token.state_history.push_back(sh);
+    sh.previous = token.history;
+    token.history = m_state_histories.size();
+    m_state_histories.push_back(sh);
+}
+
+
+void
+Segmenter::store_left_state(Token &token)
+{
+    if (token.left_node_idx == -1) return;
+    StateHistory sh(token.left_node_idx);
+    sh.end_frame = m_frame_idx;
+    sh.start_frame = token.left_start_frame;
+    sh.previous = token.history;
+    token.history = m_state_histories.size();
+    m_state_histories.push_back(sh);
+    token.left_node_idx = -1;
 }
 
 
@@ -38,10 +101,13 @@ void
 Segmenter::print_phn_segmentation(Token &token,
                                   ostream &outf)
 {
+    vector<int> path;
+    for (int h = token.history; h != -1; h = m_state_histories[h].previous)
+        path.push_back(h);
 
-    for (auto sit = token.state_history.begin(); sit != token.state_history.end(); ++sit)
+    for (auto pit = path.rbegin(); pit != path.rend(); ++pit)
     {
-        StateHistory &sh = *sit;
+        StateHistory &sh = m_state_histories[*pit];
         string label = m_state_history_labels[sh.node_idx];
 
         if (label.length() > 0) {
@@ -63,28 +129,67 @@ Segmenter::segment_lna_file(string lnafname,
                             map<int, string> &node_labels,
                             ostream *outf,
                             int info_level) {
-    m_state_history_labels = node_labels;
     m_lna_reader.open_file(lnafname, 1024);
-    m_acoustics = &m_lna_reader;
-    initialize();
-
-    m_frame_idx = 0;
-    while (m_lna_reader.go_to(m_frame_idx)) {
-        float curr_prob_limit = m_best_log_prob - m_global_beam;
-        m_best_log_prob = TINY_FLOAT;
-        propagate_tokens(curr_prob_limit);
-        m_frame_idx++;
-    }
+    float log_prob = segment(m_lna_reader, node_labels, outf, info_level);
     m_lna_reader.close();
+    return log_prob;
+}
+
+
+float
+Segmenter::segment(Acoustics &acoustics,
+                   map<int, string> &node_labels,
+                   ostream *outf,
+                   int info_level) {
+    m_state_history_labels = node_labels;
+    m_acoustics = &acoustics;
+    float global_beam = m_global_beam;
+    int token_limit = m_token_limit;
+    initialize();
 
     Token *best_token = nullptr;
-    for (auto enit = m_decode_end_nodes.begin(); enit != m_decode_end_nodes.end(); ++enit) {
-        Token *curr_tok = &(m_recombined_tokens[*enit]);
-        if (best_token == nullptr || curr_tok->log_prob > best_token->log_prob)
-            best_token = curr_tok;
+    int attempts = 1;
+    while (true) {
+        while (m_acoustics->go_to(m_frame_idx)) {
+            if (m_frame_idx % m_checkpoint_interval == 0
+                && (m_checkpoints.size() == 0 || m_checkpoints.back().frame_idx < m_frame_idx))
+                save_checkpoint();
+            float curr_prob_limit = m_best_log_prob - m_global_beam;
+            m_best_log_prob = TINY_FLOAT;
+            propagate_tokens(curr_prob_limit);
+            m_frame_idx++;
+            if (m_active_nodes.size() == 0) break;
+        }
+
+        best_token = nullptr;
+        for (auto enit = m_decode_end_nodes.begin(); enit != m_decode_end_nodes.end(); ++enit) {
+            Token *curr_tok = &(m_recombined_tokens[*enit]);
+            if (curr_tok->node_idx == -1) continue;
+            if (best_token == nullptr || curr_tok->log_prob > best_token->log_prob)
+                best_token = curr_tok;
+        }
+        if (best_token != nullptr || attempts >= m_max_attempts) break;
+
+        // Widens the beams and continues from an earlier frame, the number of
+        // checkpoints gone back doubles and the last attempt starts from the beginning
+        attempts++;
+        m_global_beam *= m_beam_growth;
+        m_token_limit *= 2;
+        int remaining_attempts = m_max_attempts - attempts;
+        int num_rollback_checkpoints = max(1, (int)m_checkpoints.size() >> remaining_attempts);
+        int checkpoint_idx = max(0, (int)m_checkpoints.size() - num_rollback_checkpoints);
+        if (remaining_attempts == 0) checkpoint_idx = 0;
+        m_checkpoints.resize(checkpoint_idx + 1);
+        restore_checkpoint(m_checkpoints.back());
+        if (info_level > 0)
+            cerr << "increasing beam to " << m_global_beam
+                 << " and maximum tokens to " << m_token_limit
+                 << " from frame " << m_frame_idx << endl;
     }
+    m_global_beam = global_beam;
+    m_token_limit = token_limit;
 
-    if (best_token->node_idx == -1) {
+    if (best_token == nullptr) {
         if (info_level > 0) cerr << "warning, no segmentation found" << endl;
         return TINY_FLOAT;
     }
@@ -98,6 +203,15 @@ Segmenter::segment_lna_file(string lnafname,
 }
 
 
+float
+Segmenter::get_node_log_prob(int node_idx) const
+{
+    if (node_idx < 0 || node_idx >= (int)m_recombined_tokens.size()
+        || m_recombined_tokens[node_idx].node_idx == -1) return TINY_FLOAT;
+    return m_recombined_tokens[node_idx].log_prob;
+}
+
+
 void
 Segmenter::apply_duration_model(Token &token, int node_idx)
 {
@@ -122,7 +236,10 @@ Segmenter::move_token_to_node(Token token,
         // Apply duration model for previous state if moved out from a hmm state
         if (m_duration_model_in_use && m_nodes[token.node_idx].hmm_state != -1)
             apply_duration_model(token, token.node_idx);
-        advance_in_state_history(token);
+        // A state left earlier in this frame is stored now
+        store_left_state(token);
+        token.left_node_idx = token.node_idx;
+        token.left_start_frame = m_frame_idx-token.dur;
         token.node_idx = node_idx;
         token.dur = 1;
     }
@@ -134,9 +251,11 @@ Segmenter::move_token_to_node(Token token,
             return;
         }
         m_best_log_prob = max(m_best_log_prob, token.log_prob);
-        if (m_recombined_tokens.find(node_idx) == m_recombined_tokens.end() ||
-            token.log_prob > m_recombined_tokens[node_idx].log_prob)
-                m_recombined_tokens[node_idx] = token;
+        Token &node_token = m_recombined_tokens[node_idx];
+        if (node_token.node_idx == -1 || token.log_prob > node_token.log_prob) {
+            node_token = token;
+            m_active_nodes.insert(node_idx);
+        }
         return;
     }
 
@@ -149,12 +268,50 @@ void
 Segmenter::propagate_tokens(float curr_prob_limit)
 {
     m_previous_recombined_tokens.swap(m_recombined_tokens);
-    m_recombined_tokens.clear();
-    for (auto rtit = m_previous_recombined_tokens.begin(); rtit != m_previous_recombined_tokens.end(); ++rtit)
+    m_previous_active_nodes.swap(m_active_nodes);
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
+        m_recombined_tokens[*nit].node_idx = -1;
+    m_active_nodes.clear();
+
+    for (auto nit = m_previous_active_nodes.begin(); nit != m_previous_active_nodes.end(); ++nit)
     {
-        if (rtit->second.log_prob < curr_prob_limit) continue;
-        Node &node = m_nodes[rtit->second.node_idx];
+        Token &token = m_previous_recombined_tokens[*nit];
+        if (token.log_prob < curr_prob_limit) continue;
+        if (token.histogram_bin < m_histogram_bin_limit) {
+            m_histogram_pruned_count++;
+            continue;
+        }
+        Node &node = m_nodes[token.node_idx];
         for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
-            move_token_to_node(rtit->second, ait->target_node, ait->log_prob);
+            move_token_to_node(token, ait->target_node, ait->log_prob);
+    }
+
+    // States left by the surviving tokens and the histogram for the next frame
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit)
+        store_left_state(m_recombined_tokens[*nit]);
+    set_histogram_bin_limit();
+}
+
+
+void
+Segmenter::set_histogram_bin_limit()
+{
+    vector<int> histogram(HISTOGRAM_BIN_COUNT, 0);
+    float current_glob_beam = m_best_log_prob - m_global_beam;
+    for (auto nit = m_active_nodes.begin(); nit != m_active_nodes.end(); ++nit) {
+        Token &token = m_recombined_tokens[*nit];
+        token.histogram_bin = (int) round((float)(HISTOGRAM_BIN_COUNT-1) * (token.log_prob-current_glob_beam)/m_global_beam);
+        token.histogram_bin = max(0, min(HISTOGRAM_BIN_COUNT-1, token.histogram_bin));
+        histogram[token.histogram_bin]++;
+    }
+
+    m_histogram_bin_limit = 0;
+    int histogram_tok_count = 0;
+    for (int i=HISTOGRAM_BIN_COUNT-1; i>= 0; i--) {
+        histogram_tok_count += histogram[i];
+        if (histogram_tok_count > m_token_limit) {
+            m_histogram_bin_limit = i;
+            break;
+        }
     }
 }
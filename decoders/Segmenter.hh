@@ -1,4 +1,5 @@
 #include <map>
+#include <set>
 
 #include "Decoder.hh"
 
@@ -8,58 +9,102 @@ public:
 
     Segmenter();
 
+    // Visited states are stored in one vector, each state
+    // points to the previous state of the path
     class StateHistory {
     public:
         StateHistory()
             : node_idx(-1),
-              start_frame(-1), end_frame(-1) { }
+              start_frame(-1), end_frame(-1), previous(-1) { }
         StateHistory(int node_idx)
             : node_idx(node_idx),
-              start_frame(-1), end_frame(-1) { }
+              start_frame(-1), end_frame(-1), previous(-1) { }
         int node_idx;
         int start_frame;
         int end_frame;
+        int previous;
     };
 
     class Token {
     public:
-        std::vector<StateHistory> state_history;
         int node_idx;
         float log_prob;
         unsigned short int dur;
         int histogram_bin;
+        // Last stored state, -1 for none
+        int history;
+        // State left in the current frame, stored if the token survives
+        int left_node_idx;
+        int left_start_frame;
 
         Token():
             node_idx(-1),
             log_prob(0.0),
             dur(0),
-            histogram_bin(0)
+            histogram_bin(0),
+            history(-1),
+            left_node_idx(-1),
+            left_start_frame(-1)
         { }
     };
 
+    // Search state at the start of a frame
+    class Checkpoint {
+    public:
+        int frame_idx;
+        float best_log_prob;
+        int num_state_histories;
+        std::vector<Token> tokens;
+    };
+
     void initialize();
     float segment_lna_file(std::string lnafname,
                            std::map<int, std::string> &node_labels,
                            std::ostream *outf=nullptr,
                            int info_level=1);
+    float segment(Acoustics &acoustics,
+                  std::map<int, std::string> &node_labels,
+                  std::ostream *outf=nullptr,
+                  int info_level=1);
+    // Log probability of the token in the node after segmenting, TINY_FLOAT if none
+    float get_node_log_prob(int node_idx) const;
     void apply_duration_model(Token &token, int node_idx);
     void print_phn_segmentation(Token &token,
                                 std::ostream &outf=std::cout);
     void advance_in_state_history(Token& token);
+    void store_left_state(Token& token);
+    void save_checkpoint();
+    void restore_checkpoint(const Checkpoint &checkpoint);
     void move_token_to_node(Token token,
                             int node_idx,
                             float transition_score);
-    void active_nodes_sorted_by_lp(std::vector<int> &nodes);
     void propagate_tokens(float curr_prob_limit);
+    // Sets the histogram bins of the active tokens and the lowest bin
+    // within the token limit for the current beam
+    void set_histogram_bin_limit();
 
     std::map<int, std::string> m_state_history_labels;
-    std::map<int, Token> m_recombined_tokens;
-    std::map<int, Token> m_previous_recombined_tokens;
+    std::vector<StateHistory> m_state_histories;
+    // Tokens by node, node_idx -1 for nodes without a token
+    std::vector<Token> m_recombined_tokens;
+    std::vector<Token> m_previous_recombined_tokens;
+    std::set<int> m_active_nodes;
+    std::set<int> m_previous_active_nodes;
 
     std::vector<int> m_decode_end_nodes;
     int m_frame_idx;
     int m_global_beam_pruned_count;
+    int m_histogram_bin_limit;
+    int m_histogram_pruned_count;
+    // Frames between the saved search states
+    int m_checkpoint_interval;
+    // Attempts if no end node is reached, each attempt multiplies
+    // the beam by the beam growth, doubles the token limit and
+    // continues from an earlier saved search state
+    int m_max_attempts;
+    float m_beam_growth;
+    std::vector<Checkpoint> m_checkpoints;
     float m_best_log_prob;
-    LnaReaderCircular m_lna_reader;
+    LnaReaderMapped m_lna_reader;
     Acoustics *m_acoustics;
 };
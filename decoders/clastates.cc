@@ -8,6 +8,7 @@ int main(int argc, char* argv[])
 {
     conf::Config config;
     config("usage: clastates [OPTION...] PH LEXICON GRAPH CLASS_ARPA CMEMPROBS LASTATES\n")
+    ('p', "num-threads", "arg", "1", "Number of threads used in setting the look-ahead scores")
     ('h', "help", "", "", "display help");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 6) config.print_help(stderr, 1);
@@ -32,7 +33,8 @@ int main(int argc, char* argv[])
         string cMemProbs = config.arguments[4];
         cerr << "Reading class bigram lookahead model: "
              << classArpa << "/" << cMemProbs << endl;
-        ClassBigramLookahead cbgla(d, classArpa, cMemProbs);
+        ClassBigramLookahead cbgla(d, classArpa, cMemProbs, false,
+                                  config["num-threads"].get_int());
 
         string lasfname = config.arguments[5];
         cerr << "Writing lookahead states: " << lasfname << endl;
@@ -1,17 +1,40 @@
 #include <algorithm>
+#include <fstream>
 #include <thread>
 #include <vector>
 #include <typeinfo>
 
 #include "Decoder.hh"
 #include "NgramDecoder.hh"
+#include "DynamicDecoder.hh"
 #include "ClassDecoder.hh"
 #include "ClassIPDecoder.hh"
 #include "WordSubwordDecoder.hh"
+#include "LnaArchive.hh"
+#include "LnaPrefetcher.hh"
 #include "conf.hh"
 
 using namespace std;
 
+// Maximum number of threads reading LNA files ahead
+static const int lna_prefetch_threads = 4;
+
+
+string
+get_lattice_fname(string lattice_dir,
+                  string lnafname)
+{
+    string archive_fname, name;
+    if (!LnaArchive::split_entry_name(lnafname, archive_fname, name)) {
+        size_t slash_pos = lnafname.rfind('/');
+        name = slash_pos == string::npos ? lnafname : lnafname.substr(slash_pos + 1);
+        if (name.length() > 4 && name.compare(name.length() - 4, 4, ".lna") == 0)
+            name = name.substr(0, name.length() - 4);
+    }
+    return lattice_dir + "/" + name + ".slf";
+}
+
+
 void join(vector<string> &lnafnames,
           vector<Recognition*> &recognitions,
           vector<RecognitionResult*> &results,
@@ -20,7 +43,9 @@ void join(vector<string> &lnafnames,
           ostream &resultf,
           ostream &logf,
           SimpleFileOutput *nbest = nullptr,
-          int nbest_num_hypotheses = 10000)
+          int nbest_num_hypotheses = 10000,
+          string lattice_dir = "",
+          float lm_scale = 0.0)
 {
     for (int i=0; i<(int)threads.size(); i += 1) {
         threads[i]->join();
@@ -41,6 +66,15 @@ void join(vector<string> &lnafnames,
                        << " " << std::count(nbest_results[h].result.begin(), nbest_results[h].result.end(), ' ')
                        << nbest_results[h].result << "\n";
         }
+        if (lattice_dir.length() > 0) {
+            const Lattice &lattice = results[i]->lattice;
+            string latticefname = get_lattice_fname(lattice_dir, lnafnames[i]);
+            ofstream latticef(latticefname);
+            if (!latticef) throw string("Problem opening file: " + latticefname);
+            lattice.write_htk(latticef, *recognitions[i]->text_units(), lnafnames[i], lm_scale);
+            logf << "\tLattice nodes: " << lattice.num_nodes()
+                 << "\tarcs: " << lattice.num_arcs() << endl;
+        }
         delete recognitions[i];
         delete results[i];
         delete threads[i];
@@ -54,7 +88,9 @@ void join(vector<string> &lnafnames,
 
 Recognition*
 get_recognition(Decoder *decoder) {
-    if (dynamic_cast<NgramDecoder*>(decoder)) {
+    if (dynamic_cast<DynamicDecoder*>(decoder)) {
+        return new DynamicRecognition(*dynamic_cast<DynamicDecoder*>(decoder));
+    } else if (dynamic_cast<NgramDecoder*>(decoder)) {
         return new NgramRecognition(*dynamic_cast<NgramDecoder*>(decoder));
     } else if (dynamic_cast<ClassDecoder*>(decoder)) {
         return new ClassRecognition(*dynamic_cast<ClassDecoder*>(decoder));
@@ -69,6 +105,66 @@ get_recognition(Decoder *decoder) {
 }
 
 
+LnaPrefetcher*
+get_lna_prefetcher(conf::Config &config,
+                   const vector<string> &lnafnames,
+                   const vector<int> &use_counts = vector<int>())
+{
+    int max_files = config["lna-prefetch"].get_int();
+    if (max_files <= 0) return nullptr;
+    long long int memory_budget = config["lna-prefetch-memory"].get_int() * 1024LL * 1024LL;
+    int num_threads = min(max_files, lna_prefetch_threads);
+    if (use_counts.size() == 0)
+        return new LnaPrefetcher(lnafnames, max_files, memory_budget, num_threads);
+    else
+        return new LnaPrefetcher(lnafnames, use_counts, max_files, memory_budget, num_threads);
+}
+
+
+// Errors are reported here as exceptions can not leave the decoding threads
+void
+recognize_lna(Recognition *recognition,
+              string lnafname,
+              RecognitionResult &res,
+              bool write_nbest,
+              double nbest_beam,
+              int nbest_max_num_hypotheses,
+              bool write_lattice)
+{
+    try {
+        recognition->recognize_lna_file(lnafname, res, write_nbest, nbest_beam,
+                                        nbest_max_num_hypotheses, write_lattice);
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+}
+
+
+void
+recognize_prefetched_lna(Recognition *recognition,
+                         LnaPrefetcher *prefetcher,
+                         int file_idx,
+                         RecognitionResult &res,
+                         bool write_nbest,
+                         double nbest_beam,
+                         int nbest_max_num_hypotheses,
+                         bool write_lattice)
+{
+    double wait_time;
+    LnaBuffer lna;
+    try {
+        lna = prefetcher->get(file_idx, wait_time);
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+    recognition->recognize(lna, res, write_nbest, nbest_beam, nbest_max_num_hypotheses, write_lattice);
+    res.io_wait_time = wait_time;
+    prefetcher->release(file_idx);
+}
+
+
 void
 recognize_lnas(Decoder &d,
                conf::Config &config,
@@ -79,6 +175,12 @@ recognize_lnas(Decoder &d,
 {
     ifstream lnalistf(lnalistfname);
     string lnafname;
+    vector<string> lnafnames;
+    while (getline(lnalistf, lnafname))
+        if (lnafname.length()) lnafnames.push_back(lnafname);
+    lnalistf.close();
+    lnafnames = LnaArchive::expand_lna_fnames(lnafnames);
+
     TotalRecognitionStats total;
 
     logf << "number of threads: " << config["num-threads"].get_int() << endl;
@@ -86,31 +188,48 @@ recognize_lnas(Decoder &d,
     d.print_config(logf);
 
     int num_threads = config["num-threads"].get_int();
+    string lattice_dir = config["lattice-dir"].get_str();
+    bool write_lattice = lattice_dir.length() > 0;
+    LnaPrefetcher *prefetcher = get_lna_prefetcher(config, lnafnames);
     vector<string> lna_fnames;
     vector<Recognition*> recognitions;
     vector<RecognitionResult*> results;
     vector<std::thread*> threads;
-    while (getline(lnalistf, lnafname)) {
-        if (!lnafname.length()) continue;
+    for (int i=0; i<(int)lnafnames.size(); i++) {
 
         if ((int)recognitions.size() < num_threads) {
-            lna_fnames.push_back(lnafname);
+            lna_fnames.push_back(lnafnames[i]);
             recognitions.push_back(get_recognition(&d));
             results.push_back(new RecognitionResult());
-            thread *thr = new thread(&Recognition::recognize_lna_file,
-                                     recognitions.back(),
-                                     lnafname,
-                                     std::ref(*results.back()),
-                                     config["nbest"].specified,
-                                     config["nbest-beam"].get_double(),
-                                     config["nbest-num-hypotheses"].get_int());
+            thread *thr;
+            if (prefetcher != nullptr)
+                thr = new thread(&recognize_prefetched_lna,
+                                 recognitions.back(),
+                                 prefetcher,
+                                 i,
+                                 std::ref(*results.back()),
+                                 config["nbest"].specified,
+                                 config["nbest-beam"].get_double(),
+                                 config["nbest-num-hypotheses"].get_int(),
+                                 write_lattice);
+            else
+                thr = new thread(&recognize_lna,
+                                 recognitions.back(),
+                                 lnafnames[i],
+                                 std::ref(*results.back()),
+                                 config["nbest"].specified,
+                                 config["nbest-beam"].get_double(),
+                                 config["nbest-num-hypotheses"].get_int(),
+                                 write_lattice);
             threads.push_back(thr);
         }
 
         if ((int)recognitions.size() == num_threads)
-            join(lna_fnames, recognitions, results, threads, total, resultf, logf, nbest, config["nbest-num-hypotheses"].get_int());
+            join(lna_fnames, recognitions, results, threads, total, resultf, logf,
+                 nbest, config["nbest-num-hypotheses"].get_int(), lattice_dir, d.m_lm_scale);
     }
-    lnalistf.close();
-    join(lna_fnames, recognitions, results, threads, total, resultf, logf, nbest, config["nbest-num-hypotheses"].get_int());
+    join(lna_fnames, recognitions, results, threads, total, resultf, logf,
+         nbest, config["nbest-num-hypotheses"].get_int(), lattice_dir, d.m_lm_scale);
+    delete prefetcher;
     if (total.num_files > 1) total.print_stats(logf);
 }
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "Decoder.hh"
+#include "LnaPrefetcher.hh"
 #include "conf.hh"
 #include "io.hh"
 
@@ -17,10 +18,21 @@ void join(std::vector<std::string> &lnafnames,
           std::ostream &resultf,
           std::ostream &logf,
           SimpleFileOutput *nbest = nullptr,
-          int nbest_num_hypotheses = 10000);
+          int nbest_num_hypotheses = 10000,
+          std::string lattice_dir = "",
+          float lm_scale = 0.0);
+
+// Lattice filename in a directory, the LNA basename with .slf suffix
+std::string get_lattice_fname(std::string lattice_dir,
+                              std::string lnafname);
 
 Recognition* get_recognition(Decoder* decoder);
 
+// Returns nullptr if prefetching is not enabled with the lna-prefetch option
+LnaPrefetcher* get_lna_prefetcher(conf::Config &config,
+                                  const std::vector<std::string> &lnafnames,
+                                  const std::vector<int> &use_counts=std::vector<int>());
+
 void recognize_lnas(Decoder &d,
                     conf::Config &config,
                     std::string lnalistfname,
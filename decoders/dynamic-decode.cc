@@ -0,0 +1,139 @@
+#include <sstream>
+#include <thread>
+
+#include "DynamicDecoder.hh"
+#include "conf.hh"
+#include "decoder-helpers.hh"
+
+using namespace std;
+
+
+void
+read_config(DynamicDecoder &d, string cfgfname)
+{
+    ifstream cfgf(cfgfname);
+    if (!cfgf) throw string("Problem opening configuration file: ") + cfgfname;
+
+    string line;
+    while (getline(cfgf, line)) {
+        if (!line.length()) continue;
+        stringstream ss(line);
+        string parameter, val;
+        ss >> parameter;
+        if (parameter == "lm_scale") ss >> d.m_lm_scale;
+        else if (parameter == "token_limit") ss >> d.m_token_limit;
+        else if (parameter == "duration_scale") ss >> d.m_duration_scale;
+        else if (parameter == "transition_scale") ss >> d.m_transition_scale;
+        else if (parameter == "global_beam") ss >> d.m_global_beam;
+        else if (parameter == "word_end_beam") ss >> d.m_word_end_beam;
+        else if (parameter == "node_beam") ss >> d.m_node_beam;
+        else if (parameter == "history_clean_frame_interval") ss >> d.m_history_clean_frame_interval;
+        else if (parameter == "frame_skip") ss >> d.m_frame_skip;
+        else if (parameter == "frame_skip_combination") {
+            string combination;
+            ss >> combination;
+            d.m_frame_skip_combination = FrameSkipAcoustics::get_combination(combination);
+        }
+        else if (parameter == "force_sentence_end") {
+            string force_str;
+            ss >> force_str;
+            d.m_force_sentence_end = (force_str == "true");
+        }
+        else if (parameter == "stats") ss >> d.m_stats;
+        else cerr << "Ignored unknown parameter: " << parameter << endl;
+    }
+
+    cfgf.close();
+}
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: dynamic-decode [OPTION...] PH LEXICON LM CFGFILE LNALIST\n"
+           "Decodes without a graph, the lexical tree is expanded during the search\n")
+    ('h', "help", "", "", "display help")
+    ('d', "duration-model=STRING", "arg", "", "Duration model")
+    ('w', "word-list=STRING", "arg", "", "Words in the tree, DEFAULT: all units in the lexicon")
+    ('m', "tree-cache-memory=INT", "arg", "0", "Memory budget for the expanded tree per thread in MB, 0 for no limit, DEFAULT: 0")
+    ('p', "num-threads", "arg", "1", "Number of threads")
+    ('a', "lna-prefetch=INT", "arg", "0", "Number of LNA files read ahead in background threads, DEFAULT: 0")
+    ('A', "lna-prefetch-memory=INT", "arg", "1024", "Memory budget for the LNA files read ahead in MB, DEFAULT: 1024")
+    ('f', "result-file=STRING", "arg", "", "Base filename for results (.rec and .log)")
+    ('l', "lookahead-model=STRING", "arg", "", "Unigram lookahead language model")
+    ('n', "nbest=STRING", "arg", "", "N-best list file (use .gz suffix for compression)")
+    ('y', "nbest-num-hypotheses", "arg", "10000", "Maximum number of hypotheses per file")
+    ('b', "nbest-beam", "arg", "1000.0", "Beam setting (total difference from the best hypothesis log prob)")
+    ('g', "lattice-dir=STRING", "arg", "", "Directory for HTK SLF word lattices, pruned with the n-best beam");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 5) config.print_help(stderr, 1);
+
+    try {
+        DynamicDecoder d;
+
+        string phfname = config.arguments[0];
+        string lexfname = config.arguments[1];
+        string lmfname = config.arguments[2];
+        string cfgfname = config.arguments[3];
+        string lnalistfname = config.arguments[4];
+
+        cerr << "Reading hmms: " << phfname << endl;
+        d.read_phone_model(phfname);
+
+        if (config["duration-model"].specified) {
+            string durfname = config["duration-model"].get_str();
+            cerr << "Reading duration model: " << durfname << endl;
+            d.read_duration_model(durfname);
+        }
+
+        cerr << "Reading lexicon: " << lexfname << endl;
+        d.read_noway_lexicon(lexfname);
+
+        cerr << "Reading configuration: " << cfgfname << endl;
+        read_config(d, cfgfname);
+
+        cerr << "Reading language model: " << lmfname << endl;
+        d.read_lm(lmfname);
+
+        cerr << "Setting lexical tree" << endl;
+        if (config["word-list"].specified) {
+            string wordfname = config["word-list"].get_str();
+            ifstream wordf(wordfname);
+            if (!wordf) throw string("Problem opening word list: " + wordfname);
+            set<string> words;
+            string word;
+            while (wordf >> word) words.insert(word);
+            d.set_lexical_tree(words);
+        }
+        else d.set_lexical_tree();
+        cerr << "number of words in the tree: " << d.m_tree_word_ids.size() << endl;
+        d.m_tree_cache_budget = config["tree-cache-memory"].get_int() * 1024LL * 1024LL;
+
+        if (config["lookahead-model"].specified) {
+            string lalmfname = config["lookahead-model"].get_str();
+            cerr << "Reading lookahead model: " << lalmfname << endl;
+            d.read_lookahead_lm(lalmfname);
+        }
+
+        SimpleFileOutput *nbest = config["nbest"].specified ? new SimpleFileOutput(config["nbest"].get_str()) : nullptr;
+        if (config["result-file"].specified) {
+            string resultfname = config["result-file"].get_str();
+            cerr << "Base filename for results: " << resultfname << endl;
+            string resfname = resultfname + string(".rec");
+            string logfname = resultfname + string(".log");
+            ofstream resultf(resfname);
+            ofstream logf(logfname);
+            recognize_lnas(d, config, lnalistfname, resultf, logf, nbest);
+        }
+        else recognize_lnas(d, config, lnalistfname, cout, cerr, nbest);
+        if (nbest != nullptr) {
+            nbest->close();
+            delete nbest;
+        }
+
+    } catch (string &e) {
+        cerr << e << endl;
+    }
+
+    exit(0);
+}
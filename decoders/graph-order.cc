@@ -0,0 +1,278 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "NgramDecoder.hh"
+#include "conf.hh"
+
+using namespace std;
+
+
+// Hardware cache reference and miss counters of this thread,
+// not available without kernel support or permissions
+class CacheCounters {
+public:
+    CacheCounters() {
+        m_references_fd = open_counter(PERF_COUNT_HW_CACHE_REFERENCES);
+        m_misses_fd = open_counter(PERF_COUNT_HW_CACHE_MISSES);
+    }
+    ~CacheCounters() {
+        if (m_references_fd >= 0) close(m_references_fd);
+        if (m_misses_fd >= 0) close(m_misses_fd);
+    }
+    bool available() const { return m_references_fd >= 0 && m_misses_fd >= 0; }
+    void start() {
+        if (!available()) return;
+        ioctl(m_references_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_misses_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_references_fd, PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(m_misses_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    void stop(long long int &references, long long int &misses) {
+        references = misses = -1;
+        if (!available()) return;
+        ioctl(m_references_fd, PERF_EVENT_IOC_DISABLE, 0);
+        ioctl(m_misses_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_references_fd, &references, sizeof(references)) != sizeof(references))
+            references = -1;
+        if (read(m_misses_fd, &misses, sizeof(misses)) != sizeof(misses))
+            misses = -1;
+    }
+
+private:
+    static int open_counter(unsigned long long int counter) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = counter;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    int m_references_fd;
+    int m_misses_fd;
+};
+
+
+class BenchmarkResult {
+public:
+    BenchmarkResult() : seconds(0.0), token_count(0), cache_references(-1), cache_misses(-1) { }
+    double seconds;
+    long long int token_count;
+    long long int cache_references;
+    long long int cache_misses;
+};
+
+
+// Pseudo random acoustic log probability, depends only on the frame and the HMM state
+// so that the search is the same in any node order
+static float
+acoustic_log_prob(int frame_idx,
+                  int hmm_state)
+{
+    unsigned int h = (unsigned int)frame_idx * 2654435761u ^ (unsigned int)hmm_state * 40503u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995;
+    h ^= h >> 15;
+    return -(float)(h % 1024) / 64.0;
+}
+
+
+// Frame synchronous token passing with the HMM transitions and a beam,
+// no language model. Tokens pass through the non-emitting nodes within the frame.
+static BenchmarkResult
+benchmark_propagation(const Decoder &d,
+                      int num_frames,
+                      float beam,
+                      CacheCounters &counters)
+{
+    const float tiny_score = TINY_FLOAT;
+    BenchmarkResult res;
+    int start_node = d.m_decode_start_node != -1 ? d.m_decode_start_node : START_NODE;
+    vector<float> scores(d.m_nodes.size(), tiny_score);
+    vector<float> next_scores(d.m_nodes.size(), tiny_score);
+    vector<float> non_emitting_scores(d.m_nodes.size(), tiny_score);
+    vector<int> active_nodes(1, start_node);
+    vector<int> next_active_nodes;
+    vector<int> visited_non_emitting;
+    vector<pair<int, float> > to_process;
+    scores[start_node] = 0.0;
+
+    counters.start();
+    auto start_time = chrono::steady_clock::now();
+    for (int f=0; f<num_frames; f++) {
+        float best_score = tiny_score;
+        for (auto nit = active_nodes.begin(); nit != active_nodes.end(); ++nit) {
+            to_process.push_back(make_pair(*nit, scores[*nit]));
+            scores[*nit] = tiny_score;
+            while (to_process.size()) {
+                const Decoder::Node &node = d.m_nodes[to_process.back().first];
+                float score = to_process.back().second;
+                to_process.pop_back();
+                for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+                    int target_node = ait->target_node;
+                    float target_score = score + ait->log_prob;
+                    int hmm_state = d.m_nodes[target_node].hmm_state;
+                    if (hmm_state == -1) {
+                        if (target_score <= non_emitting_scores[target_node]) continue;
+                        if (non_emitting_scores[target_node] == tiny_score)
+                            visited_non_emitting.push_back(target_node);
+                        non_emitting_scores[target_node] = target_score;
+                        to_process.push_back(make_pair(target_node, target_score));
+                        continue;
+                    }
+                    target_score += acoustic_log_prob(f, hmm_state);
+                    res.token_count++;
+                    if (next_scores[target_node] == tiny_score)
+                        next_active_nodes.push_back(target_node);
+                    if (target_score > next_scores[target_node]) {
+                        next_scores[target_node] = target_score;
+                        best_score = max(best_score, target_score);
+                    }
+                }
+            }
+        }
+
+        for (auto nit = visited_non_emitting.begin(); nit != visited_non_emitting.end(); ++nit)
+            non_emitting_scores[*nit] = tiny_score;
+        visited_non_emitting.clear();
+
+        active_nodes.clear();
+        for (auto nit = next_active_nodes.begin(); nit != next_active_nodes.end(); ++nit) {
+            if (next_scores[*nit] >= best_score - beam) {
+                scores[*nit] = next_scores[*nit];
+                active_nodes.push_back(*nit);
+            }
+            next_scores[*nit] = tiny_score;
+        }
+        next_active_nodes.clear();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+    counters.stop(res.cache_references, res.cache_misses);
+    res.seconds = elapsed.count();
+
+    return res;
+}
+
+
+static void
+print_benchmark_result(string label,
+                       const BenchmarkResult &res)
+{
+    cerr << label << ": " << res.seconds << " s, tokens: " << res.token_count;
+    if (res.cache_misses >= 0)
+        cerr << ", cache references: " << res.cache_references
+             << ", cache misses: " << res.cache_misses;
+    cerr << endl;
+}
+
+
+// Class look-ahead states are stored by the node index
+static void
+remap_class_la_states(string ifname,
+                      string ofname,
+                      const vector<int> &new_indices)
+{
+    ifstream instatesf(ifname);
+    if (!instatesf) throw string("Problem opening file: " + ifname);
+    string line;
+    int node_count = 0;
+    if (!getline(instatesf, line) || !(stringstream(line) >> node_count)
+            || node_count != (int)new_indices.size())
+        throw string("Look-ahead states file is not for the graph: " + ifname);
+
+    vector<int> la_states(node_count, -1);
+    for (int i=0; i<node_count; i++) {
+        int node_idx = -1, la_state = -1;
+        if (!getline(instatesf, line)) throw string("Problem reading state file");
+        stringstream ss(line);
+        ss >> node_idx >> la_state;
+        if (ss.fail() || node_idx != i) throw string("Problem reading state file");
+        la_states[new_indices[i]] = la_state;
+    }
+
+    ofstream outstatesf(ofname);
+    if (!outstatesf) throw string("Problem opening file: " + ofname);
+    outstatesf << node_count << endl;
+    for (int i=0; i<node_count; i++)
+        outstatesf << i << " " << la_states[i] << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: graph-order [OPTION...] PH GRAPH OUTGRAPH\n"
+           "Renumbers the graph nodes for memory locality, the arc order is kept\n"
+           "so the large bigram look-ahead states files are valid for both graphs\n")
+    ('c', "class-lastates=STRING", "arg", "", "Class look-ahead states file for GRAPH")
+    ('C', "out-class-lastates=STRING", "arg", "", "Class look-ahead states file remapped for OUTGRAPH")
+    ('b', "benchmark", "", "", "Compare token propagation in the original and renumbered graph")
+    ('f', "benchmark-frames=INT", "arg", "500", "Number of frames in the benchmark, DEFAULT: 500")
+    ('B', "benchmark-beam=FLOAT", "arg", "60.0", "Beam in the benchmark, DEFAULT: 60.0")
+    ('h', "help", "", "", "display help");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 3) config.print_help(stderr, 1);
+    if (config["class-lastates"].specified != config["out-class-lastates"].specified) {
+        cerr << "Specify both class look-ahead states files" << endl;
+        exit(1);
+    }
+
+    try {
+        NgramDecoder d;
+
+        string phfname = config.arguments[0];
+        cerr << "Reading hmms: " << phfname << endl;
+        d.read_phone_model(phfname);
+
+        string graphfname = config.arguments[1];
+        cerr << "Reading graph: " << graphfname << endl;
+        d.read_dgraph(graphfname);
+        cerr << "node count: " << d.m_nodes.size() << endl;
+
+        bool benchmark = config["benchmark"].specified;
+        int num_frames = config["benchmark-frames"].get_int();
+        float beam = config["benchmark-beam"].get_float();
+        CacheCounters counters;
+        BenchmarkResult original_res;
+        if (benchmark) original_res = benchmark_propagation(d, num_frames, beam, counters);
+
+        vector<int> new_indices = d.order_nodes_for_locality();
+
+        if (benchmark) {
+            BenchmarkResult ordered_res = benchmark_propagation(d, num_frames, beam, counters);
+            print_benchmark_result("original order", original_res);
+            print_benchmark_result("locality order", ordered_res);
+            if (!counters.available())
+                cerr << "hardware cache counters not available" << endl;
+            else if (original_res.cache_misses > 0)
+                cerr << "cache miss reduction: "
+                     << 100.0 * (original_res.cache_misses - ordered_res.cache_misses)
+                        / original_res.cache_misses << " %" << endl;
+        }
+
+        string outgraphfname = config.arguments[2];
+        cerr << "Writing graph: " << outgraphfname << endl;
+        d.write_dgraph(outgraphfname);
+
+        if (config["class-lastates"].specified) {
+            string outstatesfname = config["out-class-lastates"].get_str();
+            cerr << "Writing look-ahead states: " << outstatesfname << endl;
+            remap_class_la_states(config["class-lastates"].get_str(), outstatesfname, new_indices);
+        }
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+
+    exit(0);
+}
@@ -7,6 +7,7 @@ int main(int argc, char* argv[])
 {
     conf::Config config;
     config("usage: lastates [OPTION...] PH LEXICON GRAPH LALM LASTATES\n")
+    ('p', "num-threads", "arg", "1", "Number of threads used in setting the look-ahead scores")
     ('h', "help", "", "", "display help");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 5) config.print_help(stderr, 1);
@@ -29,7 +30,7 @@ int main(int argc, char* argv[])
 
         string lalmfname = config.arguments[3];
         cerr << "Reading lookahead model: " << lalmfname << endl;
-        LargeBigramLookahead lbla(d, lalmfname);
+        LargeBigramLookahead lbla(d, lalmfname, config["num-threads"].get_int());
 
         string lasfname = config.arguments[4];
         cerr << "Writing lookahead states: " << lasfname << endl;
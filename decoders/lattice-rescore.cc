@@ -0,0 +1,167 @@
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "LatticeRescorer.hh"
+#include "conf.hh"
+
+using namespace std;
+
+
+class RescoringResult {
+public:
+    RescoringResult() : num_nodes(0), num_arcs(0), num_rescored_nodes(0), num_rescored_arcs(0) { }
+    string utterance;
+    string result;
+    Lattice::Hypothesis best_hypo;
+    string error;
+    int num_nodes;
+    int num_arcs;
+    int num_rescored_nodes;
+    int num_rescored_arcs;
+};
+
+
+string
+get_output_fname(string outdir,
+                 string latticefname)
+{
+    size_t slash_pos = latticefname.rfind('/');
+    string name = slash_pos == string::npos ? latticefname : latticefname.substr(slash_pos + 1);
+    return outdir + "/" + name;
+}
+
+
+void
+rescore_lattices(const RescoringLM *lm,
+                 conf::Config *config,
+                 const vector<string> *latticefnames,
+                 vector<RescoringResult> *results,
+                 int thread_idx,
+                 int num_threads)
+{
+    for (int i=thread_idx; i<(int)latticefnames->size(); i += num_threads) {
+        RescoringResult &res = results->at(i);
+        try {
+            string latticefname = latticefnames->at(i);
+            ifstream latticef(latticefname);
+            if (!latticef) throw string("Problem opening file: " + latticefname);
+
+            Lattice lattice;
+            vector<string> text_units;
+            map<string, int> text_unit_map;
+            float lm_scale = 0.0;
+            res.utterance = latticefname;
+            lattice.read_htk(latticef, text_units, text_unit_map, res.utterance, lm_scale);
+            res.num_nodes = lattice.num_nodes();
+            res.num_arcs = lattice.num_arcs();
+            if ((*config)["lm-scale"].specified)
+                lm_scale = (*config)["lm-scale"].get_float();
+
+            LatticeRescorer rescorer(*lm, lm_scale, (*config)["history-length"].get_int());
+            vector<int> word_map = rescorer.get_word_map(text_units);
+            Lattice rescored;
+            res.best_hypo = rescorer.rescore(lattice, word_map, rescored);
+            for (auto wit = res.best_hypo.word_ids.begin(); wit != res.best_hypo.word_ids.end(); ++wit)
+                res.result += " " + text_units[*wit];
+
+            if ((*config)["output-dir"].specified) {
+                if ((*config)["beam"].specified)
+                    rescored.prune(lm_scale, (*config)["beam"].get_float());
+                string outfname = get_output_fname((*config)["output-dir"].get_str(), latticefname);
+                ofstream outf(outfname);
+                if (!outf) throw string("Problem opening file: " + outfname);
+                rescored.write_htk(outf, text_units, res.utterance, lm_scale);
+            }
+            res.num_rescored_nodes = rescored.num_nodes();
+            res.num_rescored_arcs = rescored.num_arcs();
+        } catch (string &e) {
+            res.error = e;
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: lattice-rescore [OPTION...] LM LATTICELIST\n")
+    ('h', "help", "", "", "display help")
+    ('c', "class-memberships=STRING", "arg", "", "Class membership file, LM is a class n-gram model")
+    ('e', "natural-log", "", "", "Use natural logarithm LM scores, DEFAULT: log10")
+    ('s', "lm-scale=FLOAT", "arg", "", "LM scale, DEFAULT: lmscale in the lattices")
+    ('H', "history-length=INT", "arg", "-1", "Maximum number of history words for merging the lattice states, DEFAULT: model order - 1")
+    ('o', "output-dir=STRING", "arg", "", "Directory for the rescored lattices")
+    ('b', "beam=FLOAT", "arg", "", "Beam for pruning the rescored lattices")
+    ('f', "result-file=STRING", "arg", "", "Result file for the best paths, DEFAULT: standard output")
+    ('p', "num-threads=INT", "arg", "1", "Number of threads");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 2) config.print_help(stderr, 1);
+
+    try {
+        string lmfname = config.arguments[0];
+        string latticelistfname = config.arguments[1];
+
+        RescoringLM *lm;
+        if (config["class-memberships"].specified) {
+            cerr << "Reading class n-gram: " << lmfname << endl;
+            lm = new ClassNgramRescoringLM(lmfname, config["class-memberships"].get_str());
+        }
+        else {
+            cerr << "Reading language model: " << lmfname << endl;
+            lm = new NgramRescoringLM(lmfname, config["natural-log"].specified);
+        }
+
+        ifstream latticelistf(latticelistfname);
+        if (!latticelistf) throw string("Problem opening file: " + latticelistfname);
+        vector<string> latticefnames;
+        string latticefname;
+        while (getline(latticelistf, latticefname))
+            if (latticefname.length()) latticefnames.push_back(latticefname);
+        latticelistf.close();
+
+        int num_threads = max(1, config["num-threads"].get_int());
+        vector<RescoringResult> results(latticefnames.size());
+        vector<std::thread*> threads;
+        for (int t=0; t<num_threads; t++)
+            threads.push_back(new std::thread(&rescore_lattices, lm, &config,
+                                              &latticefnames, &results, t, num_threads));
+        for (int t=0; t<num_threads; t++) {
+            threads[t]->join();
+            delete threads[t];
+        }
+
+        ofstream resultf;
+        if (config["result-file"].specified) {
+            resultf.open(config["result-file"].get_str());
+            if (!resultf) throw string("Problem opening file: " + config["result-file"].get_str());
+        }
+        ostream &out = config["result-file"].specified ? resultf : cout;
+        long long int total_nodes = 0, total_arcs = 0, total_rescored_nodes = 0, total_rescored_arcs = 0;
+        int num_errors = 0;
+        for (int i=0; i<(int)results.size(); i++) {
+            if (results[i].error.length() > 0) {
+                cerr << latticefnames[i] << ": " << results[i].error << endl;
+                num_errors++;
+                continue;
+            }
+            out << results[i].utterance << ":" << results[i].result << endl;
+            total_nodes += results[i].num_nodes;
+            total_arcs += results[i].num_arcs;
+            total_rescored_nodes += results[i].num_rescored_nodes;
+            total_rescored_arcs += results[i].num_rescored_arcs;
+        }
+
+        cerr << "number of rescored lattices: " << results.size() - num_errors << endl;
+        cerr << "total lattice nodes: " << total_nodes << "\tarcs: " << total_arcs << endl;
+        cerr << "total rescored lattice nodes: " << total_rescored_nodes
+             << "\tarcs: " << total_rescored_arcs << endl;
+        delete lm;
+        if (num_errors > 0) exit(1);
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+
+    exit(0);
+}
@@ -0,0 +1,58 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "LnaArchive.hh"
+#include "conf.hh"
+
+using namespace std;
+
+
+// Utterance id is the file name without the directory and extension
+string
+get_utterance_id(string lnafname)
+{
+    size_t slash_pos = lnafname.rfind('/');
+    if (slash_pos != string::npos) lnafname = lnafname.substr(slash_pos+1);
+    size_t dot_pos = lnafname.rfind('.');
+    if (dot_pos != string::npos && dot_pos > 0) lnafname = lnafname.substr(0, dot_pos);
+    return lnafname;
+}
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: lna-pack [OPTION...] LNALIST ARCHIVE\n"
+           "LNALIST lines: LNAFILE [UTTID], by default the id is the file name without extension\n")
+    ('h', "help", "", "", "display help");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 2) config.print_help(stderr, 1);
+
+    try {
+        string lnalistfname = config.arguments[0];
+        string archivefname = config.arguments[1];
+
+        ifstream lnalistf(lnalistfname);
+        if (!lnalistf) throw string("Problem opening file: " + lnalistfname);
+        vector<string> lnafnames;
+        vector<string> ids;
+        string line;
+        while (getline(lnalistf, line)) {
+            stringstream ss(line);
+            string lnafname, id;
+            if (!(ss >> lnafname)) continue;
+            if (!(ss >> id)) id = get_utterance_id(lnafname);
+            lnafnames.push_back(lnafname);
+            ids.push_back(id);
+        }
+
+        cerr << "Packing " << lnafnames.size() << " LNA files to " << archivefname << endl;
+        LnaArchive::pack(archivefname, ids, lnafnames);
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+
+    exit(0);
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+
+#include "LnaArchive.hh"
+#include "conf.hh"
+
+using namespace std;
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: lna-unpack [OPTION...] ARCHIVE OUTDIR\n")
+    ('h', "help", "", "", "display help")
+    ('l', "list", "", "", "Only list the utterances with the number of models, bytes per value and frames");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 2 && !(config.arguments.size() == 1 && config["list"].specified))
+        config.print_help(stderr, 1);
+
+    try {
+        string archivefname = config.arguments[0];
+        LnaArchive archive(archivefname);
+        const vector<LnaArchive::Entry> &entries = archive.entries();
+
+        if (config["list"].specified) {
+            for (auto eit = entries.begin(); eit != entries.end(); ++eit)
+                cout << eit->id << " " << eit->num_models << " "
+                     << eit->lna_bytes << " " << eit->num_frames << endl;
+            exit(0);
+        }
+
+        string outdir = config.arguments[1];
+        cerr << "Unpacking " << entries.size() << " LNA files to " << outdir << endl;
+        for (auto eit = entries.begin(); eit != entries.end(); ++eit)
+            archive.extract(*eit, outdir + "/" + eit->id + ".lna");
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+
+    exit(0);
+}
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -5,6 +9,7 @@
 #include "DecoderGraph.hh"
 #include "Segmenter.hh"
 #include "conf.hh"
+#include "decoder-helpers.hh"
 #include "str.hh"
 
 using namespace std;
@@ -13,7 +18,6 @@ using namespace std;
 struct NbestFileEntry {
 public:
     NbestFileEntry() {
-        rescored = false;
         rescore_success = true;
     };
 
@@ -36,21 +40,20 @@ public:
     string original_line;
     string nbest_hypo_text;
     string nbest_hypo_text_cleaned;
-    bool rescored;
     bool rescore_success;
 };
 
 
-vector<int>
-create_forced_path(const DecoderGraph &dg,
-                   vector<DecoderGraph::Node> &nodes,
-                   string &sentstr,
-                   map<int, string> &node_labels,
-                   bool breaking_short_silence,
-                   bool breaking_long_silence,
-                   bool subwords_with_word_boundary)
+// Triphones of a hypothesis with short silences between the words,
+// the word ids are set on the word final triphones.
+// Returns false if the hypothesis can not be converted.
+bool
+get_hypothesis_triphones(const DecoderGraph &dg,
+                         const string &sentstr,
+                         bool subwords_with_word_boundary,
+                         vector<TriphoneNode> &tnodes)
 {
-    vector<int> end_nodes;
+    tnodes.clear();
     vector<string> triphones;
     vector<int> wordIndices;
     stringstream fls(sentstr);
@@ -61,13 +64,13 @@ create_forced_path(const DecoderGraph &dg,
         while (fls >> subword) {
             if (dg.m_lexicon.find(subword) == dg.m_lexicon.end()) {
                 cerr << "error: " << subword << " was not found in the lexicon" << endl;
-                return end_nodes;
+                return false;
             }
 
             if (subword == "<w>") {
                 if (curr_word_triphones.size() == 1) {
                     cerr << "error: one phone word " << curr_word_triphones[0] << endl;
-                    return end_nodes;
+                    return false;
                 }
 
                 if (curr_word_triphones.size() > 0) {
@@ -95,13 +98,13 @@ create_forced_path(const DecoderGraph &dg,
         while (fls >> wrd) {
             if (dg.m_lexicon.find(wrd) == dg.m_lexicon.end()) {
                 cerr << "error: " << wrd << " was not found in the lexicon" << endl;
-                return end_nodes;
+                return false;
             }
 
             const vector <string> &wt = dg.m_lexicon.at(wrd);
             if (wt.size() == 1) {
                 cerr << "error: one phone word " << wrd << endl;
-                return end_nodes;
+                return false;
             }
             if (triphones.size())
                 triphones.push_back(SHORT_SIL);
@@ -110,7 +113,7 @@ create_forced_path(const DecoderGraph &dg,
             wordIndices.push_back(dg.m_subword_map.at(wrd));
         }
     }
-    if (wordIndices.size() == 0) return end_nodes;
+    if (wordIndices.size() == 0 || triphones.size() == 0) return true;
 
     for (int i=1; i<(int)triphones.size()-1; i++) {
         if (triphones[i] == SHORT_SIL) {
@@ -119,8 +122,7 @@ create_forced_path(const DecoderGraph &dg,
         }
     }
 
-    // Create initial triphone graph only with crossword context
-    vector<TriphoneNode> tnodes;
+    // Triphones only with crossword context
     int wordPosition = 0;
     for (auto tit=triphones.begin(); tit != triphones.end(); ++tit) {
         if (*tit == SHORT_SIL)
@@ -129,6 +131,37 @@ create_forced_path(const DecoderGraph &dg,
     }
     tnodes.back().subword_id = wordIndices[wordPosition];
 
+    return true;
+}
+
+
+class PrefixTreeElement {
+public:
+    PrefixTreeElement() : parent(-1), first_node(-1), last_node(-1) { }
+    TriphoneNode tnode;
+    int parent;
+    int first_node;
+    int last_node;
+    // Children by hmm id and word id
+    map<pair<int, int>, int> children;
+    // Short and long silence paths for hypotheses ending in this element
+    vector<int> end_first_nodes;
+    vector<int> end_nodes;
+};
+
+
+// Forced alignment graph of the hypotheses as a prefix tree of triphones.
+// Returns the end nodes of each hypothesis, empty for hypotheses without triphones.
+vector<vector<int> >
+create_forced_prefix_tree(const DecoderGraph &dg,
+                          vector<DecoderGraph::Node> &nodes,
+                          const vector<vector<TriphoneNode> > &hypotheses,
+                          map<int, string> &node_labels,
+                          bool breaking_short_silence,
+                          bool breaking_long_silence)
+{
+    vector<vector<int> > end_nodes(hypotheses.size());
+
     nodes.clear();
     nodes.resize(1);
     node_labels.clear();
@@ -136,47 +169,74 @@ create_forced_path(const DecoderGraph &dg,
     int initial_ss_idx = dg.connect_triphone(nodes, dg.m_hmm_map.at(SHORT_SIL), start_idx, node_labels);
     int initial_ls_idx = dg.connect_triphone(nodes, dg.m_hmm_map.at(LONG_SIL), start_idx, node_labels);
     int word_start_idx = dg.connect_dummy(nodes, initial_ss_idx);
-    int idx = word_start_idx;
     nodes[initial_ls_idx].arcs.insert(word_start_idx);
 
-    map<int, string> wordLabels;
-    for (int t=0; t<(int)tnodes.size(); t++) {
-        idx = dg.connect_triphone(nodes, tnodes[t].hmm_id, idx, node_labels);
-        if (tnodes[t].subword_id != -1) {
-            wordLabels[idx] = dg.m_subwords[tnodes[t].subword_id];
-            node_labels[idx] += " " + dg.m_subwords[tnodes[t].subword_id];
+    vector<PrefixTreeElement> tree(1);
+    tree[0].last_node = word_start_idx;
+    for (int h=0; h<(int)hypotheses.size(); h++) {
+        if (hypotheses[h].size() == 0) continue;
+        int el = 0;
+        for (auto tit = hypotheses[h].begin(); tit != hypotheses[h].end(); ++tit) {
+            pair<int, int> key = make_pair(tit->hmm_id, tit->subword_id);
+            auto cit = tree[el].children.find(key);
+            if (cit != tree[el].children.end()) {
+                el = cit->second;
+                continue;
+            }
+            PrefixTreeElement child;
+            child.tnode = *tit;
+            child.parent = el;
+            child.first_node = nodes.size();
+            child.last_node = dg.connect_triphone(nodes, tit->hmm_id, tree[el].last_node, node_labels);
+            if (tit->subword_id != -1)
+                node_labels[child.last_node] += " " + dg.m_subwords[tit->subword_id];
+            tree[el].children[key] = tree.size();
+            el = tree.size();
+            tree.push_back(child);
         }
+
+        PrefixTreeElement &leaf = tree[el];
+        if (leaf.end_nodes.size() == 0) {
+            leaf.end_first_nodes.push_back(nodes.size());
+            leaf.end_nodes.push_back(
+                dg.connect_triphone(nodes, dg.m_hmm_map.at(SHORT_SIL), leaf.last_node, node_labels));
+            leaf.end_first_nodes.push_back(nodes.size());
+            leaf.end_nodes.push_back(
+                dg.connect_triphone(nodes, dg.m_hmm_map.at(LONG_SIL), leaf.last_node, node_labels));
+        }
+        end_nodes[h] = leaf.end_nodes;
     }
 
-    int word_end_idx = idx;
-    int end_ss_idx = dg.connect_triphone(nodes, dg.m_hmm_map.at(SHORT_SIL), word_end_idx, node_labels);
-    int end_ls_idx = dg.connect_triphone(nodes, dg.m_hmm_map.at(LONG_SIL), word_end_idx, node_labels);
-    end_nodes.push_back(end_ss_idx);
-    end_nodes.push_back(end_ls_idx);
-
-    if (breaking_short_silence || breaking_long_silence) {
-        for (int i=word_start_idx; i<word_end_idx; i++) {
-            if (node_labels.find(i) == node_labels.end()
-                || node_labels[i] != "_.0") continue;
-
-            string left_triphone = node_labels[i-1].substr(0, 5);
-            left_triphone[4] = SIL_CTXT;
-            string right_triphone = node_labels[i+1].substr(0, 5);
-            right_triphone[0] = SIL_CTXT;
-
-            int left_idx = dg.connect_triphone(nodes, left_triphone, i-4, node_labels);
-            if (wordLabels.find(i-1) != wordLabels.end())
-                node_labels[left_idx] += " " + wordLabels[i-1];
-
-            if (breaking_short_silence) {
-                int idx = dg.connect_triphone(nodes, SHORT_SIL, left_idx, node_labels);
-                idx = dg.connect_triphone(nodes, right_triphone, idx, node_labels);
-                nodes[idx].arcs.insert(i+4);
-            }
-            if (breaking_long_silence) {
-                int idx = dg.connect_triphone(nodes, LONG_SIL, left_idx, node_labels);
-                idx = dg.connect_triphone(nodes, right_triphone, idx, node_labels);
-                nodes[idx].arcs.insert(i+4);
+    if (!breaking_short_silence && !breaking_long_silence) return end_nodes;
+
+    // Silence paths between words replacing the crossword contexts
+    vector<string> silences;
+    if (breaking_short_silence) silences.push_back(SHORT_SIL);
+    if (breaking_long_silence) silences.push_back(LONG_SIL);
+    int short_sil_hmm_id = dg.m_hmm_map.at(SHORT_SIL);
+    int num_elements = tree.size();
+    for (int el=1; el<num_elements; el++) {
+        if (tree[el].tnode.hmm_id != short_sil_hmm_id) continue;
+        const PrefixTreeElement &left = tree[tree[el].parent];
+        if (left.parent < 0) continue;
+
+        string left_triphone = dg.m_hmms[left.tnode.hmm_id].label;
+        left_triphone[4] = SIL_CTXT;
+        int left_idx = dg.connect_triphone(nodes, left_triphone, tree[left.parent].last_node, node_labels);
+        if (left.tnode.subword_id != -1)
+            node_labels[left_idx] += " " + dg.m_subwords[left.tnode.subword_id];
+
+        for (auto sit = silences.begin(); sit != silences.end(); ++sit) {
+            int sil_idx = dg.connect_triphone(nodes, *sit, left_idx, node_labels);
+            for (auto cit = tree[el].children.begin(); cit != tree[el].children.end(); ++cit) {
+                const PrefixTreeElement &right = tree[cit->second];
+                string right_triphone = dg.m_hmms[right.tnode.hmm_id].label;
+                right_triphone[0] = SIL_CTXT;
+                int idx = dg.connect_triphone(nodes, right_triphone, sil_idx, node_labels);
+                for (auto rcit = right.children.begin(); rcit != right.children.end(); ++rcit)
+                    nodes[idx].arcs.insert(tree[rcit->second].first_node);
+                for (auto enit = right.end_first_nodes.begin(); enit != right.end_first_nodes.end(); ++enit)
+                    nodes[idx].arcs.insert(*enit);
             }
         }
     }
@@ -236,33 +296,32 @@ print_dot_digraph(vector<Decoder::Node> &nodes,
 }
 
 
+// Sets the forced alignment graph to the segmenter
 void
-rescore_nbest_entry(Segmenter &s,
+set_segmenter_graph(Segmenter &s,
                     const DecoderGraph &dg,
-                    const conf::Config &config,
-                    NbestFileEntry &curr_entry)
+                    vector<DecoderGraph::Node> &nodes,
+                    const vector<vector<int> > &end_nodes)
 {
-    int info_level = config["info"].get_int();
-    bool attempt_once = config["attempt-once"].specified;
-
-    vector<DecoderGraph::Node> nodes;
-    map<int, string> node_labels;
-    vector <int> end_node_idxs = create_forced_path(
-                                       dg, nodes, curr_entry.nbest_hypo_text_cleaned, node_labels,
-                                       config["short-silence"].specified,
-                                       config["long-silence"].specified,
-                                       config["subwords-with-word-boundary"].specified);
-    if (end_node_idxs.size() == 0) {
-        cerr << "Problem creating forced path for line: " << curr_entry.original_line << endl;
-        exit(EXIT_FAILURE);
-    }
-
     dg.add_hmm_self_transitions(nodes);
     convert_nodes_for_decoder(nodes, s.m_nodes);
     s.set_hmm_transition_probs();
     s.m_decode_start_node = 0;
-    s.m_decode_end_nodes = end_node_idxs;
+    s.m_decode_end_nodes.clear();
+    for (auto enit = end_nodes.begin(); enit != end_nodes.end(); ++enit)
+        s.m_decode_end_nodes.insert(s.m_decode_end_nodes.end(), enit->begin(), enit->end());
+}
+
 
+// Segments the LNA once with the segmenter graph,
+// returns the best log probability of each end node set
+vector<float>
+segment_hypotheses(Segmenter &s,
+                   map<int, string> &node_labels,
+                   const vector<vector<int> > &end_nodes,
+                   LnaBuffer &lna,
+                   int info_level)
+{
     /*
     ofstream dotf("graph.dot");
     print_dot_digraph(s.m_nodes, dotf, node_labels);
@@ -270,34 +329,186 @@ rescore_nbest_entry(Segmenter &s,
     exit(0);
     */
 
-    int attempts = 0;
-    float rescored_am_log_prob;
-    while (true) {
-        rescored_am_log_prob = s.segment_lna_file(curr_entry.lna_fname, node_labels, nullptr, 0);
-        attempts++;
-        if (rescored_am_log_prob > float(TINY_FLOAT)) {
-            if (info_level > 0) cerr << "log prob: " << rescored_am_log_prob << endl;
-            break;
-        } else if (attempts >= 5 || attempt_once) {
-            break;
+    s.segment(lna, node_labels, nullptr, info_level);
+
+    vector<float> log_probs(end_nodes.size(), TINY_FLOAT);
+    for (int i=0; i<(int)end_nodes.size(); i++)
+        for (auto nit = end_nodes[i].begin(); nit != end_nodes[i].end(); ++nit)
+            log_probs[i] = max(log_probs[i], s.get_node_log_prob(*nit));
+    return log_probs;
+}
+
+
+// Consecutive n-best entries of one LNA file
+class NbestUtterance {
+public:
+    NbestUtterance() : idx(-1), lna_read(false), rescored(false) { }
+    int idx;
+    string lna_fname;
+    vector<NbestFileEntry> entries;
+    LnaBuffer lna;
+    bool lna_read;
+    bool rescored;
+};
+
+
+// Utterances in input order from the input reader to the rescoring
+// threads and the in-order writer. Utterances are kept until written,
+// the input reader blocks while the queue is full.
+class RescoreQueue {
+public:
+    RescoreQueue(int max_utterances, long long int lna_memory_budget)
+        : m_max_utterances(max(1, max_utterances)),
+          m_lna_memory_budget(lna_memory_budget),
+          m_queued_lna_bytes(0),
+          m_next_to_rescore(0),
+          m_input_ended(false) { }
+
+    ~RescoreQueue() {
+        for (auto uit = m_utterances.begin(); uit != m_utterances.end(); ++uit)
+            delete *uit;
+    }
+
+    void push(NbestUtterance *utterance) {
+        unique_lock<mutex> lock(m_mutex);
+        m_space_cv.wait(lock, [this] {
+            return (int)m_utterances.size() < m_max_utterances
+                   && (m_queued_lna_bytes < m_lna_memory_budget
+                       || m_next_to_rescore == (int)m_utterances.size());
+        });
+        m_queued_lna_bytes += utterance->lna.size_in_bytes();
+        m_utterances.push_back(utterance);
+        m_work_cv.notify_one();
+    }
+
+    void end_input() {
+        lock_guard<mutex> lock(m_mutex);
+        m_input_ended = true;
+        m_work_cv.notify_all();
+        m_done_cv.notify_all();
+    }
+
+    // Next utterance to rescore, nullptr after all utterances have been taken
+    NbestUtterance* get_work() {
+        unique_lock<mutex> lock(m_mutex);
+        m_work_cv.wait(lock, [this] {
+            return m_input_ended || m_next_to_rescore < (int)m_utterances.size();
+        });
+        if (m_next_to_rescore >= (int)m_utterances.size()) return nullptr;
+        NbestUtterance *utterance = m_utterances[m_next_to_rescore++];
+        m_queued_lna_bytes -= utterance->lna.size_in_bytes();
+        m_space_cv.notify_all();
+        return utterance;
+    }
+
+    void set_rescored(NbestUtterance *utterance) {
+        lock_guard<mutex> lock(m_mutex);
+        utterance->rescored = true;
+        m_done_cv.notify_all();
+    }
+
+    // Blocks until the first unwritten utterance has been rescored,
+    // nullptr after all utterances have been written
+    NbestUtterance* get_rescored() {
+        unique_lock<mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this] {
+            return (m_utterances.size() > 0 && m_utterances.front()->rescored)
+                   || (m_input_ended && m_utterances.size() == 0);
+        });
+        if (m_utterances.size() == 0) return nullptr;
+        return m_utterances.front();
+    }
+
+    // Frees the first utterance after it has been written
+    void pop_written() {
+        lock_guard<mutex> lock(m_mutex);
+        delete m_utterances.front();
+        m_utterances.pop_front();
+        m_next_to_rescore--;
+        m_space_cv.notify_all();
+    }
+
+private:
+    int m_max_utterances;
+    long long int m_lna_memory_budget;
+    long long int m_queued_lna_bytes;
+    deque<NbestUtterance*> m_utterances;
+    int m_next_to_rescore;
+    bool m_input_ended;
+    mutex m_mutex;
+    condition_variable m_space_cv;
+    condition_variable m_work_cv;
+    condition_variable m_done_cv;
+};
+
+
+// Rescores all hypotheses of one utterance in one pass over the LNA,
+// hypotheses pruned from the prefix tree are retried alone with increasing beams
+void
+rescore_utterance(Segmenter &s,
+                  const DecoderGraph &dg,
+                  const conf::Config &config,
+                  NbestUtterance &utterance)
+{
+    int info_level = config["info"].get_int();
+    bool attempt_once = config["attempt-once"].specified;
+    bool breaking_short_silence = config["short-silence"].specified;
+    bool breaking_long_silence = config["long-silence"].specified;
+
+    vector<vector<TriphoneNode> > hypotheses(utterance.entries.size());
+    for (int i=0; i<(int)utterance.entries.size(); i++) {
+        NbestFileEntry &curr_entry = utterance.entries[i];
+        if (!get_hypothesis_triphones(dg, curr_entry.nbest_hypo_text_cleaned,
+                                      config["subwords-with-word-boundary"].specified,
+                                      hypotheses[i])) {
+            cerr << "Problem creating forced path for line: " << curr_entry.original_line << endl;
+            exit(EXIT_FAILURE);
         }
-        s.m_global_beam *= 2.0;
-        s.m_token_limit *= 2;
-        if (info_level > 1)
-            cerr << "trying beam " << s.m_global_beam << " and maximum tokens " << s.m_token_limit << endl;
     }
-    s.m_global_beam = config["global-beam"].get_float();
-    s.m_token_limit = config["max-tokens"].get_int();
 
-    if (rescored_am_log_prob > float(TINY_FLOAT)) {
-        curr_entry.rescored_am_prob = rescored_am_log_prob;
-        curr_entry.rescored = true;
-        curr_entry.rescore_success = true;
-    } else {
-        if (info_level > 0)
-            cerr << "warning, could not find segmentation for line: " << curr_entry.original_line << endl;
-        curr_entry.rescored = true;
-        curr_entry.rescore_success = false;
+    if (!utterance.lna_read) {
+        utterance.lna.read_lna_file(utterance.lna_fname);
+        utterance.lna_read = true;
+    }
+
+    vector<DecoderGraph::Node> nodes;
+    map<int, string> node_labels;
+    vector<vector<int> > end_nodes = create_forced_prefix_tree(dg, nodes, hypotheses, node_labels,
+                                                               breaking_short_silence, breaking_long_silence);
+    if (info_level > 1)
+        cerr << "prefix tree for " << hypotheses.size() << " hypotheses: " << nodes.size() << " nodes" << endl;
+    set_segmenter_graph(s, dg, nodes, end_nodes);
+    vector<float> log_probs = segment_hypotheses(s, node_labels, end_nodes, utterance.lna, info_level-1);
+
+    for (int i=0; i<(int)utterance.entries.size(); i++) {
+        NbestFileEntry &curr_entry = utterance.entries[i];
+        float rescored_am_log_prob = log_probs[i];
+
+        // Hypotheses pruned in the shared pass are aligned alone starting from
+        // the widened beams, the segmenter widens the beams further if needed
+        if (hypotheses[i].size() > 0 && rescored_am_log_prob <= float(TINY_FLOAT) && !attempt_once) {
+            vector<vector<TriphoneNode> > hypothesis(1, hypotheses[i]);
+            end_nodes = create_forced_prefix_tree(dg, nodes, hypothesis, node_labels,
+                                                  breaking_short_silence, breaking_long_silence);
+            set_segmenter_graph(s, dg, nodes, end_nodes);
+            float global_beam = s.m_global_beam;
+            int token_limit = s.m_token_limit;
+            s.m_global_beam *= s.m_beam_growth;
+            s.m_token_limit *= 2;
+            rescored_am_log_prob = segment_hypotheses(s, node_labels, end_nodes, utterance.lna, info_level-1)[0];
+            s.m_global_beam = global_beam;
+            s.m_token_limit = token_limit;
+        }
+
+        if (rescored_am_log_prob > float(TINY_FLOAT)) {
+            if (info_level > 0) cerr << "log prob: " << rescored_am_log_prob << endl;
+            curr_entry.rescored_am_prob = rescored_am_log_prob;
+            curr_entry.rescore_success = true;
+        } else {
+            if (info_level > 0)
+                cerr << "warning, could not find segmentation for line: " << curr_entry.original_line << endl;
+            curr_entry.rescore_success = false;
+        }
     }
 }
 
@@ -305,18 +516,106 @@ rescore_nbest_entry(Segmenter &s,
 void
 start_rescore_worker(
     Segmenter &s,
-    vector<NbestFileEntry> &nbest_entries,
+    RescoreQueue &queue,
     const DecoderGraph &dg,
-    const conf::Config &config,
-    int thread_idx,
-    int num_threads)
+    const conf::Config &config)
 {
-    for (int i=0; i<(int)nbest_entries.size(); i++) {
-        if (i % num_threads == thread_idx) {
-            cerr << i + 1 << "/" << nbest_entries.size() << " ";
-            rescore_nbest_entry(s, dg, config, nbest_entries[i]);
+    while (true) {
+        NbestUtterance *utterance = queue.get_work();
+        if (utterance == nullptr) return;
+        cerr << utterance->idx + 1 << " ";
+        try {
+            rescore_utterance(s, dg, config, *utterance);
+        } catch (string &e) {
+            cerr << e << endl;
+            exit(EXIT_FAILURE);
+        }
+        queue.set_rescored(utterance);
+    }
+}
+
+
+// Parses one n-best line, returns false for lines to skip
+bool
+parse_nbest_line(const string &nbest_line,
+                 NbestFileEntry &curr_entry)
+{
+    curr_entry.original_line.assign(nbest_line);
+    stringstream nbest_line_ss(nbest_line);
+    nbest_line_ss
+            >> curr_entry.lna_fname
+            >> curr_entry.original_log_prob
+            >> curr_entry.original_am_prob
+            >> curr_entry.original_lm_prob
+            >> curr_entry.num_words
+            >> std::ws;
+
+    if (curr_entry.num_words == 0) {
+        cerr << "Skipping empty hypothesis: " << nbest_line << endl;
+        return false;
+    }
+
+    getline(nbest_line_ss, curr_entry.nbest_hypo_text);
+    if (nbest_line_ss.fail()) {
+        cerr << "Problem parsing line: " << nbest_line << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    curr_entry.nbest_hypo_text_cleaned.assign(curr_entry.nbest_hypo_text);
+    string se_symbol(" </s>");
+    while(curr_entry.nbest_hypo_text_cleaned.find(se_symbol) != std::string::npos)
+        curr_entry.nbest_hypo_text_cleaned.replace(curr_entry.nbest_hypo_text_cleaned.find(se_symbol),
+                                                   se_symbol.size(), "");
+    return true;
+}
+
+
+// Streams the n-best file to the queue grouping consecutive lines
+// of the same LNA file, LNA files are read here if reading ahead
+void
+read_nbest_file(string nbest_fname,
+                RescoreQueue &queue,
+                bool read_lnas,
+                double &lm_scale)
+{
+    try {
+        SimpleFileInput nbest_file(nbest_fname);
+        string nbest_line;
+        NbestUtterance *utterance = nullptr;
+        int num_utterances = 0;
+        bool lm_scale_set = false;
+        while (true) {
+            NbestFileEntry curr_entry;
+            bool line_read = nbest_file.getline(nbest_line);
+            if (line_read && !parse_nbest_line(nbest_line, curr_entry)) continue;
+
+            if (utterance != nullptr && (!line_read || curr_entry.lna_fname != utterance->lna_fname)) {
+                if (read_lnas) {
+                    utterance->lna.read_lna_file(utterance->lna_fname);
+                    utterance->lna_read = true;
+                }
+                queue.push(utterance);
+                utterance = nullptr;
+            }
+            if (!line_read) break;
+
+            if (!lm_scale_set) {
+                lm_scale = (curr_entry.original_log_prob - curr_entry.original_am_prob)
+                           / curr_entry.original_lm_prob;
+                lm_scale_set = true;
+            }
+            if (utterance == nullptr) {
+                utterance = new NbestUtterance();
+                utterance->idx = num_utterances++;
+                utterance->lna_fname = curr_entry.lna_fname;
+            }
+            utterance->entries.push_back(curr_entry);
         }
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(EXIT_FAILURE);
     }
+    queue.end_input();
 }
 
 
@@ -332,6 +631,9 @@ int main(int argc, char* argv[])
             ('m', "max-tokens=INT", "arg", "500", "Maximum number of active tokens, DEFAULT: 500")
             ('o', "attempt-once", "", "", "Attempt segmentation only once without increasing beams")
             ('t', "num-threads", "arg", "1", "Number of threads")
+            ('q', "queue-size=INT", "arg", "0", "Maximum number of utterances in memory, DEFAULT: 4 per thread and the LNA files read ahead")
+            ('a', "lna-prefetch=INT", "arg", "0", "Number of LNA files read ahead in the input thread, DEFAULT: 0")
+            ('A', "lna-prefetch-memory=INT", "arg", "1024", "Memory budget for the LNA files read ahead in MB, DEFAULT: 1024")
             ('w', "subwords-with-word-boundary", "", "",
                     "Subword lexicon with the word boundary symbol <w>, otherwise a word lexicon is assumed")
             ('i', "info=INT", "arg", "0", "Info level, DEFAULT: 0");
@@ -344,7 +646,7 @@ int main(int argc, char* argv[])
         string nbest_fname = config.arguments[2];
         string rescored_nbest_fname = config.arguments[3];
         int info_level = config["info"].get_int();
-        int num_threads = config["num-threads"].get_int();
+        int num_threads = max(1, config["num-threads"].get_int());
 
         DecoderGraph dg;
         dg.read_phone_model(ph_fname);
@@ -356,77 +658,49 @@ int main(int argc, char* argv[])
             if (info_level > 0) cerr << "Initializing segmenter " << t << endl;
             segmenters[t].m_global_beam = config["global-beam"].get_float();
             segmenters[t].m_token_limit = config["max-tokens"].get_int();
+            segmenters[t].m_max_attempts = config["attempt-once"].specified ? 1 : 5;
+            segmenters[t].m_beam_growth = 2.0;
             segmenters[t].read_phone_model(ph_fname);
             if (config["duration-model"].specified)
                 segmenters[t].read_duration_model(config["duration-model"].get_str());
         }
 
-        SimpleFileInput nbest_file(nbest_fname);
-        string nbest_line;
-        double lm_scale = 0.0;
-        vector<NbestFileEntry> nbest_entries;
-        while (nbest_file.getline(nbest_line)) {
-            NbestFileEntry curr_entry;
-            curr_entry.original_line.assign(nbest_line);
-            stringstream nbest_line_ss(nbest_line);
-            nbest_line_ss
-                    >> curr_entry.lna_fname
-                    >> curr_entry.original_log_prob
-                    >> curr_entry.original_am_prob
-                    >> curr_entry.original_lm_prob
-                    >> curr_entry.num_words
-                    >> std::ws;
-
-            if (curr_entry.num_words == 0) {
-                cerr << "Skipping empty hypothesis: " << nbest_line << endl;
-                continue;
-            }
+        int lna_prefetch = max(0, config["lna-prefetch"].get_int());
+        int queue_size = config["queue-size"].get_int();
+        if (queue_size <= 0) queue_size = 4 * num_threads + lna_prefetch;
+        long long int lna_memory_budget = config["lna-prefetch-memory"].get_int() * 1024LL * 1024LL;
+        RescoreQueue queue(queue_size, lna_prefetch > 0 ? lna_memory_budget : 0);
 
-            getline(nbest_line_ss, curr_entry.nbest_hypo_text);
-            if (nbest_line_ss.fail()) {
-                cerr << "Problem parsing line: " << nbest_line << endl;
-                exit(EXIT_FAILURE);
-            }
-
-            curr_entry.nbest_hypo_text_cleaned.assign(curr_entry.nbest_hypo_text);
-            string se_symbol(" </s>");
-            while(curr_entry.nbest_hypo_text_cleaned.find(se_symbol) != std::string::npos)
-                curr_entry.nbest_hypo_text_cleaned.replace(curr_entry.nbest_hypo_text_cleaned.find(se_symbol),
-                                                           se_symbol.size(), "");
-
-            if (nbest_entries.size() == 0)
-                lm_scale = (curr_entry.original_log_prob - curr_entry.original_am_prob)
-                           / curr_entry.original_lm_prob;
-            nbest_entries.push_back(curr_entry);
-        }
+        double lm_scale = 0.0;
+        thread input_thread(&read_nbest_file, nbest_fname, std::ref(queue),
+                            lna_prefetch > 0, std::ref(lm_scale));
 
         vector<std::thread*> threads;
         for (int t=0; t<num_threads; t++) {
             thread *thr = new std::thread(&start_rescore_worker,
                                           std::ref(segmenters[t]),
-                                          std::ref(nbest_entries),
+                                          std::ref(queue),
                                           std::cref(dg),
-                                          std::cref(config),
-                                          t,
-                                          num_threads);
+                                          std::cref(config));
             threads.push_back(thr);
         }
 
-        int curr_line_idx = 0;
         SimpleFileOutput rescored_nbest_file(rescored_nbest_fname);
-        while (curr_line_idx < (int)nbest_entries.size()) {
-            if (nbest_entries[curr_line_idx].rescored) {
-                if (nbest_entries[curr_line_idx].rescore_success)
-                    nbest_entries[curr_line_idx].print_rescored_entry(rescored_nbest_file, lm_scale);
-                curr_line_idx++;
-            }
-            else sleep(2);
+        while (true) {
+            NbestUtterance *utterance = queue.get_rescored();
+            if (utterance == nullptr) break;
+            for (auto eit = utterance->entries.begin(); eit != utterance->entries.end(); ++eit)
+                if (eit->rescore_success)
+                    eit->print_rescored_entry(rescored_nbest_file, lm_scale);
+            queue.pop_written();
         }
         rescored_nbest_file.close();
 
-        for (int t=0; t<num_threads; t++)
+        input_thread.join();
+        for (int t=0; t<num_threads; t++) {
             threads[t]->join();
-
+            delete threads[t];
+        }
 
     } catch (string &e) {
         cerr << e << endl;
@@ -3,7 +3,9 @@
 #include "SubwordGraph.hh"
 #include "LWBSubwordGraph.hh"
 #include "NgramDecoder.hh"
+#include "LnaArchive.hh"
 #include "conf.hh"
+#include "decoder-helpers.hh"
 
 using namespace std;
 
@@ -28,6 +30,12 @@ read_config(NgramDecoder &d, string cfgfname)
         else if (parameter == "word_end_beam") ss >> d.m_word_end_beam;
         else if (parameter == "node_beam") ss >> d.m_node_beam;
         else if (parameter == "history_clean_frame_interval") ss >> d.m_history_clean_frame_interval;
+        else if (parameter == "frame_skip") ss >> d.m_frame_skip;
+        else if (parameter == "frame_skip_combination") {
+            string combination;
+            ss >> combination;
+            d.m_frame_skip_combination = FrameSkipAcoustics::get_combination(combination);
+        }
         else if (parameter == "force_sentence_end") {
             string force_str;
             ss >> force_str;
@@ -95,7 +103,9 @@ int main(int argc, char* argv[])
     conf::Config config;
     config("usage: score [OPTION...] PH LEXICON SUBWORD_LM CFGFILE LNALIST RESLIST\n")
     ('h', "help", "", "", "display help")
-    ('d', "duration-model=STRING", "arg", "", "Duration model");
+    ('d', "duration-model=STRING", "arg", "", "Duration model")
+    ('a', "lna-prefetch=INT", "arg", "0", "Number of LNA files read ahead in background threads, DEFAULT: 0")
+    ('A', "lna-prefetch-memory=INT", "arg", "1024", "Memory budget for the LNA files read ahead in MB, DEFAULT: 1024");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 6) config.print_help(stderr, 1);
 
@@ -135,16 +145,32 @@ int main(int argc, char* argv[])
         ifstream reslistf(reslistfname);
         string resline;
 
+        vector<string> lnafnames;
+        vector<string> reslines;
+        while (getline(lnalistf, lnafname)) {
+            getline(reslistf, resline);
+            if (!lnafname.length()) continue;
+            // Whole archive takes one result line per utterance
+            vector<string> utt_lnafnames = LnaArchive::expand_lna_fnames(vector<string>(1, lnafname));
+            for (int u=0; u<(int)utt_lnafnames.size(); u++) {
+                if (u > 0) getline(reslistf, resline);
+                lnafnames.push_back(utt_lnafnames[u]);
+                reslines.push_back(resline);
+            }
+        }
+        lnalistf.close();
+
         int file_count = 0;
 
         DecoderGraph *dg = new SubwordGraph();
         dg->read_phone_model(phfname);
         dg->read_noway_lexicon(lexfname);
 
+        LnaPrefetcher *prefetcher = get_lna_prefetcher(config, lnafnames);
         TotalRecognitionStats total;
-        while (getline(lnalistf, lnafname)) {
-            getline(reslistf, resline);
-            if (!lnafname.length()) continue;
+        for (int i=0; i<(int)lnafnames.size(); i++) {
+            lnafname = lnafnames[i];
+            resline = reslines[i];
             cerr << endl << "scoring: " << lnafname << endl;
 
             vector<string> reswordstrs;
@@ -164,12 +190,20 @@ int main(int argc, char* argv[])
 
             NgramRecognition recognition(d);
             RecognitionResult result;
-            recognition.recognize_lna_file(lnafname, result);
+            if (prefetcher != nullptr) {
+                double wait_time;
+                LnaBuffer lna = prefetcher->get(i, wait_time);
+                recognition.recognize(lna, result);
+                result.io_wait_time = wait_time;
+                prefetcher->release(i);
+            }
+            else
+                recognition.recognize_lna_file(lnafname, result);
             result.print_file_stats(cerr);
             total.accumulate(result);
             file_count++;
         }
-        lnalistf.close();
+        delete prefetcher;
 
         cerr << endl;
         cerr << file_count << " files scored" << endl;
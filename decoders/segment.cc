@@ -273,7 +273,8 @@ int main(int argc, char* argv[])
         s.m_global_beam = config["global-beam"].get_float();
         s.m_token_limit = config["max-tokens"].get_int();
         int info_level = config["info"].get_int();
-        bool attempt_once = config["attempt-once"].specified;
+        s.m_max_attempts = config["attempt-once"].specified ? 1 : 3;
+        s.m_beam_growth = 1.5;
 
         if (!config["text-field"].specified &&
                 (config["long-silence"].specified || config["short-silence"].specified))
@@ -368,24 +369,11 @@ int main(int argc, char* argv[])
             */
 
             ofstream phnf(recipe_fields["alignment"]);
-            int attempts = 0;
-            while (true) {
-                float log_prob = s.segment_lna_file(lna_file, node_labels, &phnf);
-                attempts++;
-                if (log_prob > float(TINY_FLOAT)) {
-                    if (info_level > 0) cerr << "log prob: " << log_prob << endl;
-                    break;
-                } else if (attempts >= 3 || attempt_once) {
-                    cerr << "giving up" << endl;
-                    break;
-                }
-                s.m_global_beam *= 1.5;
-                s.m_token_limit *= 2;
-                cerr << "increasing beam to " << s.m_global_beam << endl;
-                cerr << "doubling maximum number of tokens to " << s.m_token_limit << endl;
+            float log_prob = s.segment_lna_file(lna_file, node_labels, &phnf, 1);
+            if (log_prob > float(TINY_FLOAT)) {
+                if (info_level > 0) cerr << "log prob: " << log_prob << endl;
             }
-            s.m_global_beam = config["global-beam"].get_float();
-            s.m_token_limit = config["max-tokens"].get_int();
+            else cerr << "giving up" << endl;
             phnf.close();
         }
         recipef.close();
@@ -0,0 +1,132 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "WordGraph.hh"
+#include "Lookahead.hh"
+#include "conf.hh"
+
+using namespace std;
+
+
+// Writes the lexicon with the entries of the new lexicon appended,
+// the text unit indices of the graph thus stay the same
+static void
+append_lexicon(string lexfname,
+               string newlexfname,
+               string outlexfname,
+               const WordGraph &wg)
+{
+    ifstream lexf(lexfname);
+    if (!lexf) throw string("Problem opening file: " + lexfname);
+    ifstream newlexf(newlexfname);
+    if (!newlexf) throw string("Problem opening file: " + newlexfname);
+    ofstream outlexf(outlexfname);
+    if (!outlexf) throw string("Problem opening file: " + outlexfname);
+
+    string line;
+    while (getline(lexf, line))
+        outlexf << line << endl;
+    while (getline(newlexf, line)) {
+        string unit;
+        stringstream ss(line);
+        ss >> unit;
+        unit = unit.substr(0, unit.find("("));
+        if (unit.length() == 0) continue;
+        if (wg.m_subword_map.find(unit) != wg.m_subword_map.end()) continue;
+        outlexf << line << endl;
+    }
+    if (!outlexf) throw string("Problem writing file: " + outlexfname);
+}
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: wgraph-update [OPTION...] PH LEXICON GRAPH POINTS NEWLEXICON OUTLEXICON OUTGRAPH OUTPOINTS\n"
+           "Adds the words in NEWLEXICON to a graph written with wgraph -c\n")
+    ('a', "lookahead-model=STRING", "arg", "", "Bigram look-ahead model for updating the look-ahead states")
+    ('s', "lastates=STRING", "arg", "", "Look-ahead states file for GRAPH")
+    ('S', "out-lastates=STRING", "arg", "", "Look-ahead states file for OUTGRAPH")
+    ('h', "help", "", "", "display help");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 8) config.print_help(stderr, 1);
+    bool update_la = config["lookahead-model"].specified;
+    if (update_la != config["lastates"].specified || update_la != config["out-lastates"].specified) {
+        cerr << "Specify the look-ahead model and both look-ahead states files" << endl;
+        exit(1);
+    }
+
+    try {
+        WordGraph wg;
+
+        string phfname = config.arguments[0];
+        cerr << "Reading hmms: " << phfname << endl;
+        wg.read_phone_model(phfname);
+
+        string lexfname = config.arguments[1];
+        cerr << "Reading lexicon: " << lexfname << endl;
+        wg.read_noway_lexicon(lexfname);
+        int old_subword_count = wg.m_subwords.size();
+
+        string graphfname = config.arguments[2];
+        cerr << "Reading graph: " << graphfname << endl;
+        wg.read_graph(graphfname);
+        cerr << "node count: " << wg.m_nodes.size() << endl;
+
+        string pointsfname = config.arguments[3];
+        cerr << "Reading connection points: " << pointsfname << endl;
+        wg.read_connection_points(pointsfname);
+
+        string newlexfname = config.arguments[4];
+        string outlexfname = config.arguments[5];
+        cerr << "Writing lexicon: " << outlexfname << endl;
+        append_lexicon(lexfname, newlexfname, outlexfname, wg);
+        wg.read_noway_lexicon(outlexfname);
+
+        set<string> new_words;
+        for (int i=old_subword_count; i<(int)wg.m_subwords.size(); i++)
+            new_words.insert(wg.m_subwords[i]);
+        cerr << "number of new words: " << new_words.size() << endl;
+
+        vector<int> new_indices = wg.add_words(new_words, true);
+
+        if (!wg.assert_words(new_words) || !wg.assert_word_pairs(new_words))
+            throw string("Problem in adding the words to the graph.");
+
+        string outgraphfname = config.arguments[6];
+        cerr << "Writing graph: " << outgraphfname << endl;
+        wg.write_graph(outgraphfname);
+
+        string outpointsfname = config.arguments[7];
+        cerr << "Writing connection points: " << outpointsfname << endl;
+        wg.write_connection_points(outpointsfname);
+
+        if (update_la) {
+            string lalmfname = config["lookahead-model"].get_str();
+
+            Decoder d;
+            d.read_phone_model(phfname);
+            d.read_noway_lexicon(lexfname);
+            d.read_dgraph(graphfname);
+            cerr << "Reading lookahead states: " << config["lastates"].get_str() << endl;
+            LargeBigramLookahead lbla(d, lalmfname, config["lastates"].get_str());
+
+            Decoder ud;
+            ud.read_phone_model(phfname);
+            ud.read_noway_lexicon(outlexfname);
+            ud.read_dgraph(outgraphfname);
+            cerr << "Updating lookahead states" << endl;
+            LargeBigramLookahead ulbla(ud, lalmfname, lbla, new_indices);
+
+            string lasfname = config["out-lastates"].get_str();
+            cerr << "Writing lookahead states: " << lasfname << endl;
+            ulbla.write(lasfname);
+        }
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+
+    exit(0);
+}
@@ -30,6 +30,12 @@ read_config(WordSubwordDecoder &d, string cfgfname)
         else if (parameter == "word_end_beam") ss >> d.m_word_end_beam;
         else if (parameter == "node_beam") ss >> d.m_node_beam;
         else if (parameter == "history_clean_frame_interval") ss >> d.m_history_clean_frame_interval;
+        else if (parameter == "frame_skip") ss >> d.m_frame_skip;
+        else if (parameter == "frame_skip_combination") {
+            string combination;
+            ss >> combination;
+            d.m_frame_skip_combination = FrameSkipAcoustics::get_combination(combination);
+        }
         else if (parameter == "force_sentence_end") {
             string force_str;
             ss >> force_str;
@@ -66,21 +72,27 @@ int main(int argc, char* argv[])
     config("usage: wsw-decode [OPTION...] PH LEXICON WORD_ARPA CLASS_ARPA CMEMPROBS SUBWORD_NGRAM SUBWORD_SEGS CFGFILE GRAPH LNALIST\n")
     ('h', "help", "", "", "display help")
     ('d', "duration-model=STRING", "arg", "", "Duration model")
+    ('O', "order-nodes", "", "", "Renumber the graph nodes for memory locality after reading")
     ('q', "quantized-lookahead", "", "", "Two byte quantized look-ahead model")
     ('p', "num-threads", "arg", "1", "Number of threads")
+    ('a', "lna-prefetch=INT", "arg", "0", "Number of LNA files read ahead in background threads, DEFAULT: 0")
+    ('A', "lna-prefetch-memory=INT", "arg", "1024", "Memory budget for the LNA files read ahead in MB, DEFAULT: 1024")
     ('f', "result-file=STRING", "arg", "", "Base filename for results (.rec and .log)")
     ('l', "lookahead-model=STRING", "arg", "", "Lookahead language model")
+    ('c', "lookahead-cache=STRING", "arg", "", "Binary cache file for the precomputed look-ahead tables")
     ('t', "lookahead-type=STRING", "arg", "", "Lookahead type\n"
      "\tunigram\n"
      "\tclass-bigram\n"
      "\tbigram-full\n"
      "\tbigram-precomputed-full\n"
+     "\tbigram-precomputed-sparse\n"
      "\tbigram-hybrid\n"
      "\tbigram-precomputed-hybrid\n"
      "\tlarge-bigram")
     ('n', "nbest=STRING", "arg", "", "N-best list file (use .gz suffix for compression)")
     ('y', "nbest-num-hypotheses", "arg", "10000", "Maximum number of hypotheses per file")
-    ('b', "nbest-beam", "arg", "1000.0", "Beam setting (total difference from the best hypothesis log prob)");
+    ('b', "nbest-beam", "arg", "1000.0", "Beam setting (total difference from the best hypothesis log prob)")
+    ('g', "lattice-dir=STRING", "arg", "", "Directory for HTK SLF word lattices, pruned with the n-best beam");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 10) config.print_help(stderr, 1);
 
@@ -124,6 +136,10 @@ int main(int argc, char* argv[])
         cerr << "Reading graph: " << graphfname << endl;
         d.read_dgraph(graphfname);
         cerr << "node count: " << d.m_nodes.size() << endl;
+        if (config["order-nodes"].specified) {
+            cerr << "Ordering graph nodes for locality" << endl;
+            d.order_nodes_for_locality();
+        }
 
         if (config["lookahead-model"].specified) {
             string la_type = config["lookahead-type"].get_str();
@@ -131,26 +147,33 @@ int main(int argc, char* argv[])
             cerr << "Reading lookahead model: " << lalmfname << endl;
 
             bool quantization = config["quantized-lookahead"].specified;
+            string la_cache = config["lookahead-cache"].get_str();
+            int la_threads = config["num-threads"].get_int();
             if (la_type == "unigram")
-                d.m_la = new UnigramLookahead(d, lalmfname);
+                d.m_la = new UnigramLookahead(d, lalmfname, la_cache);
             else if (la_type == "class-bigram") {
                 vector<string> class_la_model = str::split(lalmfname, ",", false);
-                d.m_la = new ClassBigramLookahead(d, class_la_model[0], class_la_model[1], quantization);
+                d.m_la = new ClassBigramLookahead(d, class_la_model[0], class_la_model[1],
+                                                 quantization, la_threads, la_cache);
             }
             else if (la_type == "bigram-full")
-                d.m_la = new FullTableBigramLookahead(d, lalmfname);
+                d.m_la = new FullTableBigramLookahead(d, lalmfname, true, false, la_cache);
             else if (la_type == "bigram-precomputed-full")
-                d.m_la = new PrecomputedFullTableBigramLookahead(d, lalmfname, quantization);
+                d.m_la = new PrecomputedFullTableBigramLookahead(d, lalmfname, quantization,
+                                                                 la_threads, la_cache);
+            else if (la_type == "bigram-precomputed-sparse")
+                d.m_la = new PrecomputedFullTableBigramLookahead(d, lalmfname, quantization,
+                                                                 la_threads, la_cache, true);
             else if (la_type == "bigram-hybrid")
-                d.m_la = new HybridBigramLookahead(d, lalmfname);
+                d.m_la = new HybridBigramLookahead(d, lalmfname, la_cache);
             else if (la_type == "bigram-precomputed-hybrid")
-                d.m_la = new PrecomputedHybridBigramLookahead(d, lalmfname);
+                d.m_la = new PrecomputedHybridBigramLookahead(d, lalmfname, la_threads, la_cache);
             else if (la_type == "large-bigram") {
                 vector<string> bigram_la_model = str::split(lalmfname, ",", false);
                 if (bigram_la_model.size() > 1)
                     d.m_la = new LargeBigramLookahead(d, bigram_la_model[0], bigram_la_model[1]);
                 else
-                    d.m_la = new LargeBigramLookahead(d, bigram_la_model[0]);
+                    d.m_la = new LargeBigramLookahead(d, bigram_la_model[0], la_threads, la_cache);
             }
             else {
                 cerr << "unknown lookahead type: " << la_type << endl;
@@ -23,12 +23,10 @@ SWWGraph::SWWGraph(const map<string, vector<string> > &word_segs,
 void
 SWWGraph::create_crossword_network(const map<string, vector<string> > &word_segs,
                                    vector<DecoderGraph::Node> &nodes,
-                                   map<string, int> &fanout,
-                                   map<string, int> &fanin,
+                                   map<int, int> &fanout,
+                                   map<int, int> &fanin,
                                    bool wb_symbol_in_middle)
 {
-    int spp = m_states_per_phone;
-
     int error_count = 0;
     for (auto wit = word_segs.begin(); wit != word_segs.end(); ++wit) {
         vector<string> triphones;
@@ -39,42 +37,14 @@ SWWGraph::create_crossword_network(const map<string, vector<string> > &word_segs
             error_count++;
             continue;
         }
-        string fanint = construct_triphone(SIL_CTXT, tphone(triphones[0]), tphone(triphones[1]));
-        string fanoutt = construct_triphone(tphone(triphones[triphones.size()-2]), tphone(triphones.back()), SIL_CTXT);
+        int fanint = triphone_id(SIL_CTXT, tphone(triphones[0]), tphone(triphones[1]));
+        int fanoutt = triphone_id(tphone(triphones[triphones.size()-2]), tphone(triphones.back()), SIL_CTXT);
         fanout[fanoutt] = -1;
         fanin[fanint] = -1;
     }
     if (error_count > 0) cerr << error_count << " words with less than two phones." << endl;
 
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, foit->second);
-            if (wb_symbol_in_middle) idx = connect_word(nodes, "<w>", idx);
-            idx = connect_triphone(nodes, SHORT_SIL, idx);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end()) {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+    connect_fanouts_to_fanins(nodes, fanout, fanin, wb_symbol_in_middle, true);
 
     for (auto cwnit = nodes.begin(); cwnit != nodes.end(); ++cwnit)
         cwnit->flags |= NODE_CW;
@@ -119,8 +89,8 @@ SWWGraph::create_graph(const map<string, vector<string> > &word_segs,
             }
             last_triphone.assign(triphone_label);
         }
-        word_nodes[3].from_fanin.insert(first_triphone);
-        word_nodes[word_nodes.size()-4].to_fanout.insert(last_triphone);
+        word_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(first_triphone));
+        word_nodes[word_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(last_triphone));
 
         add_nodes_to_tree(m_nodes, word_nodes);
     }
@@ -133,10 +103,10 @@ SWWGraph::create_graph(const map<string, vector<string> > &word_segs,
 
         if (verbose) cerr << "Creating crossword network.." << endl;
         vector<DecoderGraph::Node> cw_nodes;
-        map<string, int> fanout, fanin;
+        map<int, int> fanout, fanin;
         create_crossword_network(word_segs, cw_nodes, fanout, fanin, wb_symbol);
         if (verbose) cerr << "crossword network size: " << cw_nodes.size() << endl;
-        minimize_crossword_network(cw_nodes, fanout, fanin);
+        minimize_crossword_network(cw_nodes, fanout, fanin, verbose);
         if (verbose) cerr << "tied crossword network size: " << cw_nodes.size() << endl;
 
         connect_crossword_network(cw_nodes, fanout, fanin, false);
@@ -152,66 +122,36 @@ void
 SWWGraph::tie_graph(bool no_push,
                     bool verbose)
 {
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << endl;
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << endl;
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << endl;
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << endl;
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
+    if (verbose) cerr << "Tying suffixes.." << endl;
+    int tied_count = tie_suffixes(m_nodes);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
     if (verbose) cerr << endl;
     if (verbose) cerr << "Removing cw dummies.." << endl;
     remove_cw_dummies(m_nodes);
     if (verbose) cerr << "Tying state prefixes.." << endl;
-    tie_state_prefixes(m_nodes);
+    tied_count = tie_prefixes(m_nodes, false);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
     if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
+    tied_count = tie_suffixes(m_nodes, false);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
     if (!no_push) {
         if (verbose) cerr << "Pushing subword ids right.." << endl;
         push_word_ids_right(m_nodes);
         if (verbose) cerr << "Tying state prefixes.." << endl;
-        tie_state_prefixes(m_nodes);
+        tied_count = tie_prefixes(m_nodes, false);
+        if (verbose) cerr << "tied nodes: " << tied_count << endl;
         if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
         if (verbose) cerr << "Pushing subword ids left.." << endl;
         push_word_ids_left(m_nodes);
         if (verbose) cerr << "Tying state suffixes.." << endl;
-        tie_state_suffixes(m_nodes);
+        tied_count = tie_suffixes(m_nodes, false);
+        if (verbose) cerr << "tied nodes: " << tied_count << endl;
         if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
     }
 }
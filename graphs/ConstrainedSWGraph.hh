@@ -26,8 +26,8 @@ public:
 
     void create_crossword_network(const std::map<std::string, std::vector<std::string> > &word_segs,
                                   std::vector<DecoderGraph::Node> &nodes,
-                                  std::map<std::string, int> &fanout,
-                                  std::map<std::string, int> &fanin,
+                                  std::map<int, int> &fanout,
+                                  std::map<int, int> &fanin,
                                   bool wb_symbol_in_middle=false);
 
     void tie_graph(bool no_push=false,
@@ -1,15 +1,167 @@
 #include <cassert>
 #include <sstream>
 #include <algorithm>
+#include <unordered_map>
+#include <thread>
 
 #include "io.hh"
 #include "defs.hh"
 #include "NowayHmmReader.hh"
+#include "NodeOrder.hh"
 #include "DecoderGraph.hh"
 
 using namespace std;
 
 
+IdSet::IdSet(const IdSet &other)
+    : m_size(other.m_size),
+      m_capacity(INLINE_CAPACITY)
+{
+    if (m_size > INLINE_CAPACITY) {
+        m_capacity = m_size;
+        m_heap = new unsigned int[m_capacity];
+    }
+    copy(other.begin(), other.end(), data());
+}
+
+
+IdSet::IdSet(IdSet &&other) noexcept
+    : m_size(0),
+      m_capacity(INLINE_CAPACITY)
+{
+    take(other);
+}
+
+
+void
+IdSet::take(IdSet &other) noexcept
+{
+    m_size = other.m_size;
+    m_capacity = other.m_capacity;
+    if (m_capacity > INLINE_CAPACITY) m_heap = other.m_heap;
+    else copy(other.m_inline, other.m_inline + m_size, m_inline);
+    other.m_size = 0;
+    other.m_capacity = INLINE_CAPACITY;
+}
+
+
+void
+IdSet::swap(IdSet &other) noexcept
+{
+    IdSet tmp(std::move(other));
+    other.take(*this);
+    take(tmp);
+}
+
+
+void
+IdSet::clear()
+{
+    if (m_capacity > INLINE_CAPACITY) delete[] m_heap;
+    m_size = 0;
+    m_capacity = INLINE_CAPACITY;
+}
+
+
+bool
+IdSet::insert(unsigned int id)
+{
+    unsigned int *ids = data();
+    unsigned int *pos = lower_bound(ids, ids + m_size, id);
+    if (pos != ids + m_size && *pos == id) return false;
+
+    unsigned int pos_idx = pos - ids;
+    if (m_size == m_capacity) {
+        unsigned int *new_ids = new unsigned int[2 * m_capacity];
+        copy(ids, pos, new_ids);
+        copy(pos, ids + m_size, new_ids + pos_idx + 1);
+        if (m_capacity > INLINE_CAPACITY) delete[] m_heap;
+        m_heap = new_ids;
+        m_capacity *= 2;
+    }
+    else copy_backward(pos, ids + m_size, ids + m_size + 1);
+
+    data()[pos_idx] = id;
+    m_size++;
+    return true;
+}
+
+
+unsigned int
+IdSet::erase(unsigned int id)
+{
+    unsigned int *ids = data();
+    unsigned int *pos = lower_bound(ids, ids + m_size, id);
+    if (pos == ids + m_size || *pos != id) return 0;
+    copy(pos + 1, ids + m_size, pos);
+    m_size--;
+    return 1;
+}
+
+
+IdSet::const_iterator
+IdSet::find(unsigned int id) const
+{
+    const_iterator pos = lower_bound(begin(), end(), id);
+    if (pos != end() && *pos == id) return pos;
+    return end();
+}
+
+
+bool
+IdSet::operator==(const IdSet &other) const
+{
+    return m_size == other.m_size && equal(begin(), end(), other.begin());
+}
+
+
+bool
+IdSet::operator<(const IdSet &other) const
+{
+    return lexicographical_compare(begin(), end(), other.begin(), other.end());
+}
+
+
+DecoderGraph::Node::Node(const Node &node)
+    : word_id(node.word_id),
+      hmm_state(node.hmm_state),
+      flags(node.flags),
+      arcs(node.arcs),
+      reverse_arcs(node.reverse_arcs),
+      lookahead(node.lookahead),
+      crossword(nullptr)
+{
+    if (node.crossword != nullptr)
+        crossword = new CrosswordContexts(*node.crossword);
+}
+
+
+DecoderGraph::Node::Node(Node &&node) noexcept
+    : word_id(node.word_id),
+      hmm_state(node.hmm_state),
+      flags(node.flags),
+      arcs(std::move(node.arcs)),
+      reverse_arcs(std::move(node.reverse_arcs)),
+      lookahead(node.lookahead),
+      crossword(node.crossword)
+{
+    node.crossword = nullptr;
+}
+
+
+void
+DecoderGraph::Node::swap(Node &node) noexcept
+{
+    std::swap(word_id, node.word_id);
+    std::swap(hmm_state, node.hmm_state);
+    std::swap(flags, node.flags);
+    arcs.swap(node.arcs);
+    reverse_arcs.swap(node.reverse_arcs);
+    std::swap(lookahead, node.lookahead);
+    std::swap(crossword, node.crossword);
+}
+
+
 void
 DecoderGraph::read_phone_model(string phnfname)
 {
@@ -18,6 +170,7 @@ DecoderGraph::read_phone_model(string phnfname)
 
     int modelcount;
     NowayHmmReader::read(phnf, m_hmms, m_hmm_map, m_hmm_states, modelcount);
+    set_phone_tables();
 
     set<string> sil_labels = { "_", "__", "_f", "_s" };
     m_states_per_phone = -1;
@@ -34,6 +187,31 @@ DecoderGraph::read_phone_model(string phnfname)
 }
 
 
+void
+DecoderGraph::set_phone_tables()
+{
+    vector<bool> is_phone(256, false);
+    is_phone[(unsigned char)SIL_CTXT] = true;
+    for (auto hmmit = m_hmm_map.begin(); hmmit != m_hmm_map.end(); ++hmmit) {
+        if (!is_triphone(hmmit->first)) continue;
+        is_phone[(unsigned char)tlc(hmmit->first)] = true;
+        is_phone[(unsigned char)tphone(hmmit->first)] = true;
+        is_phone[(unsigned char)trc(hmmit->first)] = true;
+    }
+    m_phones.clear();
+    m_phone_ids.assign(256, -1);
+    for (int c=0; c<256; c++) {
+        if (!is_phone[c]) continue;
+        m_phone_ids[c] = m_phones.size();
+        m_phones.push_back((char)c);
+    }
+    m_triphone_hmms.assign(m_phones.size() * m_phones.size() * m_phones.size(), -1);
+    for (auto hmmit = m_hmm_map.begin(); hmmit != m_hmm_map.end(); ++hmmit)
+        if (is_triphone(hmmit->first))
+            m_triphone_hmms[triphone_id(hmmit->first)] = hmmit->second;
+}
+
+
 void
 DecoderGraph::read_noway_lexicon(string lexfname)
 {
@@ -79,6 +257,52 @@ DecoderGraph::read_noway_lexicon(string lexfname)
 }
 
 
+int
+DecoderGraph::triphone_id(const string &triphone) const
+{
+    if (!is_triphone(triphone)) throw string("Unknown triphone: " + triphone);
+    return triphone_id(triphone[0], triphone[2], triphone[4]);
+}
+
+
+int
+DecoderGraph::triphone_id(char left_ctxt,
+                          char phone,
+                          char right_ctxt) const
+{
+    int lc = m_phone_ids[(unsigned char)left_ctxt];
+    int ph = m_phone_ids[(unsigned char)phone];
+    int rc = m_phone_ids[(unsigned char)right_ctxt];
+    if (lc == -1 || ph == -1 || rc == -1)
+        throw string("Unknown triphone: " + construct_triphone(left_ctxt, phone, right_ctxt));
+    return phone_ids_to_triphone_id(lc, ph, rc);
+}
+
+
+string
+DecoderGraph::triphone(int triphone_id) const
+{
+    return construct_triphone(tlc(triphone_id), tphone(triphone_id), trc(triphone_id));
+}
+
+
+int
+DecoderGraph::triphone_hmm(int triphone_id) const
+{
+    int hmm_index = m_triphone_hmms[triphone_id];
+    if (hmm_index == -1) throw string("Triphone not found: " + triphone(triphone_id));
+    return hmm_index;
+}
+
+
+int
+DecoderGraph::hmm_index(const string &label) const
+{
+    if (is_triphone(label)) return triphone_hmm(triphone_id(label));
+    return m_hmm_map.at(label);
+}
+
+
 void
 DecoderGraph::read_words(string wordfname,
                          set<string> &words) const
@@ -233,6 +457,34 @@ DecoderGraph::triphonize_phone_string(string pstring,
 }
 
 
+void
+DecoderGraph::triphonize_phone_string(const string &pstring,
+                                      vector<int> &hmm_ids) const
+{
+    string tword(1, SIL_CTXT);
+    for (auto cit = pstring.begin(); cit != pstring.end(); ++cit) {
+        char phone = *cit;
+        if (phone == ' ' || phone == '\t' || phone == '\r' || phone == '\n') phone = SIL_CTXT;
+        if (phone == SIL_CTXT && tword.back() == SIL_CTXT) continue;
+        tword += phone;
+    }
+    if (tword.back() != SIL_CTXT) tword += SIL_CTXT;
+
+    hmm_ids.clear();
+    for (unsigned int i = 1; i < tword.length() - 1; i++) {
+        if (tword[i] == SIL_CTXT) {
+            hmm_ids.push_back(m_hmm_map.at(SHORT_SIL));
+            continue;
+        }
+        char lc = tword[i-1];
+        char rc = tword[i+1];
+        if (i > 1 && lc == SIL_CTXT) lc = tword[i-2];
+        if (i < tword.length()-2 && rc == SIL_CTXT) rc = tword[i+2];
+        hmm_ids.push_back(triphone_hmm(triphone_id(lc, tword[i], rc)));
+    }
+}
+
+
 void
 DecoderGraph::triphonize(map<string, vector<string> > &word_segs,
                          string word,
@@ -270,7 +522,7 @@ DecoderGraph::triphonize(const vector<string> &word_seg,
 
     string tripstring;
     vector<pair<int, int> > word_id_positions;
-    vector<string> triphones;
+    vector<int> hmm_ids;
 
     for (auto swit = word_seg.begin(); swit != word_seg.end(); ++swit) {
         if (m_lexicon.find(*swit) == m_lexicon.end())
@@ -283,14 +535,10 @@ DecoderGraph::triphonize(const vector<string> &word_seg,
         word_id_positions.push_back(make_pair(m_subword_map.at(*swit), word_id_pos));
     }
 
-    triphonize_phone_string(tripstring, triphones);
+    triphonize_phone_string(tripstring, hmm_ids);
 
-    for (auto triit = triphones.begin(); triit != triphones.end(); ++triit)
-    {
-        TriphoneNode trin;
-        trin.hmm_id = m_hmm_map.at(*triit);
-        nodes.push_back(trin);
-    }
+    for (auto hmmit = hmm_ids.begin(); hmmit != hmm_ids.end(); ++hmmit)
+        nodes.push_back(TriphoneNode(-1, *hmmit));
 
     if (nodes.size() == 0) return false;
 
@@ -313,11 +561,8 @@ DecoderGraph::triphonize_subword(const string &subword,
     const vector<string> &triphones = m_lexicon.at(subword);
     if (triphones.size() == 0) return;
     int word_id_pos = max(1, (int) (triphones.size() - 1));
-    for (auto triit = triphones.begin(); triit != triphones.end(); ++triit) {
-        TriphoneNode trin;
-        trin.hmm_id = m_hmm_map.at(*triit);
-        nodes.push_back(trin);
-    }
+    for (auto triit = triphones.begin(); triit != triphones.end(); ++triit)
+        nodes.push_back(TriphoneNode(-1, hmm_index(*triit)));
 
     TriphoneNode trin;
     trin.subword_id = m_subword_map.at(subword);
@@ -356,20 +601,25 @@ DecoderGraph::add_nodes_to_tree(vector<DecoderGraph::Node> &nodes,
         int hmm_state = nnit->hmm_state;
 
         DecoderGraph::Node &curr_node = nodes[curr_node_idx];
-        if (curr_node.lookahead == nullptr) curr_node.lookahead = new map<pair<int, int>, int>;
-        int next_node = nodes[curr_node_idx].find_next(word_id, hmm_state);
+        if (curr_node.lookahead == nullptr) curr_node.lookahead = new vector<pair<pair<int, int>, int> >;
+        int next_node = curr_node.find_next(word_id, hmm_state);
         if (next_node == -1) {
+            curr_node.lookahead->insert(curr_node.find_lookahead(word_id, hmm_state),
+                                        make_pair(make_pair(word_id, hmm_state), nodes.size()));
             nodes.resize(nodes.size()+1);
             nodes.back().word_id = word_id;
             nodes.back().hmm_state = hmm_state;
-            (*(nodes[curr_node_idx].lookahead))[make_pair(word_id, hmm_state)] = nodes.size()-1;
             curr_node_idx = nodes.size()-1;
         }
         else curr_node_idx = next_node;
 
-        nodes[curr_node_idx].to_fanout.insert(nnit->to_fanout.begin(), nnit->to_fanout.end());
-        nodes[curr_node_idx].to_fanout_2.insert(nnit->to_fanout_2.begin(), nnit->to_fanout_2.end());
-        nodes[curr_node_idx].from_fanin.insert(nnit->from_fanin.begin(), nnit->from_fanin.end());
+        if (nnit->crossword != nullptr) {
+            CrosswordContexts &contexts = nodes[curr_node_idx].crossword_contexts();
+            CrosswordContexts &new_contexts = *(nnit->crossword);
+            contexts.to_fanout.insert(new_contexts.to_fanout.begin(), new_contexts.to_fanout.end());
+            contexts.to_fanout_2.insert(new_contexts.to_fanout_2.begin(), new_contexts.to_fanout_2.end());
+            contexts.from_fanin.insert(new_contexts.from_fanin.begin(), new_contexts.from_fanin.end());
+        }
     }
 
     if (connect_to_end_node) {
@@ -387,10 +637,179 @@ DecoderGraph::lookahead_to_arcs(vector<DecoderGraph::Node> &nodes)
         for (auto lait=(*(node.lookahead)).begin(); lait != (*(node.lookahead)).end(); ++lait)
             node.arcs.insert(lait->second);
         delete nit->lookahead;
+        nit->lookahead = nullptr;
     }
 }
 
 
+void
+DecoderGraph::sort_by_state_chain(const set<string> &subwords,
+                                  vector<string> &sorted_subwords) const
+{
+    // Chain labels of all units in one vector, start and end offset per unit
+    vector<int> labels;
+    vector<pair<pair<int, int>, string> > chains;
+    for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
+        if (swit->find("<") != string::npos) continue;
+        vector<TriphoneNode> subword_triphones;
+        triphonize_subword(*swit, subword_triphones);
+        vector<DecoderGraph::Node> subword_nodes;
+        triphones_to_state_chain(subword_triphones, subword_nodes);
+        int start = labels.size();
+        for (auto nit = subword_nodes.begin(); nit != subword_nodes.end(); ++nit)
+            labels.push_back(chain_label(*nit));
+        chains.push_back(make_pair(make_pair(start, (int)labels.size()), *swit));
+    }
+
+    sort(chains.begin(), chains.end(),
+         [&](const pair<pair<int, int>, string> &a, const pair<pair<int, int>, string> &b) {
+             return lexicographical_compare(labels.begin() + a.first.first, labels.begin() + a.first.second,
+                                            labels.begin() + b.first.first, labels.begin() + b.first.second);
+         });
+
+    sorted_subwords.clear();
+    for (auto cit = chains.begin(); cit != chains.end(); ++cit)
+        sorted_subwords.push_back(cit->second);
+}
+
+
+DecoderGraph::MinimizingTreeBuilder::MinimizingTreeBuilder(vector<Node> &nodes)
+    : m_nodes(nodes),
+      m_merged_count(0)
+{
+    m_path.push_back(START_NODE);
+}
+
+
+void
+DecoderGraph::MinimizingTreeBuilder::add_nodes(vector<Node> &new_nodes)
+{
+    unsigned int prefix_length = 0;
+    while (prefix_length < m_labels.size() && prefix_length < new_nodes.size()
+           && m_labels[prefix_length] == chain_label(new_nodes[prefix_length]))
+        prefix_length++;
+    if ((prefix_length == new_nodes.size() && prefix_length < m_labels.size())
+        || (prefix_length < new_nodes.size() && prefix_length < m_labels.size()
+            && chain_label(new_nodes[prefix_length]) < m_labels[prefix_length]))
+        throw string("State chains not in sorted order.");
+
+    minimize_path(prefix_length+1);
+
+    for (unsigned int i=0; i<prefix_length; i++) {
+        if (new_nodes[i].crossword == nullptr) continue;
+        CrosswordContexts &contexts = m_nodes[m_path[i+1]].crossword_contexts();
+        CrosswordContexts &new_contexts = *(new_nodes[i].crossword);
+        contexts.to_fanout.insert(new_contexts.to_fanout.begin(), new_contexts.to_fanout.end());
+        contexts.to_fanout_2.insert(new_contexts.to_fanout_2.begin(), new_contexts.to_fanout_2.end());
+        contexts.from_fanin.insert(new_contexts.from_fanin.begin(), new_contexts.from_fanin.end());
+    }
+
+    m_labels.resize(prefix_length);
+    for (unsigned int i=prefix_length; i<new_nodes.size(); i++) {
+        node_idx_t node_idx = new_node();
+        Node &nd = m_nodes[node_idx];
+        nd.word_id = new_nodes[i].word_id;
+        nd.hmm_state = new_nodes[i].hmm_state;
+        std::swap(nd.crossword, new_nodes[i].crossword);
+        m_nodes[m_path.back()].arcs.insert(node_idx);
+        m_path.push_back(node_idx);
+        m_labels.push_back(chain_label(new_nodes[i]));
+    }
+
+    m_nodes[m_path.back()].arcs.insert(END_NODE);
+}
+
+
+void
+DecoderGraph::MinimizingTreeBuilder::minimize_path(unsigned int depth)
+{
+    // Deepest nodes first so that the successors are already registered
+    for (unsigned int d=m_path.size()-1; d>=depth && d>0; d--) {
+        node_idx_t node_idx = m_path[d];
+        size_t hash = signature_hash(node_idx);
+        int registered_node_idx = -1;
+        auto range = m_register.equal_range(hash);
+        for (auto rit = range.first; rit != range.second; ++rit) {
+            if (!same_signature(node_idx, rit->second)) continue;
+            registered_node_idx = rit->second;
+            break;
+        }
+
+        if (registered_node_idx == -1) {
+            m_register.insert(make_pair(hash, node_idx));
+            continue;
+        }
+
+        IdSet &parent_arcs = m_nodes[m_path[d-1]].arcs;
+        parent_arcs.erase(node_idx);
+        parent_arcs.insert(registered_node_idx);
+        m_nodes[node_idx] = Node();
+        m_free_nodes.push_back(node_idx);
+        m_merged_count++;
+    }
+    if (depth < m_path.size()) m_path.resize(depth);
+}
+
+
+size_t
+DecoderGraph::MinimizingTreeBuilder::signature_hash(node_idx_t node_idx) const
+{
+    const Node &nd = m_nodes[node_idx];
+    size_t hash = nd.hmm_state;
+    hash = hash * 1000003 + nd.word_id;
+    hash = hash * 1000003 + nd.flags;
+    for (auto ait = nd.arcs.begin(); ait != nd.arcs.end(); ++ait)
+        hash = hash * 1000003 + *ait;
+    if (nd.crossword != nullptr) {
+        for (auto cit = nd.crossword->from_fanin.begin(); cit != nd.crossword->from_fanin.end(); ++cit)
+            hash = hash * 1000003 + *cit;
+        for (auto cit = nd.crossword->to_fanout.begin(); cit != nd.crossword->to_fanout.end(); ++cit)
+            hash = hash * 1000003 + *cit;
+        for (auto cit = nd.crossword->to_fanout_2.begin(); cit != nd.crossword->to_fanout_2.end(); ++cit)
+            hash = hash * 1000003 + *cit;
+    }
+    return hash;
+}
+
+
+bool
+DecoderGraph::MinimizingTreeBuilder::same_signature(node_idx_t node_idx_1,
+                                                    node_idx_t node_idx_2) const
+{
+    const Node &nd1 = m_nodes[node_idx_1];
+    const Node &nd2 = m_nodes[node_idx_2];
+    if (nd1.hmm_state != nd2.hmm_state
+        || nd1.word_id != nd2.word_id
+        || nd1.flags != nd2.flags
+        || nd1.arcs != nd2.arcs)
+        return false;
+    if (nd1.crossword == nullptr || nd2.crossword == nullptr) {
+        auto no_contexts = [](const CrosswordContexts *contexts) {
+            return contexts == nullptr
+                || (contexts->from_fanin.empty() && contexts->to_fanout.empty()
+                    && contexts->to_fanout_2.empty());
+        };
+        return no_contexts(nd1.crossword) && no_contexts(nd2.crossword);
+    }
+    return nd1.crossword->from_fanin == nd2.crossword->from_fanin
+        && nd1.crossword->to_fanout == nd2.crossword->to_fanout
+        && nd1.crossword->to_fanout_2 == nd2.crossword->to_fanout_2;
+}
+
+
+node_idx_t
+DecoderGraph::MinimizingTreeBuilder::new_node()
+{
+    if (m_free_nodes.size()) {
+        node_idx_t node_idx = m_free_nodes.back();
+        m_free_nodes.pop_back();
+        return node_idx;
+    }
+    m_nodes.resize(m_nodes.size()+1);
+    return m_nodes.size()-1;
+}
+
+
 void
 DecoderGraph::get_hmm_states(const vector<string> &triphones,
                              vector<int> &states) const
@@ -965,22 +1384,23 @@ DecoderGraph::assert_only_cw_word_pairs(std::set<std::string> &words)
 }
 
 
-void
-DecoderGraph::tie_state_prefixes(vector<DecoderGraph::Node> &nodes,
-                                 bool stop_propagation,
-                                 node_idx_t node_idx)
+int
+DecoderGraph::tie_prefixes(vector<DecoderGraph::Node> &nodes,
+                           bool tie_word_ids,
+                           node_idx_t node_idx)
 {
-    list<node_idx_t> nodes_to_process = { node_idx };
     set_reverse_arcs_also_from_unreachable(nodes);
-    tie_state_prefixes(nodes, nodes_to_process, stop_propagation);
+    int merged_count = tie_nodes(nodes, { node_idx }, false, tie_word_ids);
     prune_unreachable_nodes(nodes);
+    return merged_count;
 }
 
-void
-DecoderGraph::tie_state_prefixes_cw(vector<DecoderGraph::Node> &nodes,
-                                    map<string, int> &fanout,
-                                    map<string, int> &fanin,
-                                    bool stop_propagation)
+
+int
+DecoderGraph::tie_prefixes_cw(vector<DecoderGraph::Node> &nodes,
+                              map<int, int> &fanout,
+                              map<int, int> &fanin,
+                              bool tie_word_ids)
 {
     set_reverse_arcs_also_from_unreachable(nodes);
 
@@ -989,337 +1409,183 @@ DecoderGraph::tie_state_prefixes_cw(vector<DecoderGraph::Node> &nodes,
         if (nodes[i].flags & NODE_FAN_OUT_DUMMY)
             start_nodes.insert(i);
 
-    list<node_idx_t> nodes_to_process;
-    for (auto snit = start_nodes.begin(); snit != start_nodes.end(); ++snit)
-        nodes_to_process.push_back(*snit);
-    tie_state_prefixes(nodes, nodes_to_process, stop_propagation);
+    int merged_count = tie_nodes(nodes, start_nodes, false, tie_word_ids);
     prune_unreachable_nodes_cw(nodes, start_nodes, fanout, fanin);
+    return merged_count;
 }
 
 
-void
-DecoderGraph::tie_state_prefixes(vector<DecoderGraph::Node> &nodes,
-                                 list<node_idx_t> nodes_to_process,
-                                 bool stop_propagation)
-{
-    vector<bool> processed_nodes(nodes.size(), false);
-    while (nodes_to_process.size()) {
-        node_idx_t node_idx = nodes_to_process.front();
-        nodes_to_process.pop_front();
-        processed_nodes[node_idx] = true;
-        DecoderGraph::Node &nd = nodes[node_idx];
-
-        // Map HMM state targets to the list of target node indexes
-        map<int, vector<unsigned int> > hmm_targets;
-        for (auto ait = nd.arcs.begin(); ait != nd.arcs.end(); ++ait) {
-            int ahmm = nodes[*ait].hmm_state;
-            if (ahmm != -1) hmm_targets[ahmm].push_back(*ait);
-        }
-
-        bool arcs_removed = false;
-        for (auto hmmit = hmm_targets.begin(); hmmit != hmm_targets.end(); ++hmmit) {
-            if (hmmit->second.size() == 1) continue;
-            map<set<unsigned int>, vector<int> > to_merge;
-            for (auto tit = hmmit->second.begin(); tit != hmmit->second.end(); ++tit)
-                to_merge[nodes[*tit].reverse_arcs].push_back(*tit);
-
-            for (auto tmit = to_merge.begin(); tmit != to_merge.end(); ++tmit) {
-                if (tmit->second.size() == 1) continue;
-                auto nit = tmit->second.begin();
-                int tied_node_idx = *nit;
-                nit++;
-                while (nit != tmit->second.end()) {
-                    int curr_node_idx = *nit;
-                    tied_node_idx = merge_nodes(nodes, tied_node_idx, curr_node_idx);
-                    arcs_removed = true;
-                    nit++;
-                }
-            }
-        }
-
-        if (stop_propagation && !arcs_removed)
-            continue;
-
-        for (auto arcit = nd.arcs.begin(); arcit != nd.arcs.end(); ++arcit)
-            if (!processed_nodes[*arcit]) nodes_to_process.push_back(*arcit);
-    }
-}
-
-
-void
-DecoderGraph::tie_word_id_prefixes(vector<DecoderGraph::Node> &nodes,
-                                   bool stop_propagation,
-                                   node_idx_t node_idx)
+int
+DecoderGraph::tie_suffixes(vector<DecoderGraph::Node> &nodes,
+                           bool tie_word_ids,
+                           node_idx_t node_idx)
 {
-    list<node_idx_t> nodes_to_process = { node_idx };
     set_reverse_arcs_also_from_unreachable(nodes);
-    tie_word_id_prefixes(nodes, nodes_to_process, stop_propagation);
+    int merged_count = tie_nodes(nodes, { node_idx }, true, tie_word_ids);
     prune_unreachable_nodes(nodes);
+    return merged_count;
 }
 
 
-void
-DecoderGraph::tie_word_id_prefixes_cw(vector<DecoderGraph::Node> &nodes,
-                                      map<string, int> &fanout,
-                                      map<string, int> &fanin,
-                                      bool stop_propagation)
+int
+DecoderGraph::tie_suffixes_cw(vector<DecoderGraph::Node> &nodes,
+                              map<int, int> &fanout,
+                              map<int, int> &fanin,
+                              bool tie_word_ids)
 {
     set_reverse_arcs_also_from_unreachable(nodes);
 
     set<node_idx_t> start_nodes;
+    set<node_idx_t> fanin_nodes;
     for (unsigned int i=0; i<nodes.size(); i++)
         if (nodes[i].flags & NODE_FAN_OUT_DUMMY)
             start_nodes.insert(i);
+        else if (nodes[i].flags & NODE_FAN_IN_DUMMY)
+            fanin_nodes.insert(i);
 
-    list<node_idx_t> nodes_to_process;
-    for (auto snit = start_nodes.begin(); snit != start_nodes.end(); ++snit)
-        nodes_to_process.push_back(*snit);
-    tie_word_id_prefixes(nodes, nodes_to_process, stop_propagation);
+    int merged_count = tie_nodes(nodes, fanin_nodes, true, tie_word_ids);
     prune_unreachable_nodes_cw(nodes, start_nodes, fanout, fanin);
+    return merged_count;
 }
 
 
-void
-DecoderGraph::tie_word_id_prefixes(vector<DecoderGraph::Node> &nodes,
-                                   list<node_idx_t> nodes_to_process,
-                                   bool stop_propagation)
-{
-    vector<bool> processed_nodes(nodes.size(), false);
-    while (nodes_to_process.size()) {
-        node_idx_t node_idx = nodes_to_process.front();
-        nodes_to_process.pop_front();
-        processed_nodes[node_idx] = true;
-        DecoderGraph::Node &nd = nodes[node_idx];
-
-        // Map word id targets to the list of target node indexes
-        map<int, vector<unsigned int> > word_targets;
-        for (auto ait = nd.arcs.begin(); ait != nd.arcs.end(); ++ait) {
-            int aword = nodes[*ait].word_id;
-            if (aword != -1) word_targets[aword].push_back(*ait);
-        }
-
-        bool arcs_removed = false;
-        for (auto wit = word_targets.begin(); wit != word_targets.end(); ++wit) {
-            if (wit->second.size() == 1) continue;
-            map<set<unsigned int>, vector<int> > to_merge;
-            for (auto tit = wit->second.begin(); tit != wit->second.end(); ++tit)
-                to_merge[nodes[*tit].reverse_arcs].push_back(*tit);
-
-            for (auto tmit = to_merge.begin(); tmit != to_merge.end(); ++tmit) {
-                if (tmit->second.size() == 1) continue;
-                auto nit = tmit->second.begin();
-                int tied_node_idx = *nit;
-                nit++;
-                while (nit != tmit->second.end()) {
-                    int curr_node_idx = *nit;
-                    tied_node_idx = merge_nodes(nodes, tied_node_idx, curr_node_idx);
-                    arcs_removed = true;
-                    nit++;
-                }
-            }
+int
+DecoderGraph::tie_nodes(vector<DecoderGraph::Node> &nodes,
+                        const set<node_idx_t> &start_nodes,
+                        bool suffixes,
+                        bool tie_word_ids)
+{
+    // Nodes whose signature contains the node, these are also the next nodes to process
+    auto referring_nodes = [&](node_idx_t node_idx) -> const IdSet& {
+        return suffixes ? nodes[node_idx].reverse_arcs : nodes[node_idx].arcs;
+    };
+    auto signature_nodes = [&](node_idx_t node_idx) -> const IdSet& {
+        return suffixes ? nodes[node_idx].arcs : nodes[node_idx].reverse_arcs;
+    };
+    auto tieable = [&](node_idx_t node_idx) {
+        const Node &nd = nodes[node_idx];
+        return nd.hmm_state != -1 || (tie_word_ids && nd.word_id != -1);
+    };
+    auto signature_hash = [&](node_idx_t node_idx) {
+        const Node &nd = nodes[node_idx];
+        size_t hash = nd.hmm_state;
+        hash = hash * 1000003 + nd.word_id;
+        hash = hash * 1000003 + nd.flags;
+        const IdSet &sig_nodes = signature_nodes(node_idx);
+        for (auto nit = sig_nodes.begin(); nit != sig_nodes.end(); ++nit)
+            hash = hash * 1000003 + *nit;
+        return hash;
+    };
+    auto same_signature = [&](node_idx_t node_idx_1, node_idx_t node_idx_2) {
+        const Node &nd1 = nodes[node_idx_1];
+        const Node &nd2 = nodes[node_idx_2];
+        return nd1.hmm_state == nd2.hmm_state
+            && nd1.word_id == nd2.word_id
+            && nd1.flags == nd2.flags
+            && signature_nodes(node_idx_1) == signature_nodes(node_idx_2);
+    };
+
+    // Nodes reachable from the start nodes, closest nodes first
+    vector<bool> reachable(nodes.size(), false);
+    deque<node_idx_t> nodes_to_process;
+    for (auto snit = start_nodes.begin(); snit != start_nodes.end(); ++snit) {
+        reachable[*snit] = true;
+        nodes_to_process.push_back(*snit);
+    }
+    for (unsigned int i=0; i<nodes_to_process.size(); i++) {
+        const IdSet &next_nodes = referring_nodes(nodes_to_process[i]);
+        for (auto nit = next_nodes.begin(); nit != next_nodes.end(); ++nit) {
+            if (reachable[*nit]) continue;
+            reachable[*nit] = true;
+            nodes_to_process.push_back(*nit);
         }
-
-        if (stop_propagation && !arcs_removed)
-            continue;
-
-        for (auto arcit = nd.arcs.begin(); arcit != nd.arcs.end(); ++arcit)
-            if (!processed_nodes[*arcit]) nodes_to_process.push_back(*arcit);
     }
-}
-
-
-void
-DecoderGraph::tie_state_suffixes(vector<DecoderGraph::Node> &nodes,
-                                 bool stop_propagation,
-                                 node_idx_t node_idx)
-{
-    list<node_idx_t> nodes_to_process = { node_idx };
-    set_reverse_arcs_also_from_unreachable(nodes);
-    tie_state_suffixes(nodes, nodes_to_process, stop_propagation);
-    prune_unreachable_nodes(nodes);
-}
-
-void
-DecoderGraph::tie_state_suffixes_cw(vector<DecoderGraph::Node> &nodes,
-                                    map<string, int> &fanout,
-                                    map<string, int> &fanin,
-                                    bool stop_propagation)
-{
-    set_reverse_arcs_also_from_unreachable(nodes);
-
-    set<node_idx_t> start_nodes;
-    list<node_idx_t> nodes_to_process;
-    for (unsigned int i=0; i<nodes.size(); i++)
-        if (nodes[i].flags & NODE_FAN_OUT_DUMMY)
-            start_nodes.insert(i);
-        else if (nodes[i].flags & NODE_FAN_IN_DUMMY)
-            nodes_to_process.push_back(i);
-
-    tie_state_suffixes(nodes, nodes_to_process, stop_propagation);
-    prune_unreachable_nodes_cw(nodes, start_nodes, fanout, fanin);
-}
+    vector<bool> queued(nodes.size(), false);
+    for (auto nit = nodes_to_process.begin(); nit != nodes_to_process.end(); ++nit)
+        queued[*nit] = true;
+
+    // Register of the processed nodes by the signature hash,
+    // a node is removed before its signature changes
+    unordered_multimap<size_t, node_idx_t> registered_nodes;
+    vector<bool> registered(nodes.size(), false);
+    auto unregister = [&](node_idx_t node_idx) {
+        if (!registered[node_idx]) return;
+        auto range = registered_nodes.equal_range(signature_hash(node_idx));
+        for (auto rit = range.first; rit != range.second; ++rit) {
+            if (rit->second != node_idx) continue;
+            registered_nodes.erase(rit);
+            break;
+        }
+        registered[node_idx] = false;
+    };
 
-void
-DecoderGraph::tie_state_suffixes(vector<DecoderGraph::Node> &nodes,
-                                 list<node_idx_t> nodes_to_process,
-                                 bool stop_propagation)
-{
-    vector<bool> processed_nodes(nodes.size(), false);
+    int merged_count = 0;
     while (nodes_to_process.size()) {
         node_idx_t node_idx = nodes_to_process.front();
         nodes_to_process.pop_front();
-        processed_nodes[node_idx] = true;
-        DecoderGraph::Node &nd = nodes[node_idx];
-
-        // Map HMM state targets to the list of target node indexes
-        map<int, vector<unsigned int> > hmm_targets;
-        for (auto ait = nd.reverse_arcs.begin(); ait != nd.reverse_arcs.end(); ++ait) {
-            int ahmm = nodes[*ait].hmm_state;
-            if (ahmm != -1) hmm_targets[ahmm].push_back(*ait);
-        }
-
-        bool arcs_removed = false;
-        for (auto hmmit = hmm_targets.begin(); hmmit != hmm_targets.end(); ++hmmit) {
-            if (hmmit->second.size() == 1) continue;
-            map<set<unsigned int>, vector<int> > to_merge;
-            for (auto tit = hmmit->second.begin(); tit != hmmit->second.end(); ++tit)
-                to_merge[nodes[*tit].arcs].push_back(*tit);
-
-            for (auto tmit = to_merge.begin(); tmit != to_merge.end(); ++tmit) {
-                if (tmit->second.size() == 1) continue;
-                auto nit = tmit->second.begin();
-                int tied_node_idx = *nit;
-                nit++;
-                while (nit != tmit->second.end()) {
-                    int curr_node_idx = *nit;
-                    tied_node_idx = merge_nodes(nodes, tied_node_idx, curr_node_idx);
-                    arcs_removed = true;
-                    nit++;
-                }
-            }
+        queued[node_idx] = false;
+        if (!tieable(node_idx)) continue;
+
+        size_t hash = signature_hash(node_idx);
+        int tied_node_idx = -1;
+        auto range = registered_nodes.equal_range(hash);
+        for (auto rit = range.first; rit != range.second; ++rit) {
+            if (!same_signature(rit->second, node_idx)) continue;
+            tied_node_idx = rit->second;
+            break;
         }
-
-        if (stop_propagation && !arcs_removed)
+        if (tied_node_idx == -1) {
+            registered_nodes.insert(make_pair(hash, node_idx));
+            registered[node_idx] = true;
             continue;
-
-        for (auto arcit = nd.reverse_arcs.begin(); arcit != nd.reverse_arcs.end(); ++arcit)
-            if (!processed_nodes[*arcit]) nodes_to_process.push_back(*arcit);
-    }
-}
-
-
-void
-DecoderGraph::tie_word_id_suffixes(vector<DecoderGraph::Node> &nodes,
-                                   bool stop_propagation,
-                                   node_idx_t node_idx)
-{
-    list<node_idx_t> nodes_to_process = { node_idx };
-    set_reverse_arcs_also_from_unreachable(nodes);
-    tie_word_id_suffixes(nodes, nodes_to_process, stop_propagation);
-    prune_unreachable_nodes(nodes);
-}
-
-void
-DecoderGraph::tie_word_id_suffixes_cw(vector<DecoderGraph::Node> &nodes,
-                                      map<string, int> &fanout,
-                                      map<string, int> &fanin,
-                                      bool stop_propagation)
-{
-    set_reverse_arcs_also_from_unreachable(nodes);
-
-    set<node_idx_t> start_nodes;
-    list<node_idx_t> nodes_to_process;
-    for (unsigned int i=0; i<nodes.size(); i++)
-        if (nodes[i].flags & NODE_FAN_OUT_DUMMY)
-            start_nodes.insert(i);
-        else if (nodes[i].flags & NODE_FAN_IN_DUMMY)
-            nodes_to_process.push_back(i);
-
-    tie_word_id_suffixes(nodes, nodes_to_process, stop_propagation);
-    prune_unreachable_nodes_cw(nodes, start_nodes, fanout, fanin);
-}
-
-
-void
-DecoderGraph::tie_word_id_suffixes(vector<DecoderGraph::Node> &nodes,
-                                   list<node_idx_t> nodes_to_process,
-                                   bool stop_propagation)
-{
-    vector<bool> processed_nodes(nodes.size(), false);
-    while (nodes_to_process.size()) {
-        node_idx_t node_idx = nodes_to_process.front();
-        nodes_to_process.pop_front();
-        processed_nodes[node_idx] = true;
-        DecoderGraph::Node &nd = nodes[node_idx];
-
-        // Map word id targets to the list of target node indexes
-        map<int, vector<unsigned int> > word_targets;
-        for (auto ait = nd.reverse_arcs.begin(); ait != nd.reverse_arcs.end(); ++ait) {
-            int aword = nodes[*ait].word_id;
-            if (aword != -1) word_targets[aword].push_back(*ait);
         }
 
-        bool arcs_removed = false;
-        for (auto wit = word_targets.begin(); wit != word_targets.end(); ++wit) {
-            if (wit->second.size() == 1) continue;
-            map<set<unsigned int>, vector<int> > to_merge;
-            for (auto tit = wit->second.begin(); tit != wit->second.end(); ++tit)
-                to_merge[nodes[*tit].arcs].push_back(*tit);
-
-            for (auto tmit = to_merge.begin(); tmit != to_merge.end(); ++tmit) {
-                if (tmit->second.size() == 1) continue;
-                auto nit = tmit->second.begin();
-                int tied_node_idx = *nit;
-                nit++;
-                while (nit != tmit->second.end()) {
-                    int curr_node_idx = *nit;
-                    tied_node_idx = merge_nodes(nodes, tied_node_idx, curr_node_idx);
-                    arcs_removed = true;
-                    nit++;
-                }
-            }
+        // Merging changes the signatures of the nodes referring to the removed node
+        IdSet affected_nodes = referring_nodes(node_idx);
+        for (auto anit = affected_nodes.begin(); anit != affected_nodes.end(); ++anit)
+            unregister(*anit);
+        merge_nodes(nodes, tied_node_idx, node_idx);
+        merged_count++;
+        for (auto anit = affected_nodes.begin(); anit != affected_nodes.end(); ++anit) {
+            if (!reachable[*anit] || queued[*anit]) continue;
+            queued[*anit] = true;
+            nodes_to_process.push_back(*anit);
         }
-
-        if (stop_propagation && !arcs_removed)
-            continue;
-
-        for (auto arcit = nd.reverse_arcs.begin(); arcit != nd.reverse_arcs.end(); ++arcit)
-            if (!processed_nodes[*arcit]) nodes_to_process.push_back(*arcit);
     }
+
+    return merged_count;
 }
 
 
 void
 DecoderGraph::minimize_crossword_network(vector<DecoderGraph::Node> &cw_nodes,
-                                         map<string, int> &fanout,
-                                         map<string, int> &fanin)
-{
-    tie_state_prefixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_prefixes_cw(cw_nodes, fanout, fanin);
-    tie_state_prefixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_prefixes_cw(cw_nodes, fanout, fanin);
-    tie_state_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_state_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_state_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_state_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_suffixes_cw(cw_nodes, fanout, fanin);
-    tie_state_prefixes_cw(cw_nodes, fanout, fanin);
-    tie_word_id_prefixes_cw(cw_nodes, fanout, fanin);
+                                         map<int, int> &fanout,
+                                         map<int, int> &fanin,
+                                         bool verbose)
+{
+    int merged_count;
+    do {
+        merged_count = tie_prefixes_cw(cw_nodes, fanout, fanin);
+        if (verbose) cerr << "tied prefix nodes: " << merged_count
+                          << ", network size: " << cw_nodes.size() << endl;
+        int suffix_merged_count = tie_suffixes_cw(cw_nodes, fanout, fanin);
+        if (verbose) cerr << "tied suffix nodes: " << suffix_merged_count
+                          << ", network size: " << cw_nodes.size() << endl;
+        merged_count += suffix_merged_count;
+    } while (merged_count > 0);
 }
 
+
 void
 DecoderGraph::connect_crossword_network(vector<DecoderGraph::Node> &cw_nodes,
-                                        map<string, int> &fanout,
-                                        map<string, int> &fanin,
+                                        map<int, int> &fanout,
+                                        map<int, int> &fanin,
                                         bool push_left_after_fanin)
 {
     int offset = m_nodes.size();
     for (auto cwnit = cw_nodes.begin(); cwnit != cw_nodes.end(); ++cwnit) {
         m_nodes.push_back(*cwnit);
-        set<unsigned int> temp_arcs = m_nodes.back().arcs;
+        IdSet temp_arcs = m_nodes.back().arcs;
         m_nodes.back().arcs.clear();
         for (auto ait = temp_arcs.begin(); ait != temp_arcs.end(); ++ait)
             m_nodes.back().arcs.insert(*ait + offset);
@@ -1332,9 +1598,11 @@ DecoderGraph::connect_crossword_network(vector<DecoderGraph::Node> &cw_nodes,
 
     for (unsigned int i=0; i<m_nodes.size(); i++) {
         DecoderGraph::Node &nd = m_nodes[i];
-        for (auto ffi=nd.from_fanin.begin(); ffi!=nd.from_fanin.end(); ++ffi)
+        if (nd.crossword == nullptr) continue;
+        IdSet &from_fanin = nd.crossword->from_fanin;
+        for (auto ffi=from_fanin.begin(); ffi!=from_fanin.end(); ++ffi)
             m_nodes[fanin[*ffi]].arcs.insert(i);
-        nd.from_fanin.clear();
+        from_fanin.clear();
     }
 
     if (push_left_after_fanin)
@@ -1344,9 +1612,11 @@ DecoderGraph::connect_crossword_network(vector<DecoderGraph::Node> &cw_nodes,
 
     for (unsigned int i=0; i<m_nodes.size(); i++) {
         DecoderGraph::Node &nd = m_nodes[i];
-        for (auto tfo=nd.to_fanout.begin(); tfo!=nd.to_fanout.end(); ++tfo)
+        if (nd.crossword == nullptr) continue;
+        IdSet &to_fanout = nd.crossword->to_fanout;
+        for (auto tfo=to_fanout.begin(); tfo!=to_fanout.end(); ++tfo)
             nd.arcs.insert(fanout[*tfo]);
-        nd.to_fanout.clear();
+        to_fanout.clear();
     }
 }
 
@@ -1495,10 +1765,14 @@ DecoderGraph::merge_nodes(vector<DecoderGraph::Node> &nodes,
         nodes[*ait].arcs.insert(node_idx_1);
     }
 
-    merged_node.to_fanout.insert(removed_node.to_fanout.begin(), removed_node.to_fanout.end());
-    merged_node.from_fanin.insert(removed_node.from_fanin.begin(), removed_node.from_fanin.end());
-    removed_node.to_fanout.clear();
-    removed_node.from_fanin.clear();
+    if (removed_node.crossword != nullptr) {
+        CrosswordContexts &merged_contexts = merged_node.crossword_contexts();
+        CrosswordContexts &removed_contexts = *(removed_node.crossword);
+        merged_contexts.to_fanout.insert(removed_contexts.to_fanout.begin(), removed_contexts.to_fanout.end());
+        merged_contexts.from_fanin.insert(removed_contexts.from_fanin.begin(), removed_contexts.from_fanin.end());
+        removed_contexts.to_fanout.clear();
+        removed_contexts.from_fanin.clear();
+    }
 
     removed_node.arcs.clear();
     removed_node.reverse_arcs.clear();
@@ -1531,14 +1805,56 @@ DecoderGraph::write_graph(string fname,
     }
 }
 
+void
+DecoderGraph::read_graph(string fname)
+{
+    SimpleFileInput ginf(fname);
+    string read_error("Problem reading graph: " + fname);
+
+    string line;
+    int node_count = 0;
+    if (!ginf.getline(line)) throw read_error;
+    stringstream ncl(line);
+    ncl >> node_count;
+    if (ncl.fail() || node_count <= END_NODE) throw read_error;
+
+    m_nodes.clear();
+    m_nodes.resize(node_count);
+    vector<int> arc_counts(node_count, 0);
+    for (int i=0; i<node_count; i++) {
+        if (!ginf.getline(line)) throw read_error;
+        stringstream nss(line);
+        string ltype;
+        int node_idx;
+        DecoderGraph::Node &node = m_nodes[i];
+        nss >> ltype >> node_idx >> node.hmm_state >> node.word_id >> arc_counts[i] >> node.flags;
+        if (nss.fail()) throw string("Problem reading graph, word labels are not supported: " + fname);
+        if (ltype != "n" || node_idx != i) throw read_error;
+        if (node.word_id >= (int)m_subwords.size()) throw string("Word id not in the lexicon: " + fname);
+    }
+
+    while (ginf.getline(line)) {
+        stringstream ass(line);
+        string ltype;
+        int src_node, tgt_node;
+        ass >> ltype >> src_node >> tgt_node;
+        if (ass.fail() || ltype != "a") throw read_error;
+        if (src_node < 0 || src_node >= node_count || tgt_node < 0 || tgt_node >= node_count)
+            throw read_error;
+        m_nodes[src_node].arcs.insert(tgt_node);
+    }
+
+    for (int i=0; i<node_count; i++)
+        if ((int)m_nodes[i].arcs.size() != arc_counts[i]) throw read_error;
+}
+
 int
 DecoderGraph::connect_triphone(vector<DecoderGraph::Node> &nodes,
                                string triphone,
                                node_idx_t node_idx,
                                int flag_mask) const
 {
-    int hmm_index = m_hmm_map.at(triphone);
-    return connect_triphone(nodes, hmm_index, node_idx, flag_mask);
+    return connect_triphone(nodes, hmm_index(triphone), node_idx, flag_mask);
 }
 
 int
@@ -1567,8 +1883,7 @@ DecoderGraph::connect_triphone(vector<DecoderGraph::Node> &nodes,
                                map<int, string> &node_labels,
                                int flag_mask) const
 {
-    int hmm_index = m_hmm_map.at(triphone);
-    return connect_triphone(nodes, hmm_index, node_idx, node_labels, flag_mask);
+    return connect_triphone(nodes, hmm_index(triphone), node_idx, node_labels, flag_mask);
 }
 
 int
@@ -1630,6 +1945,215 @@ DecoderGraph::connect_dummy(vector<DecoderGraph::Node> &nodes,
     return nodes.size()-1;
 }
 
+
+// Fanout and fanin triphones in map order for building
+// the fanout subnetworks, shared read-only by the threads
+class FanoutFaninTables {
+public:
+    std::vector<int> fanout_triphones;
+    std::vector<int> fanin_triphones;
+    // Fanin node indices before building, -1 if not created
+    std::vector<int> fanin_nodes;
+    // First fanout index with the phone, this one creates the triphone2 chains
+    std::vector<int> first_fanout_of_phone;
+    // First fanin index with the same triphone2 as the fanin for a given fanout phone
+    std::vector<int> triphone2_owner;
+    int short_sil_hmm;
+    int wb_symbol_id;
+    bool short_silence;
+    bool triphone1_to_triphone2;
+};
+
+
+// Node layout of one fanout subnetwork, indices relative to the fanout node
+class FanoutLayout {
+public:
+    FanoutLayout() : num_nodes(0) { }
+    int num_nodes;
+    // Triphone2 chain starts by fanin index, only in the creating subnetwork
+    std::vector<int> triphone2_starts;
+    // Fanin nodes by fanin index, only in the first subnetwork
+    std::vector<int> fanin_nodes;
+    std::string error;
+};
+
+
+// Builds the fanout subnetworks of the thread with the node indices of the serial order.
+// Only computes the layouts if nodes is null, otherwise fills the nodes
+// in the ranges given by the offsets.
+static void
+build_fanout_subnetworks(const DecoderGraph *graph,
+                         const FanoutFaninTables *tables,
+                         vector<FanoutLayout> *layouts,
+                         const vector<int> *offsets,
+                         const vector<int> *fanin_nodes,
+                         vector<DecoderGraph::Node> *nodes,
+                         int thread_idx,
+                         int num_threads)
+{
+    int num_fanins = tables->fanin_triphones.size();
+    for (int i=thread_idx; i<(int)tables->fanout_triphones.size(); i += num_threads) {
+        FanoutLayout &layout = layouts->at(i);
+        int offset = nodes == nullptr ? 0 : offsets->at(i);
+        int next_node_idx = offset;
+
+        // Nodes of the subnetwork by the predecessor and the HMM state or the word boundary,
+        // common prefixes are created only once instead of tying them afterwards
+        map<pair<int, int>, int> child_nodes;
+        auto connect_node = [&](int node_idx, int label) {
+            if (node_idx != -1 && label != -1) {
+                auto cnit = child_nodes.find(make_pair(node_idx, label));
+                if (cnit != child_nodes.end()) return cnit->second;
+            }
+            int new_node_idx = next_node_idx++;
+            if (nodes != nullptr && node_idx != -1) (*nodes)[node_idx].arcs.insert(new_node_idx);
+            if (node_idx != -1 && label != -1) child_nodes[make_pair(node_idx, label)] = new_node_idx;
+            return new_node_idx;
+        };
+        auto connect_triphone = [&](int hmm_idx, int node_idx, int &first_node_idx) {
+            const Hmm &hmm = graph->m_hmms.at(hmm_idx);
+            // The chain starts from the predecessor if the HMM has no emitting states
+            first_node_idx = node_idx;
+            for (unsigned int sidx = 2; sidx < hmm.states.size(); ++sidx) {
+                node_idx = connect_node(node_idx, hmm.states[sidx].model);
+                if (nodes != nullptr) (*nodes)[node_idx].hmm_state = hmm.states[sidx].model;
+                if (sidx == 2) first_node_idx = node_idx;
+            }
+            return node_idx;
+        };
+        auto connect_arc = [&](int node_idx, int target_node_idx) {
+            if (nodes != nullptr) (*nodes)[node_idx].arcs.insert(target_node_idx);
+        };
+
+        try {
+            int fanoutt = tables->fanout_triphones[i];
+            char fanout_phone = graph->tphone(fanoutt);
+            int creator = tables->first_fanout_of_phone[graph->m_phone_ids[(unsigned char)fanout_phone]];
+            if (nodes == nullptr && creator == i) layout.triphone2_starts.resize(num_fanins, -1);
+            if (nodes == nullptr && i == 0) layout.fanin_nodes.resize(num_fanins, -1);
+
+            int fanout_idx = connect_node(-1, -1);
+            if (nodes != nullptr) (*nodes)[fanout_idx].flags |= NODE_FAN_OUT_DUMMY;
+
+            for (int j=0; j<num_fanins; j++) {
+                int fanint = tables->fanin_triphones[j];
+                int triphone1 = graph->triphone_hmm(
+                    graph->triphone_id(graph->tlc(fanoutt), fanout_phone, graph->tphone(fanint)));
+                int first_idx = -1;
+                int tri1_idx = connect_triphone(triphone1, fanout_idx, first_idx);
+                int idx = tri1_idx;
+                if (tables->wb_symbol_id != -1) {
+                    idx = connect_node(idx, -2);
+                    if (nodes != nullptr) (*nodes)[idx].word_id = tables->wb_symbol_id;
+                }
+                if (tables->short_silence) idx = connect_triphone(tables->short_sil_hmm, idx, first_idx);
+
+                if (creator == i && tables->triphone2_owner[j] == j) {
+                    int triphone2 = graph->triphone_hmm(
+                        graph->triphone_id(fanout_phone, graph->tphone(fanint), graph->trc(fanint)));
+                    int triphone2_start = -1;
+                    idx = connect_triphone(triphone2, idx, triphone2_start);
+                    if (tables->triphone1_to_triphone2) connect_arc(tri1_idx, triphone2_start);
+                    if (nodes == nullptr) layout.triphone2_starts[j] = triphone2_start;
+                    if (i == 0 && tables->fanin_nodes[j] == -1) {
+                        int fanin_idx = connect_node(idx, -1);
+                        if (nodes == nullptr) layout.fanin_nodes[j] = fanin_idx;
+                        else (*nodes)[fanin_idx].flags |= NODE_FAN_IN_DUMMY;
+                    }
+                    else if (nodes != nullptr) connect_arc(idx, fanin_nodes->at(j));
+                }
+                else if (nodes != nullptr) {
+                    int triphone2_start = offsets->at(creator)
+                        + layouts->at(creator).triphone2_starts[tables->triphone2_owner[j]];
+                    if (tables->triphone1_to_triphone2) connect_arc(tri1_idx, triphone2_start);
+                    connect_arc(idx, triphone2_start);
+                }
+            }
+        } catch (string &e) {
+            layout.error = e;
+        }
+        if (nodes == nullptr) layout.num_nodes = next_node_idx;
+    }
+}
+
+
+void
+DecoderGraph::connect_fanouts_to_fanins(vector<DecoderGraph::Node> &nodes,
+                                        map<int, int> &fanout,
+                                        map<int, int> &fanin,
+                                        bool wb_symbol,
+                                        bool short_silence,
+                                        bool triphone1_to_triphone2,
+                                        int num_extra_nodes) const
+{
+    if (fanout.size() == 0) return;
+
+    FanoutFaninTables tables;
+    tables.short_silence = short_silence;
+    tables.triphone1_to_triphone2 = triphone1_to_triphone2;
+    tables.short_sil_hmm = short_silence ? m_hmm_map.at(SHORT_SIL) : -1;
+    tables.wb_symbol_id = wb_symbol ? m_subword_map.at("<w>") : -1;
+
+    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit)
+        tables.fanout_triphones.push_back(foit->first);
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
+        tables.fanin_triphones.push_back(fiit->first);
+        tables.fanin_nodes.push_back(fiit->second);
+    }
+
+    tables.first_fanout_of_phone.resize(m_phones.size(), -1);
+    for (int i=0; i<(int)tables.fanout_triphones.size(); i++) {
+        int phone = m_phone_ids[(unsigned char)tphone(tables.fanout_triphones[i])];
+        if (tables.first_fanout_of_phone[phone] == -1)
+            tables.first_fanout_of_phone[phone] = i;
+    }
+
+    map<pair<char, char>, int> triphone2_owners;
+    for (int j=0; j<(int)tables.fanin_triphones.size(); j++) {
+        int fanint = tables.fanin_triphones[j];
+        auto owner = triphone2_owners.insert(make_pair(make_pair(tphone(fanint), trc(fanint)), j));
+        tables.triphone2_owner.push_back(owner.first->second);
+    }
+
+    // Layouts of the subnetworks first, then the nodes in place
+    vector<FanoutLayout> layouts(tables.fanout_triphones.size());
+    vector<int> offsets;
+    vector<int> fanin_nodes;
+    int num_threads = max(1, min(m_num_threads, (int)layouts.size()));
+    for (int pass=0; pass<2; pass++) {
+        vector<std::thread*> threads;
+        for (int t=0; t<num_threads; t++)
+            threads.push_back(new std::thread(&build_fanout_subnetworks, this, &tables, &layouts,
+                                              &offsets, &fanin_nodes, pass == 0 ? nullptr : &nodes,
+                                              t, num_threads));
+        for (int t=0; t<num_threads; t++) {
+            threads[t]->join();
+            delete threads[t];
+        }
+        for (auto lit = layouts.begin(); lit != layouts.end(); ++lit)
+            if (lit->error.length() > 0) throw lit->error;
+        if (pass > 0) break;
+
+        int num_nodes = nodes.size();
+        for (auto lit = layouts.begin(); lit != layouts.end(); ++lit) {
+            offsets.push_back(num_nodes);
+            num_nodes += lit->num_nodes;
+        }
+        nodes.reserve(num_nodes + num_extra_nodes);
+        nodes.resize(num_nodes);
+
+        int fo_idx = 0;
+        for (auto foit = fanout.begin(); foit != fanout.end(); ++foit, ++fo_idx)
+            foit->second = offsets[fo_idx];
+        int fi_idx = 0;
+        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit, ++fi_idx) {
+            if (layouts[0].fanin_nodes[fi_idx] != -1)
+                fiit->second = offsets[0] + layouts[0].fanin_nodes[fi_idx];
+            fanin_nodes.push_back(fiit->second);
+        }
+    }
+}
+
 void
 DecoderGraph::reachable_graph_nodes(vector<DecoderGraph::Node> &nodes,
                                     set<node_idx_t> &node_idxs,
@@ -1688,11 +2212,52 @@ DecoderGraph::prune_unreachable_nodes(vector<DecoderGraph::Node> &nodes)
 }
 
 
+vector<int>
+DecoderGraph::order_nodes_for_locality(vector<DecoderGraph::Node> &nodes)
+{
+    vector<int> arc_offsets(1, 0);
+    vector<int> arc_targets;
+    vector<int> flags;
+    for (auto nit = nodes.begin(); nit != nodes.end(); ++nit) {
+        arc_targets.insert(arc_targets.end(), nit->arcs.begin(), nit->arcs.end());
+        arc_offsets.push_back(arc_targets.size());
+        flags.push_back(nit->flags);
+    }
+    vector<int> order = locality_node_order(arc_offsets, arc_targets, flags);
+    vector<int> new_indices = invert_node_order(order);
+    vector<int>().swap(arc_targets);
+
+    auto remap = [&new_indices](IdSet &ids) {
+        IdSet remapped;
+        for (auto iit = ids.begin(); iit != ids.end(); ++iit)
+            remapped.insert(new_indices[*iit]);
+        ids.swap(remapped);
+    };
+
+    // Pruning does not update the reverse arcs, they are set again when needed.
+    // The cross-word contexts are triphone ids and stay as they are.
+    vector<DecoderGraph::Node> ordered_nodes(nodes.size());
+    for (int i=0; i<(int)order.size(); i++) {
+        DecoderGraph::Node &node = ordered_nodes[i];
+        node = std::move(nodes[order[i]]);
+        remap(node.arcs);
+        node.reverse_arcs.clear();
+        if (node.lookahead != nullptr)
+            for (auto lait = node.lookahead->begin(); lait != node.lookahead->end(); ++lait)
+                lait->second = new_indices[lait->second];
+    }
+
+    nodes.swap(ordered_nodes);
+
+    return new_indices;
+}
+
+
 void
 DecoderGraph::prune_unreachable_nodes_cw(vector<DecoderGraph::Node> &nodes,
                                          const set<node_idx_t> &start_nodes,
-                                         map<string, int> &fanout,
-                                         map<string, int> &fanin)
+                                         map<int, int> &fanout,
+                                         map<int, int> &fanin)
 {
     vector<DecoderGraph::Node> pruned_nodes;
     map<node_idx_t, node_idx_t> index_mapping;
@@ -1931,6 +2496,116 @@ DecoderGraph::remove_cw_dummies(vector<DecoderGraph::Node> &nodes)
 }
 
 
+static bool
+is_removable_dummy(const DecoderGraph::Node &node,
+                   node_idx_t node_idx)
+{
+    if (node_idx <= END_NODE) return false;
+    if (node.hmm_state != -1 || node.word_id >= 0) return false;
+    return (node.flags & ~(NODE_FAN_OUT_DUMMY | NODE_FAN_IN_DUMMY | NODE_CW)) == 0;
+}
+
+
+int
+DecoderGraph::remove_dummy_nodes(vector<DecoderGraph::Node> &nodes,
+                                 int max_arc_product)
+{
+    set_reverse_arcs_also_from_unreachable(nodes);
+
+    int removed_count = 0;
+    for (node_idx_t i=0; i<nodes.size(); i++) {
+        DecoderGraph::Node &node = nodes[i];
+        if (!is_removable_dummy(node, i)) continue;
+        if ((long long int)node.reverse_arcs.size() * node.arcs.size() > max_arc_product) continue;
+
+        // Self transitions would be created for the acoustic nodes
+        bool loop = node.arcs.count(i) > 0;
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+            if (node.reverse_arcs.count(*ait)) loop = true;
+        if (loop) continue;
+
+        for (auto rait = node.reverse_arcs.begin(); rait != node.reverse_arcs.end(); ++rait) {
+            DecoderGraph::Node &pred_node = nodes[*rait];
+            pred_node.arcs.erase(i);
+            for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+                pred_node.arcs.insert(*ait);
+                nodes[*ait].reverse_arcs.insert(*rait);
+            }
+        }
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+            nodes[*ait].reverse_arcs.erase(i);
+        node.arcs.clear();
+        node.reverse_arcs.clear();
+        removed_count++;
+    }
+
+    clear_reverse_arcs(nodes);
+    prune_unreachable_nodes(nodes);
+
+    return removed_count;
+}
+
+
+void
+DecoderGraph::remove_dummy_nodes(int max_arc_product,
+                                 bool verbose)
+{
+    int node_count = 0, arc_count = 0;
+    double token_arcs = 0.0;
+    if (verbose) {
+        node_count = reachable_graph_nodes(m_nodes);
+        arc_count = num_arcs(m_nodes);
+        token_arcs = arcs_per_token(m_nodes);
+    }
+
+    int removed_count = remove_dummy_nodes(m_nodes, max_arc_product);
+
+    if (verbose) {
+        cerr << "removed dummy nodes: " << removed_count << endl;
+        cerr << "number of nodes: " << node_count << " -> " << reachable_graph_nodes(m_nodes) << endl;
+        cerr << "number of arcs: " << arc_count << " -> " << num_arcs(m_nodes) << endl;
+        cerr << "arcs followed per token: " << token_arcs << " -> " << arcs_per_token(m_nodes) << endl;
+    }
+}
+
+
+// Arcs followed from the node, the arcs of the removable dummy nodes are
+// followed further. Counts of the dummy nodes are stored, -1 for not set.
+static long long int
+followed_arcs(const vector<DecoderGraph::Node> &nodes,
+              node_idx_t node_idx,
+              vector<long long int> &dummy_arc_counts)
+{
+    long long int arc_count = 0;
+    for (auto ait = nodes[node_idx].arcs.begin(); ait != nodes[node_idx].arcs.end(); ++ait) {
+        arc_count++;
+        if (*ait == node_idx || !is_removable_dummy(nodes[*ait], *ait)) continue;
+        if (dummy_arc_counts[*ait] == -1) {
+            dummy_arc_counts[*ait] = 0;
+            dummy_arc_counts[*ait] = followed_arcs(nodes, *ait, dummy_arc_counts);
+        }
+        arc_count += dummy_arc_counts[*ait];
+    }
+    return arc_count;
+}
+
+
+double
+DecoderGraph::arcs_per_token(vector<DecoderGraph::Node> &nodes)
+{
+    vector<long long int> dummy_arc_counts(nodes.size(), -1);
+    long long int arc_count = 0;
+    int acoustic_node_count = 0;
+    for (node_idx_t i=0; i<nodes.size(); i++) {
+        if (nodes[i].hmm_state == -1) continue;
+        acoustic_node_count++;
+        arc_count += followed_arcs(nodes, i, dummy_arc_counts);
+    }
+    if (acoustic_node_count == 0) return 0.0;
+    return (double)arc_count / acoustic_node_count;
+}
+
+
 void
 DecoderGraph::remove_nodes_with_no_arcs(vector<DecoderGraph::Node> &nodes)
 {
@@ -1,12 +1,13 @@
 #ifndef DECODERGRAPH_HH
 #define DECODERGRAPH_HH
 
-#include <list>
+#include <algorithm>
 #include <map>
 #include <deque>
 #include <fstream>
 #include <vector>
 #include <set>
+#include <unordered_map>
 
 #include "defs.hh"
 #include "Hmm.hh"
@@ -21,35 +22,139 @@ public:
 };
 
 
+// Sorted set of unsigned integer ids in a small vector,
+// up to two ids are stored without a heap allocation
+class IdSet {
+public:
+    typedef const unsigned int* const_iterator;
+    typedef const_iterator iterator;
+
+    IdSet() : m_size(0), m_capacity(INLINE_CAPACITY) { }
+    IdSet(const IdSet &other);
+    IdSet(IdSet &&other) noexcept;
+    ~IdSet() { if (m_capacity > INLINE_CAPACITY) delete[] m_heap; }
+    IdSet& operator=(IdSet other) noexcept { swap(other); return *this; }
+
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + m_size; }
+    unsigned int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    void clear();
+    bool insert(unsigned int id);
+    template<class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        std::vector<unsigned int> ids(first, last);
+        for (auto iit = ids.begin(); iit != ids.end(); ++iit) insert(*iit);
+    }
+    unsigned int erase(unsigned int id);
+    const_iterator find(unsigned int id) const;
+    unsigned int count(unsigned int id) const { return find(id) != end() ? 1 : 0; }
+    void swap(IdSet &other) noexcept;
+
+    bool operator==(const IdSet &other) const;
+    bool operator!=(const IdSet &other) const { return !(*this == other); }
+    bool operator<(const IdSet &other) const;
+
+private:
+    static const unsigned int INLINE_CAPACITY = 2;
+    // Moves the ids of the other set, this set must not own a heap array
+    void take(IdSet &other) noexcept;
+    unsigned int* data() { return m_capacity > INLINE_CAPACITY ? m_heap : m_inline; }
+    const unsigned int* data() const { return m_capacity > INLINE_CAPACITY ? m_heap : m_inline; }
+
+    unsigned int m_size;
+    unsigned int m_capacity;
+    union {
+        unsigned int m_inline[INLINE_CAPACITY];
+        unsigned int *m_heap;
+    };
+};
+
+
 class DecoderGraph {
 
 public:
 
+    // Cross-word book-keeping used in construction,
+    // interned triphone ids, see m_phones
+    class CrosswordContexts {
+    public:
+        IdSet from_fanin;
+        IdSet to_fanout;
+        // to_fanout_2 is for cases where suffix and non-suffix units in the same tree
+        IdSet to_fanout_2;
+    };
+
     class Node {
     public:
-        Node() : word_id(-1), hmm_state(-1), flags(0), lookahead(nullptr) { }
+        Node() : word_id(-1), hmm_state(-1), flags(0), lookahead(nullptr), crossword(nullptr) { }
+        Node(const Node &node);
+        Node(Node &&node) noexcept;
+        ~Node() { delete crossword; }
+        Node& operator=(Node node) noexcept { swap(node); return *this; }
+        void swap(Node &node) noexcept;
+
         int word_id; // -1 for nodes without word identity.
         int hmm_state; // -1 for nodes without acoustics.
         int flags;
-        std::set<unsigned int> arcs;
-        std::set<unsigned int> reverse_arcs;
+        IdSet arcs;
+        IdSet reverse_arcs;
 
-        // word_id, hmm_state pairs
+        // word_id, hmm_state pairs and the target nodes sorted by the pair,
         // used in construction
-        std::map<std::pair<int, int>, int> *lookahead;
-        // Cross-word book-keeping used in construction
-        std::set<std::string> from_fanin;
-        std::set<std::string> to_fanout;
-        std::set<std::string> to_fanout_2;
-        // to_fanout_2 is for cases where suffix and non-suffix units in the same tree
+        std::vector<std::pair<std::pair<int, int>, int> > *lookahead;
+        // Allocated for the nodes with cross-word contexts
+        CrosswordContexts *crossword;
+
+        CrosswordContexts& crossword_contexts() {
+            if (crossword == nullptr) crossword = new CrosswordContexts;
+            return *crossword;
+        }
 
         int find_next(int word_id, int hmm_state) {
             if (lookahead == nullptr) throw std::string("Lookahead not set.");
-            std::pair<int,int> id = std::make_pair(word_id, hmm_state);
-            if (lookahead->find(id) != lookahead->end())
-                return (*lookahead)[id];
+            auto lait = find_lookahead(word_id, hmm_state);
+            if (lait != lookahead->end() && lait->first == std::make_pair(word_id, hmm_state))
+                return lait->second;
             else return -1;
         }
+
+        std::vector<std::pair<std::pair<int, int>, int> >::iterator
+        find_lookahead(int word_id, int hmm_state) {
+            return std::lower_bound(lookahead->begin(), lookahead->end(),
+                                    std::make_pair(std::make_pair(word_id, hmm_state), -1));
+        }
+    };
+
+    // Builds a tree of state chains like add_nodes_to_tree, but the chains
+    // are added in sorted order (see sort_by_state_chain) and each finished
+    // suffix is merged right away with an equivalent registered node.
+    // The graph stays close to its suffix-minimized size during construction.
+    class MinimizingTreeBuilder {
+    public:
+        MinimizingTreeBuilder(std::vector<Node> &nodes);
+        // Adds the chain and connects it to the end node,
+        // takes the cross-word contexts of the new nodes
+        void add_nodes(std::vector<Node> &new_nodes);
+        // Registers the last chain, call after adding all the chains
+        void finish() { minimize_path(1); }
+        int merged_count() const { return m_merged_count; }
+
+    private:
+        void minimize_path(unsigned int depth);
+        size_t signature_hash(node_idx_t node_idx) const;
+        bool same_signature(node_idx_t node_idx_1, node_idx_t node_idx_2) const;
+        node_idx_t new_node();
+
+        std::vector<Node> &m_nodes;
+        // Nodes of the last chain, START_NODE first
+        std::vector<node_idx_t> m_path;
+        std::vector<int> m_labels;
+        // Finished nodes by the signature hash
+        std::unordered_multimap<size_t, node_idx_t> m_register;
+        // Merged nodes, reused for the next chains
+        std::vector<node_idx_t> m_free_nodes;
+        int m_merged_count;
     };
 
     // Text units
@@ -64,19 +169,50 @@ public:
     std::vector<Hmm> m_hmms;
     // Hmm states
     std::vector<HmmState> m_hmm_states;
+    // Phones of the triphone HMMs in character order and the phone id by
+    // the character, -1 if not a phone. A triphone id is
+    // (left * m_phones.size() + phone) * m_phones.size() + right,
+    // the ids sort like the triphone labels.
+    std::vector<char> m_phones;
+    std::vector<int> m_phone_ids;
+    // HMM index by the triphone id, -1 if not in the model
+    std::vector<int> m_triphone_hmms;
 
     int m_states_per_phone;
+    // Threads for building the cross-word networks
+    int m_num_threads;
 
     std::vector<DecoderGraph::Node> m_nodes;
 
 
     DecoderGraph() { m_states_per_phone = -1;
+                     m_num_threads = 1;
                      m_nodes.resize(2); }
     virtual ~DecoderGraph() { };
 
     void read_phone_model(std::string phnfname);
+    // Phone and triphone tables from the HMM labels, called by read_phone_model
+    void set_phone_tables();
     void read_noway_lexicon(std::string lexfname);
 
+    // Interned triphones, the functions throw for unknown phones
+    int triphone_id(const std::string &triphone) const;
+    int triphone_id(char left_ctxt,
+                    char phone,
+                    char right_ctxt) const;
+    std::string triphone(int triphone_id) const;
+    char tlc(int triphone_id) const { return m_phones[triphone_id / (m_phones.size() * m_phones.size())]; }
+    char tphone(int triphone_id) const { return m_phones[triphone_id / m_phones.size() % m_phones.size()]; }
+    char trc(int triphone_id) const { return m_phones[triphone_id % m_phones.size()]; }
+    // Triphone id from the phone ids
+    int phone_ids_to_triphone_id(int left_ctxt_id, int phone_id, int right_ctxt_id) const {
+        return (left_ctxt_id * m_phones.size() + phone_id) * m_phones.size() + right_ctxt_id;
+    }
+    // HMM index of the triphone, throws if not in the model
+    int triphone_hmm(int triphone_id) const;
+    // HMM index of a triphone or another HMM label
+    int hmm_index(const std::string &label) const;
+
 
     void read_words(std::string wordfname,
                     std::set<std::string> &words) const;
@@ -99,6 +235,9 @@ public:
                                           char right_ctxt);
     static void triphonize_phone_string(std::string pstring,
                                         std::vector<std::string> &triphones);
+    // Same with the HMM indices, a silence inside the string is a short silence
+    void triphonize_phone_string(const std::string &pstring,
+                                 std::vector<int> &hmm_ids) const;
     void triphonize(std::map<std::string, std::vector<std::string> > &word_segs,
                     std::string word,
                     std::vector<std::string> &triphones) const;
@@ -115,6 +254,13 @@ public:
                            std::vector<DecoderGraph::Node> &new_nodes,
                            bool connect_to_end_node = true);
     void lookahead_to_arcs(std::vector<DecoderGraph::Node> &nodes);
+    // Sort key of a state chain node
+    static int chain_label(const DecoderGraph::Node &node) {
+        return node.word_id != -1 ? -2 - node.word_id : node.hmm_state;
+    }
+    // Units in the order of their state chains, units with '<' are left out
+    void sort_by_state_chain(const std::set<std::string> &subwords,
+                             std::vector<std::string> &sorted_subwords) const;
 
     void get_hmm_states(const std::vector<std::string> &triphones,
                         std::vector<int> &states) const;
@@ -188,57 +334,40 @@ public:
             bool cw_visited = false);
     bool assert_only_cw_word_pairs(std::set<std::string> &words);
 
-    static void tie_state_prefixes(std::vector<DecoderGraph::Node> &nodes,
-                                   bool stop_propagation=false,
-                                   node_idx_t node_idx=START_NODE);
-    static void tie_state_prefixes_cw(std::vector<DecoderGraph::Node> &cw_nodes,
-                                      std::map<std::string, int> &fanout,
-                                      std::map<std::string, int> &fanin,
-                                      bool stop_propagation=false);
-    static void tie_state_prefixes(std::vector<DecoderGraph::Node> &nodes,
-                                   std::list<node_idx_t> nodes_to_process,
-                                   bool stop_propagation=false);
-
-    static void tie_word_id_prefixes(std::vector<DecoderGraph::Node> &nodes,
-                                     bool stop_propagation=false,
-                                     node_idx_t node_idx=START_NODE);
-    static void tie_word_id_prefixes_cw(std::vector<DecoderGraph::Node> &cw_nodes,
-                                        std::map<std::string, int> &fanout,
-                                        std::map<std::string, int> &fanin,
-                                        bool stop_propagation=false);
-    static void tie_word_id_prefixes(std::vector<DecoderGraph::Node> &nodes,
-                                     std::list<node_idx_t> nodes_to_process,
-                                     bool stop_propagation=false);
-
-    static void tie_state_suffixes(std::vector<DecoderGraph::Node> &nodes,
-                                   bool stop_propagation=false,
-                                   node_idx_t node_idx=END_NODE);
-    static void tie_state_suffixes_cw(std::vector<DecoderGraph::Node> &cw_nodes,
-                                      std::map<std::string, int> &fanout,
-                                      std::map<std::string, int> &fanin,
-                                      bool stop_propagation=false);
-    static void tie_state_suffixes(std::vector<DecoderGraph::Node> &nodes,
-                                   std::list<node_idx_t> nodes_to_process,
-                                   bool stop_propagation=false);
-
-    static void tie_word_id_suffixes(std::vector<DecoderGraph::Node> &nodes,
-                                     bool stop_propagation=false,
-                                     node_idx_t node_idx=END_NODE);
-    static void tie_word_id_suffixes_cw(std::vector<DecoderGraph::Node> &cw_nodes,
-                                        std::map<std::string, int> &fanout,
-                                        std::map<std::string, int> &fanin,
-                                        bool stop_propagation=false);
-    static void tie_word_id_suffixes(std::vector<DecoderGraph::Node> &nodes,
-                                     std::list<node_idx_t> nodes_to_process,
-                                     bool stop_propagation=false);
+    // Merges nodes with the same HMM state, word id, flags and predecessors
+    // (prefixes) or successors (suffixes) until no more nodes can be merged.
+    // Only HMM state nodes are merged if tie_word_ids is false.
+    // Flags are compared so that cross-word nodes are not merged into word nodes.
+    // Returns the number of merged nodes.
+    static int tie_prefixes(std::vector<DecoderGraph::Node> &nodes,
+                            bool tie_word_ids=true,
+                            node_idx_t node_idx=START_NODE);
+    static int tie_prefixes_cw(std::vector<DecoderGraph::Node> &cw_nodes,
+                               std::map<int, int> &fanout,
+                               std::map<int, int> &fanin,
+                               bool tie_word_ids=true);
+    static int tie_suffixes(std::vector<DecoderGraph::Node> &nodes,
+                            bool tie_word_ids=true,
+                            node_idx_t node_idx=END_NODE);
+    static int tie_suffixes_cw(std::vector<DecoderGraph::Node> &cw_nodes,
+                               std::map<int, int> &fanout,
+                               std::map<int, int> &fanin,
+                               bool tie_word_ids=true);
+    // Nodes reachable from the start nodes are hashed by their signature
+    // and processed with a work list, reverse arcs must be set
+    static int tie_nodes(std::vector<DecoderGraph::Node> &nodes,
+                         const std::set<node_idx_t> &start_nodes,
+                         bool suffixes,
+                         bool tie_word_ids);
 
     void minimize_crossword_network(std::vector<DecoderGraph::Node> &cw_nodes,
-                                    std::map<std::string, int> &fanout,
-                                    std::map<std::string, int> &fanin);
+                                    std::map<int, int> &fanout,
+                                    std::map<int, int> &fanin,
+                                    bool verbose=false);
 
     void connect_crossword_network(std::vector<DecoderGraph::Node> &cw_nodes,
-                                   std::map<std::string, int> &fanout,
-                                   std::map<std::string, int> &fanin,
+                                   std::map<int, int> &fanout,
+                                   std::map<int, int> &fanin,
                                    bool push_left_after_fanin=true);
 
     void print_graph(std::vector<DecoderGraph::Node> &nodes,
@@ -287,6 +416,21 @@ public:
     int connect_dummy(std::vector<DecoderGraph::Node> &nodes,
                       node_idx_t node_idx,
                       int flag_mask=0) const;
+    // Connects each fanout to each fanin through triphone1, optional word break
+    // symbol and short silence and triphone2, the fanouts with the same phone
+    // share the triphone2 chains. Creates the fanout and fanin nodes.
+    // The fanout subnetworks are built in m_num_threads threads,
+    // the result is the same as when building serially.
+    // Room is reserved for num_extra_nodes nodes the caller adds after the network.
+    void connect_fanouts_to_fanins(std::vector<DecoderGraph::Node> &nodes,
+                                   std::map<int, int> &fanout,
+                                   std::map<int, int> &fanin,
+                                   bool wb_symbol,
+                                   bool short_silence,
+                                   bool triphone1_to_triphone2=false,
+                                   int num_extra_nodes=0) const;
+    // Number of nodes connect_triphone adds for the HMM
+    int hmm_node_count(const std::string &label) const { return m_hmms[hmm_index(label)].states.size() - 2; }
 
     static int reachable_graph_nodes(std::vector<DecoderGraph::Node> &nodes);
     static void reachable_graph_nodes(std::vector<DecoderGraph::Node> &nodes,
@@ -296,10 +440,13 @@ public:
                                std::set<node_idx_t> &node_idxs,
                                node_idx_t node_idx=START_NODE);
     static void prune_unreachable_nodes(std::vector<DecoderGraph::Node> &nodes);
+    // Renumbers the nodes in the locality order of NodeOrder.hh,
+    // returns the new index of each old node
+    static std::vector<int> order_nodes_for_locality(std::vector<DecoderGraph::Node> &nodes);
     static void prune_unreachable_nodes_cw(std::vector<DecoderGraph::Node> &nodes,
                                            const std::set<node_idx_t> &start_nodes,
-                                           std::map<std::string, int> &fanout,
-                                           std::map<std::string, int> &fanin);
+                                           std::map<int, int> &fanout,
+                                           std::map<int, int> &fanin);
     static void push_word_ids_left(std::vector<DecoderGraph::Node> &nodes);
     static void push_word_ids_left(std::vector<DecoderGraph::Node> &nodes,
                                    int &move_count,
@@ -325,8 +472,20 @@ public:
     void add_silence_loop(bool sentence_end_symbol=true);
     void write_graph(std::string fname,
                      bool lm_labels=false);
+    // Reads a graph written with word indices
+    void read_graph(std::string fname);
 
     void remove_cw_dummies(std::vector<DecoderGraph::Node> &nodes);
+    // Removes the non-acoustic nodes without word identity and without other
+    // flags than the cross-word markers by connecting the predecessors directly
+    // to the successors. Nodes with fan-in times fan-out above the limit are kept.
+    // Returns the number of removed nodes.
+    static int remove_dummy_nodes(std::vector<DecoderGraph::Node> &nodes,
+                                  int max_arc_product);
+    void remove_dummy_nodes(int max_arc_product, bool verbose=false);
+    // Average number of arcs a token follows from an acoustic node
+    // until the next acoustic, word or flagged node
+    static double arcs_per_token(std::vector<DecoderGraph::Node> &nodes);
     void remove_nodes_with_no_arcs(std::vector<DecoderGraph::Node> &nodes);
 
     virtual void create_forced_path(std::vector<DecoderGraph::Node> &nodes,
@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "GraphValidator.hh"
+
+using namespace std;
+
+
+// Search state with the remaining HMM states and text units as interned suffixes
+class PathKey {
+public:
+    PathKey(int node_idx, int state_suffix, int word_suffix)
+        : node_idx(node_idx), state_suffix(state_suffix), word_suffix(word_suffix) { }
+    bool operator==(const PathKey &other) const {
+        return node_idx == other.node_idx
+            && state_suffix == other.state_suffix
+            && word_suffix == other.word_suffix;
+    }
+    int node_idx;
+    int state_suffix;
+    int word_suffix;
+};
+
+
+class PathKeyHash {
+public:
+    size_t operator()(const PathKey &key) const {
+        unsigned long long int h = (unsigned int)key.node_idx;
+        h = h * 0x9e3779b97f4a7c15ULL + (unsigned int)key.state_suffix;
+        h = h * 0x9e3779b97f4a7c15ULL + (unsigned int)key.word_suffix;
+        return h ^ (h >> 29);
+    }
+};
+
+
+// Depth-first path search of one thread. The interned suffixes and the
+// states on the found paths are kept between the searches.
+class PathSearch {
+public:
+    PathSearch(const GraphValidator &validator)
+        : m_validator(validator), m_nodes(validator.m_graph.m_nodes) { }
+    bool find_path(const vector<int> &states,
+                   const vector<int> &word_ids);
+
+private:
+    static const unsigned int MAX_SUFFIXES = 1 << 22;
+    static const unsigned int MAX_FOUND = 1 << 23;
+
+    class PathFrame {
+    public:
+        PathFrame(const PathKey &key, int state_pos, int word_pos)
+            : key(key), state_pos(state_pos), word_pos(word_pos), arc_pos(0) { }
+        PathKey key;
+        int state_pos;
+        int word_pos;
+        int arc_pos;
+    };
+
+    // Suffix ids by the position, the last one is the empty suffix
+    void intern_suffixes(const vector<int> &labels,
+                         bool word_labels,
+                         vector<int> &suffix_ids);
+    // Consumes the HMM state and the text unit of the node, false if they do not match
+    bool enter(int node_idx,
+               int &state_pos,
+               int &word_pos) const;
+    // Pushes the state to the path, true if the path is complete
+    bool push(int node_idx,
+              int state_pos,
+              int word_pos);
+
+    const GraphValidator &m_validator;
+    const vector<DecoderGraph::Node> &m_nodes;
+    // Suffix id by the suffix id after the first label and the label
+    unordered_map<long long int, int> m_suffixes;
+    unordered_set<PathKey, PathKeyHash> m_found;
+    unordered_set<PathKey, PathKeyHash> m_visited;
+    vector<PathFrame> m_path;
+    const vector<int> *m_states;
+    const vector<int> *m_word_ids;
+    vector<int> m_state_suffixes;
+    vector<int> m_word_suffixes;
+};
+
+
+void
+PathSearch::intern_suffixes(const vector<int> &labels,
+                            bool word_labels,
+                            vector<int> &suffix_ids)
+{
+    suffix_ids.resize(labels.size()+1);
+    suffix_ids.back() = 0;
+    for (int i=labels.size()-1; i>=0; i--) {
+        unsigned int label = word_labels ? -2 - labels[i] : labels[i];
+        long long int key = ((long long int)suffix_ids[i+1] << 32) | label;
+        auto sit = m_suffixes.insert(make_pair(key, (int)m_suffixes.size()+1));
+        suffix_ids[i] = sit.first->second;
+    }
+}
+
+
+bool
+PathSearch::enter(int node_idx,
+                  int &state_pos,
+                  int &word_pos) const
+{
+    const DecoderGraph::Node &node = m_nodes[node_idx];
+    if (node.hmm_state != -1) {
+        if (state_pos == (int)m_states->size()) return false;
+        if ((*m_states)[state_pos] != node.hmm_state) return false;
+        state_pos++;
+    }
+    if (node.word_id != -1) {
+        if (word_pos == (int)m_word_ids->size()) return false;
+        if ((*m_word_ids)[word_pos] != node.word_id) return false;
+        word_pos++;
+    }
+    return true;
+}
+
+
+bool
+PathSearch::push(int node_idx,
+                 int state_pos,
+                 int word_pos)
+{
+    PathKey key(node_idx, m_state_suffixes[state_pos], m_word_suffixes[word_pos]);
+    if (!m_visited.insert(key).second) return false;
+    m_path.push_back(PathFrame(key, state_pos, word_pos));
+
+    bool complete = node_idx == END_NODE
+        && state_pos == (int)m_states->size()
+        && word_pos == (int)m_word_ids->size();
+    if (!complete && m_found.find(key) == m_found.end()) return false;
+
+    for (auto pit = m_path.begin(); pit != m_path.end(); ++pit)
+        m_found.insert(pit->key);
+    return true;
+}
+
+
+bool
+PathSearch::find_path(const vector<int> &states,
+                      const vector<int> &word_ids)
+{
+    if (m_suffixes.size() > MAX_SUFFIXES || m_found.size() > MAX_FOUND) {
+        m_suffixes.clear();
+        m_found.clear();
+    }
+    intern_suffixes(states, false, m_state_suffixes);
+    intern_suffixes(word_ids, true, m_word_suffixes);
+    m_states = &states;
+    m_word_ids = &word_ids;
+    m_visited.clear();
+    m_path.clear();
+
+    int state_pos = 0;
+    int word_pos = 0;
+    if (!m_validator.m_live[START_NODE]) return false;
+    if (!enter(START_NODE, state_pos, word_pos)) return false;
+    if (push(START_NODE, state_pos, word_pos)) return true;
+
+    while (m_path.size()) {
+        PathFrame &frame = m_path.back();
+        const IdSet &arcs = m_nodes[frame.key.node_idx].arcs;
+        if (frame.arc_pos == (int)arcs.size()) {
+            m_path.pop_back();
+            continue;
+        }
+        int node_idx = arcs.begin()[frame.arc_pos++];
+        if (node_idx == frame.key.node_idx) continue;
+        if (!m_validator.m_live[node_idx]) continue;
+        state_pos = frame.state_pos;
+        word_pos = frame.word_pos;
+        if (!enter(node_idx, state_pos, word_pos)) continue;
+        if (push(node_idx, state_pos, word_pos)) return true;
+    }
+
+    return false;
+}
+
+
+// Runs the checks in [first_check, last_check), a second word -1 is a single word check
+static void
+check_paths(const GraphValidator *validator,
+            const vector<GraphValidator::CheckedWord> *words,
+            const vector<pair<int, int> > *checks,
+            bool short_silence,
+            int wb_symbol_id,
+            vector<char> *results,
+            int first_check,
+            int last_check)
+{
+    PathSearch search(*validator);
+    vector<string> triphones;
+    vector<int> states;
+    vector<int> word_ids;
+    for (int i=first_check; i<last_check; i++) {
+        const GraphValidator::CheckedWord &first_word = words->at(checks->at(i).first);
+        if (checks->at(i).second == -1) {
+            (*results)[i] = first_word.valid && search.find_path(first_word.states, first_word.word_ids);
+            continue;
+        }
+
+        const GraphValidator::CheckedWord &second_word = words->at(checks->at(i).second);
+        if (!first_word.valid || !second_word.valid || wb_symbol_id == -2) {
+            (*results)[i] = false;
+            continue;
+        }
+        string phones = first_word.phones;
+        if (short_silence) phones += "_";
+        phones += second_word.phones;
+        DecoderGraph::triphonize_phone_string(phones, triphones);
+        states.clear();
+        if (!validator->triphone_states(triphones, states)) {
+            (*results)[i] = false;
+            continue;
+        }
+        word_ids = first_word.word_ids;
+        if (wb_symbol_id != -1) word_ids.push_back(wb_symbol_id);
+        word_ids.insert(word_ids.end(), second_word.word_ids.begin(), second_word.word_ids.end());
+        (*results)[i] = search.find_path(states, word_ids);
+    }
+}
+
+
+GraphValidator::GraphValidator(const DecoderGraph &graph,
+                               int num_threads)
+    : m_graph(graph),
+      m_num_threads(num_threads),
+      m_max_reported_errors(10)
+{
+    const vector<DecoderGraph::Node> &nodes = m_graph.m_nodes;
+    m_reachable.assign(nodes.size(), false);
+    m_live.assign(nodes.size(), false);
+
+    vector<int> queue;
+    m_reachable[START_NODE] = true;
+    queue.push_back(START_NODE);
+    while (queue.size()) {
+        int node_idx = queue.back();
+        queue.pop_back();
+        for (auto ait = nodes[node_idx].arcs.begin(); ait != nodes[node_idx].arcs.end(); ++ait) {
+            if (m_reachable[*ait]) continue;
+            m_reachable[*ait] = true;
+            queue.push_back(*ait);
+        }
+    }
+
+    // Predecessors in one array by the target node
+    vector<int> first_predecessor(nodes.size()+1, 0);
+    for (auto nit = nodes.begin(); nit != nodes.end(); ++nit)
+        for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
+            first_predecessor[*ait+1]++;
+    for (unsigned int i=1; i<first_predecessor.size(); i++)
+        first_predecessor[i] += first_predecessor[i-1];
+    vector<int> predecessors(first_predecessor.back());
+    vector<int> fill_pos(first_predecessor.begin(), first_predecessor.end()-1);
+    for (int node_idx=0; node_idx<(int)nodes.size(); node_idx++)
+        for (auto ait = nodes[node_idx].arcs.begin(); ait != nodes[node_idx].arcs.end(); ++ait)
+            predecessors[fill_pos[*ait]++] = node_idx;
+
+    m_live[END_NODE] = true;
+    queue.push_back(END_NODE);
+    while (queue.size()) {
+        int node_idx = queue.back();
+        queue.pop_back();
+        for (int i=first_predecessor[node_idx]; i<first_predecessor[node_idx+1]; i++) {
+            if (m_live[predecessors[i]]) continue;
+            m_live[predecessors[i]] = true;
+            queue.push_back(predecessors[i]);
+        }
+    }
+}
+
+
+vector<int>
+GraphValidator::unreachable_nodes() const
+{
+    vector<int> node_idxs;
+    for (int i=0; i<(int)m_reachable.size(); i++)
+        if (!m_reachable[i]) node_idxs.push_back(i);
+    return node_idxs;
+}
+
+
+vector<int>
+GraphValidator::dead_nodes() const
+{
+    vector<int> node_idxs;
+    for (int i=0; i<(int)m_live.size(); i++)
+        if (!m_live[i]) node_idxs.push_back(i);
+    return node_idxs;
+}
+
+
+bool
+GraphValidator::triphone_states(const vector<string> &triphones,
+                                vector<int> &states) const
+{
+    for (auto tit = triphones.begin(); tit != triphones.end(); ++tit) {
+        auto hit = m_graph.m_hmm_map.find(*tit);
+        if (hit == m_graph.m_hmm_map.end()) return false;
+        const Hmm &hmm = m_graph.m_hmms[hit->second];
+        for (auto sit = hmm.states.begin(); sit != hmm.states.end(); ++sit)
+            if (sit->model >= 0) states.push_back(sit->model);
+    }
+    return true;
+}
+
+
+void
+GraphValidator::set_word(CheckedWord &word,
+                         const string &label,
+                         const vector<string> &subwords) const
+{
+    word.label = label;
+    for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
+        auto wit = m_graph.m_subword_map.find(*swit);
+        auto lit = m_graph.m_lexicon.find(*swit);
+        if (wit == m_graph.m_subword_map.end() || lit == m_graph.m_lexicon.end()) {
+            word.valid = false;
+            return;
+        }
+        word.word_ids.push_back(wit->second);
+        for (auto tit = lit->second.begin(); tit != lit->second.end(); ++tit)
+            word.phones += DecoderGraph::is_triphone(*tit) ? DecoderGraph::tphone(*tit) : (*tit)[0];
+    }
+}
+
+
+bool
+GraphValidator::assert_words(const set<string> &words)
+{
+    vector<CheckedWord> checked_words(words.size());
+    auto cwit = checked_words.begin();
+    for (auto wit = words.begin(); wit != words.end(); ++wit, ++cwit) {
+        set_word(*cwit, *wit, vector<string>(1, *wit));
+        if (cwit->valid)
+            cwit->valid = triphone_states(m_graph.m_lexicon.at(*wit), cwit->states);
+    }
+    return check_words(checked_words);
+}
+
+
+bool
+GraphValidator::assert_words(const map<string, vector<string> > &word_segs)
+{
+    vector<CheckedWord> checked_words(word_segs.size());
+    auto cwit = checked_words.begin();
+    for (auto wit = word_segs.begin(); wit != word_segs.end(); ++wit, ++cwit) {
+        set_word(*cwit, wit->first, wit->second);
+        if (!cwit->valid) continue;
+        vector<string> triphones;
+        DecoderGraph::triphonize_phone_string(cwit->phones, triphones);
+        cwit->valid = triphone_states(triphones, cwit->states);
+    }
+    return check_words(checked_words);
+}
+
+
+bool
+GraphValidator::assert_word_pairs(const set<string> &words,
+                                  int num_pairs,
+                                  bool short_silence,
+                                  bool wb_symbol)
+{
+    vector<CheckedWord> checked_words(words.size());
+    auto cwit = checked_words.begin();
+    for (auto wit = words.begin(); wit != words.end(); ++wit, ++cwit)
+        set_word(*cwit, *wit, vector<string>(1, *wit));
+    return check_word_pairs(checked_words, num_pairs, short_silence, wb_symbol);
+}
+
+
+bool
+GraphValidator::assert_word_pairs(const map<string, vector<string> > &word_segs,
+                                  int num_pairs,
+                                  bool short_silence,
+                                  bool wb_symbol)
+{
+    vector<CheckedWord> checked_words(word_segs.size());
+    auto cwit = checked_words.begin();
+    for (auto wit = word_segs.begin(); wit != word_segs.end(); ++wit, ++cwit)
+        set_word(*cwit, wit->first, wit->second);
+    return check_word_pairs(checked_words, num_pairs, short_silence, wb_symbol);
+}
+
+
+bool
+GraphValidator::check_words(const vector<CheckedWord> &words)
+{
+    vector<pair<int, int> > checks;
+    for (int i=0; i<(int)words.size(); i++)
+        checks.push_back(make_pair(i, -1));
+    return check(words, checks, true, false);
+}
+
+
+bool
+GraphValidator::check_word_pairs(const vector<CheckedWord> &words,
+                                 int num_pairs,
+                                 bool short_silence,
+                                 bool wb_symbol)
+{
+    if (words.size() == 0) return true;
+
+    vector<pair<int, int> > checks;
+    if (num_pairs < 0) {
+        for (int i=0; i<(int)words.size(); i++)
+            for (int j=0; j<(int)words.size(); j++)
+                checks.push_back(make_pair(i, j));
+    }
+    else {
+        for (int i=0; i<num_pairs; i++) {
+            int rand1 = rand() % words.size();
+            int rand2 = rand() % words.size();
+            checks.push_back(make_pair(rand1, rand2));
+        }
+        // Pairs with the same second word next to each other for the found paths
+        sort(checks.begin(), checks.end(),
+             [](const pair<int, int> &a, const pair<int, int> &b) {
+                 return make_pair(a.second, a.first) < make_pair(b.second, b.first);
+             });
+    }
+    return check(words, checks, short_silence, wb_symbol);
+}
+
+
+bool
+GraphValidator::check(const vector<CheckedWord> &words,
+                      const vector<pair<int, int> > &checks,
+                      bool short_silence,
+                      bool wb_symbol)
+{
+    int wb_symbol_id = -1;
+    if (wb_symbol) {
+        auto wbit = m_graph.m_subword_map.find("<w>");
+        wb_symbol_id = wbit != m_graph.m_subword_map.end() ? wbit->second : -2;
+    }
+
+    vector<char> results(checks.size(), false);
+    int num_threads = max(1, min(m_num_threads, (int)checks.size()));
+    vector<std::thread*> threads;
+    for (int t=0; t<num_threads; t++) {
+        int first_check = (long long int)t * checks.size() / num_threads;
+        int last_check = (long long int)(t+1) * checks.size() / num_threads;
+        threads.push_back(new std::thread(&check_paths, this, &words, &checks,
+                                          short_silence, wb_symbol_id, &results,
+                                          first_check, last_check));
+    }
+    for (int t=0; t<num_threads; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+
+    int error_count = 0;
+    for (int i=0; i<(int)checks.size(); i++) {
+        if (results[i]) continue;
+        if (error_count++ >= m_max_reported_errors) continue;
+        const CheckedWord &first_word = words[checks[i].first];
+        if (checks[i].second == -1)
+            cerr << "error, word: " << first_word.label << " not found" << endl;
+        else
+            cerr << "error, word pair: " << first_word.label << " - "
+                 << words[checks[i].second].label << " not found" << endl;
+    }
+    if (error_count > 0)
+        cerr << error_count << " of " << checks.size() << " checks failed" << endl;
+
+    return error_count == 0;
+}
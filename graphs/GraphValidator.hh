@@ -0,0 +1,79 @@
+#ifndef GRAPH_VALIDATOR_HH
+#define GRAPH_VALIDATOR_HH
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "DecoderGraph.hh"
+
+
+// Checks the paths of words and word pairs in a graph like the assert_*
+// functions of DecoderGraph, but the checks are run in threads and each
+// check is a search over (node, remaining states, remaining text units).
+// A search visits these once and does not enter nodes from which the end
+// node can not be reached. The remaining suffixes are interned, so the
+// states on found paths are remembered for the next checks of the thread.
+class GraphValidator {
+public:
+    // Text units of a word with the phones and the HMM states of the word alone
+    class CheckedWord {
+    public:
+        CheckedWord() : valid(true) { }
+        std::string label;
+        std::vector<int> word_ids;
+        std::string phones;
+        std::vector<int> states;
+        // False if a text unit or a triphone is not in the model
+        bool valid;
+    };
+
+    // The graph is not copied and must not change while validating
+    GraphValidator(const DecoderGraph &graph,
+                   int num_threads=1);
+
+    // Nodes not reachable from the start node
+    std::vector<int> unreachable_nodes() const;
+    // Nodes from which the end node is not reachable
+    std::vector<int> dead_nodes() const;
+
+    bool assert_words(const std::set<std::string> &words);
+    bool assert_words(const std::map<std::string, std::vector<std::string> > &word_segs);
+    // Checks num_pairs random word pairs, all pairs if num_pairs is negative
+    bool assert_word_pairs(const std::set<std::string> &words,
+                           int num_pairs=-1,
+                           bool short_silence=true,
+                           bool wb_symbol=false);
+    bool assert_word_pairs(const std::map<std::string, std::vector<std::string> > &word_segs,
+                           int num_pairs=-1,
+                           bool short_silence=true,
+                           bool wb_symbol=false);
+
+    // Appends the HMM states of the triphones, false if some triphone is not in the model
+    bool triphone_states(const std::vector<std::string> &triphones,
+                         std::vector<int> &states) const;
+
+    const DecoderGraph &m_graph;
+    int m_num_threads;
+    // Number of failed checks printed to stderr
+    int m_max_reported_errors;
+    std::vector<bool> m_reachable;
+    std::vector<bool> m_live;
+
+private:
+    void set_word(CheckedWord &word,
+                  const std::string &label,
+                  const std::vector<std::string> &subwords) const;
+    bool check_words(const std::vector<CheckedWord> &words);
+    bool check_word_pairs(const std::vector<CheckedWord> &words,
+                          int num_pairs,
+                          bool short_silence,
+                          bool wb_symbol);
+    bool check(const std::vector<CheckedWord> &words,
+               const std::vector<std::pair<int, int> > &checks,
+               bool short_silence,
+               bool wb_symbol);
+};
+
+#endif /* GRAPH_VALIDATOR_HH */
@@ -58,17 +58,16 @@ LRWBSubwordGraph::read_lexicon(string lexfname,
 
 void
 LRWBSubwordGraph::create_crossunit_network(
-    vector<pair<unsigned int, string> > &fanout_triphones,
-    vector<pair<unsigned int, string> > &fanin_triphones,
-    vector<pair<unsigned int, string> > &cw_fanout_triphones,
+    vector<pair<unsigned int, int> > &fanout_triphones,
+    vector<pair<unsigned int, int> > &fanin_triphones,
+    vector<pair<unsigned int, int> > &cw_fanout_triphones,
     set<string> &one_phone_prefix_subwords,
     set<string> &one_phone_stem_subwords,
     set<string> &one_phone_suffix_subwords,
     vector<DecoderGraph::Node> &nodes,
-    map<string, int> &fanout,
-    map<string, int> &fanin)
+    map<int, int> &fanout,
+    map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
     set<char> prefix_phones, stem_phones, suffix_phones;
 
     for (auto foit=fanout_triphones.begin(); foit != fanout_triphones.end(); ++foit)
@@ -78,7 +77,7 @@ LRWBSubwordGraph::create_crossunit_network(
         fanin[fiit->second] = -1;
 
     for (auto opswit = one_phone_prefix_subwords.begin(); opswit != one_phone_prefix_subwords.end(); ++opswit) {
-        fanout[m_lexicon.at(*opswit)[0]] = -1;
+        fanout[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         prefix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
@@ -86,7 +85,7 @@ LRWBSubwordGraph::create_crossunit_network(
         stem_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
 
     for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit) {
-        fanin[m_lexicon.at(*opswit)[0]] = -1;
+        fanin[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         suffix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
@@ -94,7 +93,7 @@ LRWBSubwordGraph::create_crossunit_network(
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         if (tlc(foit->first) == SIL_CTXT) continue;
         for (auto phit = stem_phones.begin(); phit != stem_phones.end(); ++phit) {
-            string fanoutt = construct_triphone(tphone(foit->first), *phit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(foit->first), *phit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
@@ -102,68 +101,42 @@ LRWBSubwordGraph::create_crossunit_network(
     // All prefix + stem one phone combinations to fanout
     for (auto ppit = prefix_phones.begin(); ppit != prefix_phones.end(); ++ppit)
         for (auto stpit = stem_phones.begin(); stpit != stem_phones.end(); ++stpit) {
-            string fanoutt = construct_triphone(*ppit, *stpit, SIL_CTXT);
+            int fanoutt = triphone_id(*ppit, *stpit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
 
     // Ending words may be connected by a one phone prefix to the cross-unit network
     for (auto cwit = cw_fanout_triphones.begin(); cwit != cw_fanout_triphones.end(); ++cwit) {
         for (auto ppit = prefix_phones.begin(); ppit != prefix_phones.end(); ++ppit) {
-            string fanoutt = construct_triphone(tphone(cwit->second), *ppit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(cwit->second), *ppit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
     for (auto spit = suffix_phones.begin(); spit != suffix_phones.end(); ++spit) {
         for (auto ppit = prefix_phones.begin(); ppit != prefix_phones.end(); ++ppit) {
-            string fanint = construct_triphone(SIL_CTXT, *spit, *ppit);
+            int fanint = triphone_id(SIL_CTXT, *spit, *ppit);
             fanin[fanint] = -1;
-            string fanoutt = construct_triphone(*spit, *ppit, SIL_CTXT);
+            int fanoutt = triphone_id(*spit, *ppit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
-    // Construct the main cross-unit network
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+    // Construct the main cross-unit network with room for the loops below
+    int num_loop_nodes = fanout.size() * one_phone_stem_subwords.size() * (m_states_per_phone + 1)
+        + one_phone_suffix_subwords.size() * one_phone_prefix_subwords.size() * (hmm_node_count(SHORT_SIL) + 2);
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, false, false, num_loop_nodes);
 
     // Add loops for one phone stem subwords from fanout back to fanout
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         for (auto opswit = one_phone_stem_subwords.begin(); opswit != one_phone_stem_subwords.end(); ++opswit) {
             char single_phone = tphone(m_lexicon[*opswit][0]);
             string triphone = construct_triphone(tlc(foit->first), tphone(foit->first), single_phone);
-            string fanout_loop_connector = construct_triphone(tphone(foit->first), single_phone, SIL_CTXT);
+            int fanout_loop_connector = triphone_id(tphone(foit->first), single_phone, SIL_CTXT);
 
             if (fanout.find(fanout_loop_connector) == fanout.end()) {
                 cerr << "problem in connecting cross-unit fanout loop for one phone subword: " << *opswit << endl;
-                cerr << fanout_loop_connector << endl;
+                cerr << DecoderGraph::triphone(fanout_loop_connector) << endl;
                 assert(false);
             }
 
@@ -178,13 +151,13 @@ LRWBSubwordGraph::create_crossunit_network(
         for (auto pswit = one_phone_prefix_subwords.begin(); pswit != one_phone_prefix_subwords.end(); ++pswit) {
             char suffix_phone = tphone(m_lexicon[*sswit][0]);
             char prefix_phone = tphone(m_lexicon[*pswit][0]);
-            string fanin_connector = construct_triphone(SIL_CTXT, suffix_phone, prefix_phone);
-            string fanout_connector = construct_triphone(suffix_phone, prefix_phone, SIL_CTXT);
+            int fanin_connector = triphone_id(SIL_CTXT, suffix_phone, prefix_phone);
+            int fanout_connector = triphone_id(suffix_phone, prefix_phone, SIL_CTXT);
             if (fanin.find(fanin_connector) == fanin.end()
                     || fanout.find(fanout_connector) == fanout.end())
             {
                 cerr << "problem in connecting from fanin to fanout" << endl;
-                cerr << fanin_connector << " " << fanout_connector << endl;
+                cerr << DecoderGraph::triphone(fanin_connector) << " " << DecoderGraph::triphone(fanout_connector) << endl;
                 assert(false);
             }
 
@@ -202,15 +175,14 @@ LRWBSubwordGraph::create_crossunit_network(
 
 void
 LRWBSubwordGraph::create_crossword_network(
-    vector<pair<unsigned int, string> > &fanout_triphones,
-    vector<pair<unsigned int, string> > &fanin_triphones,
-    vector<pair<unsigned int, string> > &cu_fanout_triphones,
+    vector<pair<unsigned int, int> > &fanout_triphones,
+    vector<pair<unsigned int, int> > &fanin_triphones,
+    vector<pair<unsigned int, int> > &cu_fanout_triphones,
     set<string> &one_phone_suffix_subwords,
     vector<DecoderGraph::Node> &nodes,
-    map<string, int> &fanout,
-    map<string, int> &fanin)
+    map<int, int> &fanout,
+    map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
     set<char> all_phones;
     set<char> suffix_phones;
 
@@ -221,7 +193,7 @@ LRWBSubwordGraph::create_crossword_network(
         fanin[fiit->second] = -1;
 
     for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit) {
-        fanin[m_lexicon.at(*opswit)[0]] = -1;
+        fanin[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         all_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
         suffix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
@@ -229,42 +201,13 @@ LRWBSubwordGraph::create_crossword_network(
     // Continuing words may be connected by a one phone suffix to the cross-word network
     for (auto cuit = cu_fanout_triphones.begin(); cuit != cu_fanout_triphones.end(); ++cuit) {
         for (auto ppit = suffix_phones.begin(); ppit != suffix_phones.end(); ++ppit) {
-            string fanoutt = construct_triphone(tphone(cuit->second), *ppit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(cuit->second), *ppit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
     // Construct the main cross-word network
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-            idx = connect_triphone(nodes, SHORT_SIL, idx);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, true);
 
     for (auto cwnit = nodes.begin(); cwnit != nodes.end(); ++cwnit)
         cwnit->flags |= NODE_CW;
@@ -273,16 +216,16 @@ LRWBSubwordGraph::create_crossword_network(
 
 void
 LRWBSubwordGraph::connect_crossword_network(vector<DecoderGraph::Node> &nodes,
-        vector<pair<unsigned int, string> > &fanout_connectors,
-        vector<pair<unsigned int, string> > &fanin_connectors,
+        vector<pair<unsigned int, int> > &fanout_connectors,
+        vector<pair<unsigned int, int> > &fanin_connectors,
         vector<DecoderGraph::Node> &cw_nodes,
-        map<string, int> &fanout,
-        map<string, int> &fanin)
+        map<int, int> &fanout,
+        map<int, int> &fanin)
 {
     int offset = nodes.size();
     for (auto cwnit = cw_nodes.begin(); cwnit != cw_nodes.end(); ++cwnit) {
         nodes.push_back(*cwnit);
-        set<unsigned int> temp_arcs = nodes.back().arcs;
+        IdSet temp_arcs = nodes.back().arcs;
         nodes.back().arcs.clear();
         for (auto ait = temp_arcs.begin(); ait != temp_arcs.end(); ++ait)
             nodes.back().arcs.insert(*ait + offset);
@@ -306,12 +249,12 @@ LRWBSubwordGraph::connect_crossword_network(vector<DecoderGraph::Node> &nodes,
 void
 LRWBSubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &subwords,
         vector<DecoderGraph::Node> &nodes,
-        map<string, int> &fanout)
+        map<int, int> &fanout)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanoutt = triphones[0];
+        int fanoutt = triphone_id(triphones[0]);
         int idx = connect_word(nodes, *swit, START_NODE);
         if (fanout.find(fanoutt) == fanout.end()) {
             cerr << "problem in connecting: " << *swit << " from start to fanout" << endl;
@@ -325,12 +268,12 @@ LRWBSubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string>
 void
 LRWBSubwordGraph::connect_one_phone_subwords_from_cw_to_end(const set<string> &subwords,
         vector<DecoderGraph::Node> &nodes,
-        map<string, int> &fanin)
+        map<int, int> &fanin)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanint = triphones[0];
+        int fanint = triphone_id(triphones[0]);
         if (fanin.find(fanint) == fanin.end()) {
             cerr << "problem in connecting: " << *swit << " fanin to end" << endl;
             assert(false);
@@ -345,16 +288,16 @@ void
 LRWBSubwordGraph::connect_one_phone_prefix_subwords_to_cu_fanout(
     const set<string> &one_phone_prefix_subwords,
     vector<DecoderGraph::Node> &nodes,
-    vector<pair<unsigned int, string> > &fanout_connectors,
-    map<string, int> &fanout)
+    vector<pair<unsigned int, int> > &fanout_connectors,
+    map<int, int> &fanout)
 {
     for (auto focit = fanout_connectors.begin(); focit != fanout_connectors.end(); ++focit) {
         for (auto swit = one_phone_prefix_subwords.begin(); swit != one_phone_prefix_subwords.end(); ++swit) {
-            string triphone = focit->second;
-            triphone[4] = tphone(m_lexicon[*swit][0]);
-            string target_fanout = construct_triphone(tphone(triphone), trc(triphone), SIL_CTXT);
+            char phone = tphone(m_lexicon[*swit][0]);
+            int triphone = triphone_id(tlc(focit->second), tphone(focit->second), phone);
+            int target_fanout = triphone_id(tphone(focit->second), phone, SIL_CTXT);
 
-            int idx = connect_triphone(nodes, triphone, focit->first);
+            int idx = connect_triphone(nodes, triphone_hmm(triphone), focit->first);
             idx = connect_triphone(nodes, SHORT_SIL, idx);
             idx = connect_word(nodes, *swit, idx);
             nodes[idx].arcs.insert(fanout[target_fanout]);
@@ -367,16 +310,16 @@ void
 LRWBSubwordGraph::connect_one_phone_suffix_subwords_to_cw_fanout(
     const set<string> &one_phone_suffix_subwords,
     vector<DecoderGraph::Node> &nodes,
-    vector<pair<unsigned int, string> > &fanout_connectors,
-    map<string, int> &fanout)
+    vector<pair<unsigned int, int> > &fanout_connectors,
+    map<int, int> &fanout)
 {
     for (auto focit = fanout_connectors.begin(); focit != fanout_connectors.end(); ++focit) {
         for (auto swit = one_phone_suffix_subwords.begin(); swit != one_phone_suffix_subwords.end(); ++swit) {
-            string triphone = focit->second;
-            triphone[4] = tphone(m_lexicon[*swit][0]);
-            string target_fanout = construct_triphone(tphone(triphone), trc(triphone), SIL_CTXT);
+            char phone = tphone(m_lexicon[*swit][0]);
+            int triphone = triphone_id(tlc(focit->second), tphone(focit->second), phone);
+            int target_fanout = triphone_id(tphone(focit->second), phone, SIL_CTXT);
 
-            int idx = connect_triphone(nodes, triphone, focit->first);
+            int idx = connect_triphone(nodes, triphone_hmm(triphone), focit->first);
             idx = connect_word(nodes, *swit, idx);
             nodes[idx].arcs.insert(fanout[target_fanout]);
         }
@@ -388,16 +331,16 @@ void
 LRWBSubwordGraph::connect_one_phone_suffix_subwords_from_cu_to_cw_fanout(
     const set<string> &one_phone_suffix_subwords,
     vector<DecoderGraph::Node> &nodes,
-    map<string, int> &cu_fanout,
-    map<string, int> &cw_fanout)
+    map<int, int> &cu_fanout,
+    map<int, int> &cw_fanout)
 {
     for (auto cuit = cu_fanout.begin(); cuit != cu_fanout.end(); ++cuit) {
         for (auto swit = one_phone_suffix_subwords.begin(); swit != one_phone_suffix_subwords.end(); ++swit) {
-            string triphone = cuit->first;
-            triphone[4] = tphone(m_lexicon[*swit][0]);
-            string target_fanout = construct_triphone(tphone(triphone), trc(triphone), SIL_CTXT);
+            char phone = tphone(m_lexicon[*swit][0]);
+            int triphone = triphone_id(tlc(cuit->first), tphone(cuit->first), phone);
+            int target_fanout = triphone_id(tphone(cuit->first), phone, SIL_CTXT);
 
-            int idx = connect_triphone(nodes, triphone, cuit->second);
+            int idx = connect_triphone(nodes, triphone_hmm(triphone), cuit->second);
             idx = connect_word(nodes, *swit, idx);
             nodes[idx].arcs.insert(cw_fanout[target_fanout]);
         }
@@ -440,12 +383,12 @@ LRWBSubwordGraph::offset(vector<DecoderGraph::Node> &nodes,
                          int offset)
 {
     for (auto nit = nodes.begin(); nit != nodes.end(); ++nit) {
-        set<unsigned int> arcs;
+        IdSet arcs;
         for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
             arcs.insert(*ait + offset);
         nit->arcs.swap(arcs);
 
-        set<unsigned int> rev_arcs;
+        IdSet rev_arcs;
         for (auto ait = nit->reverse_arcs.begin(); ait != nit->reverse_arcs.end(); ++ait)
             rev_arcs.insert(*ait + offset);
         nit->reverse_arcs.swap(rev_arcs);
@@ -454,7 +397,7 @@ LRWBSubwordGraph::offset(vector<DecoderGraph::Node> &nodes,
 
 
 void
-LRWBSubwordGraph::offset(vector<pair<unsigned int, string> > &connectors,
+LRWBSubwordGraph::offset(vector<pair<unsigned int, int> > &connectors,
                          int offset)
 {
     for (auto cit = connectors.begin(); cit != connectors.end(); ++cit)
@@ -479,8 +422,8 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
         subword_nodes.resize(subword_nodes.size()-3);
         add_nodes_to_tree(prefix_and_word_nodes, subword_nodes, false);
     }
@@ -492,8 +435,8 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout_2.insert(m_lexicon[*swit].back());
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout_2.insert(triphone_id(m_lexicon[*swit].back()));
         add_nodes_to_tree(prefix_and_word_nodes, subword_nodes);
     }
     if (prefix_and_word_nodes.size() == 2) {
@@ -505,10 +448,11 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     cerr << "prefix and word nodes: " << prefix_and_word_nodes.size() << endl;
 
     // Collect fan-in connectors for the word initial tree
-    vector<pair<unsigned int, string> > wi_fanin_connectors;
+    vector<pair<unsigned int, int> > wi_fanin_connectors;
     for (unsigned int i=0; i<prefix_and_word_nodes.size(); i++) {
         Node &nd = prefix_and_word_nodes[i];
-        for (auto fiit = nd.from_fanin.begin(); fiit != nd.from_fanin.end(); ++fiit)
+        if (nd.crossword == nullptr) continue;
+        for (auto fiit = nd.crossword->from_fanin.begin(); fiit != nd.crossword->from_fanin.end(); ++fiit)
             wi_fanin_connectors.push_back(make_pair(i, *fiit));
     }
 
@@ -522,8 +466,8 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
         subword_nodes.resize(subword_nodes.size()-3);
         add_nodes_to_tree(stem_and_suffix_nodes, subword_nodes, false);
     }
@@ -535,8 +479,8 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout_2.insert(m_lexicon[*swit].back());
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout_2.insert(triphone_id(m_lexicon[*swit].back()));
         add_nodes_to_tree(stem_and_suffix_nodes, subword_nodes);
     }
     if (stem_and_suffix_nodes.size() == 2) {
@@ -548,10 +492,11 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     cerr << "stem and suffix nodes: " << stem_and_suffix_nodes.size() << endl;
 
     // Collect fan-in connectors for the word-continuing tree
-    vector<pair<unsigned int, string> > wc_fanin_connectors;
+    vector<pair<unsigned int, int> > wc_fanin_connectors;
     for (unsigned int i=0; i<stem_and_suffix_nodes.size(); i++) {
         Node &nd = stem_and_suffix_nodes[i];
-        for (auto fiit = nd.from_fanin.begin(); fiit != nd.from_fanin.end(); ++fiit)
+        if (nd.crossword == nullptr) continue;
+        for (auto fiit = nd.crossword->from_fanin.begin(); fiit != nd.crossword->from_fanin.end(); ++fiit)
             wc_fanin_connectors.push_back(make_pair(i, *fiit));
     }
 
@@ -575,18 +520,20 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     cerr << "combined size: " << nodes.size() << endl;
 
     // Collect fan-out connectors for the cross-unit network
-    vector<pair<unsigned int, string> > cu_fanout_connectors;
+    vector<pair<unsigned int, int> > cu_fanout_connectors;
     for (unsigned int i=0; i<nodes.size(); i++) {
         Node &nd = nodes[i];
-        for (auto foit = nd.to_fanout.begin(); foit != nd.to_fanout.end(); ++foit)
+        if (nd.crossword == nullptr) continue;
+        for (auto foit = nd.crossword->to_fanout.begin(); foit != nd.crossword->to_fanout.end(); ++foit)
             cu_fanout_connectors.push_back(make_pair(i, *foit));
     }
 
     // Collect fan-out connectors for the cross-word network
-    vector<pair<unsigned int, string> > cw_fanout_connectors;
+    vector<pair<unsigned int, int> > cw_fanout_connectors;
     for (unsigned int i=0; i<nodes.size(); i++) {
         Node &nd = nodes[i];
-        for (auto foit = nd.to_fanout_2.begin(); foit != nd.to_fanout_2.end(); ++foit)
+        if (nd.crossword == nullptr) continue;
+        for (auto foit = nd.crossword->to_fanout_2.begin(); foit != nd.crossword->to_fanout_2.end(); ++foit)
             cw_fanout_connectors.push_back(make_pair(i, *foit));
     }
 
@@ -599,8 +546,8 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     // Cross-unit network
     if (verbose) cerr << "creating cross-unit network" << endl;
     set<string> dummy_one_phones;
-    map<string, int> cu_fanout;
-    map<string, int> cu_fanin;
+    map<int, int> cu_fanout;
+    map<int, int> cu_fanin;
     vector<DecoderGraph::Node> cu_nodes;
     create_crossunit_network(cu_fanout_connectors,
                              wc_fanin_connectors,
@@ -609,7 +556,7 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
                              one_phone_stem_subwords,
                              one_phone_suffix_subwords,
                              cu_nodes, cu_fanout, cu_fanin);
-    minimize_crossword_network(cu_nodes, cu_fanout, cu_fanin);
+    minimize_crossword_network(cu_nodes, cu_fanout, cu_fanin, verbose);
     if (verbose) cerr << "tied cross-unit network size: " << cu_nodes.size() << endl;
     connect_crossword_network(nodes,
                               cu_fanout_connectors, wc_fanin_connectors,
@@ -620,15 +567,15 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     // Cross-word network
     if (verbose) cerr << "creating cross-word network" << endl;
-    map<string, int> cw_fanout;
-    map<string, int> cw_fanin;
+    map<int, int> cw_fanout;
+    map<int, int> cw_fanin;
     vector<DecoderGraph::Node> cw_nodes;
     create_crossword_network(cw_fanout_connectors,
                              wi_fanin_connectors,
                              cu_fanout_connectors,
                              one_phone_suffix_subwords,
                              cw_nodes, cw_fanout, cw_fanin);
-    minimize_crossword_network(cw_nodes, cw_fanout, cw_fanin);
+    minimize_crossword_network(cw_nodes, cw_fanout, cw_fanin, verbose);
     if (verbose) cerr << "tied cross-word network size: " << cw_nodes.size() << endl;
     connect_crossword_network(nodes,
                               cw_fanout_connectors, wi_fanin_connectors,
@@ -664,40 +611,18 @@ LRWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     if (verbose) cerr << "Pushing word ids right.." << endl;
     push_word_ids_right(m_nodes);
 
-    if (verbose) cerr << "Tying state prefixes.." << endl;
-    tie_state_prefixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << "Tying word id prefixes.." << endl;
-    tie_word_id_prefixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << "Tying state prefixes.." << endl;
-    tie_state_prefixes(m_nodes);
+    if (verbose) cerr << "Tying prefixes.." << endl;
+    int tied_count = tie_prefixes(m_nodes);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
     if (verbose) cerr << "Pushing word ids left.." << endl;
     push_word_ids_left(m_nodes);
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << "Tying word id suffixes.." << endl;
-    tie_word_id_suffixes(m_nodes);
-    if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
-
-    if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
+    if (verbose) cerr << "Tying suffixes.." << endl;
+    tied_count = tie_suffixes(m_nodes);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
 
     prune_unreachable_nodes(m_nodes);
 
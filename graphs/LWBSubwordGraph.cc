@@ -19,15 +19,14 @@ LWBSubwordGraph::LWBSubwordGraph(const set<string> &prefix_subwords,
 
 
 void
-LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &fanout_triphones,
-                                           vector<pair<unsigned int, string> > &fanin_triphones,
+LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, int> > &fanout_triphones,
+                                           vector<pair<unsigned int, int> > &fanin_triphones,
                                            set<string> &one_phone_prefix_subwords,
                                            set<string> &one_phone_suffix_subwords,
                                            vector<DecoderGraph::Node> &nodes,
-                                           map<string, int> &fanout,
-                                           map<string, int> &fanin)
+                                           map<int, int> &fanout,
+                                           map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
     set<char> all_phones;
     set<char> suffix_phones;
 
@@ -38,12 +37,12 @@ LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
         fanin[fiit->second] = -1;
 
     for (auto opswit = one_phone_prefix_subwords.begin(); opswit != one_phone_prefix_subwords.end(); ++opswit) {
-        fanout[m_lexicon.at(*opswit)[0]] = -1;
+        fanout[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         all_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
     for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit) {
-        fanin[m_lexicon.at(*opswit)[0]] = -1;
+        fanin[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         suffix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
         all_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
@@ -52,7 +51,7 @@ LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         if (tlc(foit->first) == SIL_CTXT) continue;
         for (auto phit = all_phones.begin(); phit != all_phones.end(); ++phit) {
-            string fanoutt = construct_triphone(tphone(foit->first), *phit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(foit->first), *phit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
@@ -60,39 +59,18 @@ LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
     // All suffix one phone combinations to fanout
     for (auto fphit = suffix_phones.begin(); fphit != suffix_phones.end(); ++fphit)
         for (auto sphit = suffix_phones.begin(); sphit != suffix_phones.end(); ++sphit) {
-            string fanoutt = construct_triphone(*fphit, *sphit, SIL_CTXT);
+            int fanoutt = triphone_id(*fphit, *sphit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
 
-    map<string, int> connected_fanin_nodes;
+    // Nodes of the fanout loops below
+    int num_loop_nodes = 0;
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
+        num_loop_nodes += one_phone_suffix_subwords.size() * (m_states_per_phone + 1);
+        if (tlc(foit->first) != SIL_CTXT)
+            num_loop_nodes += one_phone_prefix_subwords.size() * (m_states_per_phone + hmm_node_count(SHORT_SIL) + 1);
     }
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, false, false, num_loop_nodes);
 
 
     // Add loops for one phone suffix subwords from fanout back to fanout
@@ -102,11 +80,11 @@ LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
 
             char single_phone = tphone(m_lexicon[*opswit][0]);
             string triphone = construct_triphone(tlc(foit->first), tphone(foit->first), single_phone);
-            string fanout_loop_connector = construct_triphone(tphone(foit->first), single_phone, SIL_CTXT);
+            int fanout_loop_connector = triphone_id(tphone(foit->first), single_phone, SIL_CTXT);
 
             if (fanout.find(fanout_loop_connector) == fanout.end()) {
                 cerr << "problem in connecting fanout loop for one phone subword: " << *opswit << endl;
-                cerr << fanout_loop_connector << endl;
+                cerr << DecoderGraph::triphone(fanout_loop_connector) << endl;
                 assert(false);
             }
 
@@ -125,11 +103,11 @@ LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
 
             char single_phone = tphone(m_lexicon[*opswit][0]);
             string triphone = construct_triphone(tlc(foit->first), tphone(foit->first), single_phone);
-            string fanout_loop_connector = construct_triphone(tphone(foit->first), single_phone, SIL_CTXT);
+            int fanout_loop_connector = triphone_id(tphone(foit->first), single_phone, SIL_CTXT);
 
             if (fanout.find(fanout_loop_connector) == fanout.end()) {
                 cerr << "problem in connecting fanout loop for one phone subword: " << *opswit << endl;
-                cerr << fanout_loop_connector << endl;
+                cerr << DecoderGraph::triphone(fanout_loop_connector) << endl;
                 assert(false);
             }
 
@@ -146,15 +124,14 @@ LWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
 
 
 void
-LWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &fanout_triphones,
-                                           vector<pair<unsigned int, string> > &fanin_triphones,
+LWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, int> > &fanout_triphones,
+                                           vector<pair<unsigned int, int> > &fanin_triphones,
                                            set<string> &one_phone_prefix_subwords,
                                            set<string> &one_phone_suffix_subwords,
                                            vector<DecoderGraph::Node> &nodes,
-                                           map<string, int> &fanout,
-                                           map<string, int> &fanin)
+                                           map<int, int> &fanout,
+                                           map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
     set<char> phones;
 
     for (auto foit=fanout_triphones.begin(); foit != fanout_triphones.end(); ++foit)
@@ -164,17 +141,17 @@ LWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
         fanin[fiit->second] = -1;
 
     for (auto opswit = one_phone_prefix_subwords.begin(); opswit != one_phone_prefix_subwords.end(); ++opswit)
-        fanout[m_lexicon.at(*opswit)[0]] = -1;
+        fanout[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
 
     for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit) {
-        fanin[m_lexicon.at(*opswit)[0]] = -1;
+        fanin[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
     // All phone-phone combinations from one phone subwords to fanout
     for (auto fphit = phones.begin(); fphit != phones.end(); ++fphit)
         for (auto sphit = phones.begin(); sphit != phones.end(); ++sphit) {
-            string fanoutt = DecoderGraph::construct_triphone(*fphit, *sphit, SIL_CTXT);
+            int fanoutt = triphone_id(*fphit, *sphit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
 
@@ -182,41 +159,14 @@ LWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         if (tlc(foit->first) == SIL_CTXT) continue;
         for (auto phit = phones.begin(); phit != phones.end(); ++phit) {
-            string fanoutt = DecoderGraph::construct_triphone(tphone(foit->first), *phit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(foit->first), *phit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-            idx = connect_triphone(nodes, SHORT_SIL, idx);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+    // Nodes of the fanout loops below
+    int num_loop_nodes = fanout.size() * one_phone_suffix_subwords.size() * (m_states_per_phone + 1);
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, true, false, num_loop_nodes);
 
     // Add loops for one phone suffix subwords from fanout back to fanout
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
@@ -225,11 +175,11 @@ LWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
 
             char single_phone = tphone(m_lexicon[*opswit][0]);
             string triphone = construct_triphone(tlc(foit->first), tphone(foit->first), single_phone);
-            string fanout_loop_connector = construct_triphone(tphone(foit->first), single_phone, SIL_CTXT);
+            int fanout_loop_connector = triphone_id(tphone(foit->first), single_phone, SIL_CTXT);
 
             if (fanout.find(fanout_loop_connector) == fanout.end()) {
                 cerr << "problem in connecting fanout loop for one phone subword: " << *opswit << endl;
-                cerr << fanout_loop_connector << endl;
+                cerr << DecoderGraph::triphone(fanout_loop_connector) << endl;
                 assert(false);
             }
 
@@ -246,16 +196,16 @@ LWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
 
 void
 LWBSubwordGraph::connect_crossword_network(vector<DecoderGraph::Node> &nodes,
-                                            vector<pair<unsigned int, string> > &fanout_connectors,
-                                            vector<pair<unsigned int, string> > &fanin_connectors,
+                                            vector<pair<unsigned int, int> > &fanout_connectors,
+                                            vector<pair<unsigned int, int> > &fanin_connectors,
                                             vector<DecoderGraph::Node> &cw_nodes,
-                                            map<string, int> &fanout,
-                                            map<string, int> &fanin)
+                                            map<int, int> &fanout,
+                                            map<int, int> &fanin)
 {
     int offset = nodes.size();
     for (auto cwnit = cw_nodes.begin(); cwnit != cw_nodes.end(); ++cwnit) {
         nodes.push_back(*cwnit);
-        set<unsigned int> temp_arcs = nodes.back().arcs;
+        IdSet temp_arcs = nodes.back().arcs;
         nodes.back().arcs.clear();
         for (auto ait = temp_arcs.begin(); ait != temp_arcs.end(); ++ait)
             nodes.back().arcs.insert(*ait + offset);
@@ -280,12 +230,12 @@ LWBSubwordGraph::connect_crossword_network(vector<DecoderGraph::Node> &nodes,
 void
 LWBSubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &subwords,
                                                               vector<DecoderGraph::Node> &nodes,
-                                                              map<string, int> &fanout)
+                                                              map<int, int> &fanout)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanoutt = triphones[0];
+        int fanoutt = triphone_id(triphones[0]);
         int idx = connect_word(nodes, *swit, START_NODE);
         if (fanout.find(fanoutt) == fanout.end()) {
             cerr << "problem in connecting: " << *swit << " from start to fanout" << endl;
@@ -299,12 +249,12 @@ LWBSubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &
 void
 LWBSubwordGraph::connect_one_phone_subwords_from_cw_to_end(const set<string> &subwords,
                                                             vector<DecoderGraph::Node> &nodes,
-                                                            map<string, int> &fanin)
+                                                            map<int, int> &fanin)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanint = triphones[0];
+        int fanint = triphone_id(triphones[0]);
         if (fanin.find(fanint) == fanin.end()) {
             cerr << "problem in connecting: " << *swit << " fanin to end" << endl;
             assert(false);
@@ -327,49 +277,53 @@ LWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     // Construct prefix tree
     vector<DecoderGraph::Node> prefix_nodes(2);
-    for (auto swit = prefix_subwords.begin(); swit != prefix_subwords.end(); ++swit) {
-        if (swit->find("<") != string::npos) continue;
+    vector<string> sorted_prefix_subwords;
+    sort_by_state_chain(prefix_subwords, sorted_prefix_subwords);
+    MinimizingTreeBuilder prefix_builder(prefix_nodes);
+    for (auto swit = sorted_prefix_subwords.begin(); swit != sorted_prefix_subwords.end(); ++swit) {
         vector<TriphoneNode> subword_triphones;
         triphonize_subword(*swit, subword_triphones);
         // One phone subwords not connected to the main tree
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
-        add_nodes_to_tree(prefix_nodes, subword_nodes);
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
+        prefix_builder.add_nodes(subword_nodes);
     }
+    prefix_builder.finish();
     if (prefix_nodes.size() == 2) {
         cerr << "Warning, no subwords in the prefix tree" << endl;
         exit(1);
     }
 
-    lookahead_to_arcs(prefix_nodes);
-    vector<pair<unsigned int, string> > prefix_fanout_connectors, prefix_fanin_connectors;
+    vector<pair<unsigned int, int> > prefix_fanout_connectors, prefix_fanin_connectors;
     collect_crossword_connectors(prefix_nodes, prefix_fanout_connectors, prefix_fanin_connectors);
     if (verbose) cerr << "prefix tree size: " << reachable_graph_nodes(prefix_nodes) << endl;
 
     // Construct suffix/stem tree
     std::vector<DecoderGraph::Node> suffix_nodes(2);
-    for (auto swit = suffix_subwords.begin(); swit != suffix_subwords.end(); ++swit) {
-        if (swit->find("<") != string::npos) continue;
+    vector<string> sorted_suffix_subwords;
+    sort_by_state_chain(suffix_subwords, sorted_suffix_subwords);
+    MinimizingTreeBuilder suffix_builder(suffix_nodes);
+    for (auto swit = sorted_suffix_subwords.begin(); swit != sorted_suffix_subwords.end(); ++swit) {
         vector<TriphoneNode> subword_triphones;
         triphonize_subword(*swit, subword_triphones);
         // One phone subwords not connected to the main tree
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
-        add_nodes_to_tree(suffix_nodes, subword_nodes);
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
+        suffix_builder.add_nodes(subword_nodes);
     }
+    suffix_builder.finish();
     if (suffix_nodes.size() == 2) {
         cerr << "Warning, no subwords in the stem/suffix tree" << endl;
         exit(1);
     }
 
-    lookahead_to_arcs(suffix_nodes);
-    vector<pair<unsigned int, string> > suffix_fanout_connectors, suffix_fanin_connectors;
+    vector<pair<unsigned int, int> > suffix_fanout_connectors, suffix_fanin_connectors;
     collect_crossword_connectors(suffix_nodes, suffix_fanout_connectors, suffix_fanin_connectors);
     if (verbose) cerr << "stem/suffix tree size: " << reachable_graph_nodes(suffix_nodes) << endl;
 
@@ -391,17 +345,17 @@ LWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     // Cross-unit network (prefix-suffix, suffix-suffix)
     if (verbose) cerr << "creating cross-unit network" << endl;
-    map<string, int> cu_fanout;
-    map<string, int> cu_fanin;
+    map<int, int> cu_fanout;
+    map<int, int> cu_fanin;
     vector<DecoderGraph::Node> cu_nodes;
-    vector<pair<unsigned int, string> > all_fanout_connectors = suffix_fanout_connectors;
+    vector<pair<unsigned int, int> > all_fanout_connectors = suffix_fanout_connectors;
     all_fanout_connectors.insert(all_fanout_connectors.end(),
                                  prefix_fanout_connectors.begin(),
                                  prefix_fanout_connectors.end());
     create_crossunit_network(all_fanout_connectors, suffix_fanin_connectors,
                              one_phone_prefix_subwords, one_phone_suffix_subwords,
                              cu_nodes, cu_fanout, cu_fanin);
-    minimize_crossword_network(cu_nodes, cu_fanout, cu_fanin);
+    minimize_crossword_network(cu_nodes, cu_fanout, cu_fanin, verbose);
     if (verbose) cerr << "tied cross-unit network size: " << cu_nodes.size() << endl;
     connect_crossword_network(nodes,
                               all_fanout_connectors, suffix_fanin_connectors,
@@ -412,13 +366,13 @@ LWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     // Cross-word network
     if (verbose) cerr << "creating cross-word network" << endl;
-    map<string, int> cw_fanout;
-    map<string, int> cw_fanin;
+    map<int, int> cw_fanout;
+    map<int, int> cw_fanin;
     vector<DecoderGraph::Node> cw_nodes;
     create_crossword_network(all_fanout_connectors, prefix_fanin_connectors,
                              one_phone_prefix_subwords, one_phone_suffix_subwords,
                              cw_nodes, cw_fanout, cw_fanin);
-    minimize_crossword_network(cw_nodes, cw_fanout, cw_fanin);
+    minimize_crossword_network(cw_nodes, cw_fanout, cw_fanin, verbose);
     if (verbose) cerr << "tied cross-word network size: " << cw_nodes.size() << endl;
     connect_crossword_network(nodes,
                               all_fanout_connectors, prefix_fanin_connectors,
@@ -437,18 +391,12 @@ LWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     if (verbose) cerr << "Tying nodes.." << endl;
     push_word_ids_right(m_nodes);
-    tie_state_prefixes(m_nodes);
-    tie_word_id_prefixes(m_nodes);
-    tie_state_prefixes(m_nodes);
-    tie_word_id_prefixes(m_nodes);
-    tie_state_prefixes(m_nodes);
+    int tied_count = tie_prefixes(m_nodes);
+    if (verbose) cerr << "tied prefix nodes: " << tied_count << endl;
 
     push_word_ids_left(m_nodes);
-    tie_state_suffixes(m_nodes);
-    tie_word_id_suffixes(m_nodes);
-    tie_state_suffixes(m_nodes);
-    tie_word_id_suffixes(m_nodes);
-    tie_state_suffixes(m_nodes);
+    tied_count = tie_suffixes(m_nodes);
+    if (verbose) cerr << "tied suffix nodes: " << tied_count << endl;
 
     prune_unreachable_nodes(m_nodes);
 
@@ -461,12 +409,12 @@ LWBSubwordGraph::offset(vector<DecoderGraph::Node> &nodes,
                          int offset)
 {
     for (auto nit = nodes.begin(); nit != nodes.end(); ++nit) {
-        std::set<unsigned int> arcs;
+        IdSet arcs;
         for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
             arcs.insert(*ait + offset);
         nit->arcs.swap(arcs);
 
-        std::set<unsigned int> rev_arcs;
+        IdSet rev_arcs;
         for (auto ait = nit->reverse_arcs.begin(); ait != nit->reverse_arcs.end(); ++ait)
             rev_arcs.insert(*ait + offset);
         nit->reverse_arcs.swap(rev_arcs);
@@ -485,7 +433,7 @@ LWBSubwordGraph::get_one_phone_subwords(const set<string> &subwords,
 
 
 void
-LWBSubwordGraph::offset(vector<pair<unsigned int, string> > &connectors,
+LWBSubwordGraph::offset(vector<pair<unsigned int, int> > &connectors,
                          int offset)
 {
     for (auto cit = connectors.begin(); cit != connectors.end(); ++cit)
@@ -495,16 +443,17 @@ LWBSubwordGraph::offset(vector<pair<unsigned int, string> > &connectors,
 
 void
 LWBSubwordGraph::collect_crossword_connectors(vector<DecoderGraph::Node> &nodes,
-                                               vector<pair<unsigned int, string> > &fanout_connectors,
-                                               vector<pair<unsigned int, string> > &fanin_connectors)
+                                               vector<pair<unsigned int, int> > &fanout_connectors,
+                                               vector<pair<unsigned int, int> > &fanin_connectors) const
 {
     fanout_connectors.clear();
     fanin_connectors.clear();
     for (unsigned int i=0; i<nodes.size(); i++) {
         Node &nd = nodes[i];
-        for (auto fiit = nd.from_fanin.begin(); fiit != nd.from_fanin.end(); ++fiit)
+        if (nd.crossword == nullptr) continue;
+        for (auto fiit = nd.crossword->from_fanin.begin(); fiit != nd.crossword->from_fanin.end(); ++fiit)
             fanin_connectors.push_back(make_pair(i, *fiit));
-        for (auto foit = nd.to_fanout.begin(); foit != nd.to_fanout.end(); ++foit)
+        for (auto foit = nd.crossword->to_fanout.begin(); foit != nd.crossword->to_fanout.end(); ++foit)
             fanout_connectors.push_back(make_pair(i, *foit));
     }
 }
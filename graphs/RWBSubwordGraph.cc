@@ -19,15 +19,14 @@ RWBSubwordGraph::RWBSubwordGraph(const set<string> &prefix_subwords,
 
 
 void
-RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &fanout_triphones,
-                                           vector<pair<unsigned int, string> > &fanin_triphones,
+RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, int> > &fanout_triphones,
+                                           vector<pair<unsigned int, int> > &fanin_triphones,
                                            set<string> &one_phone_prefix_subwords,
                                            set<string> &one_phone_suffix_subwords,
                                            vector<DecoderGraph::Node> &nodes,
-                                           map<string, int> &fanout,
-                                           map<string, int> &fanin)
+                                           map<int, int> &fanout,
+                                           map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
     set<char> prefix_phones;
     set<char> suffix_phones;
 
@@ -38,12 +37,12 @@ RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
         fanin[fiit->second] = -1;
 
     for (auto opswit = one_phone_prefix_subwords.begin(); opswit != one_phone_prefix_subwords.end(); ++opswit) {
-        fanout[m_lexicon.at(*opswit)[0]] = -1;
+        fanout[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         prefix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
     for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit) {
-        fanin[m_lexicon.at(*opswit)[0]] = -1;
+        fanin[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         suffix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
@@ -51,7 +50,7 @@ RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         if (tlc(foit->first) == SIL_CTXT) continue;
         for (auto phit = prefix_phones.begin(); phit != prefix_phones.end(); ++phit) {
-            string fanoutt = construct_triphone(tphone(foit->first), *phit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(foit->first), *phit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
@@ -59,49 +58,34 @@ RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
     // All prefix one phone combinations to fanout
     for (auto fphit = prefix_phones.begin(); fphit != prefix_phones.end(); ++fphit)
         for (auto sphit = prefix_phones.begin(); sphit != prefix_phones.end(); ++sphit) {
-            string fanoutt = construct_triphone(*fphit, *sphit, SIL_CTXT);
+            int fanoutt = triphone_id(*fphit, *sphit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
 
     for (auto fphit = suffix_phones.begin(); fphit != suffix_phones.end(); ++fphit) {
         for (auto sphit = prefix_phones.begin(); sphit != prefix_phones.end(); ++sphit) {
-            string fanint = construct_triphone(SIL_CTXT, *fphit, *sphit);
+            int fanint = triphone_id(SIL_CTXT, *fphit, *sphit);
             fanin[fanint] = -1;
-            string fanoutt = construct_triphone(*fphit, *sphit, SIL_CTXT);
+            int fanoutt = triphone_id(*fphit, *sphit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
-    // Construct the main cross-unit network
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
+    // Nodes of the loops below, counted by the phone of the one phone subwords
+    // and by the phone of the fanin triphones
+    vector<int> suffix_subword_counts(256, 0), fanin_counts(256, 0);
+    for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit)
+        suffix_subword_counts[(unsigned char)tphone(m_lexicon.at(*opswit)[0])]++;
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        fanin_counts[(unsigned char)tphone(fiit->first)]++;
+    int num_loop_nodes = fanout.size() * one_phone_prefix_subwords.size() * (m_states_per_phone + 1)
+        + one_phone_suffix_subwords.size() * one_phone_prefix_subwords.size() * (hmm_node_count(SHORT_SIL) + 2);
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        num_loop_nodes += suffix_subword_counts[(unsigned char)tphone(fiit->first)]
+            * fanin_counts[(unsigned char)trc(fiit->first)] * (m_states_per_phone + hmm_node_count(SHORT_SIL) + 1);
 
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+    // Construct the main cross-unit network
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, false, false, num_loop_nodes);
 
 
     // Add loops for one phone prefix subwords from fanout back to fanout
@@ -111,11 +95,11 @@ RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
 
             char single_phone = tphone(m_lexicon[*opswit][0]);
             string triphone = construct_triphone(tlc(foit->first), tphone(foit->first), single_phone);
-            string fanout_loop_connector = construct_triphone(tphone(foit->first), single_phone, SIL_CTXT);
+            int fanout_loop_connector = triphone_id(tphone(foit->first), single_phone, SIL_CTXT);
 
             if (fanout.find(fanout_loop_connector) == fanout.end()) {
                 cerr << "problem in connecting cross-unit fanout loop for one phone subword: " << *opswit << endl;
-                cerr << fanout_loop_connector << endl;
+                cerr << DecoderGraph::triphone(fanout_loop_connector) << endl;
                 assert(false);
             }
 
@@ -130,13 +114,13 @@ RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
         for (auto pswit = one_phone_prefix_subwords.begin(); pswit != one_phone_prefix_subwords.end(); ++pswit) {
             char suffix_phone = tphone(m_lexicon[*sswit][0]);
             char prefix_phone = tphone(m_lexicon[*pswit][0]);
-            string fanin_connector = construct_triphone(SIL_CTXT, suffix_phone, prefix_phone);
-            string fanout_connector = construct_triphone(suffix_phone, prefix_phone, SIL_CTXT);
+            int fanin_connector = triphone_id(SIL_CTXT, suffix_phone, prefix_phone);
+            int fanout_connector = triphone_id(suffix_phone, prefix_phone, SIL_CTXT);
             if (fanin.find(fanin_connector) == fanin.end()
                 || fanout.find(fanout_connector) == fanout.end())
             {
                 cerr << "problem in connecting from fanin to fanout" << endl;
-                cerr << fanin_connector << " " << fanout_connector << endl;
+                cerr << DecoderGraph::triphone(fanin_connector) << " " << DecoderGraph::triphone(fanout_connector) << endl;
                 assert(false);
             }
 
@@ -171,15 +155,14 @@ RWBSubwordGraph::create_crossunit_network(vector<pair<unsigned int, string> > &f
 
 
 void
-RWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &fanout_triphones,
-                                           vector<pair<unsigned int, string> > &fanin_triphones,
+RWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, int> > &fanout_triphones,
+                                           vector<pair<unsigned int, int> > &fanin_triphones,
                                            set<string> &one_phone_prefix_subwords,
                                            set<string> &one_phone_suffix_subwords,
                                            vector<DecoderGraph::Node> &nodes,
-                                           map<string, int> &fanout,
-                                           map<string, int> &fanin)
+                                           map<int, int> &fanout,
+                                           map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
     set<char> all_phones;
     set<char> prefix_phones;
     set<char> suffix_phones;
@@ -191,29 +174,29 @@ RWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
         fanin[fiit->second] = -1;
 
     for (auto opswit = one_phone_prefix_subwords.begin(); opswit != one_phone_prefix_subwords.end(); ++opswit) {
-        fanout[m_lexicon.at(*opswit)[0]] = -1;
+        fanout[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         all_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
         prefix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
     for (auto opswit = one_phone_suffix_subwords.begin(); opswit != one_phone_suffix_subwords.end(); ++opswit) {
-        fanin[m_lexicon.at(*opswit)[0]] = -1;
+        fanin[triphone_id(m_lexicon.at(*opswit)[0])] = -1;
         all_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
         suffix_phones.insert(tphone(m_lexicon.at(*opswit)[0]));
     }
 
     for (auto fphit = suffix_phones.begin(); fphit != suffix_phones.end(); ++fphit) {
         for (auto sphit = prefix_phones.begin(); sphit != prefix_phones.end(); ++sphit) {
-            string fanint = construct_triphone(SIL_CTXT, *fphit, *sphit);
+            int fanint = triphone_id(SIL_CTXT, *fphit, *sphit);
             fanin[fanint] = -1;
-            string fanoutt = construct_triphone(*fphit, *sphit, SIL_CTXT);
+            int fanoutt = triphone_id(*fphit, *sphit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
     for (auto fphit = prefix_phones.begin(); fphit != prefix_phones.end(); ++fphit) {
         for (auto sphit = prefix_phones.begin(); sphit != prefix_phones.end(); ++sphit) {
-            string fanint = construct_triphone(SIL_CTXT, *fphit, *sphit);
+            int fanint = triphone_id(SIL_CTXT, *fphit, *sphit);
             fanin[fanint] = -1;
         }
     }
@@ -221,55 +204,38 @@ RWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
     for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
         char phone = tphone(fiit->first);
         for (auto fphit = prefix_phones.begin(); fphit != prefix_phones.end(); ++fphit) {
-            string fanint = construct_triphone(SIL_CTXT, *fphit, phone);
+            int fanint = triphone_id(SIL_CTXT, *fphit, phone);
             fanin[fanint] = -1;
         }
     }
 
-    // Construct the main cross-word network
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-            idx = connect_triphone(nodes, SHORT_SIL, idx);
+    // Nodes of the loops below, counted by the phone of the one phone subwords
+    // and by the phone of the fanin triphones
+    vector<int> prefix_subword_counts(256, 0), fanin_counts(256, 0);
+    for (auto opswit = one_phone_prefix_subwords.begin(); opswit != one_phone_prefix_subwords.end(); ++opswit)
+        prefix_subword_counts[(unsigned char)tphone(m_lexicon.at(*opswit)[0])]++;
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        fanin_counts[(unsigned char)tphone(fiit->first)]++;
+    int num_loop_nodes = one_phone_suffix_subwords.size() * one_phone_prefix_subwords.size() * (hmm_node_count(SHORT_SIL) + 2);
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        num_loop_nodes += prefix_subword_counts[(unsigned char)tphone(fiit->first)]
+            * fanin_counts[(unsigned char)trc(fiit->first)] * (m_states_per_phone + 1);
 
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+    // Construct the main cross-word network
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, true, false, num_loop_nodes);
 
     // Add loops for one phone suffix+prefix subwords from fanin to fanout
     for (auto sswit = one_phone_suffix_subwords.begin(); sswit != one_phone_suffix_subwords.end(); ++sswit) {
         for (auto pswit = one_phone_prefix_subwords.begin(); pswit != one_phone_prefix_subwords.end(); ++pswit) {
             char suffix_phone = tphone(m_lexicon[*sswit][0]);
             char prefix_phone = tphone(m_lexicon[*pswit][0]);
-            string fanin_connector = construct_triphone(SIL_CTXT, suffix_phone, prefix_phone);
-            string fanout_connector = construct_triphone(suffix_phone, prefix_phone, SIL_CTXT);
+            int fanin_connector = triphone_id(SIL_CTXT, suffix_phone, prefix_phone);
+            int fanout_connector = triphone_id(suffix_phone, prefix_phone, SIL_CTXT);
             if (fanin.find(fanin_connector) == fanin.end()
                 || fanout.find(fanout_connector) == fanout.end())
             {
                 cerr << "problem in connecting from fanin to fanout" << endl;
-                cerr << fanin_connector << " " << fanout_connector << endl;
+                cerr << DecoderGraph::triphone(fanin_connector) << " " << DecoderGraph::triphone(fanout_connector) << endl;
                 assert(false);
             }
 
@@ -304,16 +270,16 @@ RWBSubwordGraph::create_crossword_network(vector<pair<unsigned int, string> > &f
 
 void
 RWBSubwordGraph::connect_crossword_network(vector<DecoderGraph::Node> &nodes,
-                                            vector<pair<unsigned int, string> > &fanout_connectors,
-                                            vector<pair<unsigned int, string> > &fanin_connectors,
+                                            vector<pair<unsigned int, int> > &fanout_connectors,
+                                            vector<pair<unsigned int, int> > &fanin_connectors,
                                             vector<DecoderGraph::Node> &cw_nodes,
-                                            map<string, int> &fanout,
-                                            map<string, int> &fanin)
+                                            map<int, int> &fanout,
+                                            map<int, int> &fanin)
 {
     int offset = nodes.size();
     for (auto cwnit = cw_nodes.begin(); cwnit != cw_nodes.end(); ++cwnit) {
         nodes.push_back(*cwnit);
-        set<unsigned int> temp_arcs = nodes.back().arcs;
+        IdSet temp_arcs = nodes.back().arcs;
         nodes.back().arcs.clear();
         for (auto ait = temp_arcs.begin(); ait != temp_arcs.end(); ++ait)
             nodes.back().arcs.insert(*ait + offset);
@@ -337,12 +303,12 @@ RWBSubwordGraph::connect_crossword_network(vector<DecoderGraph::Node> &nodes,
 void
 RWBSubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &subwords,
                                                               vector<DecoderGraph::Node> &nodes,
-                                                              map<string, int> &fanout)
+                                                              map<int, int> &fanout)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanoutt = triphones[0];
+        int fanoutt = triphone_id(triphones[0]);
         int idx = connect_word(nodes, *swit, START_NODE);
         if (fanout.find(fanoutt) == fanout.end()) {
             cerr << "problem in connecting: " << *swit << " from start to fanout" << endl;
@@ -356,12 +322,12 @@ RWBSubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &
 void
 RWBSubwordGraph::connect_one_phone_subwords_from_cw_to_end(const set<string> &subwords,
                                                             vector<DecoderGraph::Node> &nodes,
-                                                            map<string, int> &fanin)
+                                                            map<int, int> &fanin)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanint = triphones[0];
+        int fanint = triphone_id(triphones[0]);
         if (fanin.find(fanint) == fanin.end()) {
             cerr << "problem in connecting: " << *swit << " fanin to end" << endl;
             assert(false);
@@ -392,8 +358,8 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
         subword_nodes.resize(subword_nodes.size()-3);
         add_nodes_to_tree(prefix_nodes, subword_nodes, false);
     }
@@ -403,7 +369,7 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     }
 
     lookahead_to_arcs(prefix_nodes);
-    vector<pair<unsigned int, string> > prefix_fanout_connectors, prefix_fanin_connectors;
+    vector<pair<unsigned int, int> > prefix_fanout_connectors, prefix_fanin_connectors;
     collect_crossword_connectors(prefix_nodes, prefix_fanout_connectors, prefix_fanin_connectors);
     if (verbose) cerr << "prefix tree size: " << reachable_graph_nodes(prefix_nodes) << endl;
 
@@ -417,8 +383,8 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
         add_nodes_to_tree(suffix_nodes, subword_nodes);
     }
     if (suffix_nodes.size() == 2) {
@@ -427,7 +393,7 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
     }
 
     lookahead_to_arcs(suffix_nodes);
-    vector<pair<unsigned int, string> > suffix_fanout_connectors, suffix_fanin_connectors;
+    vector<pair<unsigned int, int> > suffix_fanout_connectors, suffix_fanin_connectors;
     collect_crossword_connectors(suffix_nodes, suffix_fanout_connectors, suffix_fanin_connectors);
     if (verbose) cerr << "stem/suffix tree size: " << reachable_graph_nodes(suffix_nodes) << endl;
 
@@ -449,17 +415,17 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     // Cross-unit network (prefix-suffix, prefix-prefix)
     if (verbose) cerr << "creating cross-unit network" << endl;
-    map<string, int> cu_fanout;
-    map<string, int> cu_fanin;
+    map<int, int> cu_fanout;
+    map<int, int> cu_fanin;
     vector<DecoderGraph::Node> cu_nodes;
-    vector<pair<unsigned int, string> > all_fanin_connectors = suffix_fanin_connectors;
+    vector<pair<unsigned int, int> > all_fanin_connectors = suffix_fanin_connectors;
     all_fanin_connectors.insert(all_fanin_connectors.end(),
                                 prefix_fanin_connectors.begin(),
                                 prefix_fanin_connectors.end());
     create_crossunit_network(prefix_fanout_connectors, all_fanin_connectors,
                              one_phone_prefix_subwords, one_phone_suffix_subwords,
                              cu_nodes, cu_fanout, cu_fanin);
-    minimize_crossword_network(cu_nodes, cu_fanout, cu_fanin);
+    minimize_crossword_network(cu_nodes, cu_fanout, cu_fanin, verbose);
     if (verbose) cerr << "tied cross-unit network size: " << cu_nodes.size() << endl;
     connect_crossword_network(nodes,
                               prefix_fanout_connectors, all_fanin_connectors,
@@ -470,13 +436,13 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     // Cross-word network
     if (verbose) cerr << "creating cross-word network" << endl;
-    map<string, int> cw_fanout;
-    map<string, int> cw_fanin;
+    map<int, int> cw_fanout;
+    map<int, int> cw_fanin;
     vector<DecoderGraph::Node> cw_nodes;
     create_crossword_network(suffix_fanout_connectors, all_fanin_connectors,
                              one_phone_prefix_subwords, one_phone_suffix_subwords,
                              cw_nodes, cw_fanout, cw_fanin);
-    minimize_crossword_network(cw_nodes, cw_fanout, cw_fanin);
+    minimize_crossword_network(cw_nodes, cw_fanout, cw_fanin, verbose);
     if (verbose) cerr << "tied cross-word network size: " << cw_nodes.size() << endl;
     connect_crossword_network(nodes,
                               suffix_fanout_connectors, all_fanin_connectors,
@@ -497,18 +463,12 @@ RWBSubwordGraph::create_graph(const set<string> &prefix_subwords,
 
     if (verbose) cerr << "Tying nodes.." << endl;
     push_word_ids_right(m_nodes);
-    tie_state_prefixes(m_nodes);
-    tie_word_id_prefixes(m_nodes);
-    tie_state_prefixes(m_nodes);
-    tie_word_id_prefixes(m_nodes);
-    tie_state_prefixes(m_nodes);
+    int tied_count = tie_prefixes(m_nodes);
+    if (verbose) cerr << "tied prefix nodes: " << tied_count << endl;
 
     push_word_ids_left(m_nodes);
-    tie_state_suffixes(m_nodes);
-    tie_word_id_suffixes(m_nodes);
-    tie_state_suffixes(m_nodes);
-    tie_word_id_suffixes(m_nodes);
-    tie_state_suffixes(m_nodes);
+    tied_count = tie_suffixes(m_nodes);
+    if (verbose) cerr << "tied suffix nodes: " << tied_count << endl;
 
     prune_unreachable_nodes(m_nodes);
 
@@ -521,12 +481,12 @@ RWBSubwordGraph::offset(vector<DecoderGraph::Node> &nodes,
                          int offset)
 {
     for (auto nit = nodes.begin(); nit != nodes.end(); ++nit) {
-        std::set<unsigned int> arcs;
+        IdSet arcs;
         for (auto ait = nit->arcs.begin(); ait != nit->arcs.end(); ++ait)
             arcs.insert(*ait + offset);
         nit->arcs.swap(arcs);
 
-        std::set<unsigned int> rev_arcs;
+        IdSet rev_arcs;
         for (auto ait = nit->reverse_arcs.begin(); ait != nit->reverse_arcs.end(); ++ait)
             rev_arcs.insert(*ait + offset);
         nit->reverse_arcs.swap(rev_arcs);
@@ -545,7 +505,7 @@ RWBSubwordGraph::get_one_phone_subwords(const set<string> &subwords,
 
 
 void
-RWBSubwordGraph::offset(vector<pair<unsigned int, string> > &connectors,
+RWBSubwordGraph::offset(vector<pair<unsigned int, int> > &connectors,
                          int offset)
 {
     for (auto cit = connectors.begin(); cit != connectors.end(); ++cit)
@@ -555,16 +515,17 @@ RWBSubwordGraph::offset(vector<pair<unsigned int, string> > &connectors,
 
 void
 RWBSubwordGraph::collect_crossword_connectors(vector<DecoderGraph::Node> &nodes,
-                                               vector<pair<unsigned int, string> > &fanout_connectors,
-                                               vector<pair<unsigned int, string> > &fanin_connectors)
+                                               vector<pair<unsigned int, int> > &fanout_connectors,
+                                               vector<pair<unsigned int, int> > &fanin_connectors) const
 {
     fanout_connectors.clear();
     fanin_connectors.clear();
     for (unsigned int i=0; i<nodes.size(); i++) {
         Node &nd = nodes[i];
-        for (auto fiit = nd.from_fanin.begin(); fiit != nd.from_fanin.end(); ++fiit)
+        if (nd.crossword == nullptr) continue;
+        for (auto fiit = nd.crossword->from_fanin.begin(); fiit != nd.crossword->from_fanin.end(); ++fiit)
             fanin_connectors.push_back(make_pair(i, *fiit));
-        for (auto foit = nd.to_fanout.begin(); foit != nd.to_fanout.end(); ++foit)
+        for (auto foit = nd.crossword->to_fanout.begin(); foit != nd.crossword->to_fanout.end(); ++foit)
             fanout_connectors.push_back(make_pair(i, *foit));
     }
 }
@@ -24,36 +24,36 @@ public:
                       const std::set<std::string> &subwords,
                       bool verbose=false);
 
-    void create_crossunit_network(std::vector<std::pair<unsigned int, std::string> > &fanout_triphones,
-                                  std::vector<std::pair<unsigned int, std::string> > &fanin_triphones,
+    void create_crossunit_network(std::vector<std::pair<unsigned int, int> > &fanout_triphones,
+                                  std::vector<std::pair<unsigned int, int> > &fanin_triphones,
                                   std::set<std::string> &one_phone_prefix_subwords,
                                   std::set<std::string> &one_phone_suffix_subwords,
                                   std::vector<DecoderGraph::Node> &cw_nodes,
-                                  std::map<std::string, int> &fanout,
-                                  std::map<std::string, int> &fanin);
+                                  std::map<int, int> &fanout,
+                                  std::map<int, int> &fanin);
 
-    void create_crossword_network(std::vector<std::pair<unsigned int, std::string> > &fanout_triphones,
-                                  std::vector<std::pair<unsigned int, std::string> > &fanin_triphones,
+    void create_crossword_network(std::vector<std::pair<unsigned int, int> > &fanout_triphones,
+                                  std::vector<std::pair<unsigned int, int> > &fanin_triphones,
                                   std::set<std::string> &one_phone_prefix_subwords,
                                   std::set<std::string> &one_phone_suffix_subwords,
                                   std::vector<DecoderGraph::Node> &cw_nodes,
-                                  std::map<std::string, int> &fanout,
-                                  std::map<std::string, int> &fanin);
+                                  std::map<int, int> &fanout,
+                                  std::map<int, int> &fanin);
 
     void connect_crossword_network(std::vector<DecoderGraph::Node> &nodes,
-                                   std::vector<std::pair<unsigned int, std::string> > &fanout_connectors,
-                                   std::vector<std::pair<unsigned int, std::string> > &fanin_connectors,
+                                   std::vector<std::pair<unsigned int, int> > &fanout_connectors,
+                                   std::vector<std::pair<unsigned int, int> > &fanin_connectors,
                                    std::vector<DecoderGraph::Node> &cw_nodes,
-                                   std::map<std::string, int> &fanout,
-                                   std::map<std::string, int> &fanin);
+                                   std::map<int, int> &fanout,
+                                   std::map<int, int> &fanin);
 
     void connect_one_phone_subwords_from_start_to_cw(const std::set<std::string> &subwords,
                                                      std::vector<DecoderGraph::Node> &nodes,
-                                                     std::map<std::string, int> &fanout);
+                                                     std::map<int, int> &fanout);
 
     void connect_one_phone_subwords_from_cw_to_end(const std::set<std::string> &subwords,
                                                    std::vector<DecoderGraph::Node> &nodes,
-                                                   std::map<std::string, int> &fanin);
+                                                   std::map<int, int> &fanin);
 
     void get_one_phone_subwords(const std::set<std::string> &subwords,
                                 std::set<std::string> &one_phone_subwords) const;
@@ -61,12 +61,12 @@ public:
     static void offset(std::vector<DecoderGraph::Node> &nodes,
                        int offset);
 
-    static void offset(std::vector<std::pair<unsigned int, std::string> > &connectors,
+    static void offset(std::vector<std::pair<unsigned int, int> > &connectors,
                        int offset);
 
-    static void collect_crossword_connectors(std::vector<DecoderGraph::Node> &nodes,
-                                             std::vector<std::pair<unsigned int, std::string> > &fanout_connectors,
-                                             std::vector<std::pair<unsigned int, std::string> > &fanin_connectors);
+    void collect_crossword_connectors(std::vector<DecoderGraph::Node> &nodes,
+                                      std::vector<std::pair<unsigned int, int> > &fanout_connectors,
+                                      std::vector<std::pair<unsigned int, int> > &fanin_connectors) const;
 
     virtual void create_forced_path(std::vector<DecoderGraph::Node> &nodes,
                                     std::vector<std::string> &sentence,
@@ -21,32 +21,30 @@ SubwordGraph::SubwordGraph(const std::set<std::string> &subwords,
 void
 SubwordGraph::create_crossword_network(const set<string> &subwords,
                                        vector<DecoderGraph::Node> &nodes,
-                                       map<string, int> &fanout,
-                                       map<string, int> &fanin)
+                                       map<int, int> &fanout,
+                                       map<int, int> &fanin)
 {
-    int spp = m_states_per_phone;
-
     set<string> one_phone_subwords;
     set<char> phones;
     for (auto swit = m_lexicon.begin(); swit != m_lexicon.end(); ++swit) {
         if (subwords.find(swit->first) == subwords.end()) continue;
         vector<string> &triphones = swit->second;
         if (triphones.size() > 1) {
-            fanout[triphones.back()] = -1;
-            fanin[triphones[0]] = -1;
+            fanout[triphone_id(triphones.back())] = -1;
+            fanin[triphone_id(triphones[0])] = -1;
         }
         else if (triphones.size() == 1 && is_triphone(triphones[0])) {
             one_phone_subwords.insert(swit->first);
             phones.insert(tphone(triphones[0]));
-            fanout[triphones[0]] = -1;
-            fanin[triphones[0]] = -1;
+            fanout[triphone_id(triphones[0])] = -1;
+            fanin[triphone_id(triphones[0])] = -1;
         }
     }
 
     // All phone-phone combinations from one phone subwords to fanout
     for (auto fphit = phones.begin(); fphit != phones.end(); ++fphit) {
         for (auto sphit = phones.begin(); sphit != phones.end(); ++sphit) {
-            string fanoutt = construct_triphone(*fphit, *sphit, SIL_CTXT);
+            int fanoutt = triphone_id(*fphit, *sphit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
@@ -55,45 +53,19 @@ SubwordGraph::create_crossword_network(const set<string> &subwords,
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         if (tlc(foit->first) == SIL_CTXT) continue;
         for (auto phit = phones.begin(); phit != phones.end(); ++phit) {
-            string fanoutt = construct_triphone(tphone(foit->first), *phit, SIL_CTXT);
+            int fanoutt = triphone_id(tphone(foit->first), *phit, SIL_CTXT);
             fanout[fanoutt] = -1;
         }
     }
 
-    map<string, int> connected_fanin_nodes;
+    // Nodes of the fanout loops below
+    int num_loop_nodes = 0;
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
-
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int tri1_idx = connect_triphone(nodes, triphone1, start_index);
-            int idx = connect_word(nodes, "<w>", tri1_idx);
-            idx = connect_triphone(nodes, SHORT_SIL, idx);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                nodes[tri1_idx].arcs.insert(idx - (spp-1));
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else {
-                nodes[tri1_idx].arcs.insert(connected_fanin_nodes[triphone2]);
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-            }
-        }
+        num_loop_nodes += one_phone_subwords.size() * (m_states_per_phone + 1);
+        if (tlc(foit->first) != SIL_CTXT || trc(foit->first) != SIL_CTXT)
+            num_loop_nodes += one_phone_subwords.size() * (hmm_node_count(SHORT_SIL) + 2);
     }
+    connect_fanouts_to_fanins(nodes, fanout, fanin, true, true, true, num_loop_nodes);
 
 
     // Add loops for one phone subwords from fanout back to fanout
@@ -105,10 +77,10 @@ SubwordGraph::create_crossword_network(const set<string> &subwords,
 
             string single_phone = m_lexicon[*opswit][0];
             string triphone = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(single_phone));
-            string fanout_loop_connector = construct_triphone(tphone(foit->first), tphone(single_phone), SIL_CTXT);
+            int fanout_loop_connector = triphone_id(tphone(foit->first), tphone(single_phone), SIL_CTXT);
             if (fanout.find(fanout_loop_connector) == fanout.end()) {
                 cerr << "problem in connecting fanout loop for one phone subword:" << *opswit << endl;
-                cerr << fanout_loop_connector << endl;
+                cerr << DecoderGraph::triphone(fanout_loop_connector) << endl;
                 assert(false);
             }
 
@@ -136,13 +108,13 @@ SubwordGraph::create_crossword_network(const set<string> &subwords,
 void
 SubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &subwords,
                                                           vector<DecoderGraph::Node> &nodes,
-                                                          map<string, int> &fanout)
+                                                          map<int, int> &fanout)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1) continue;
         if (!is_triphone(triphones[0])) continue;
-        string fanoutt = triphones[0];
+        int fanoutt = triphone_id(triphones[0]);
         int idx = connect_word(nodes, *swit, START_NODE);
         if (fanout.find(fanoutt) == fanout.end()) {
             cerr << "problem in connecting: " << *swit << " from start to fanout" << endl;
@@ -156,13 +128,13 @@ SubwordGraph::connect_one_phone_subwords_from_start_to_cw(const set<string> &sub
 void
 SubwordGraph::connect_one_phone_subwords_from_cw_to_end(const set<string> &subwords,
                                                         vector<DecoderGraph::Node> &nodes,
-                                                        map<string, int> &fanin)
+                                                        map<int, int> &fanin)
 {
     for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
         vector<string> &triphones = m_lexicon[*swit];
         if (triphones.size() != 1) continue;
         if (!is_triphone(triphones[0])) continue;
-        string fanint = triphones[0];
+        int fanint = triphone_id(triphones[0]);
         if (fanin.find(fanint) == fanin.end()) {
             cerr << "problem in connecting: " << *swit << " fanin to end" << endl;
             assert(false);
@@ -243,29 +215,31 @@ void
 SubwordGraph::create_graph(const set<string> &subwords,
                            bool verbose)
 {
-    for (auto swit = subwords.begin(); swit != subwords.end(); ++swit) {
-        if (swit->find("<") != string::npos) continue;
+    vector<string> sorted_subwords;
+    sort_by_state_chain(subwords, sorted_subwords);
+    MinimizingTreeBuilder tree_builder(m_nodes);
+    for (auto swit = sorted_subwords.begin(); swit != sorted_subwords.end(); ++swit) {
         vector<TriphoneNode> subword_triphones;
         triphonize_subword(*swit, subword_triphones);
         // One phone subwords not connected yet to the main tree
         if (num_triphones(subword_triphones) < 2) continue;
         vector<DecoderGraph::Node> subword_nodes;
         triphones_to_state_chain(subword_triphones, subword_nodes);
-        subword_nodes[3].from_fanin.insert(m_lexicon[*swit][0]);
-        subword_nodes[subword_nodes.size()-4].to_fanout.insert(m_lexicon[*swit].back());
-        add_nodes_to_tree(m_nodes, subword_nodes);
+        subword_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*swit][0]));
+        subword_nodes[subword_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*swit].back()));
+        tree_builder.add_nodes(subword_nodes);
     }
-    lookahead_to_arcs(m_nodes);
+    tree_builder.finish();
 
     prune_unreachable_nodes(m_nodes);
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
     vector<DecoderGraph::Node> cw_nodes;
-    map<string, int> fanout, fanin;
+    map<int, int> fanout, fanin;
     if (verbose) cerr << "Creating crossword network.." << endl;
     create_crossword_network(subwords, cw_nodes, fanout, fanin);
     if (verbose) cerr << "crossword network size: " << cw_nodes.size() << endl;
-    minimize_crossword_network(cw_nodes, fanout, fanin);
+    minimize_crossword_network(cw_nodes, fanout, fanin, verbose);
     if (verbose) cerr << "tied crossword network size: " << cw_nodes.size() << endl;
 
     if (verbose) cerr << "Connecting crossword network.." << endl;
@@ -282,18 +256,12 @@ SubwordGraph::create_graph(const set<string> &subwords,
 
     if (verbose) cerr << "Tying nodes.." << endl;
     push_word_ids_right(m_nodes);
-    tie_state_prefixes(m_nodes);
-    tie_word_id_prefixes(m_nodes);
-    tie_state_prefixes(m_nodes);
-    tie_word_id_prefixes(m_nodes);
-    tie_state_prefixes(m_nodes);
+    int tied_count = tie_prefixes(m_nodes);
+    if (verbose) cerr << "tied prefix nodes: " << tied_count << endl;
 
     push_word_ids_left(m_nodes);
-    tie_state_suffixes(m_nodes);
-    tie_word_id_suffixes(m_nodes);
-    tie_state_suffixes(m_nodes);
-    tie_word_id_suffixes(m_nodes);
-    tie_state_suffixes(m_nodes);
+    tied_count = tie_suffixes(m_nodes);
+    if (verbose) cerr << "tied suffix nodes: " << tied_count << endl;
 
     prune_unreachable_nodes(m_nodes);
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
@@ -25,16 +25,16 @@ public:
 
     void create_crossword_network(const std::set<std::string> &subwords,
                                   std::vector<DecoderGraph::Node> &nodes,
-                                  std::map<std::string, int> &fanout,
-                                  std::map<std::string, int> &fanin);
+                                  std::map<int, int> &fanout,
+                                  std::map<int, int> &fanin);
 
     void connect_one_phone_subwords_from_start_to_cw(const std::set<std::string> &subwords,
                                                      std::vector<DecoderGraph::Node> &nodes,
-                                                     std::map<std::string, int> &fanout);
+                                                     std::map<int, int> &fanout);
 
     void connect_one_phone_subwords_from_cw_to_end(const std::set<std::string> &subwords,
                                                    std::vector<DecoderGraph::Node> &nodes,
-                                                   std::map<std::string, int> &fanin);
+                                                   std::map<int, int> &fanin);
 
     virtual void create_forced_path(std::vector<DecoderGraph::Node> &nodes,
                                     std::vector<std::string> &sentence,
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <sstream>
 
 #include "WordGraph.hh"
 
@@ -19,77 +20,49 @@ WordGraph::WordGraph(const std::set<std::string> &words,
 
 
 void
-WordGraph::create_crossword_network(const set<string> &words,
-                                    vector<DecoderGraph::Node> &nodes,
-                                    map<string, int> &fanout,
-                                    map<string, int> &fanin)
+WordGraph::crossword_network_triphones(const set<string> &words,
+                                       map<int, int> &fanout,
+                                       map<int, int> &fanin) const
 {
-    int spp = m_states_per_phone;
-
-    set<string> one_phone_subwords;
     set<char> phones;
     for (auto swit = m_lexicon.begin(); swit != m_lexicon.end(); ++swit) {
         if (words.find(swit->first) == words.end()) continue;
-        vector<string> &triphones = swit->second;
+        const vector<string> &triphones = swit->second;
         if (triphones.size() == 0) continue;
         else if (triphones.size() == 1 && is_triphone(triphones[0])) {
-            one_phone_subwords.insert(swit->first);
             phones.insert(tphone(triphones[0]));
-            fanout[triphones[0]] = -1;
-            fanin[triphones[0]] = -1;
+            fanout[triphone_id(triphones[0])] = -1;
+            fanin[triphone_id(triphones[0])] = -1;
         }
         else if (triphones.size() > 1) {
-            fanout[triphones.back()] = -1;
-            fanin[triphones[0]] = -1;
+            fanout[triphone_id(triphones.back())] = -1;
+            fanin[triphone_id(triphones[0])] = -1;
         }
     }
 
     // All phone-phone combinations from one phone words to fanout
     for (auto fphit = phones.begin(); fphit != phones.end(); ++fphit)
-        for (auto sphit = phones.begin(); sphit != phones.end(); ++sphit) {
-            string fanoutt = construct_triphone(*fphit, *sphit, SIL_CTXT);
-            fanout[fanoutt] = -1;
-        }
+        for (auto sphit = phones.begin(); sphit != phones.end(); ++sphit)
+            fanout[triphone_id(*fphit, *sphit, SIL_CTXT)] = -1;
 
     // Fanout last triphone + phone from one phone words, all combinations to fanout
     for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
         if (tlc(foit->first) == SIL_CTXT) continue;
-        for (auto phit = phones.begin(); phit != phones.end(); ++phit) {
-            string fanoutt = construct_triphone(tphone(foit->first), *phit, SIL_CTXT);
-            fanout[fanoutt] = -1;
-        }
+        for (auto phit = phones.begin(); phit != phones.end(); ++phit)
+            fanout[triphone_id(tphone(foit->first), *phit, SIL_CTXT)] = -1;
     }
+}
 
-    map<string, int> connected_fanin_nodes;
-    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit) {
 
-        nodes.resize(nodes.size()+1);
-        nodes.back().flags |= NODE_FAN_OUT_DUMMY;
-        foit->second = nodes.size()-1;
-        int start_index = foit->second;
-
-        for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit) {
-            string triphone1 = construct_triphone(tlc(foit->first), tphone(foit->first), tphone(fiit->first));
-            string triphone2 = construct_triphone(tphone(foit->first), tphone(fiit->first), trc(fiit->first));
-
-            int idx = connect_triphone(nodes, triphone1, start_index);
-            idx = connect_triphone(nodes, SHORT_SIL, idx);
-
-            if (connected_fanin_nodes.find(triphone2) == connected_fanin_nodes.end())
-            {
-                idx = connect_triphone(nodes, triphone2, idx);
-                connected_fanin_nodes[triphone2] = idx - (spp-1);
-                if (fiit->second == -1) {
-                    nodes.resize(nodes.size()+1);
-                    nodes.back().flags |= NODE_FAN_IN_DUMMY;
-                    fiit->second = nodes.size()-1;
-                }
-                nodes[idx].arcs.insert(fiit->second);
-            }
-            else
-                nodes[idx].arcs.insert(connected_fanin_nodes[triphone2]);
-        }
-    }
+void
+WordGraph::create_crossword_network(const set<string> &words,
+                                    vector<DecoderGraph::Node> &nodes,
+                                    map<int, int> &fanout,
+                                    map<int, int> &fanin)
+{
+    crossword_network_triphones(words, fanout, fanin);
+
+    connect_fanouts_to_fanins(nodes, fanout, fanin, false, true);
 
     for (auto cwnit = nodes.begin(); cwnit != nodes.end(); ++cwnit)
         cwnit->flags |= NODE_CW;
@@ -99,12 +72,12 @@ WordGraph::create_crossword_network(const set<string> &words,
 void
 WordGraph::connect_one_phone_words_from_start_to_cw(const set<string> &words,
                                                     vector<DecoderGraph::Node> &nodes,
-                                                    map<string, int> &fanout)
+                                                    map<int, int> &fanout)
 {
     for (auto wit = words.begin(); wit != words.end(); ++wit) {
         vector<string> &triphones = m_lexicon[*wit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanoutt = triphones[0];
+        int fanoutt = triphone_id(triphones[0]);
         int idx = connect_word(nodes, *wit, START_NODE);
         if (fanout.find(fanoutt) == fanout.end()) {
             cerr << "problem in connecting: " << *wit << " from start to fanout" << endl;
@@ -118,12 +91,12 @@ WordGraph::connect_one_phone_words_from_start_to_cw(const set<string> &words,
 void
 WordGraph::connect_one_phone_words_from_cw_to_end(const set<string> &words,
                                                   vector<DecoderGraph::Node> &nodes,
-                                                  map<string, int> &fanin)
+                                                  map<int, int> &fanin)
 {
     for (auto wit = words.begin(); wit != words.end(); ++wit) {
         vector<string> &triphones = m_lexicon[*wit];
         if (triphones.size() != 1 || !is_triphone(triphones[0])) continue;
-        string fanint = triphones[0];
+        int fanint = triphone_id(triphones[0]);
         if (fanin.find(fanint) == fanin.end()) {
             cerr << "problem in connecting: " << *wit << " fanin to end" << endl;
             assert(false);
@@ -138,27 +111,30 @@ void
 WordGraph::create_graph(const set<string> &words,
                         bool verbose)
 {
-    for (auto wit = words.begin(); wit != words.end(); ++wit) {
-        if (wit->find("<") != string::npos) continue;
+    vector<string> sorted_words;
+    sort_by_state_chain(words, sorted_words);
+    MinimizingTreeBuilder tree_builder(m_nodes);
+    for (auto wit = sorted_words.begin(); wit != sorted_words.end(); ++wit) {
         vector<TriphoneNode> word_triphones;
         triphonize_subword(*wit, word_triphones);
         vector<DecoderGraph::Node> word_nodes;
         triphones_to_state_chain(word_triphones, word_nodes);
         // One phone words without crossword path
         if (num_triphones(word_triphones) > 1) {
-            word_nodes[3].from_fanin.insert(m_lexicon[*wit][0]);
-            word_nodes[word_nodes.size()-4].to_fanout.insert(m_lexicon[*wit].back());
+            word_nodes[3].crossword_contexts().from_fanin.insert(triphone_id(m_lexicon[*wit][0]));
+            word_nodes[word_nodes.size()-4].crossword_contexts().to_fanout.insert(triphone_id(m_lexicon[*wit].back()));
         }
-        add_nodes_to_tree(m_nodes, word_nodes);
+        tree_builder.add_nodes(word_nodes);
     }
-    lookahead_to_arcs(m_nodes);
+    tree_builder.finish();
     prune_unreachable_nodes(m_nodes);
+    if (verbose) cerr << "tied word tree suffix nodes: " << tree_builder.merged_count() << endl;
 
     vector<DecoderGraph::Node> cw_nodes;
-    map<string, int> fanout, fanin;
+    map<int, int> fanout, fanin;
     create_crossword_network(words, cw_nodes, fanout, fanin);
     if (verbose) cerr << "crossword network size: " << cw_nodes.size() << endl;
-    minimize_crossword_network(cw_nodes, fanout, fanin);
+    minimize_crossword_network(cw_nodes, fanout, fanin, verbose);
     if (verbose) cerr << "tied crossword network size: " << cw_nodes.size() << endl;
 
     if (verbose) cerr << "Connecting crossword network.." << endl;
@@ -168,6 +144,17 @@ WordGraph::create_graph(const set<string> &words,
 
     connect_one_phone_words_from_start_to_cw(words, m_nodes, fanout);
     connect_one_phone_words_from_cw_to_end(words, m_nodes, fanin);
+
+    set<node_idx_t> reachable_nodes;
+    reachable_graph_nodes(m_nodes, reachable_nodes);
+    m_fanout.clear();
+    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit)
+        if (reachable_nodes.count(foit->second) && m_nodes[foit->second].flags & NODE_FAN_OUT_DUMMY)
+            m_fanout.insert(*foit);
+    m_fanin.clear();
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        if (reachable_nodes.count(fiit->second) && m_nodes[fiit->second].flags & NODE_FAN_IN_DUMMY)
+            m_fanin.insert(*fiit);
 }
 
 
@@ -181,14 +168,16 @@ WordGraph::tie_graph(bool verbose,
     if (verbose) cerr << "Pushing word ids right.." << endl;
     push_word_ids_right(m_nodes);
     if (verbose) cerr << "Tying state prefixes.." << endl;
-    tie_state_prefixes(m_nodes);
+    int tied_count = tie_prefixes(m_nodes, false);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
     if (verbose) cerr << endl;
     if (verbose) cerr << "Pushing word ids left.." << endl;
     push_word_ids_left(m_nodes);
     if (verbose) cerr << "Tying state suffixes.." << endl;
-    tie_state_suffixes(m_nodes);
+    tied_count = tie_suffixes(m_nodes, false);
+    if (verbose) cerr << "tied nodes: " << tied_count << endl;
     if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
     if (remove_cw_markers) {
@@ -199,12 +188,376 @@ WordGraph::tie_graph(bool verbose,
 
         if (verbose) cerr << endl;
         if (verbose) cerr << "Tying state suffixes.." << endl;
-        tie_state_suffixes(m_nodes);
+        tied_count = tie_suffixes(m_nodes, false);
+        if (verbose) cerr << "tied nodes: " << tied_count << endl;
         if (verbose) cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
 
         cerr << "Tying state prefixes.." << endl;
-        tie_state_prefixes(m_nodes);
+        tied_count = tie_prefixes(m_nodes, false);
+        cerr << "tied nodes: " << tied_count << endl;
         cerr << "number of nodes: " << reachable_graph_nodes(m_nodes) << endl;
+
+        m_fanout.clear();
+        m_fanin.clear();
+    }
+    else {
+        renumber_connection_points(m_fanout, NODE_FAN_OUT_DUMMY);
+        renumber_connection_points(m_fanin, NODE_FAN_IN_DUMMY);
     }
 }
 
+
+// The dummy nodes are not tied and pruning keeps the order of the nodes,
+// so the connection points are the flagged nodes in the same order as before tying
+void
+WordGraph::renumber_connection_points(map<int, int> &points,
+                                      int flag)
+{
+    set<int> old_node_idxs;
+    for (auto pit = points.begin(); pit != points.end(); ++pit)
+        old_node_idxs.insert(pit->second);
+
+    map<int, int> new_node_idxs;
+    auto onit = old_node_idxs.begin();
+    for (int i=0; i<(int)m_nodes.size(); i++) {
+        if (!(m_nodes[i].flags & flag)) continue;
+        if (onit == old_node_idxs.end()) throw string("Problem in tracking the cross-word connection points.");
+        new_node_idxs[*onit++] = i;
+    }
+    if (onit != old_node_idxs.end()) throw string("Problem in tracking the cross-word connection points.");
+
+    for (auto pit = points.begin(); pit != points.end(); ++pit)
+        pit->second = new_node_idxs[pit->second];
+}
+
+
+void
+WordGraph::remap_connection_points(const vector<int> &new_indices)
+{
+    map<int, int>* points[2] = { &m_fanout, &m_fanin };
+    for (int p=0; p<2; p++) {
+        for (auto pit = points[p]->begin(); pit != points[p]->end(); ) {
+            int new_idx = new_indices.at(pit->second);
+            if (new_idx == -1) points[p]->erase(pit++);
+            else (pit++)->second = new_idx;
+        }
+    }
+}
+
+
+// One point per line: fanout|fanin TRIPHONE NODE
+void
+WordGraph::write_connection_points(string fname) const
+{
+    ofstream outf(fname);
+    if (!outf) throw string("Problem opening file: " + fname);
+    for (auto foit = m_fanout.begin(); foit != m_fanout.end(); ++foit)
+        outf << "fanout " << triphone(foit->first) << " " << foit->second << "\n";
+    for (auto fiit = m_fanin.begin(); fiit != m_fanin.end(); ++fiit)
+        outf << "fanin " << triphone(fiit->first) << " " << fiit->second << "\n";
+    if (!outf) throw string("Problem writing file: " + fname);
+}
+
+
+void
+WordGraph::read_connection_points(string fname)
+{
+    ifstream inf(fname);
+    if (!inf) throw string("Problem opening file: " + fname);
+
+    m_fanout.clear();
+    m_fanin.clear();
+    string line;
+    while (getline(inf, line)) {
+        stringstream ss(line);
+        string type, triphone;
+        int node_idx;
+        ss >> type >> triphone >> node_idx;
+        if (ss.fail() || node_idx < 0 || node_idx >= (int)m_nodes.size())
+            throw string("Problem reading connection points: " + fname);
+        if (type == "fanout" && m_nodes[node_idx].flags & NODE_FAN_OUT_DUMMY)
+            m_fanout[triphone_id(triphone)] = node_idx;
+        else if (type == "fanin" && m_nodes[node_idx].flags & NODE_FAN_IN_DUMMY)
+            m_fanin[triphone_id(triphone)] = node_idx;
+        else throw string("Connection points not for the graph: " + fname);
+    }
+}
+
+
+
+void
+WordGraph::link(node_idx_t src_node_idx,
+                node_idx_t tgt_node_idx)
+{
+    m_nodes[src_node_idx].arcs.insert(tgt_node_idx);
+    m_nodes[tgt_node_idx].reverse_arcs.insert(src_node_idx);
+}
+
+
+node_idx_t
+WordGraph::new_node(node_idx_t pred_node_idx,
+                    int hmm_state,
+                    int word_id)
+{
+    m_nodes.resize(m_nodes.size()+1);
+    m_nodes.back().hmm_state = hmm_state;
+    m_nodes.back().word_id = word_id;
+    link(pred_node_idx, m_nodes.size()-1);
+    return m_nodes.size()-1;
+}
+
+
+// Builds the network for all the words and redirects the arcs
+// to the old fan-out nodes and from the old fan-in nodes to it,
+// the old network is left unreachable
+void
+WordGraph::replace_crossword_network(const set<string> &words,
+                                     bool verbose)
+{
+    vector<DecoderGraph::Node> cw_nodes;
+    map<int, int> fanout, fanin;
+    create_crossword_network(words, cw_nodes, fanout, fanin);
+    minimize_crossword_network(cw_nodes, fanout, fanin);
+    if (verbose) cerr << "new crossword network size: " << cw_nodes.size() << endl;
+
+    int offset = m_nodes.size();
+    for (auto cwnit = cw_nodes.begin(); cwnit != cw_nodes.end(); ++cwnit) {
+        m_nodes.push_back(*cwnit);
+        IdSet temp_arcs = m_nodes.back().arcs;
+        m_nodes.back().arcs.clear();
+        for (auto ait = temp_arcs.begin(); ait != temp_arcs.end(); ++ait)
+            m_nodes.back().arcs.insert(*ait + offset);
+    }
+    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit)
+        foit->second += offset;
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        fiit->second += offset;
+
+    map<int, int> fanout_replacements;
+    for (auto foit = m_fanout.begin(); foit != m_fanout.end(); ++foit)
+        fanout_replacements[foit->second] = fanout.at(foit->first);
+    for (int i=0; i<offset; i++) {
+        DecoderGraph::Node &node = m_nodes[i];
+        if (node.flags & NODE_CW) continue;
+        IdSet temp_arcs = node.arcs;
+        for (auto ait = temp_arcs.begin(); ait != temp_arcs.end(); ++ait) {
+            auto frit = fanout_replacements.find(*ait);
+            if (frit == fanout_replacements.end()) continue;
+            node.arcs.erase(*ait);
+            node.arcs.insert(frit->second);
+        }
+    }
+
+    for (auto fiit = m_fanin.begin(); fiit != m_fanin.end(); ++fiit) {
+        if (tlc(fiit->first) == SIL_CTXT && trc(fiit->first) == SIL_CTXT) continue;
+        DecoderGraph::Node &old_fanin_node = m_nodes[fiit->second];
+        DecoderGraph::Node &fanin_node = m_nodes[fanin.at(fiit->first)];
+        for (auto ait = old_fanin_node.arcs.begin(); ait != old_fanin_node.arcs.end(); ++ait)
+            if (!(m_nodes[*ait].flags & NODE_CW)) fanin_node.arcs.insert(*ait);
+    }
+
+    m_fanout.swap(fanout);
+    m_fanin.swap(fanin);
+
+    // Pushing the word ids left may have moved the word ids
+    // of one phone words to the old network
+    connect_one_phone_words_from_cw_to_end(words, m_nodes, m_fanin);
+}
+
+
+// The word is branched after the longest prefix of single predecessor tree nodes.
+// As after pushing the word ids left, the word id follows the branching node
+// but is not before the node entered from the fan-in.
+void
+WordGraph::add_word(const string &word)
+{
+    const vector<string> &triphones = m_lexicon.at(word);
+    int word_id = m_subword_map.at(word);
+
+    // The path from the fan-in is connected with the new cross-word network
+    if (triphones.size() == 1) {
+        node_idx_t word_node_idx = new_node(START_NODE, -1, word_id);
+        link(word_node_idx, m_fanout.at(triphone_id(triphones[0])));
+        node_idx_t node_idx = word_node_idx;
+        const Hmm &hmm = m_hmms.at(hmm_index(triphones[0]));
+        for (unsigned int sidx = 2; sidx < hmm.states.size(); ++sidx)
+            node_idx = new_node(node_idx, hmm.states[sidx].model);
+        link(node_idx, END_NODE);
+        merge_suffix(node_idx, word_node_idx);
+        return;
+    }
+
+    vector<TriphoneNode> word_triphones;
+    triphonize_subword(word, word_triphones);
+    vector<DecoderGraph::Node> chain;
+    triphones_to_state_chain(word_triphones, chain);
+    int word_pos = 0;
+    while (chain[word_pos].word_id == -1) word_pos++;
+    int fanin_pos = m_hmms.at(word_triphones[0].hmm_id).states.size() - 2;
+    node_idx_t fanin_node_idx = m_fanin.at(triphone_id(triphones[0]));
+
+    node_idx_t node_idx = START_NODE;
+    int matched = 0;
+    while (matched < word_pos) {
+        int next_node_idx = -1;
+        const DecoderGraph::Node &node = m_nodes[node_idx];
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait) {
+            if (*ait == node_idx) continue;
+            const DecoderGraph::Node &next_node = m_nodes[*ait];
+            if (next_node.hmm_state != chain[matched].hmm_state
+                || next_node.word_id != -1 || next_node.flags != 0) continue;
+            int tree_pred_count = 0, fanin_pred_count = 0;
+            for (auto rait = next_node.reverse_arcs.begin(); rait != next_node.reverse_arcs.end(); ++rait) {
+                if (*rait == *ait) continue;
+                if (m_nodes[*rait].flags & NODE_FAN_IN_DUMMY) fanin_pred_count++;
+                else tree_pred_count++;
+            }
+            if (tree_pred_count != 1) continue;
+            if (matched == fanin_pos) {
+                if (!next_node.reverse_arcs.count(fanin_node_idx)) continue;
+            }
+            else if (fanin_pred_count > 0) continue;
+            next_node_idx = *ait;
+            break;
+        }
+        if (next_node_idx == -1) break;
+        node_idx = next_node_idx;
+        matched++;
+    }
+    int branch_pos = max(matched, fanin_pos);
+    for (int i=matched; i<branch_pos; i++)
+        node_idx = new_node(node_idx, chain[i].hmm_state);
+    node_idx_t word_node_idx = new_node(node_idx, -1, word_id);
+    if (matched <= fanin_pos) link(fanin_node_idx, word_node_idx);
+    node_idx = word_node_idx;
+    for (int i=branch_pos; i<word_pos; i++)
+        node_idx = new_node(node_idx, chain[i].hmm_state);
+    link(node_idx, m_fanout.at(triphone_id(triphones.back())));
+    for (int i=word_pos+1; i<(int)chain.size(); i++)
+        node_idx = new_node(node_idx, chain[i].hmm_state);
+    link(node_idx, END_NODE);
+
+    merge_suffix(node_idx, word_node_idx);
+}
+
+
+// Merges the chain ending in the node with the equivalent existing nodes
+// from the end, the predecessor of each chain node is the previous node
+void
+WordGraph::merge_suffix(node_idx_t node_idx,
+                        node_idx_t stop_node_idx)
+{
+    auto successors = [&](node_idx_t idx) {
+        IdSet nodes = m_nodes[idx].arcs;
+        nodes.erase(idx);
+        return nodes;
+    };
+
+    while (node_idx != stop_node_idx) {
+        DecoderGraph::Node &node = m_nodes[node_idx];
+        IdSet node_successors = successors(node_idx);
+        node_idx_t pred_node_idx = *(node.reverse_arcs.begin());
+
+        int equivalent_node_idx = -1;
+        const IdSet &candidates = m_nodes[*(node_successors.begin())].reverse_arcs;
+        for (auto cit = candidates.begin(); cit != candidates.end(); ++cit) {
+            const DecoderGraph::Node &candidate = m_nodes[*cit];
+            if (*cit == node_idx || *cit == *(node_successors.begin())) continue;
+            if (candidate.hmm_state != node.hmm_state || candidate.word_id != node.word_id
+                || candidate.flags != node.flags) continue;
+            if (successors(*cit) != node_successors) continue;
+            equivalent_node_idx = *cit;
+            break;
+        }
+        if (equivalent_node_idx == -1) break;
+
+        for (auto ait = node.arcs.begin(); ait != node.arcs.end(); ++ait)
+            m_nodes[*ait].reverse_arcs.erase(node_idx);
+        node.arcs.clear();
+        node.reverse_arcs.clear();
+        m_nodes[pred_node_idx].arcs.erase(node_idx);
+        link(pred_node_idx, equivalent_node_idx);
+        node_idx = pred_node_idx;
+    }
+}
+
+
+vector<int>
+WordGraph::add_words(const set<string> &words,
+                     bool verbose)
+{
+    if (m_fanout.size() == 0 || m_fanin.size() == 0)
+        throw string("Cross-word connection points not set.");
+
+    set<string> graph_words;
+    for (auto nit = m_nodes.begin(); nit != m_nodes.end(); ++nit)
+        if (nit->word_id != -1) graph_words.insert(m_subwords.at(nit->word_id));
+
+    set<string> new_words;
+    for (auto wit = words.begin(); wit != words.end(); ++wit) {
+        if (graph_words.find(*wit) != graph_words.end()) {
+            if (verbose) cerr << "Word " << *wit << " already in the graph" << endl;
+            continue;
+        }
+        auto lexit = m_lexicon.find(*wit);
+        if (lexit == m_lexicon.end()) throw string("Word " + *wit + " not in the lexicon");
+        const vector<string> &triphones = lexit->second;
+        if (triphones.size() == 0 || (triphones.size() == 1 && !is_triphone(triphones[0]))) {
+            cerr << "Word " << *wit << " without triphones not added" << endl;
+            continue;
+        }
+        new_words.insert(*wit);
+    }
+
+    bool self_transitions = false;
+    for (int i=0; i<(int)m_nodes.size(); i++)
+        if (m_nodes[i].hmm_state != -1) {
+            self_transitions = m_nodes[i].arcs.count(i) > 0;
+            break;
+        }
+    int old_node_count = m_nodes.size();
+
+    set<string> all_words(graph_words);
+    all_words.insert(new_words.begin(), new_words.end());
+    map<int, int> fanout, fanin;
+    crossword_network_triphones(all_words, fanout, fanin);
+    bool rebuild_crossword_network = false;
+    for (auto foit = fanout.begin(); foit != fanout.end(); ++foit)
+        if (m_fanout.find(foit->first) == m_fanout.end()) rebuild_crossword_network = true;
+    for (auto fiit = fanin.begin(); fiit != fanin.end(); ++fiit)
+        if (m_fanin.find(fiit->first) == m_fanin.end()) rebuild_crossword_network = true;
+    for (auto wit = new_words.begin(); wit != new_words.end(); ++wit)
+        if (m_lexicon.at(*wit).size() == 1) rebuild_crossword_network = true;
+    if (rebuild_crossword_network) {
+        if (verbose) cerr << "Rebuilding the crossword network.." << endl;
+        replace_crossword_network(all_words, verbose);
+    }
+
+    set_reverse_arcs_also_from_unreachable(m_nodes);
+    vector<string> sorted_words;
+    sort_by_state_chain(new_words, sorted_words);
+    for (auto wit = sorted_words.begin(); wit != sorted_words.end(); ++wit)
+        add_word(*wit);
+    clear_reverse_arcs(m_nodes);
+
+    if (self_transitions)
+        for (int i=old_node_count; i<(int)m_nodes.size(); i++)
+            if (m_nodes[i].hmm_state != -1) m_nodes[i].arcs.insert(i);
+
+    // Pruning keeps the order of the nodes
+    set<node_idx_t> reachable_nodes;
+    reachable_graph_nodes(m_nodes, reachable_nodes);
+    vector<int> new_indices(m_nodes.size(), -1);
+    int new_idx = 0;
+    for (auto rnit = reachable_nodes.begin(); rnit != reachable_nodes.end(); ++rnit)
+        new_indices[*rnit] = new_idx++;
+    prune_unreachable_nodes(m_nodes);
+    remap_connection_points(new_indices);
+    if (verbose) {
+        cerr << "added words: " << sorted_words.size() << endl;
+        cerr << "number of nodes: " << old_node_count << " -> " << m_nodes.size() << endl;
+    }
+
+    new_indices.resize(old_node_count);
+    return new_indices;
+}
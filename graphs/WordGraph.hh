@@ -24,20 +24,57 @@ public:
 
     void create_crossword_network(const std::set<std::string> &words,
                                   std::vector<DecoderGraph::Node> &nodes,
-                                  std::map<std::string, int> &fanout,
-                                  std::map<std::string, int> &fanin);
+                                  std::map<int, int> &fanout,
+                                  std::map<int, int> &fanin);
+
+    // Fan-out and fan-in triphones of the cross-word network for the words
+    void crossword_network_triphones(const std::set<std::string> &words,
+                                     std::map<int, int> &fanout,
+                                     std::map<int, int> &fanin) const;
 
     void connect_one_phone_words_from_start_to_cw(const std::set<std::string> &words,
                                                   std::vector<DecoderGraph::Node> &nodes,
-                                                  std::map<std::string, int> &fanout);
+                                                  std::map<int, int> &fanout);
 
     void connect_one_phone_words_from_cw_to_end(const std::set<std::string> &words,
                                                 std::vector<DecoderGraph::Node> &nodes,
-                                                std::map<std::string, int> &fanin);
+                                                std::map<int, int> &fanin);
 
     void tie_graph(bool verbose=false,
                    bool remove_cw_markers=false);
 
+    void write_connection_points(std::string fname) const;
+    void read_connection_points(std::string fname);
+    // Drops the points of removed nodes (-1)
+    void remap_connection_points(const std::vector<int> &new_indices);
+
+    // Adds words to a graph with the connection points set, for example one read
+    // with read_graph and read_connection_points. Each word is branched from the
+    // longest shared prefix of the tree and its tail is merged with the
+    // equivalent existing nodes. The cross-word network is rebuilt only for
+    // new fan-out or fan-in triphones or one phone words.
+    // Returns the new index of each old node, -1 for the removed nodes.
+    std::vector<int> add_words(const std::set<std::string> &words,
+                               bool verbose=false);
+
+    // Fan-out and fan-in nodes of the cross-word network by the triphone,
+    // set in creating the graph and needed for adding words
+    std::map<int, int> m_fanout;
+    std::map<int, int> m_fanin;
+
+private:
+    void renumber_connection_points(std::map<int, int> &points,
+                                    int flag);
+    void replace_crossword_network(const std::set<std::string> &words,
+                                   bool verbose);
+    void add_word(const std::string &word);
+    void merge_suffix(node_idx_t node_idx,
+                      node_idx_t stop_node_idx);
+    void link(node_idx_t src_node_idx,
+              node_idx_t tgt_node_idx);
+    node_idx_t new_node(node_idx_t pred_node_idx,
+                        int hmm_state,
+                        int word_id=-1);
 };
 
 #endif /* WORD_GRAPH_HH */
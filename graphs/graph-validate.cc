@@ -0,0 +1,77 @@
+#include "conf.hh"
+#include "DecoderGraph.hh"
+#include "GraphValidator.hh"
+
+using namespace std;
+
+
+int main(int argc, char* argv[])
+{
+    conf::Config config;
+    config("usage: graph-validate [OPTION...] PH LEXICON GRAPH WORDS\n"
+           "Checks that the words and word pairs have paths in the graph\n")
+    ('s', "word-segmentations", "", "", "WORDS is a word segmentation file for a subword graph")
+    ('n', "num-pairs=INT", "arg", "100000", "Number of random word pairs checked, -1 for all pairs, DEFAULT: 100000")
+    ('o', "no-short-silence", "", "", "No short silence between the words of a pair")
+    ('b', "word-boundary", "", "", "Word boundary symbol <w> between the words of a pair")
+    ('p', "num-threads=INT", "arg", "1", "Number of threads for the checks")
+    ('h', "help", "", "", "display help");
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 4) config.print_help(stderr, 1);
+    bool short_silence = !config["no-short-silence"].specified;
+    bool wb_symbol = config["word-boundary"].specified;
+
+    bool ok = true;
+    try {
+        DecoderGraph dg;
+
+        string phfname = config.arguments[0];
+        cerr << "Reading hmms: " << phfname << endl;
+        dg.read_phone_model(phfname);
+
+        string lexfname = config.arguments[1];
+        cerr << "Reading lexicon: " << lexfname << endl;
+        dg.read_noway_lexicon(lexfname);
+
+        string graphfname = config.arguments[2];
+        cerr << "Reading graph: " << graphfname << endl;
+        dg.read_graph(graphfname);
+        cerr << "node count: " << dg.m_nodes.size() << endl;
+
+        GraphValidator validator(dg, max(1, config["num-threads"].get_int()));
+
+        vector<int> unreachable_nodes = validator.unreachable_nodes();
+        cerr << "unreachable nodes: " << unreachable_nodes.size() << endl;
+        vector<int> dead_nodes = validator.dead_nodes();
+        cerr << "dead nodes: " << dead_nodes.size() << endl;
+        ok = unreachable_nodes.size() == 0 && dead_nodes.size() == 0;
+
+        string wordfname = config.arguments[3];
+        int num_pairs = config["num-pairs"].get_int();
+        if (config["word-segmentations"].specified) {
+            cerr << "Reading word segmentations: " << wordfname << endl;
+            map<string, vector<string> > word_segs;
+            dg.read_word_segmentations(wordfname, word_segs);
+            cerr << "Checking " << word_segs.size() << " words" << endl;
+            ok = validator.assert_words(word_segs) && ok;
+            cerr << "Checking word pairs" << endl;
+            ok = validator.assert_word_pairs(word_segs, num_pairs, short_silence, wb_symbol) && ok;
+        }
+        else {
+            cerr << "Reading word list: " << wordfname << endl;
+            set<string> words;
+            dg.read_words(wordfname, words);
+            cerr << "Checking " << words.size() << " words" << endl;
+            ok = validator.assert_words(words) && ok;
+            cerr << "Checking word pairs" << endl;
+            ok = validator.assert_word_pairs(words, num_pairs, short_silence, wb_symbol) && ok;
+        }
+
+    } catch (string &e) {
+        cerr << e << endl;
+        exit(1);
+    }
+
+    cerr << (ok ? "Graph is valid." : "Graph is not valid.") << endl;
+    exit(ok ? 0 : 1);
+}
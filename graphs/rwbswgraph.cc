@@ -9,12 +9,16 @@ int main(int argc, char* argv[])
     conf::Config config;
     config("usage: rwbswgraph [OPTION...] PH LEXICON GRAPH\n")
     ('o', "omit-sentence-end-symbol", "", "", "No sentence end symbol in the silence loop")
+    ('p', "num-threads=INT", "arg", "1", "Number of threads for building the cross-word networks")
+    ('d', "remove-dummies=INT", "arg", "", "Remove the non-acoustic dummy nodes with fan-in x fan-out at most INT")
+    ('L', "locality-order", "", "", "Renumber the nodes for memory locality in decoding")
     ('h', "help", "", "", "display help");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 3) config.print_help(stderr, 1);
     bool sentence_end_symbol = !(config["omit-sentence-end-symbol"].specified);
 
     RWBSubwordGraph swg;
+    swg.m_num_threads = max(1, config["num-threads"].get_int());
 
     try {
         string phfname = config.arguments[0];
@@ -40,6 +44,9 @@ int main(int argc, char* argv[])
         swg.create_graph(prefix_subwords, suffix_subwords, true);
         swg.add_silence_loop(sentence_end_symbol);
         swg.add_hmm_self_transitions();
+        if (config["remove-dummies"].specified)
+            swg.remove_dummy_nodes(config["remove-dummies"].get_int(), true);
+        if (config["locality-order"].specified) swg.order_nodes_for_locality(swg.m_nodes);
         swg.write_graph(graphfname);
 
     } catch (string &e) {
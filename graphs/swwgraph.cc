@@ -11,6 +11,9 @@ int main(int argc, char* argv[])
     ('b', "word-boundary", "", "", "Use word boundary symbol (<w>)")
     ('n', "no-push", "", "", "Don't move subword identifiers in the graph")
     ('o', "omit-sentence-end-symbol", "", "", "No sentence end symbol in the silence loop")
+    ('p', "num-threads=INT", "arg", "1", "Number of threads for building the cross-word networks")
+    ('d', "remove-dummies=INT", "arg", "", "Remove the non-acoustic dummy nodes with fan-in x fan-out at most INT")
+    ('L', "locality-order", "", "", "Renumber the nodes for memory locality in decoding")
     ('h', "help", "", "", "display help");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 4) config.print_help(stderr, 1);
@@ -19,6 +22,7 @@ int main(int argc, char* argv[])
     bool sentence_end_symbol = !(config["omit-sentence-end-symbol"].specified);
 
     SWWGraph swwg;
+    swwg.m_num_threads = max(1, config["num-threads"].get_int());
 
     try {
         string phfname = config.arguments[0];
@@ -45,6 +49,10 @@ int main(int argc, char* argv[])
         swwg.add_silence_loop(sentence_end_symbol);
         swwg.add_hmm_self_transitions();
 
+        if (config["remove-dummies"].specified)
+            swwg.remove_dummy_nodes(config["remove-dummies"].get_int(), true);
+        if (config["locality-order"].specified) swwg.order_nodes_for_locality(swwg.m_nodes);
+
         swwg.write_graph(graphfname);
 
     } catch (string &e) {
@@ -14,6 +14,10 @@ int main(int argc, char* argv[])
     ('o', "omit-sentence-end-symbol", "", "", "No sentence end symbol in the silence loop")
     ('n', "no-tying", "", "", "Only cross-word network tied, main graph kept as a lexical prefix tree")
     ('r', "remove-cw-markers", "", "", "Remove the cross-word markers for the most compact tying")
+    ('p', "num-threads=INT", "arg", "1", "Number of threads for building the cross-word networks")
+    ('d', "remove-dummies=INT", "arg", "", "Remove the non-acoustic dummy nodes with fan-in x fan-out at most INT")
+    ('L', "locality-order", "", "", "Renumber the nodes for memory locality in decoding")
+    ('c', "connection-points=STRING", "arg", "", "Write the cross-word connection points for adding words with wgraph-update")
     ('h', "help", "", "", "display help");
     config.default_parse(argc, argv);
     if (config.arguments.size() != 4) config.print_help(stderr, 1);
@@ -21,8 +25,15 @@ int main(int argc, char* argv[])
     bool sentence_end_symbol = !(config["omit-sentence-end-symbol"].specified);
     bool no_tying = config["no-tying"].specified;
     bool remove_cw_markers = config["remove-cw-markers"].specified;
+    if (config["connection-points"].specified
+        && (remove_cw_markers || config["remove-dummies"].specified || word_labels))
+    {
+        cerr << "Connection points are not kept with -r, -d or -l" << endl;
+        exit(1);
+    }
 
     WordGraph wg;
+    wg.m_num_threads = max(1, config["num-threads"].get_int());
 
     try {
         string phfname = config.arguments[0];
@@ -47,8 +58,19 @@ int main(int argc, char* argv[])
         wg.add_silence_loop(sentence_end_symbol);
         wg.add_hmm_self_transitions();
 
+        if (config["remove-dummies"].specified)
+            wg.remove_dummy_nodes(config["remove-dummies"].get_int(), true);
+        if (config["locality-order"].specified)
+            wg.remap_connection_points(wg.order_nodes_for_locality(wg.m_nodes));
+
         wg.write_graph(graphfname, word_labels);
 
+        if (config["connection-points"].specified) {
+            string pointsfname = config["connection-points"].get_str();
+            cerr << "Writing connection points: " << pointsfname << endl;
+            wg.write_connection_points(pointsfname);
+        }
+
     } catch (string &e) {
         cerr << e << endl;
     }
@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+def read_results(recfname, word_boundary):
+
+    results = dict()
+    for line in open(recfname, encoding="latin-1"):
+        line = line.strip()
+        if not line: continue
+        (key, sep, text) = line.rpartition(": ")
+        if not sep:
+            (key, sep, text) = line.partition(":")
+        tokens = [t for t in text.split() if t not in ("<s>", "</s>")]
+        if word_boundary:
+            words = " ".join(tokens).split(word_boundary)
+            tokens = ["".join(w.split()) for w in words if w.strip()]
+        results[key.strip()] = tokens
+    return results
+
+
+def edit_distance(ref, hyp):
+
+    prev = list(range(len(hyp)+1))
+    for i in range(1, len(ref)+1):
+        curr = [i] + [0] * len(hyp)
+        for j in range(1, len(hyp)+1):
+            curr[j] = min(prev[j] + 1,
+                          curr[j-1] + 1,
+                          prev[j-1] + (ref[i-1] != hyp[j-1]))
+        prev = curr
+    return prev[-1]
+
+
+def wer(refs, hyps):
+
+    errors = 0
+    num_words = 0
+    for key, ref in refs.items():
+        errors += edit_distance(ref, hyps.get(key, []))
+        num_words += len(ref)
+    return 100.0 * errors / max(1, num_words)
+
+
+def total_rtf(logfname):
+
+    rtf = None
+    for line in open(logfname, encoding="latin-1"):
+        m = re.match(r"total RTF: (\S+)", line)
+        if m: rtf = float(m.group(1))
+    return rtf
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decodes with different frame skip settings and reports RTF and WER")
+    parser.add_argument("DECODER", help="Decoder command, e.g. decode or 'class-decode -p 4'")
+    parser.add_argument("CFGFILE", help="Decoder configuration file")
+    parser.add_argument("ARGS", nargs="+",
+                        help="Decoder arguments, CFGFILE is inserted after the first three (PH LEXICON LM ...)")
+    parser.add_argument("-r", "--reference", action="store",
+                        help="Reference transcriptions, lines 'LNAFILE: words' as in the .rec files")
+    parser.add_argument("-w", "--word_boundary", action="store",
+                        help="Word boundary symbol for joining subwords to words before scoring")
+    parser.add_argument("-k", "--frame_skips", action="store", default="1,2,3",
+                        help="Comma separated frame skip values, default: 1,2,3")
+    parser.add_argument("-o", "--output_directory", action="store",
+                        help="Directory for the results, default: temporary directory")
+    args = parser.parse_args()
+
+    if len(args.ARGS) < 5:
+        print("give PH LEXICON LM GRAPH LNALIST and possible options as the decoder arguments", file=sys.stderr)
+        sys.exit()
+
+    outdir = args.output_directory or tempfile.mkdtemp()
+    if not os.path.exists(outdir): os.makedirs(outdir)
+    refs = read_results(args.reference, args.word_boundary) if args.reference else None
+    base_cfg = open(args.CFGFILE).read()
+    base_cfg = "\n".join([l for l in base_cfg.split("\n") if not l.startswith("frame_skip")])
+
+    print("frame skip\tcombination\tRTF\tWER")
+    for frame_skip in [int(k) for k in args.frame_skips.split(",")]:
+        combinations = ["mean", "max"] if frame_skip > 1 else ["-"]
+        for combination in combinations:
+            name = "skip%i.%s" % (frame_skip, combination.strip("-") or "none")
+            cfgfname = os.path.join(outdir, "%s.cfg" % name)
+            cfgf = open(cfgfname, "w")
+            print(base_cfg, file=cfgf)
+            print("frame_skip %i" % frame_skip, file=cfgf)
+            if frame_skip > 1:
+                print("frame_skip_combination %s" % combination, file=cfgf)
+            cfgf.close()
+
+            resultbase = os.path.join(outdir, name)
+            decoder_args = args.ARGS[:3] + [cfgfname] + args.ARGS[3:]
+            cmd = "%s -f %s %s" % (args.DECODER, resultbase, " ".join(decoder_args))
+            p = subprocess.Popen(cmd, shell=True)
+            p.wait()
+
+            rtf = total_rtf("%s.log" % resultbase)
+            error_rate = "-"
+            if refs is not None:
+                hyps = read_results("%s.rec" % resultbase, args.word_boundary)
+                error_rate = "%.2f" % wer(refs, hyps)
+            print("%i\t%s\t%s\t%s" % (frame_skip, combination, rtf, error_rate))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,160 @@
+#include <boost/test/unit_test.hpp>
+
+#include "Acoustics.hh"
+#include "DynamicDecoder.hh"
+
+using namespace std;
+
+
+// Pseudo random acoustic log probabilities, depend only on the frame and the HMM state
+class RandomAcoustics : public Acoustics {
+public:
+    RandomAcoustics(int num_models, int num_frames)
+        : m_num_frames(num_frames), m_frame_log_probs(num_models) {
+        m_num_models = num_models;
+        m_log_prob = m_frame_log_probs.data();
+    }
+    bool go_to(int frame) {
+        if (frame >= m_num_frames) return false;
+        for (int i=0; i<m_num_models; i++) {
+            unsigned int h = (unsigned int)frame * 2654435761u ^ (unsigned int)i * 40503u;
+            h ^= h >> 13;
+            h *= 0x5bd1e995;
+            h ^= h >> 15;
+            m_frame_log_probs[i] = -(float)(h % 1024) / 64.0;
+        }
+        return true;
+    }
+private:
+    int m_num_frames;
+    vector<float> m_frame_log_probs;
+};
+
+
+// Look-ahead scores by the node index
+class NodeScoreLookahead : public Decoder::Lookahead {
+public:
+    NodeScoreLookahead(const vector<float> &la_scores) : m_la_scores(la_scores) { }
+    float get_lookahead_score(int node_idx, int word_id) { return m_la_scores[node_idx]; }
+    vector<float> m_la_scores;
+};
+
+
+void
+read_dynamic_decoder(DynamicDecoder &d,
+                     bool unigram_la)
+{
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/20k.words.lex");
+    d.m_lm_scale = 10.0;
+    d.m_global_beam = 150.0;
+    d.m_word_end_beam = 100.0;
+    d.m_node_beam = 150.0;
+    d.m_token_limit = 20000;
+    d.read_lm("data/20k.words.2g.D030E060.arpa.gz");
+    set<string> words;
+    for (int i=0; i<(int)d.m_text_units.size(); i += 50)
+        words.insert(d.m_text_units[i]);
+    words.insert("</s>");
+    d.set_lexical_tree(words);
+    if (unigram_la) d.read_lookahead_lm("data/20k.words.2g.D030E060.arpa.gz");
+}
+
+
+// Copies the fully expanded network to the decoder graph
+void
+set_expanded_graph(DynamicDecoder &d)
+{
+    DynamicGraph graph(d);
+    graph.expand_all();
+    d.m_nodes.clear();
+    vector<float> la_scores;
+    for (int i=0; i<graph.num_nodes(); i++) {
+        d.m_nodes.push_back(graph.node(i));
+        la_scores.push_back(graph.la_score(i));
+    }
+    d.m_decode_start_node = graph.decode_start_node();
+    d.m_la = new NodeScoreLookahead(la_scores);
+}
+
+
+void
+assert_same_result(const RecognitionResult &res1,
+                   const RecognitionResult &res2)
+{
+    BOOST_CHECK_EQUAL( res1.best_result.result, res2.best_result.result );
+    BOOST_CHECK_EQUAL( res1.best_result.total_lp, res2.best_result.total_lp );
+    BOOST_CHECK_EQUAL( res1.best_result.total_am_lp, res2.best_result.total_am_lp );
+    BOOST_CHECK_EQUAL( res1.best_result.total_lm_lp, res2.best_result.total_lm_lp );
+}
+
+
+// Without a cache limit the search is the same as in the expanded graph
+BOOST_AUTO_TEST_CASE(DynamicDecoderTest1)
+{
+    cerr << endl;
+    DynamicDecoder d;
+    read_dynamic_decoder(d, false);
+
+    RandomAcoustics acoustics(d.m_hmm_states.size(), 150);
+    DynamicRecognition dynamic_rec(d);
+    RecognitionResult dynamic_res;
+    dynamic_rec.recognize(acoustics, dynamic_res);
+    cerr << "dynamic result:" << dynamic_res.best_result.result << endl;
+    BOOST_CHECK( dynamic_res.best_result.result.length() > 0 );
+    BOOST_CHECK_EQUAL( dynamic_rec.graph().eviction_count(), 0 );
+
+    set_expanded_graph(d);
+    cerr << "expanded graph node count: " << d.m_nodes.size() << endl;
+    NgramRecognition static_rec(d);
+    RecognitionResult static_res;
+    static_rec.recognize(acoustics, static_res);
+    assert_same_result(dynamic_res, static_res);
+}
+
+
+// Same with the unigram look-ahead
+BOOST_AUTO_TEST_CASE(DynamicDecoderTest2)
+{
+    cerr << endl;
+    DynamicDecoder d;
+    read_dynamic_decoder(d, true);
+
+    RandomAcoustics acoustics(d.m_hmm_states.size(), 150);
+    DynamicRecognition dynamic_rec(d);
+    RecognitionResult dynamic_res;
+    dynamic_rec.recognize(acoustics, dynamic_res);
+    cerr << "dynamic result:" << dynamic_res.best_result.result << endl;
+
+    set_expanded_graph(d);
+    NgramRecognition static_rec(d);
+    RecognitionResult static_res;
+    static_rec.recognize(acoustics, static_res);
+    assert_same_result(dynamic_res, static_res);
+}
+
+
+// Evicted regions are expanded again, the result does not change
+BOOST_AUTO_TEST_CASE(DynamicDecoderTest3)
+{
+    cerr << endl;
+    DynamicDecoder d;
+    read_dynamic_decoder(d, true);
+
+    RandomAcoustics acoustics(d.m_hmm_states.size(), 150);
+    DynamicRecognition unlimited_rec(d);
+    RecognitionResult unlimited_res;
+    unlimited_rec.recognize(acoustics, unlimited_res);
+
+    d.m_tree_cache_budget = unlimited_rec.graph().peak_cache_bytes() / 4;
+    DynamicRecognition limited_rec(d);
+    RecognitionResult limited_res;
+    limited_rec.recognize(acoustics, limited_res);
+    cerr << "peak cache bytes without a limit: " << unlimited_rec.graph().peak_cache_bytes() << endl;
+    cerr << "peak cache bytes with the limit: " << limited_rec.graph().peak_cache_bytes() << endl;
+    cerr << "evicted regions: " << limited_rec.graph().eviction_count() << endl;
+    BOOST_CHECK( limited_rec.graph().eviction_count() > 0 );
+    BOOST_CHECK( limited_rec.graph().expansion_count() > unlimited_rec.graph().expansion_count() );
+    BOOST_CHECK( limited_rec.graph().peak_cache_bytes() < unlimited_rec.graph().peak_cache_bytes() );
+    assert_same_result(unlimited_res, limited_res);
+}
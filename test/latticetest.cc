@@ -0,0 +1,266 @@
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+#include "Decoder.hh"
+#include "Lattice.hh"
+#include "LatticeRescorer.hh"
+
+using namespace std;
+
+
+// Lattice with two alternatives for the first word,
+// a null arc and a low scoring path
+void create_test_lattice(Lattice &lattice)
+{
+    lattice.clear();
+    lattice.m_initial_node = lattice.add_node(0);
+    int n1 = lattice.add_node(10);
+    int n2 = lattice.add_node(12);
+    int n3 = lattice.add_node(30);
+    lattice.m_final_node = lattice.add_node(40);
+    lattice.add_arc(lattice.m_initial_node, n1, 0, -10.0, -1.0);
+    lattice.add_arc(lattice.m_initial_node, n2, 1, -12.0, -0.5);
+    lattice.add_arc(lattice.m_initial_node, n3, 3, -100.0, -5.0);
+    lattice.add_arc(n1, n3, 2, -20.0, -1.0);
+    lattice.add_arc(n2, n3, 2, -19.0, -1.0);
+    lattice.add_arc(n2, n1, -1, -0.5, 0.0);
+    lattice.add_arc(n3, lattice.m_final_node, -1, -5.0, 0.0);
+}
+
+
+BOOST_AUTO_TEST_CASE(LatticeNbestTest1)
+{
+    Lattice lattice;
+    create_test_lattice(lattice);
+    float lm_scale = 10.0;
+
+    vector<Lattice::Hypothesis> nbest = lattice.get_nbest(lm_scale, 10, 1000.0);
+    BOOST_REQUIRE_EQUAL( nbest.size(), 3 );
+    // 1 2: -12-19-5 + 10*(-1.5), the path 1 (null) 2 has the same words
+    BOOST_REQUIRE_EQUAL( nbest[0].word_ids.size(), 2 );
+    BOOST_CHECK_EQUAL( nbest[0].word_ids[0], 1 );
+    BOOST_CHECK_EQUAL( nbest[0].word_ids[1], 2 );
+    BOOST_CHECK_CLOSE( nbest[0].total_lp, -51.0, 0.0001 );
+    BOOST_CHECK_CLOSE( nbest[0].total_am_lp, -36.0, 0.0001 );
+    BOOST_CHECK_CLOSE( nbest[0].total_lm_lp, -1.5, 0.0001 );
+    // 0 2: -10-20-5 + 10*(-2)
+    BOOST_REQUIRE_EQUAL( nbest[1].word_ids.size(), 2 );
+    BOOST_CHECK_EQUAL( nbest[1].word_ids[0], 0 );
+    BOOST_CHECK_CLOSE( nbest[1].total_lp, -55.0, 0.0001 );
+    // 3: -100-5 + 10*(-5)
+    BOOST_REQUIRE_EQUAL( nbest[2].word_ids.size(), 1 );
+    BOOST_CHECK_EQUAL( nbest[2].word_ids[0], 3 );
+    BOOST_CHECK_CLOSE( nbest[2].total_lp, -155.0, 0.0001 );
+
+    nbest = lattice.get_nbest(lm_scale, 2, 1000.0);
+    BOOST_CHECK_EQUAL( nbest.size(), 2 );
+    nbest = lattice.get_nbest(lm_scale, 10, 10.0);
+    BOOST_CHECK_EQUAL( nbest.size(), 2 );
+}
+
+
+BOOST_AUTO_TEST_CASE(LatticePruneTest1)
+{
+    Lattice lattice;
+    create_test_lattice(lattice);
+    float lm_scale = 10.0;
+
+    lattice.prune(lm_scale, 10.0);
+    BOOST_CHECK_EQUAL( lattice.num_nodes(), 5 );
+    BOOST_CHECK_EQUAL( lattice.num_arcs(), 6 );
+    BOOST_CHECK_EQUAL( lattice.m_initial_node, 0 );
+    BOOST_CHECK_EQUAL( lattice.m_final_node, 4 );
+    for (int i=0; i<lattice.num_arcs(); i++)
+        BOOST_CHECK( lattice.m_arcs[i].source_node < lattice.m_arcs[i].target_node );
+    vector<Lattice::Hypothesis> nbest = lattice.get_nbest(lm_scale, 10, 1000.0);
+    BOOST_CHECK_EQUAL( nbest.size(), 2 );
+    BOOST_CHECK_CLOSE( nbest[0].total_lp, -51.0, 0.0001 );
+
+    lattice.prune(lm_scale, 1.0);
+    BOOST_CHECK_EQUAL( lattice.num_nodes(), 4 );
+    BOOST_CHECK_EQUAL( lattice.num_arcs(), 3 );
+
+    vector<string> text_units = { "a", "b", "c", "d" };
+    ostringstream latticef;
+    lattice.write_htk(latticef, text_units, "utt", lm_scale);
+    string slf = latticef.str();
+    BOOST_CHECK( slf.find("N=4\tL=3") != string::npos );
+    BOOST_CHECK( slf.find("W=b\ta=-12.0000\tl=-0.5000") != string::npos );
+    BOOST_CHECK( slf.find("W=!NULL") != string::npos );
+    BOOST_CHECK( slf.find("t=0.32") != string::npos );
+}
+
+
+// Recognition with the word histories set by the test
+class TestRecognition : public Recognition {
+public:
+    TestRecognition(Decoder &decoder, int frame_idx) : Recognition(decoder) {
+        m_frame_idx = frame_idx;
+    }
+    void build(std::vector<Token*> &hypo_tokens, Lattice &lattice) {
+        build_lattice(hypo_tokens, lattice);
+    }
+    void get_tokens(std::vector<Token*> &tokens) override { }
+    void add_sentence_ends(std::vector<Token*> &tokens) override { }
+private:
+    void reset_frame_variables() override { }
+    void propagate_tokens() override { }
+    void prune_tokens(bool collect_active_histories=false,
+                      bool nbest=false) override { }
+};
+
+
+void add_history_link(Recognition::WordHistory &history,
+                      Recognition::WordHistory &recombined,
+                      int frame_idx)
+{
+    history.recombination_links[&recombined] = RecombinationLink(-1.0, -1.0, 0.0, frame_idx);
+}
+
+
+// Histories with the same recombination links before the frame limits
+// should share the lattice nodes
+BOOST_AUTO_TEST_CASE(LatticeBuildTest1)
+{
+    Recognition::WordHistory root;
+    Recognition::WordHistory h1(0, &root), h2(1, &h1), h3(2, &h2);
+    Recognition::WordHistory r1(3, &h1), r2(4, &h1);
+    h1.end_frame = 1; h2.end_frame = 2; h3.end_frame = 4;
+    r1.end_frame = 3; r2.end_frame = 3;
+    add_history_link(h3, r1, 5);
+    add_history_link(h3, r2, 8);
+    // The child history recombined to its predecessor
+    add_history_link(h1, h2, 3);
+
+    Decoder decoder;
+    TestRecognition recognition(decoder, 10);
+    Recognition::Token token;
+    token.history = &h3;
+    vector<Recognition::Token*> hypo_tokens = { &token };
+    Lattice lattice;
+    recognition.build(hypo_tokens, lattice);
+
+    // h1 before and after its link, h2 before and after the link of h1
+    BOOST_CHECK_EQUAL( lattice.num_nodes(), 9 );
+    vector<Lattice::Hypothesis> nbest = lattice.get_nbest(1.0, 100, 1000.0);
+    set<vector<int> > word_sequences;
+    for (auto hit = nbest.begin(); hit != nbest.end(); ++hit)
+        word_sequences.insert(hit->word_ids);
+    set<vector<int> > expected_sequences = {
+        { 0, 1, 2 }, { 0, 1, 1, 2 }, { 0, 3 }, { 0, 1, 3 }, { 0, 4 }, { 0, 1, 4 } };
+    BOOST_CHECK( word_sequences == expected_sequences );
+}
+
+
+// Lattice written in HTK format should be read back the same
+BOOST_AUTO_TEST_CASE(LatticeReadTest1)
+{
+    Lattice lattice;
+    create_test_lattice(lattice);
+    vector<string> text_units = { "a", "b", "c", "d" };
+    stringstream latticef;
+    lattice.write_htk(latticef, text_units, "utt", 10.0);
+
+    Lattice read_lattice;
+    vector<string> read_text_units;
+    map<string, int> read_text_unit_map;
+    string utterance;
+    float lm_scale = 0.0;
+    read_lattice.read_htk(latticef, read_text_units, read_text_unit_map, utterance, lm_scale);
+    BOOST_CHECK_EQUAL( utterance, "utt" );
+    BOOST_CHECK_EQUAL( lm_scale, 10.0 );
+    BOOST_REQUIRE_EQUAL( read_lattice.num_nodes(), lattice.num_nodes() );
+    BOOST_REQUIRE_EQUAL( read_lattice.num_arcs(), lattice.num_arcs() );
+    BOOST_CHECK_EQUAL( read_lattice.m_initial_node, lattice.m_initial_node );
+    BOOST_CHECK_EQUAL( read_lattice.m_final_node, lattice.m_final_node );
+    for (int i=0; i<lattice.num_nodes(); i++)
+        BOOST_CHECK_EQUAL( read_lattice.m_nodes[i].frame, lattice.m_nodes[i].frame );
+    for (int i=0; i<lattice.num_arcs(); i++) {
+        const Lattice::Arc &arc = lattice.m_arcs[i];
+        const Lattice::Arc &read_arc = read_lattice.m_arcs[i];
+        BOOST_CHECK_EQUAL( read_arc.source_node, arc.source_node );
+        BOOST_CHECK_EQUAL( read_arc.target_node, arc.target_node );
+        if (arc.word_id < 0) BOOST_CHECK_EQUAL( read_arc.word_id, -1 );
+        else BOOST_CHECK_EQUAL( read_text_units[read_arc.word_id], text_units[arc.word_id] );
+        BOOST_CHECK_CLOSE( read_arc.am_log_prob, arc.am_log_prob, 0.0001 );
+        BOOST_CHECK_CLOSE( read_arc.lm_log_prob, arc.lm_log_prob, 0.0001 );
+    }
+
+    // Words on nodes and several end nodes
+    stringstream nodef;
+    nodef << "VERSION=1.0\nN=4 L=3\nI=0 t=0.00\nI=1 t=0.10 W=x\nI=2 t=0.20 W=y\nI=3 t=0.20 W=z\n"
+          << "J=0 S=0 E=1 a=-1.0\nJ=1 S=1 E=2 a=-2.0 l=-1.0\nJ=2 S=1 E=3 a=-3.0\n";
+    read_lattice.read_htk(nodef, read_text_units, read_text_unit_map, utterance, lm_scale);
+    BOOST_CHECK_EQUAL( read_lattice.num_nodes(), 5 );
+    BOOST_CHECK_EQUAL( read_lattice.num_arcs(), 5 );
+    BOOST_CHECK_EQUAL( read_lattice.m_final_node, 4 );
+    BOOST_CHECK_EQUAL( read_text_units[read_lattice.m_arcs[1].word_id], "y" );
+    BOOST_CHECK_EQUAL( read_lattice.m_nodes[2].frame, 25 );
+}
+
+
+// Rescored LM scores should equal the model scores of the paths
+BOOST_AUTO_TEST_CASE(LatticeRescoreTest1)
+{
+    NgramRescoringLM lm("data/1k.subwords.3g.arpa");
+    const Ngram &ngram = lm.ngram();
+    vector<string> text_units = { "<w>", "mielipide", "tiedustelu", "un", "a" };
+    float lm_scale = 30.0;
+
+    Lattice lattice;
+    lattice.m_initial_node = lattice.add_node(0);
+    int n1 = lattice.add_node(5);
+    int n2 = lattice.add_node(20);
+    int n3 = lattice.add_node(40);
+    int n4 = lattice.add_node(50);
+    lattice.m_final_node = lattice.add_node(60);
+    lattice.add_arc(lattice.m_initial_node, n1, 0, -5.0, 0.0);
+    lattice.add_arc(n1, n2, 1, -30.0, 0.0);
+    lattice.add_arc(n1, n2, 4, -20.0, 0.0);
+    lattice.add_arc(n2, n3, 2, -30.0, 0.0);
+    lattice.add_arc(n3, n4, 3, -15.0, 0.0);
+    lattice.add_arc(n3, n4, 4, -16.0, 0.0);
+    lattice.add_arc(n4, lattice.m_final_node, 0, -10.0, 0.0);
+
+    LatticeRescorer rescorer(lm, lm_scale);
+    vector<int> word_map = rescorer.get_word_map(text_units);
+    Lattice rescored;
+    Lattice::Hypothesis best = rescorer.rescore(lattice, word_map, rescored);
+
+    // Best path by scoring all four paths with the model
+    int first_words[] = { 1, 4 };
+    int third_words[] = { 3, 4 };
+    double best_score = -1e20;
+    vector<int> best_words;
+    double best_lm = 0.0;
+    for (int i=0; i<2; i++) {
+        for (int j=0; j<2; j++) {
+            vector<int> words = { 0, first_words[i], 2, third_words[j], 0 };
+            double am = -5.0 + (i == 0 ? -30.0 : -20.0) - 30.0 + (j == 0 ? -15.0 : -16.0) - 10.0;
+            double lm_lp = 0.0;
+            int node = ngram.sentence_start_node;
+            for (auto wit = words.begin(); wit != words.end(); ++wit)
+                node = ngram.score(node, ngram.vocabulary_lookup.at(text_units[*wit]), lm_lp);
+            double score = am + lm_scale * lm_lp;
+            if (score > best_score) {
+                best_score = score;
+                best_words = words;
+                best_lm = lm_lp;
+            }
+        }
+    }
+    BOOST_CHECK( best.word_ids == best_words );
+    BOOST_CHECK_CLOSE( best.total_lp, best_score, 0.001 );
+    BOOST_CHECK_CLOSE( best.total_lm_lp, best_lm, 0.001 );
+
+    vector<Lattice::Hypothesis> nbest = rescored.get_nbest(lm_scale, 10, 1e10);
+    BOOST_CHECK_EQUAL( nbest.size(), 4 );
+    BOOST_CHECK( nbest[0].word_ids == best_words );
+    BOOST_CHECK_CLOSE( nbest[0].total_lp, best_score, 0.001 );
+
+    // States split by the trigram context and merged with unigram histories
+    BOOST_CHECK( rescored.num_nodes() > lattice.num_nodes() + 1 );
+    LatticeRescorer short_rescorer(lm, lm_scale, 0);
+    short_rescorer.rescore(lattice, word_map, rescored);
+    BOOST_CHECK_EQUAL( rescored.num_nodes(), lattice.num_nodes() + 1 );
+}
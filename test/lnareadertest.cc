@@ -0,0 +1,301 @@
+#include <boost/test/unit_test.hpp>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#include "FrameSkipAcoustics.hh"
+#include "LnaArchive.hh"
+#include "LnaPrefetcher.hh"
+#include "LnaReaderCircular.hh"
+#include "LnaReaderMapped.hh"
+
+using namespace std;
+
+
+void write_lna_file(string fname, int num_models, int num_frames, int lna_bytes)
+{
+    ofstream lnaf(fname, ios::binary);
+    lnaf.put((num_models >> 24) & 0xff);
+    lnaf.put((num_models >> 16) & 0xff);
+    lnaf.put((num_models >> 8) & 0xff);
+    lnaf.put(num_models & 0xff);
+    lnaf.put(lna_bytes);
+    srand(lna_bytes);
+    for (int i=0; i<num_models*num_frames; i++) {
+        if (lna_bytes == 4) {
+            float val = -(float)rand() / RAND_MAX * 50.0;
+            lnaf.write((const char*)&val, sizeof(val));
+        }
+        else
+            for (int b=0; b<lna_bytes; b++)
+                lnaf.put(rand() & 0xff);
+    }
+}
+
+
+void check_frame(Acoustics &ref, Acoustics &hyp)
+{
+    BOOST_REQUIRE_EQUAL( ref.num_models(), hyp.num_models() );
+    for (int m=0; m<ref.num_models(); m++)
+        BOOST_CHECK_EQUAL( ref.log_prob(m), hyp.log_prob(m) );
+}
+
+
+// Mapped reader should give the same values as the circular reader
+BOOST_AUTO_TEST_CASE(LnaReaderMappedTest1)
+{
+    string lnafname("/tmp/lnareadertest.lna");
+    int num_models = 37;
+    int num_frames = 100;
+    int lna_bytes[] = { 1, 2, 4 };
+
+    for (int b=0; b<3; b++) {
+        write_lna_file(lnafname, num_models, num_frames, lna_bytes[b]);
+        LnaReaderCircular ref;
+        LnaReaderMapped hyp;
+        ref.open_file(lnafname, 1024);
+        hyp.open_file(lnafname, 16);
+        BOOST_CHECK_EQUAL( hyp.num_frames(), num_frames );
+
+        int frame = 0;
+        while (ref.go_to(frame)) {
+            BOOST_REQUIRE( hyp.go_to(frame) );
+            check_frame(ref, hyp);
+            frame++;
+        }
+        BOOST_CHECK_EQUAL( frame, num_frames );
+        BOOST_CHECK( !hyp.go_to(num_frames) );
+
+        // Random access
+        int frames[] = { 99, 3, 50, 17, 16, 0 };
+        for (int i=0; i<6; i++) {
+            BOOST_REQUIRE( ref.go_to(frames[i]) );
+            BOOST_REQUIRE( hyp.go_to(frames[i]) );
+            check_frame(ref, hyp);
+        }
+
+        ref.close();
+        hyp.close();
+    }
+    remove(lnafname.c_str());
+}
+
+
+// Non-seekable files are read in blocks
+BOOST_AUTO_TEST_CASE(LnaReaderMappedTest2)
+{
+    string lnafname("/tmp/lnareadertest.lna");
+    string fifofname("/tmp/lnareadertest.fifo");
+    int num_models = 37;
+    int num_frames = 100;
+    write_lna_file(lnafname, num_models, num_frames, 2);
+
+    remove(fifofname.c_str());
+    BOOST_REQUIRE( mkfifo(fifofname.c_str(), 0600) == 0 );
+    thread writer([&]() {
+        ifstream lnaf(lnafname, ios::binary);
+        ofstream fifof(fifofname, ios::binary);
+        fifof << lnaf.rdbuf();
+    });
+
+    LnaReaderCircular ref;
+    LnaReaderMapped hyp;
+    ref.open_file(lnafname, 1024);
+    hyp.open_file(fifofname, 16);
+    BOOST_CHECK_EQUAL( hyp.num_frames(), -1 );
+
+    int frame = 0;
+    while (ref.go_to(frame)) {
+        BOOST_REQUIRE( hyp.go_to(frame) );
+        check_frame(ref, hyp);
+        frame++;
+    }
+    BOOST_CHECK_EQUAL( frame, num_frames );
+    BOOST_CHECK( !hyp.go_to(num_frames) );
+    BOOST_CHECK_THROW( hyp.go_to(0), string );
+
+    writer.join();
+    ref.close();
+    hyp.close();
+    remove(fifofname.c_str());
+    remove(lnafname.c_str());
+}
+
+
+// Prefetched buffers should equal the files also with a small memory budget
+BOOST_AUTO_TEST_CASE(LnaPrefetcherTest1)
+{
+    int num_models = 37;
+    int num_frames = 100;
+    vector<string> lnafnames;
+    for (int i=0; i<6; i++) {
+        lnafnames.push_back("/tmp/lnareadertest." + to_string(i) + ".lna");
+        write_lna_file(lnafnames.back(), num_models, num_frames + i, 1 + i % 2);
+    }
+    vector<int> use_counts(lnafnames.size(), 2);
+
+    LnaPrefetcher prefetcher(lnafnames, use_counts, 3, num_models * num_frames * sizeof(float), 2);
+    for (int i=0; i<(int)lnafnames.size(); i++) {
+        double wait_time;
+        LnaBuffer hyp1 = prefetcher.get(i, wait_time);
+        LnaBuffer hyp2 = prefetcher.get(i, wait_time);
+        BOOST_CHECK( wait_time >= 0.0 );
+        BOOST_CHECK_EQUAL( hyp1.num_frames(), num_frames + i );
+
+        LnaReaderCircular ref;
+        ref.open_file(lnafnames[i], 1024);
+        int frame = 0;
+        while (ref.go_to(frame)) {
+            BOOST_REQUIRE( hyp1.go_to(frame) );
+            check_frame(ref, hyp1);
+            frame++;
+        }
+        BOOST_CHECK( !hyp1.go_to(frame) );
+        BOOST_REQUIRE( hyp2.go_to(0) );
+        BOOST_REQUIRE( ref.go_to(0) );
+        check_frame(ref, hyp2);
+        ref.close();
+
+        prefetcher.release(i);
+        prefetcher.release(i);
+    }
+
+    for (int i=0; i<(int)lnafnames.size(); i++)
+        remove(lnafnames[i].c_str());
+}
+
+
+// A file that can not be read should throw when got and release its use
+BOOST_AUTO_TEST_CASE(LnaPrefetcherTest2)
+{
+    int num_models = 37;
+    int num_frames = 100;
+    vector<string> lnafnames;
+    for (int i=0; i<3; i++) {
+        lnafnames.push_back("/tmp/lnareadertest." + to_string(i) + ".lna");
+        if (i != 1) write_lna_file(lnafnames.back(), num_models, num_frames, 1);
+    }
+    remove(lnafnames[1].c_str());
+
+    LnaPrefetcher prefetcher(lnafnames, 1, num_models * num_frames * sizeof(float), 2);
+    double wait_time;
+    LnaBuffer hyp = prefetcher.get(0, wait_time);
+    BOOST_CHECK_EQUAL( hyp.num_frames(), num_frames );
+    prefetcher.release(0);
+    BOOST_CHECK_THROW( prefetcher.get(1, wait_time), string );
+    hyp = prefetcher.get(2, wait_time);
+    BOOST_CHECK_EQUAL( hyp.num_frames(), num_frames );
+    prefetcher.release(2);
+
+    for (int i=0; i<(int)lnafnames.size(); i++)
+        remove(lnafnames[i].c_str());
+}
+
+
+// Utterances read from an archive should equal the packed files
+BOOST_AUTO_TEST_CASE(LnaArchiveTest1)
+{
+    string archivefname("/tmp/lnareadertest.lnar");
+    int num_models = 37;
+    vector<string> lnafnames;
+    vector<string> ids;
+    for (int i=0; i<3; i++) {
+        lnafnames.push_back("/tmp/lnareadertest." + to_string(i) + ".lna");
+        ids.push_back("utt" + to_string(i));
+        write_lna_file(lnafnames.back(), num_models, 50 + i, i == 2 ? 4 : i + 1);
+    }
+    LnaArchive::pack(archivefname, ids, lnafnames);
+    BOOST_CHECK_THROW( LnaArchive::pack(archivefname + ".dup", vector<string>(2, "utt"),
+                                        vector<string>(lnafnames.begin(), lnafnames.begin()+2)),
+                       string );
+
+    vector<string> expanded = LnaArchive::expand_lna_fnames(vector<string>(1, archivefname));
+    BOOST_REQUIRE_EQUAL( expanded.size(), 3 );
+    for (int i=0; i<3; i++) {
+        BOOST_CHECK_EQUAL( expanded[i], archivefname + ":" + ids[i] );
+
+        LnaReaderCircular ref;
+        LnaReaderMapped hyp;
+        ref.open_file(lnafnames[i], 1024);
+        hyp.open_file(expanded[i], 16);
+        BOOST_CHECK_EQUAL( hyp.num_frames(), 50 + i );
+        int frame = 0;
+        while (ref.go_to(frame)) {
+            BOOST_REQUIRE( hyp.go_to(frame) );
+            check_frame(ref, hyp);
+            frame++;
+        }
+        BOOST_CHECK( !hyp.go_to(frame) );
+        ref.close();
+        hyp.close();
+    }
+
+    LnaReaderMapped hyp;
+    BOOST_CHECK_THROW( hyp.open_file(archivefname + ":utt3", 16), string );
+
+    // Extracted files should equal the original files
+    LnaArchive archive(archivefname);
+    for (int i=0; i<3; i++) {
+        const LnaArchive::Entry *entry = archive.find(ids[i]);
+        BOOST_REQUIRE( entry != nullptr );
+        string extractedfname = lnafnames[i] + ".extracted";
+        archive.extract(*entry, extractedfname);
+        ifstream origf(lnafnames[i], ios::binary);
+        ifstream extractedf(extractedfname, ios::binary);
+        string orig((istreambuf_iterator<char>(origf)), istreambuf_iterator<char>());
+        string extracted((istreambuf_iterator<char>(extractedf)), istreambuf_iterator<char>());
+        BOOST_CHECK( orig == extracted );
+        remove(extractedfname.c_str());
+        remove(lnafnames[i].c_str());
+    }
+    remove(archivefname.c_str());
+}
+
+
+// Combined frames should be the scaled mean or maximum of the original frames
+BOOST_AUTO_TEST_CASE(FrameSkipAcousticsTest1)
+{
+    string lnafname("/tmp/lnareadertest.lna");
+    int num_models = 37;
+    int num_frames = 100;
+    write_lna_file(lnafname, num_models, num_frames, 2);
+
+    FrameSkipAcoustics::Combination combinations[] = { FrameSkipAcoustics::MEAN, FrameSkipAcoustics::MAX };
+    for (int c=0; c<2; c++) {
+        for (int frame_skip=1; frame_skip<=3; frame_skip++) {
+            LnaReaderCircular ref;
+            LnaReaderMapped source;
+            ref.open_file(lnafname, 1024);
+            source.open_file(lnafname, 16);
+            FrameSkipAcoustics hyp(source, frame_skip, combinations[c]);
+
+            int frame = 0;
+            while (hyp.go_to(frame)) {
+                int first = frame * frame_skip;
+                int count = min(frame_skip, num_frames - first);
+                vector<float> expected(num_models, 0.0);
+                for (int i=0; i<count; i++) {
+                    BOOST_REQUIRE( ref.go_to(first + i) );
+                    for (int m=0; m<num_models; m++) {
+                        if (combinations[c] == FrameSkipAcoustics::MEAN)
+                            expected[m] += ref.log_prob(m);
+                        else if (i == 0 || ref.log_prob(m) > expected[m])
+                            expected[m] = ref.log_prob(m);
+                    }
+                }
+                float scale = combinations[c] == FrameSkipAcoustics::MAX ? frame_skip : (float)frame_skip / count;
+                for (int m=0; m<num_models; m++)
+                    BOOST_CHECK_CLOSE( hyp.log_prob(m), expected[m] * scale, 0.001 );
+                frame++;
+            }
+            BOOST_CHECK_EQUAL( frame, (num_frames + frame_skip - 1) / frame_skip );
+            BOOST_CHECK_EQUAL( hyp.num_source_frames(), num_frames );
+            ref.close();
+            source.close();
+        }
+    }
+    BOOST_CHECK_THROW( FrameSkipAcoustics::get_combination("median"), string );
+    remove(lnafname.c_str());
+}
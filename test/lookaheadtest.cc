@@ -1,8 +1,14 @@
 #include <boost/test/unit_test.hpp>
 
+#include <cstdio>
+
+#include "WordGraph.hh"
+
 #define private public
+#define protected public
 #include "Decoder.hh"
 #include "Lookahead.hh"
+#undef protected
 #undef private
 
 using namespace std;
@@ -210,6 +216,148 @@ BOOST_AUTO_TEST_CASE(LargeBigramLookaheadTest4)
 }
 
 
+// Binary states file round trip
+BOOST_AUTO_TEST_CASE(LargeBigramLookaheadTest5)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    LargeBigramLookahead refla(d, "data/1k.subwords.2g.arpa");
+    string statesfname("/tmp/lookaheadtest.lastates");
+    refla.write(statesfname);
+    LargeBigramLookahead hypla(d, "data/1k.subwords.2g.arpa", statesfname);
+
+    BOOST_CHECK( hypla.m_states_file.is_open() );
+    BOOST_CHECK_EQUAL( refla.m_la_state_count, hypla.m_la_state_count );
+
+    int idx=0;
+    for (int i=0; i<(int)d.m_nodes.size(); i++) {
+        int curr_eval_ratio = d.m_nodes[i].flags & NODE_SILENCE ? 1 : _ratio;
+        for (int w=0; w<(int)refla.m_text_unit_id_to_la_ngram_symbol.size(); w++) {
+            if (++idx % curr_eval_ratio != 0) continue;
+            BOOST_CHECK_EQUAL( refla.get_lookahead_score(i, w), hypla.get_lookahead_score(i, w) );
+        }
+    }
+}
+
+
+// Scores set with several threads should equal the single thread scores
+BOOST_AUTO_TEST_CASE(LargeBigramLookaheadTest6)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    LargeBigramLookahead refla(d, "data/1k.subwords.2g.arpa", 1);
+    LargeBigramLookahead hypla(d, "data/1k.subwords.2g.arpa", 3);
+
+    BOOST_CHECK( refla.m_node_la_states == hypla.m_node_la_states );
+    BOOST_CHECK( refla.m_bigram_offsets == hypla.m_bigram_offsets );
+    BOOST_CHECK( refla.m_bigram_word_ids == hypla.m_bigram_word_ids );
+    BOOST_CHECK( refla.m_bigram_scores == hypla.m_bigram_scores );
+}
+
+
+// States file written for the original graph should be valid
+// after renumbering the nodes for locality
+BOOST_AUTO_TEST_CASE(LargeBigramLookaheadTest7)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    LargeBigramLookahead refla(d, "data/1k.subwords.2g.arpa");
+    string statesfname("/tmp/lookaheadtest.lastates");
+    refla.write(statesfname);
+
+    Decoder od;
+    od.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    od.read_noway_lexicon("data/1k.subwords.lex");
+    od.read_dgraph("data/1k.subwords.sww.graph");
+    vector<int> new_indices = od.order_nodes_for_locality();
+    LargeBigramLookahead hypla(od, "data/1k.subwords.2g.arpa", statesfname);
+
+    BOOST_CHECK_EQUAL( new_indices[START_NODE], START_NODE );
+    BOOST_CHECK_EQUAL( new_indices[END_NODE], END_NODE );
+    BOOST_CHECK_EQUAL( od.m_decode_start_node, new_indices[d.m_decode_start_node] );
+    BOOST_CHECK( od.m_nodes[od.m_decode_start_node].flags & NODE_DECODE_START );
+    BOOST_CHECK_EQUAL( refla.m_la_state_count, hypla.m_la_state_count );
+
+    int idx=0;
+    for (int i=0; i<(int)d.m_nodes.size(); i++) {
+        Decoder::Node &node = d.m_nodes[i];
+        Decoder::Node &onode = od.m_nodes[new_indices[i]];
+        BOOST_CHECK_EQUAL( node.hmm_state, onode.hmm_state );
+        BOOST_CHECK_EQUAL( node.word_id, onode.word_id );
+        BOOST_CHECK_EQUAL( node.flags, onode.flags );
+        BOOST_REQUIRE_EQUAL( node.arcs.size(), onode.arcs.size() );
+        for (int a=0; a<(int)node.arcs.size(); a++) {
+            BOOST_CHECK_EQUAL( new_indices[node.arcs[a].target_node], onode.arcs[a].target_node );
+            BOOST_CHECK_EQUAL( node.arcs[a].log_prob, onode.arcs[a].log_prob );
+            BOOST_CHECK_EQUAL( node.arcs[a].update_lookahead, onode.arcs[a].update_lookahead );
+        }
+
+        int curr_eval_ratio = node.flags & NODE_SILENCE ? 1 : _ratio;
+        for (int w=0; w<(int)refla.m_text_unit_id_to_la_ngram_symbol.size(); w++) {
+            if (++idx % curr_eval_ratio != 0) continue;
+            BOOST_CHECK_EQUAL( refla.get_lookahead_score(i, w),
+                               hypla.get_lookahead_score(new_indices[i], w) );
+        }
+    }
+}
+
+
+// Look-ahead updated for words added to the graph
+// should equal the look-ahead computed for the updated graph
+BOOST_AUTO_TEST_CASE(LargeBigramLookaheadTest8)
+{
+    cerr << endl;
+    string phfname("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    string lexfname("data/20k.words.lex");
+    string lafname("data/20k.words.2g.D030E060.arpa.gz");
+    WordGraph wg;
+    wg.read_phone_model(phfname);
+    wg.read_noway_lexicon(lexfname);
+    set<string> graph_words, new_words;
+    for (int i=2; i<(int)wg.m_subwords.size(); i += 10)
+        if (i % 200 == 2) new_words.insert(wg.m_subwords[i]);
+        else graph_words.insert(wg.m_subwords[i]);
+    wg.create_graph(graph_words, false);
+    wg.tie_graph(false);
+    string graphfname("/tmp/lookaheadtest.graph");
+    wg.write_graph(graphfname);
+    vector<int> new_indices = wg.add_words(new_words);
+    string newgraphfname("/tmp/lookaheadtest.new.graph");
+    wg.write_graph(newgraphfname);
+
+    Decoder d;
+    d.read_phone_model(phfname);
+    d.read_noway_lexicon(lexfname);
+    d.read_dgraph(graphfname);
+    LargeBigramLookahead la(d, lafname);
+
+    Decoder nd;
+    nd.read_phone_model(phfname);
+    nd.read_noway_lexicon(lexfname);
+    nd.read_dgraph(newgraphfname);
+    LargeBigramLookahead refla(nd, lafname);
+    LargeBigramLookahead hypla(nd, lafname, la, new_indices);
+
+    BOOST_CHECK( refla.m_node_la_states == hypla.m_node_la_states );
+    BOOST_REQUIRE_EQUAL( refla.m_la_state_count, hypla.m_la_state_count );
+    for (int i=0; i<refla.m_la_state_count; i++)
+        BOOST_CHECK_EQUAL( refla.m_lookahead_states[i].m_best_unigram_word_id,
+                           hypla.m_lookahead_states[i].m_best_unigram_word_id );
+    BOOST_CHECK( refla.m_bigram_offsets == hypla.m_bigram_offsets );
+    BOOST_CHECK( refla.m_bigram_word_ids == hypla.m_bigram_word_ids );
+    BOOST_CHECK( refla.m_bigram_scores == hypla.m_bigram_scores );
+}
+
+
 BOOST_AUTO_TEST_CASE(HybridBigramLookaheadTest1)
 {
     cerr << endl;
@@ -290,3 +438,276 @@ BOOST_AUTO_TEST_CASE(HybridBigramLookaheadTest2)
         }
     }
 }
+
+
+BOOST_AUTO_TEST_CASE(HybridBigramLookaheadTest3)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    PrecomputedHybridBigramLookahead refla(d, "data/1k.subwords.2g.arpa", 1);
+    PrecomputedHybridBigramLookahead hypla(d, "data/1k.subwords.2g.arpa", 4);
+
+    BOOST_CHECK( refla.m_bigram_la_scores == hypla.m_bigram_la_scores );
+}
+
+
+// Full tables set with several threads should equal the single thread tables
+BOOST_AUTO_TEST_CASE(BigramLookaheadTest3)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    PrecomputedFullTableBigramLookahead refla(d, "data/1k.subwords.2g.arpa", false, 1);
+    PrecomputedFullTableBigramLookahead hypla(d, "data/1k.subwords.2g.arpa", false, 3);
+    BOOST_CHECK( refla.m_bigram_la_scores == hypla.m_bigram_la_scores );
+
+    PrecomputedFullTableBigramLookahead quant_refla(d, "data/1k.subwords.2g.arpa", true, 1);
+    PrecomputedFullTableBigramLookahead quant_hypla(d, "data/1k.subwords.2g.arpa", true, 3);
+    BOOST_CHECK( quant_refla.m_quant_bigram_lookup == quant_hypla.m_quant_bigram_lookup );
+}
+
+
+void read_subword_decoder(Decoder &d)
+{
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+}
+
+
+void check_cached_lookahead(Decoder &refd, Decoder::Lookahead &refla,
+                            Decoder &hypd, Decoder::Lookahead &hypla,
+                            bool compare_scores=true)
+{
+    BOOST_REQUIRE_EQUAL( refd.m_nodes.size(), hypd.m_nodes.size() );
+    int idx=0;
+    for (int i=0; i<(int)refd.m_nodes.size(); i++) {
+        BOOST_CHECK_EQUAL( refd.m_nodes[i].flags, hypd.m_nodes[i].flags );
+        for (int a=0; a<(int)refd.m_nodes[i].arcs.size(); a++)
+            BOOST_CHECK_EQUAL( refd.m_nodes[i].arcs[a].update_lookahead,
+                               hypd.m_nodes[i].arcs[a].update_lookahead );
+        if (!compare_scores) continue;
+        int curr_eval_ratio = refd.m_nodes[i].flags & NODE_SILENCE ? 1 : _ratio;
+        for (int w=0; w<(int)refla.m_text_unit_id_to_la_ngram_symbol.size(); w++) {
+            if (++idx % curr_eval_ratio != 0) continue;
+            BOOST_CHECK_EQUAL( refla.get_lookahead_score(i, w), hypla.get_lookahead_score(i, w) );
+        }
+    }
+}
+
+
+// Tables read from the cache should equal the computed ones
+BOOST_AUTO_TEST_CASE(LookaheadCacheTest1)
+{
+    cerr << endl;
+    string cachefname("/tmp/lookaheadtest.lacache");
+    string lafname("data/1k.subwords.2g.arpa");
+
+    {
+        remove(cachefname.c_str());
+        Decoder refd, hypd;
+        read_subword_decoder(refd);
+        read_subword_decoder(hypd);
+        UnigramLookahead refla(refd, lafname, cachefname);
+        UnigramLookahead hypla(hypd, lafname, cachefname);
+        check_cached_lookahead(refd, refla, hypd, hypla);
+    }
+
+    {
+        remove(cachefname.c_str());
+        Decoder refd, hypd;
+        read_subword_decoder(refd);
+        read_subword_decoder(hypd);
+        PrecomputedHybridBigramLookahead refla(refd, lafname, 1, cachefname);
+        PrecomputedHybridBigramLookahead hypla(hypd, lafname, 1, cachefname);
+        // Inner node scores are defined only for the predecessor words
+        check_cached_lookahead(refd, refla, hypd, hypla, false);
+        BOOST_CHECK( refla.m_node_la_states == hypla.m_node_la_states );
+        BOOST_CHECK( refla.m_bigram_la_scores == hypla.m_bigram_la_scores );
+        BOOST_CHECK( refla.m_inner_bigram_score_idxs == hypla.m_inner_bigram_score_idxs );
+        BOOST_CHECK( refla.m_inner_bigram_scores == hypla.m_inner_bigram_scores );
+        BOOST_CHECK( refla.m_single_inner_bigram_score == hypla.m_single_inner_bigram_score );
+    }
+
+    {
+        remove(cachefname.c_str());
+        Decoder refd, hypd;
+        read_subword_decoder(refd);
+        read_subword_decoder(hypd);
+        LargeBigramLookahead refla(refd, lafname, 1, cachefname);
+        LargeBigramLookahead hypla(hypd, lafname, 1, cachefname);
+        check_cached_lookahead(refd, refla, hypd, hypla);
+        // Scores are used from the mapped cache without copying
+        BOOST_CHECK( hypla.m_bigram_scores.empty() );
+    }
+
+    {
+        remove(cachefname.c_str());
+        Decoder refd, hypd;
+        read_subword_decoder(refd);
+        read_subword_decoder(hypd);
+        PrecomputedFullTableBigramLookahead refla(refd, lafname, true, 1, cachefname);
+        PrecomputedFullTableBigramLookahead hypla(hypd, lafname, true, 1, cachefname);
+        check_cached_lookahead(refd, refla, hypd, hypla);
+    }
+}
+
+
+// Cache computed for another look-ahead type or model is not used
+BOOST_AUTO_TEST_CASE(LookaheadCacheTest2)
+{
+    cerr << endl;
+    string cachefname("/tmp/lookaheadtest.lacache");
+    remove(cachefname.c_str());
+
+    Decoder d;
+    read_subword_decoder(d);
+    UnigramLookahead ugla(d, "data/1k.subwords.2g.arpa", cachefname);
+
+    LookaheadCache cache("unigram", d, vector<string>(1, "data/1k.subwords.2g.arpa"));
+    BOOST_CHECK( cache.read(cachefname) );
+    LookaheadCache type_cache("large-bigram", d, vector<string>(1, "data/1k.subwords.2g.arpa"));
+    BOOST_CHECK( !type_cache.read(cachefname) );
+    LookaheadCache model_cache("unigram", d, vector<string>(1, "data/1k.subwords.3g.arpa"));
+    BOOST_CHECK( !model_cache.read(cachefname) );
+
+    d.m_nodes[d.m_nodes.size()-1].arcs.push_back(Decoder::Arc());
+    LookaheadCache graph_cache("unigram", d, vector<string>(1, "data/1k.subwords.2g.arpa"));
+    BOOST_CHECK( !graph_cache.read(cachefname) );
+}
+
+
+// Sparse table should give the same scores as the full table
+BOOST_AUTO_TEST_CASE(SparseBigramLookaheadTest1)
+{
+    cerr << endl;
+    string cachefname("/tmp/lookaheadtest.lacache");
+    string lafname("data/1k.subwords.2g.arpa");
+
+    Decoder refd, hypd;
+    read_subword_decoder(refd);
+    read_subword_decoder(hypd);
+    PrecomputedFullTableBigramLookahead refla(refd, lafname, false, 1);
+    PrecomputedFullTableBigramLookahead hypla(hypd, lafname, false, 2, "", true);
+    BOOST_CHECK( hypla.m_sparse_word_ids.size()
+                 < (size_t)hypla.m_la_state_count * hypla.m_word_backoff_scores.size() );
+    check_cached_lookahead(refd, refla, hypd, hypla);
+
+    // Rows of each thread are concatenated in state order
+    Decoder threadd;
+    read_subword_decoder(threadd);
+    PrecomputedFullTableBigramLookahead threadla(threadd, lafname, false, 3, "", true);
+    BOOST_CHECK( threadla.m_sparse_offsets == hypla.m_sparse_offsets );
+    BOOST_CHECK( threadla.m_sparse_word_ids == hypla.m_sparse_word_ids );
+    BOOST_CHECK( threadla.m_sparse_scores == hypla.m_sparse_scores );
+
+    remove(cachefname.c_str());
+    Decoder cached1d, cached2d;
+    read_subword_decoder(cached1d);
+    read_subword_decoder(cached2d);
+    PrecomputedFullTableBigramLookahead cached1la(cached1d, lafname, true, 1, cachefname, true);
+    PrecomputedFullTableBigramLookahead cached2la(cached2d, lafname, true, 1, cachefname, true);
+    check_cached_lookahead(cached1d, cached1la, cached2d, cached2la);
+    BOOST_CHECK( cached2la.m_quant_sparse_scores.empty() );
+}
+
+
+BOOST_AUTO_TEST_CASE(TrigramLookaheadTest1)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    DummyBigramLookahead refla(d, "data/1k.subwords.2g.arpa");
+    TrigramLookahead *trila = new TrigramLookahead(d, "data/1k.subwords.2g.arpa");
+    d.m_la = trila;
+    int end_la_state = trila->m_node_la_states[END_NODE];
+
+    int sentence_begin_symbol_idx = d.m_text_unit_map.at("<s>");
+    int sentence_end_symbol_idx = d.m_text_unit_map.at("</s>");
+    int word_count = d.m_la->m_text_unit_id_to_la_ngram_symbol.size();
+
+    // Bigram model, scores should match the bigram scores for any context
+    // Nodes sharing the end node look-ahead state are skipped
+    int idx=0;
+    for (int i=0; i<(int)d.m_nodes.size(); i++) {
+        if (trila->m_node_la_states[i] == end_la_state) continue;
+        int curr_eval_ratio = d.m_nodes[i].flags & NODE_SILENCE ? 1 : _ratio;
+        for (int w=0; w<word_count; w++) {
+            if ((++idx % curr_eval_ratio != 0) && (w != sentence_begin_symbol_idx)) continue;
+            if (w == sentence_end_symbol_idx) continue;
+            int prev_w = idx % word_count;
+            float ref = refla.get_lookahead_score(i, w);
+            float hyp = d.m_la->get_lookahead_score(i, prev_w, w);
+            BOOST_CHECK_CLOSE( ref, hyp, tolerance );
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(TrigramLookaheadTest2)
+{
+    cerr << endl;
+    Decoder d;
+    d.read_phone_model("data/speecon_ml_gain3500_occ300_21.7.2011_22.ph");
+    d.read_noway_lexicon("data/1k.subwords.lex");
+    d.read_dgraph("data/1k.subwords.sww.graph");
+    DummyBigramLookahead refla(d, "data/1k.subwords.3g.arpa");
+    TrigramLookahead *trila = new TrigramLookahead(d, "data/1k.subwords.3g.arpa", 50);
+    d.m_la = trila;
+    int end_la_state = trila->m_node_la_states[END_NODE];
+    Ngram &lm = refla.m_la_lm;
+
+    // Two word contexts with trigrams in the model
+    vector<pair<int, int> > contexts;
+    Ngram::Node &root = lm.nodes[lm.root_node];
+    for (int a1=root.first_arc; a1<=root.last_arc; a1++) {
+        Ngram::Node &nd1 = lm.nodes[lm.arc_target_nodes[a1]];
+        if (nd1.first_arc == -1) continue;
+        for (int a2=nd1.first_arc; a2<=nd1.last_arc; a2++) {
+            if (lm.nodes[lm.arc_target_nodes[a2]].first_arc == -1) continue;
+            string w1 = lm.vocabulary[lm.arc_words[a1]];
+            string w2 = lm.vocabulary[lm.arc_words[a2]];
+            if (d.m_text_unit_map.find(w1) == d.m_text_unit_map.end()) continue;
+            if (d.m_text_unit_map.find(w2) == d.m_text_unit_map.end()) continue;
+            contexts.push_back(make_pair(d.m_text_unit_map[w1], d.m_text_unit_map[w2]));
+        }
+    }
+    BOOST_CHECK( contexts.size() > 0 );
+
+    for (int i=0; i<(int)d.m_nodes.size(); i++) {
+        if (i % _ratio != 0) continue;
+        if (trila->m_node_la_states[i] == end_la_state) continue;
+        vector<int> successor_words;
+        refla.find_successor_words(i, successor_words);
+        for (auto cit = contexts.begin(); cit != contexts.end(); ++cit) {
+            int ctx = lm.advance(lm.root_node, refla.m_text_unit_id_to_la_ngram_symbol[cit->first]);
+            ctx = lm.find_node(ctx, refla.m_text_unit_id_to_la_ngram_symbol[cit->second]);
+
+            float exact = TINY_FLOAT;
+            float trigram_max = TINY_FLOAT;
+            for (auto swit = successor_words.begin(); swit != successor_words.end(); ++swit) {
+                int sym = refla.m_text_unit_id_to_la_ngram_symbol[*swit];
+                float prob = 0.0;
+                lm.score(ctx, sym, prob);
+                exact = max(exact, prob);
+                int tgt = lm.find_node(ctx, sym);
+                if (tgt != -1) trigram_max = max(trigram_max, (float)lm.nodes[tgt].prob);
+            }
+            float bound = lm.nodes[ctx].backoff_prob + refla.get_lookahead_score(i, cit->second);
+            float ref = max(trigram_max, bound);
+            float hyp = d.m_la->get_lookahead_score(i, cit->first, cit->second);
+            BOOST_CHECK_CLOSE( ref, hyp, tolerance );
+            BOOST_CHECK( hyp >= exact - 0.0001 );
+        }
+    }
+
+    BOOST_CHECK( trila->cached_context_count() > 0 );
+    BOOST_CHECK( trila->cached_context_count() <= 50 );
+}
@@ -27,7 +27,7 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest1)
     swwg.create_graph(word_segs, true, false);
 
     BOOST_CHECK_EQUAL( 145, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
     BOOST_CHECK_EQUAL( 145, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
@@ -42,8 +42,8 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest2)
 
     swwg.create_graph(word_segs, true, false);
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
     DecoderGraph::prune_unreachable_nodes(swwg.m_nodes);
 
     BOOST_CHECK( swwg.assert_words(word_segs) );
@@ -64,8 +64,8 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest3)
     swwg.create_graph(word_segs, true, false);
 
     BOOST_CHECK_EQUAL( 145, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
     BOOST_CHECK_EQUAL( 137, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
 
     DecoderGraph::prune_unreachable_nodes(swwg.m_nodes);
@@ -87,9 +87,9 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest4)
 
     BOOST_CHECK_EQUAL( 145, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
     DecoderGraph::prune_unreachable_nodes(swwg.m_nodes);
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
     DecoderGraph::prune_unreachable_nodes(swwg.m_nodes);
     BOOST_CHECK_EQUAL( 137, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
 
@@ -117,13 +117,13 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest5)
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
     DecoderGraph::prune_unreachable_nodes(swwg.m_nodes);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
 
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
@@ -153,11 +153,11 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest6)
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 
@@ -183,8 +183,8 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest7)
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 }
@@ -202,12 +202,12 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest8)
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
 }
@@ -295,11 +295,11 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest13)
     DecoderGraph::push_word_ids_right(swwg.m_nodes);
     BOOST_CHECK( DecoderGraph::assert_subword_ids_right(swwg.m_nodes));
 
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
 
     DecoderGraph::push_word_ids_left(swwg.m_nodes);
     BOOST_CHECK( DecoderGraph::assert_subword_ids_left(swwg.m_nodes));
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
 
     BOOST_CHECK_EQUAL( 96, (int)DecoderGraph::reachable_graph_nodes(swwg.m_nodes) );
     BOOST_CHECK( swwg.assert_words(word_segs) );
@@ -338,11 +338,11 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest15)
     swwg.create_graph(word_segs, false, true);
 
     DecoderGraph::push_word_ids_right(swwg.m_nodes);
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
 
     DecoderGraph::push_word_ids_left(swwg.m_nodes);
     BOOST_CHECK( DecoderGraph::assert_subword_ids_left(swwg.m_nodes));
-    DecoderGraph::tie_state_suffixes(swwg.m_nodes);
+    DecoderGraph::tie_suffixes(swwg.m_nodes, false);
 
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
@@ -408,7 +408,7 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest19)
     BOOST_CHECK( swwg.assert_only_segmented_cw_word_pairs(word_segs) );
 
     DecoderGraph::push_word_ids_right(swwg.m_nodes);
-    DecoderGraph::tie_state_prefixes(swwg.m_nodes, false);
+    DecoderGraph::tie_prefixes(swwg.m_nodes, false);
 
     BOOST_CHECK( swwg.assert_words(word_segs) );
     BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
@@ -528,6 +528,34 @@ BOOST_AUTO_TEST_CASE(SWWGraphTest24)
 }
 
 
+// Test tying prefixes and suffixes until no more nodes can be merged
+BOOST_AUTO_TEST_CASE(SWWGraphTest25)
+{
+    SWWGraph swwg;
+    string segname = "data/bg.segs";
+    read_fixtures(swwg, segname);
+
+    swwg.create_graph(word_segs, false, true);
+    int num_nodes = DecoderGraph::reachable_graph_nodes(swwg.m_nodes);
+
+    DecoderGraph::push_word_ids_right(swwg.m_nodes);
+    int tied_count = DecoderGraph::tie_prefixes(swwg.m_nodes);
+    BOOST_CHECK( tied_count > 0 );
+    BOOST_CHECK_EQUAL( 0, DecoderGraph::tie_prefixes(swwg.m_nodes) );
+
+    DecoderGraph::push_word_ids_left(swwg.m_nodes);
+    tied_count = DecoderGraph::tie_suffixes(swwg.m_nodes);
+    BOOST_CHECK( tied_count > 0 );
+    BOOST_CHECK_EQUAL( 0, DecoderGraph::tie_suffixes(swwg.m_nodes) );
+    BOOST_CHECK( DecoderGraph::reachable_graph_nodes(swwg.m_nodes) < num_nodes );
+
+    BOOST_CHECK( swwg.assert_words(word_segs) );
+    BOOST_CHECK( swwg.assert_only_segmented_words(word_segs) );
+    BOOST_CHECK( swwg.assert_word_pairs(word_segs) );
+    BOOST_CHECK( swwg.assert_only_segmented_cw_word_pairs(word_segs) );
+}
+
+
 // ofstream origoutf("cw_simple.dot");
 // print_dot_digraph(dg, nodes, origoutf);
 // origoutf.close();
@@ -1,6 +1,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "WordGraph.hh"
+#include "GraphValidator.hh"
 
 using namespace std;
 
@@ -59,3 +60,311 @@ BOOST_AUTO_TEST_CASE(WordGraphTest2)
     BOOST_CHECK( wg.assert_only_cw_word_pairs(words) );
 }
 
+
+
+// Test the word tree built in state chain order with suffix merging
+BOOST_AUTO_TEST_CASE(WordGraphTest3)
+{
+    WordGraph wg;
+    read_fixtures(wg);
+
+    set<string> words;
+    wg.read_words("data/1k.words.txt", words);
+
+    vector<string> sorted_words;
+    wg.sort_by_state_chain(words, sorted_words);
+    vector<DecoderGraph::Node> tree_nodes(2);
+    vector<DecoderGraph::Node> minimized_nodes(2);
+    DecoderGraph::MinimizingTreeBuilder tree_builder(minimized_nodes);
+    for (auto wit = sorted_words.begin(); wit != sorted_words.end(); ++wit) {
+        vector<TriphoneNode> word_triphones;
+        wg.triphonize_subword(*wit, word_triphones);
+        vector<DecoderGraph::Node> word_nodes;
+        wg.triphones_to_state_chain(word_triphones, word_nodes);
+        vector<DecoderGraph::Node> word_nodes_copy = word_nodes;
+        wg.add_nodes_to_tree(tree_nodes, word_nodes);
+        tree_builder.add_nodes(word_nodes_copy);
+    }
+    wg.lookahead_to_arcs(tree_nodes);
+    tree_builder.finish();
+    DecoderGraph::prune_unreachable_nodes(minimized_nodes);
+
+    BOOST_CHECK( tree_builder.merged_count() > 0 );
+    BOOST_CHECK_EQUAL( (int)tree_nodes.size() - tree_builder.merged_count(),
+                       (int)minimized_nodes.size() );
+    BOOST_CHECK_EQUAL( DecoderGraph::num_subword_states(tree_nodes),
+                       DecoderGraph::num_subword_states(minimized_nodes) );
+    int tied_count = DecoderGraph::tie_suffixes(minimized_nodes, false);
+    BOOST_CHECK_EQUAL( 0, tied_count );
+
+    vector<DecoderGraph::Node> word_nodes;
+    vector<TriphoneNode> word_triphones;
+    wg.triphonize_subword(sorted_words.front(), word_triphones);
+    wg.triphones_to_state_chain(word_triphones, word_nodes);
+    BOOST_CHECK_THROW( tree_builder.add_nodes(word_nodes), string );
+}
+
+
+// Test that the cross-word network built in threads matches the serial one
+BOOST_AUTO_TEST_CASE(WordGraphTest4)
+{
+    WordGraph wg;
+    string lexname = "data/500.words.1pwords.lex";
+    read_fixtures(wg, lexname);
+
+    set<string> words;
+    wg.read_words("data/500.words.1pwords.txt", words);
+
+    vector<DecoderGraph::Node> serial_nodes;
+    map<int, int> serial_fanout, serial_fanin;
+    wg.m_num_threads = 1;
+    wg.create_crossword_network(words, serial_nodes, serial_fanout, serial_fanin);
+
+    vector<DecoderGraph::Node> threaded_nodes;
+    map<int, int> threaded_fanout, threaded_fanin;
+    wg.m_num_threads = 3;
+    wg.create_crossword_network(words, threaded_nodes, threaded_fanout, threaded_fanin);
+
+    BOOST_CHECK( serial_fanout == threaded_fanout );
+    BOOST_CHECK( serial_fanin == threaded_fanin );
+    BOOST_REQUIRE_EQUAL( serial_nodes.size(), threaded_nodes.size() );
+    int num_differing_nodes = 0;
+    for (unsigned int i=0; i<serial_nodes.size(); i++) {
+        const DecoderGraph::Node &snd = serial_nodes[i];
+        const DecoderGraph::Node &tnd = threaded_nodes[i];
+        if (snd.hmm_state != tnd.hmm_state || snd.word_id != tnd.word_id
+            || snd.flags != tnd.flags || snd.arcs != tnd.arcs)
+            num_differing_nodes++;
+    }
+    BOOST_CHECK_EQUAL( 0, num_differing_nodes );
+}
+
+
+// Test that removing the dummy nodes keeps the words and word pairs
+BOOST_AUTO_TEST_CASE(WordGraphTest5)
+{
+    WordGraph wg;
+    string lexname = "data/500.words.1pwords.lex";
+    read_fixtures(wg, lexname);
+
+    set<string> words;
+    wg.read_words("data/500.words.1pwords.txt", words);
+
+    cerr << endl;
+    wg.create_graph(words, false);
+    wg.tie_graph(false);
+
+    int arc_count = DecoderGraph::num_arcs(wg.m_nodes);
+    int removed_count = DecoderGraph::remove_dummy_nodes(wg.m_nodes, 1);
+    BOOST_CHECK( removed_count > 0 );
+    BOOST_CHECK( DecoderGraph::num_arcs(wg.m_nodes) < arc_count );
+
+    removed_count += DecoderGraph::remove_dummy_nodes(wg.m_nodes, 1000000);
+    cerr << "removed dummy nodes: " << removed_count << endl;
+    int num_dummies = 0;
+    for (unsigned int i=END_NODE+1; i<wg.m_nodes.size(); i++)
+        if (wg.m_nodes[i].hmm_state == -1 && wg.m_nodes[i].word_id == -1) num_dummies++;
+    BOOST_CHECK_EQUAL( 0, num_dummies );
+
+    BOOST_CHECK_EQUAL( 524, DecoderGraph::num_subword_states(wg.m_nodes) );
+    BOOST_CHECK( wg.assert_words(words) );
+    BOOST_CHECK( wg.assert_only_words(words) );
+    BOOST_CHECK( wg.assert_word_pairs(words, 20000) );
+    BOOST_CHECK( wg.assert_only_cw_word_pairs(words) );
+}
+
+
+// Test adding words to a tied graph, includes one phone words
+BOOST_AUTO_TEST_CASE(WordGraphTest6)
+{
+    WordGraph wg;
+    string lexname = "data/500.words.1pwords.lex";
+    read_fixtures(wg, lexname);
+
+    set<string> words;
+    wg.read_words("data/500.words.1pwords.txt", words);
+    set<string> graph_words, new_words;
+    int word_idx = 0;
+    for (auto wit = words.begin(); wit != words.end(); ++wit)
+        if (word_idx++ % 10 == 0) new_words.insert(*wit);
+        else graph_words.insert(*wit);
+
+    cerr << endl;
+    wg.create_graph(graph_words, false);
+    wg.tie_graph(false);
+    int node_count = wg.m_nodes.size();
+    vector<int> new_indices = wg.add_words(new_words);
+
+    BOOST_CHECK_EQUAL( node_count, (int)new_indices.size() );
+    BOOST_CHECK_EQUAL( START_NODE, new_indices[START_NODE] );
+    BOOST_CHECK_EQUAL( END_NODE, new_indices[END_NODE] );
+    BOOST_CHECK( wg.assert_words(new_words) );
+    BOOST_CHECK( wg.assert_word_pairs(new_words) );
+    BOOST_CHECK( wg.assert_only_words(words) );
+    BOOST_CHECK( wg.assert_word_pairs(words, 20000) );
+    BOOST_CHECK( wg.assert_only_cw_word_pairs(words) );
+}
+
+
+// Test adding words to a graph read from a file with the connection points
+BOOST_AUTO_TEST_CASE(WordGraphTest7)
+{
+    WordGraph wg;
+    read_fixtures(wg);
+
+    set<string> words;
+    wg.read_words("data/1k.words.txt", words);
+    set<string> graph_words, candidate_words, new_words;
+    int word_idx = 0;
+    for (auto wit = words.begin(); wit != words.end(); ++wit)
+        if (word_idx++ % 20 == 0) candidate_words.insert(*wit);
+        else graph_words.insert(*wit);
+
+    // New words with the cross-word triphones in the graph,
+    // all the old nodes are kept
+    map<int, int> fanout, fanin;
+    wg.crossword_network_triphones(graph_words, fanout, fanin);
+    for (auto wit = candidate_words.begin(); wit != candidate_words.end(); ++wit) {
+        set<string> word;
+        word.insert(*wit);
+        map<int, int> word_fanout, word_fanin;
+        wg.crossword_network_triphones(word, word_fanout, word_fanin);
+        bool covered = true;
+        for (auto foit = word_fanout.begin(); foit != word_fanout.end(); ++foit)
+            if (fanout.find(foit->first) == fanout.end()) covered = false;
+        for (auto fiit = word_fanin.begin(); fiit != word_fanin.end(); ++fiit)
+            if (fanin.find(fiit->first) == fanin.end()) covered = false;
+        if (covered) new_words.insert(*wit);
+        else graph_words.insert(*wit);
+    }
+    BOOST_REQUIRE( new_words.size() > 0 );
+
+    cerr << endl;
+    wg.create_graph(graph_words, false);
+    wg.tie_graph(false);
+    wg.add_hmm_self_transitions();
+    wg.remap_connection_points(wg.order_nodes_for_locality(wg.m_nodes));
+    string graphfname("/tmp/wgraphtest.graph");
+    string pointsfname("/tmp/wgraphtest.points");
+    wg.write_graph(graphfname);
+    wg.write_connection_points(pointsfname);
+
+    WordGraph uwg;
+    read_fixtures(uwg);
+    uwg.read_graph(graphfname);
+    uwg.read_connection_points(pointsfname);
+    BOOST_CHECK( uwg.m_fanout == wg.m_fanout );
+    BOOST_CHECK( uwg.m_fanin == wg.m_fanin );
+    map<string, vector<string> > new_word_segs;
+    for (auto wit = new_words.begin(); wit != new_words.end(); ++wit)
+        new_word_segs[*wit].push_back(*wit);
+    BOOST_CHECK( uwg.assert_words_not_in_graph(new_word_segs) );
+    vector<int> new_indices = uwg.add_words(new_words);
+
+    for (unsigned int i=0; i<new_indices.size(); i++) {
+        BOOST_REQUIRE( new_indices[i] != -1 );
+        BOOST_CHECK_EQUAL( wg.m_nodes[i].hmm_state, uwg.m_nodes[new_indices[i]].hmm_state );
+        BOOST_CHECK_EQUAL( wg.m_nodes[i].word_id, uwg.m_nodes[new_indices[i]].word_id );
+    }
+    // The checks for only the given words do not follow self transitions
+    BOOST_CHECK( uwg.assert_words(new_words) );
+    BOOST_CHECK( uwg.assert_word_pairs(new_words) );
+    BOOST_CHECK( uwg.assert_words(graph_words) );
+    BOOST_CHECK( uwg.assert_transitions(uwg.m_nodes) );
+}
+
+
+// Test the graph validator against the assert functions
+BOOST_AUTO_TEST_CASE(WordGraphTest8)
+{
+    WordGraph wg;
+    read_fixtures(wg);
+
+    set<string> words;
+    wg.read_words("data/1k.words.txt", words);
+
+    cerr << endl;
+    wg.create_graph(words, false);
+    wg.tie_graph(false);
+
+    GraphValidator validator(wg, 2);
+    BOOST_CHECK_EQUAL( 0, (int)validator.unreachable_nodes().size() );
+    BOOST_CHECK_EQUAL( 0, (int)validator.dead_nodes().size() );
+    BOOST_CHECK( validator.assert_words(words) );
+    BOOST_CHECK( validator.assert_word_pairs(words, 200000) );
+
+    string broken_word = *(words.begin());
+    int word_id = wg.m_subword_map[broken_word];
+    int broken_node = -1;
+    for (int i=0; i<(int)wg.m_nodes.size(); i++)
+        if (wg.m_nodes[i].word_id == word_id) broken_node = i;
+    BOOST_REQUIRE( broken_node != -1 );
+    wg.m_nodes[broken_node].arcs.clear();
+
+    set<string> broken_words;
+    broken_words.insert(broken_word);
+    BOOST_CHECK( !wg.assert_words(broken_words) );
+    GraphValidator broken_validator(wg, 2);
+    vector<int> dead_nodes = broken_validator.dead_nodes();
+    BOOST_CHECK( find(dead_nodes.begin(), dead_nodes.end(), broken_node) != dead_nodes.end() );
+    BOOST_CHECK( !broken_validator.assert_words(broken_words) );
+    BOOST_CHECK( !broken_validator.assert_words(words) );
+    set<string> other_words(++words.begin(), words.end());
+    BOOST_CHECK( broken_validator.assert_words(other_words) );
+}
+
+
+// Renumbering a pruned word tree keeps the arcs and the cross-word contexts,
+// the stale reverse arcs from before the pruning are cleared
+BOOST_AUTO_TEST_CASE(WordGraphTest9)
+{
+    WordGraph wg;
+    read_fixtures(wg);
+
+    set<string> words;
+    wg.read_words("data/1k.words.txt", words);
+
+    vector<string> sorted_words;
+    wg.sort_by_state_chain(words, sorted_words);
+    DecoderGraph::MinimizingTreeBuilder tree_builder(wg.m_nodes);
+    for (auto wit = sorted_words.begin(); wit != sorted_words.end(); ++wit) {
+        vector<TriphoneNode> word_triphones;
+        wg.triphonize_subword(*wit, word_triphones);
+        vector<DecoderGraph::Node> word_nodes;
+        wg.triphones_to_state_chain(word_triphones, word_nodes);
+        if (DecoderGraph::num_triphones(word_triphones) > 1) {
+            word_nodes[3].crossword_contexts().from_fanin.insert(wg.triphone_id(wg.m_lexicon[*wit][0]));
+            word_nodes[word_nodes.size()-4].crossword_contexts().to_fanout.insert(wg.triphone_id(wg.m_lexicon[*wit].back()));
+        }
+        tree_builder.add_nodes(word_nodes);
+    }
+    tree_builder.finish();
+    DecoderGraph::set_reverse_arcs_also_from_unreachable(wg.m_nodes);
+    int unpruned_node_count = wg.m_nodes.size();
+    DecoderGraph::prune_unreachable_nodes(wg.m_nodes);
+    BOOST_REQUIRE( (int)wg.m_nodes.size() < unpruned_node_count );
+
+    vector<DecoderGraph::Node> nodes = wg.m_nodes;
+    vector<int> new_indices = DecoderGraph::order_nodes_for_locality(nodes);
+    BOOST_REQUIRE_EQUAL( nodes.size(), wg.m_nodes.size() );
+
+    int crossword_node_count = 0;
+    for (unsigned int i=0; i<wg.m_nodes.size(); i++) {
+        const DecoderGraph::Node &old_node = wg.m_nodes[i];
+        const DecoderGraph::Node &new_node = nodes[new_indices[i]];
+        BOOST_CHECK_EQUAL( old_node.hmm_state, new_node.hmm_state );
+        BOOST_CHECK_EQUAL( old_node.word_id, new_node.word_id );
+        BOOST_CHECK( new_node.reverse_arcs.size() == 0 );
+        IdSet remapped_arcs;
+        for (auto ait = old_node.arcs.begin(); ait != old_node.arcs.end(); ++ait)
+            remapped_arcs.insert(new_indices[*ait]);
+        BOOST_CHECK( remapped_arcs == new_node.arcs );
+        BOOST_REQUIRE_EQUAL( old_node.crossword == nullptr, new_node.crossword == nullptr );
+        if (old_node.crossword == nullptr) continue;
+        crossword_node_count++;
+        BOOST_CHECK( old_node.crossword->from_fanin == new_node.crossword->from_fanin );
+        BOOST_CHECK( old_node.crossword->to_fanout == new_node.crossword->to_fanout );
+        BOOST_CHECK( old_node.crossword->to_fanout_2 == new_node.crossword->to_fanout_2 );
+    }
+    BOOST_CHECK( crossword_node_count > 0 );
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "FrameSkipAcoustics.hh"
+
+using namespace std;
+
+
+FrameSkipAcoustics::FrameSkipAcoustics(Acoustics &acoustics,
+                                       int frame_skip,
+                                       Combination combination)
+    : m_acoustics(&acoustics),
+      m_frame_skip(max(1, frame_skip)),
+      m_combination(combination),
+      m_num_source_frames(0),
+      m_frame(-1)
+{
+}
+
+
+bool
+FrameSkipAcoustics::go_to(int frame)
+{
+    if (frame == m_frame) return true;
+
+    int num_frames = 0;
+    for (int i=0; i<m_frame_skip; i++) {
+        if (!m_acoustics->go_to(frame * m_frame_skip + i)) break;
+        int num_models = m_acoustics->num_models();
+        if (num_frames == 0) {
+            m_num_models = num_models;
+            m_log_prob_buffer.resize(num_models);
+            for (int m=0; m<num_models; m++)
+                m_log_prob_buffer[m] = m_acoustics->log_prob(m);
+        }
+        else if (m_combination == MAX) {
+            for (int m=0; m<num_models; m++)
+                m_log_prob_buffer[m] = max(m_log_prob_buffer[m], m_acoustics->log_prob(m));
+        }
+        else {
+            for (int m=0; m<num_models; m++)
+                m_log_prob_buffer[m] += m_acoustics->log_prob(m);
+        }
+        num_frames++;
+    }
+    if (num_frames == 0) return false;
+
+    // Sum of the frames for the mean, scaled maximum for the max
+    float scale = m_combination == MAX ? m_frame_skip : (float)m_frame_skip / num_frames;
+    if (scale != 1.0)
+        for (int m=0; m<m_num_models; m++)
+            m_log_prob_buffer[m] *= scale;
+
+    m_num_source_frames = max(m_num_source_frames, frame * m_frame_skip + num_frames);
+    m_frame = frame;
+    m_log_prob = m_log_prob_buffer.data();
+    return true;
+}
+
+
+FrameSkipAcoustics::Combination
+FrameSkipAcoustics::get_combination(string combination)
+{
+    if (combination == "mean") return MEAN;
+    if (combination == "max") return MAX;
+    throw string("Unknown frame combination: " + combination);
+}
+
+
+string
+FrameSkipAcoustics::get_combination_name(Combination combination)
+{
+    return combination == MAX ? "max" : "mean";
+}
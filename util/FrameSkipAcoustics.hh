@@ -0,0 +1,38 @@
+#ifndef FRAMESKIPACOUSTICS_HH
+#define FRAMESKIPACOUSTICS_HH
+
+#include <string>
+#include <vector>
+
+#include "Acoustics.hh"
+
+
+// Combines each k consecutive frames of another Acoustics to one frame.
+// The combined log probability is the maximum or the mean of the frames
+// multiplied by k, so the acoustic scores stay comparable to the
+// language model scores as without skipping.
+class FrameSkipAcoustics : public Acoustics {
+public:
+    enum Combination { MEAN, MAX };
+
+    FrameSkipAcoustics(Acoustics &acoustics,
+                       int frame_skip,
+                       Combination combination=MEAN);
+    virtual bool go_to(int frame);
+
+    // Number of original frames read
+    int num_source_frames() const { return m_num_source_frames; }
+
+    static Combination get_combination(std::string combination);
+    static std::string get_combination_name(Combination combination);
+
+private:
+    Acoustics *m_acoustics;
+    int m_frame_skip;
+    Combination m_combination;
+    int m_num_source_frames;
+    int m_frame;
+    std::vector<float> m_log_prob_buffer;
+};
+
+#endif /* FRAMESKIPACOUSTICS_HH */
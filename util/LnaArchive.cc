@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <set>
+
+#include "LnaArchive.hh"
+
+using namespace std;
+
+
+static const char lna_archive_magic[8] = { 'L', 'N', 'A', 'R', 'C', 'H', '0', '1' };
+static const int lna_header_size = 5;
+static const string lna_archive_suffix(".lnar");
+
+
+static void
+read_lna_header(string lnafname,
+                LnaArchive::Entry &entry)
+{
+    ifstream lnaf(lnafname, ios::binary | ios::ate);
+    if (!lnaf) throw string("Problem opening file: " + lnafname);
+    long long int file_size = lnaf.tellg();
+    lnaf.seekg(0);
+
+    unsigned char header[lna_header_size];
+    if (!lnaf.read((char*)header, lna_header_size))
+        throw string("Problem reading LNA header: " + lnafname);
+    entry.num_models = (header[0] << 24) + (header[1] << 16) + (header[2] << 8) + header[3];
+    entry.lna_bytes = header[4];
+    if (entry.num_models <= 0)
+        throw string("Invalid number of states in LNA file: " + lnafname);
+    if (entry.lna_bytes != 1 && entry.lna_bytes != 2 && entry.lna_bytes != 4)
+        throw string("Invalid LNA byte number in file: " + lnafname);
+    entry.num_frames = (file_size - lna_header_size) / ((long long int)entry.num_models * entry.lna_bytes);
+}
+
+
+static long long int
+aligned(long long int pos)
+{
+    return (pos + 7) & ~7LL;
+}
+
+
+void
+LnaArchive::open(string fname)
+{
+    close();
+    m_fname = fname;
+    m_file.open(fname);
+    const char *data = m_file.data();
+    size_t size = m_file.size();
+    string read_error("Problem reading LNA archive: " + fname);
+
+    long long int num_entries;
+    size_t pos = sizeof(lna_archive_magic) + sizeof(num_entries);
+    if (size < pos || memcmp(data, lna_archive_magic, sizeof(lna_archive_magic)) != 0)
+        throw read_error;
+    memcpy(&num_entries, data + sizeof(lna_archive_magic), sizeof(num_entries));
+    if (num_entries < 0) throw read_error;
+
+    m_entries.resize(num_entries);
+    for (int i=0; i<(int)num_entries; i++) {
+        Entry &entry = m_entries[i];
+        unsigned int id_len;
+        if (pos + sizeof(id_len) > size) throw read_error;
+        memcpy(&id_len, data + pos, sizeof(id_len));
+        pos += sizeof(id_len);
+
+        size_t fields_size = sizeof(int) * 2 + sizeof(long long int) * 2;
+        if (pos + id_len + fields_size > size) throw read_error;
+        entry.id.assign(data + pos, id_len);
+        pos += id_len;
+        memcpy(&entry.num_models, data + pos, sizeof(int));
+        pos += sizeof(int);
+        memcpy(&entry.lna_bytes, data + pos, sizeof(int));
+        pos += sizeof(int);
+        memcpy(&entry.num_frames, data + pos, sizeof(long long int));
+        pos += sizeof(long long int);
+        memcpy(&entry.offset, data + pos, sizeof(long long int));
+        pos += sizeof(long long int);
+
+        long long int data_size = entry.num_frames * entry.num_models * entry.lna_bytes;
+        if (entry.offset < 0 || entry.num_frames < 0 || entry.offset + data_size > (long long int)size)
+            throw read_error;
+        m_entry_idxs[entry.id] = i;
+    }
+}
+
+
+void
+LnaArchive::close()
+{
+    m_file.close();
+    m_entries.clear();
+    m_entry_idxs.clear();
+}
+
+
+const LnaArchive::Entry*
+LnaArchive::find(string id) const
+{
+    auto eit = m_entry_idxs.find(id);
+    if (eit == m_entry_idxs.end()) return nullptr;
+    return &m_entries[eit->second];
+}
+
+
+const unsigned char*
+LnaArchive::frame_data(const Entry &entry) const
+{
+    return (const unsigned char*)m_file.data() + entry.offset;
+}
+
+
+void
+LnaArchive::extract(const Entry &entry,
+                    string lnafname) const
+{
+    ofstream lnaf(lnafname, ios::binary);
+    if (!lnaf) throw string("Problem opening file: " + lnafname);
+    lnaf.put((entry.num_models >> 24) & 0xff);
+    lnaf.put((entry.num_models >> 16) & 0xff);
+    lnaf.put((entry.num_models >> 8) & 0xff);
+    lnaf.put(entry.num_models & 0xff);
+    lnaf.put(entry.lna_bytes);
+    lnaf.write((const char*)frame_data(entry),
+               entry.num_frames * entry.num_models * entry.lna_bytes);
+    lnaf.close();
+    if (lnaf.fail()) throw string("Problem writing file: " + lnafname);
+}
+
+
+void
+LnaArchive::pack(string fname,
+                 const vector<string> &ids,
+                 const vector<string> &lnafnames)
+{
+    if (ids.size() != lnafnames.size())
+        throw string("LnaArchive::pack: utterance id not set for all files");
+
+    vector<Entry> entries(lnafnames.size());
+    set<string> unique_ids;
+    long long int pos = sizeof(lna_archive_magic) + sizeof(long long int);
+    for (int i=0; i<(int)lnafnames.size(); i++) {
+        if (!unique_ids.insert(ids[i]).second)
+            throw string("Duplicate utterance id: " + ids[i]);
+        entries[i].id = ids[i];
+        read_lna_header(lnafnames[i], entries[i]);
+        pos += sizeof(unsigned int) + ids[i].length() + sizeof(int) * 2 + sizeof(long long int) * 2;
+    }
+    for (auto eit = entries.begin(); eit != entries.end(); ++eit) {
+        pos = aligned(pos);
+        eit->offset = pos;
+        pos += eit->num_frames * eit->num_models * eit->lna_bytes;
+    }
+
+    ofstream archivef(fname, ios::binary);
+    if (!archivef) throw string("Problem opening file: " + fname);
+    long long int num_entries = entries.size();
+    archivef.write(lna_archive_magic, sizeof(lna_archive_magic));
+    archivef.write((const char*)&num_entries, sizeof(num_entries));
+    for (auto eit = entries.begin(); eit != entries.end(); ++eit) {
+        unsigned int id_len = eit->id.length();
+        archivef.write((const char*)&id_len, sizeof(id_len));
+        archivef.write(eit->id.c_str(), id_len);
+        archivef.write((const char*)&eit->num_models, sizeof(int));
+        archivef.write((const char*)&eit->lna_bytes, sizeof(int));
+        archivef.write((const char*)&eit->num_frames, sizeof(long long int));
+        archivef.write((const char*)&eit->offset, sizeof(long long int));
+    }
+
+    vector<char> buffer(1 << 20);
+    const char padding[8] = { 0 };
+    for (int i=0; i<(int)entries.size(); i++) {
+        long long int curr_pos = archivef.tellp();
+        archivef.write(padding, entries[i].offset - curr_pos);
+
+        ifstream lnaf(lnafnames[i], ios::binary);
+        lnaf.seekg(lna_header_size);
+        long long int data_left = entries[i].num_frames * entries[i].num_models * entries[i].lna_bytes;
+        while (data_left > 0) {
+            long long int read_size = min(data_left, (long long int)buffer.size());
+            if (!lnaf.read(buffer.data(), read_size))
+                throw string("Problem reading file: " + lnafnames[i]);
+            archivef.write(buffer.data(), read_size);
+            data_left -= read_size;
+        }
+    }
+
+    archivef.close();
+    if (archivef.fail()) throw string("Problem writing file: " + fname);
+}
+
+
+const LnaArchive&
+LnaArchive::get_shared(string fname)
+{
+    static mutex shared_mutex;
+    static map<string, LnaArchive*> shared_archives;
+
+    lock_guard<mutex> lock(shared_mutex);
+    auto ait = shared_archives.find(fname);
+    if (ait != shared_archives.end()) return *(ait->second);
+
+    LnaArchive *archive = new LnaArchive(fname);
+    shared_archives[fname] = archive;
+    return *archive;
+}
+
+
+bool
+LnaArchive::split_entry_name(string lnafname,
+                             string &archive_fname,
+                             string &id)
+{
+    size_t suffix_pos = lnafname.rfind(lna_archive_suffix + ":");
+    if (suffix_pos == string::npos) return false;
+    archive_fname = lnafname.substr(0, suffix_pos + lna_archive_suffix.length());
+    id = lnafname.substr(suffix_pos + lna_archive_suffix.length() + 1);
+    return true;
+}
+
+
+vector<string>
+LnaArchive::expand_lna_fnames(const vector<string> &lnafnames)
+{
+    vector<string> expanded_fnames;
+    for (auto fnit = lnafnames.begin(); fnit != lnafnames.end(); ++fnit) {
+        if (fnit->length() < lna_archive_suffix.length()
+            || fnit->compare(fnit->length() - lna_archive_suffix.length(),
+                             lna_archive_suffix.length(), lna_archive_suffix) != 0)
+        {
+            expanded_fnames.push_back(*fnit);
+            continue;
+        }
+        const LnaArchive &archive = get_shared(*fnit);
+        for (auto eit = archive.entries().begin(); eit != archive.entries().end(); ++eit)
+            expanded_fnames.push_back(*fnit + ":" + eit->id);
+    }
+    return expanded_fnames;
+}
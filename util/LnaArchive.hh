@@ -0,0 +1,66 @@
+#ifndef LNAARCHIVE_HH
+#define LNAARCHIVE_HH
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hh"
+
+
+// Many LNA files packed in one memory mapped file with an index.
+// Utterances are referred as archive.lnar:uttid in the LNA lists,
+// an archive name without the utterance id means all utterances.
+//
+// File layout: magic "LNARCH01", int64 utterance count, index entries
+// (uint32 id length, id, int32 models, int32 bytes per value,
+// int64 frames, int64 data offset) and the frame data of the utterances
+// as in the LNA files, each aligned to eight bytes.
+class LnaArchive {
+public:
+    class Entry {
+    public:
+        Entry() : num_models(0), lna_bytes(0), num_frames(0), offset(0) { }
+        std::string id;
+        int num_models;
+        int lna_bytes;
+        long long int num_frames;
+        long long int offset;
+    };
+
+    LnaArchive() { }
+    LnaArchive(std::string fname) { open(fname); }
+    void open(std::string fname);
+    void close();
+
+    // Returns nullptr if the utterance is not in the archive
+    const Entry* find(std::string id) const;
+    const std::vector<Entry>& entries() const { return m_entries; }
+    const unsigned char* frame_data(const Entry &entry) const;
+    void extract(const Entry &entry, std::string lnafname) const;
+
+    static void pack(std::string fname,
+                     const std::vector<std::string> &ids,
+                     const std::vector<std::string> &lnafnames);
+
+    // Archives opened once and kept open for the process lifetime
+    static const LnaArchive& get_shared(std::string fname);
+
+    // Splits archive.lnar:uttid, returns false for normal LNA files
+    static bool split_entry_name(std::string lnafname,
+                                 std::string &archive_fname,
+                                 std::string &id);
+    // Whole archives are replaced by their utterances
+    static std::vector<std::string> expand_lna_fnames(const std::vector<std::string> &lnafnames);
+
+private:
+    LnaArchive(const LnaArchive&);
+    LnaArchive& operator=(const LnaArchive&);
+
+    std::string m_fname;
+    MappedFile m_file;
+    std::vector<Entry> m_entries;
+    std::map<std::string, int> m_entry_idxs;
+};
+
+#endif /* LNAARCHIVE_HH */
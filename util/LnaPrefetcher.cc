@@ -0,0 +1,189 @@
+#include <chrono>
+#include <exception>
+
+#include "LnaPrefetcher.hh"
+#include "LnaReaderMapped.hh"
+
+using namespace std;
+
+
+void
+LnaBuffer::read_lna_file(string lnafname)
+{
+    LnaReaderMapped lna_reader;
+    lna_reader.open_file(lnafname, 1024);
+    m_num_models = lna_reader.num_models();
+    vector<float> *log_probs = new vector<float>();
+    m_log_probs.reset(log_probs);
+    if (lna_reader.num_frames() > 0)
+        log_probs->reserve((size_t)lna_reader.num_frames() * m_num_models);
+
+    m_num_frames = 0;
+    while (lna_reader.go_to(m_num_frames)) {
+        for (int i=0; i<m_num_models; i++)
+            log_probs->push_back(lna_reader.log_prob(i));
+        m_num_frames++;
+    }
+    lna_reader.close();
+    m_log_prob = nullptr;
+}
+
+
+bool
+LnaBuffer::go_to(int frame)
+{
+    if (frame < 0 || frame >= m_num_frames) return false;
+    m_log_prob = const_cast<float*>(m_log_probs->data()) + (size_t)frame * m_num_models;
+    return true;
+}
+
+
+LnaPrefetcher::LnaPrefetcher(const vector<string> &lnafnames,
+                             int max_files,
+                             long long int memory_budget,
+                             int num_threads)
+    : m_lnafnames(lnafnames),
+      m_use_counts(lnafnames.size(), 1),
+      m_max_files(max_files),
+      m_memory_budget(memory_budget)
+{
+    start(num_threads);
+}
+
+
+LnaPrefetcher::LnaPrefetcher(const vector<string> &lnafnames,
+                             const vector<int> &use_counts,
+                             int max_files,
+                             long long int memory_budget,
+                             int num_threads)
+    : m_lnafnames(lnafnames),
+      m_use_counts(use_counts),
+      m_max_files(max_files),
+      m_memory_budget(memory_budget)
+{
+    if (m_use_counts.size() != m_lnafnames.size())
+        throw string("LnaPrefetcher: use count not set for all files");
+    start(num_threads);
+}
+
+
+LnaPrefetcher::~LnaPrefetcher()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_read_cv.notify_all();
+    for (auto tit = m_threads.begin(); tit != m_threads.end(); ++tit) {
+        (*tit)->join();
+        delete *tit;
+    }
+    for (auto bit = m_buffers.begin(); bit != m_buffers.end(); ++bit)
+        delete *bit;
+}
+
+
+void
+LnaPrefetcher::start(int num_threads)
+{
+    m_buffers.resize(m_lnafnames.size(), nullptr);
+    m_ready.resize(m_lnafnames.size(), false);
+    m_errors.resize(m_lnafnames.size());
+    m_next_file = 0;
+    m_max_requested = -1;
+    m_bytes_in_use = 0;
+    m_stop = false;
+
+    num_threads = max(1, num_threads);
+    for (int t=0; t<num_threads; t++)
+        m_threads.push_back(new thread(&LnaPrefetcher::read_files, this));
+}
+
+
+bool
+LnaPrefetcher::can_read_next() const
+{
+    if (m_next_file >= (int)m_lnafnames.size()) return false;
+    if (m_next_file <= m_max_requested) return true;
+    return m_next_file - m_max_requested - 1 < m_max_files
+           && m_bytes_in_use < m_memory_budget;
+}
+
+
+void
+LnaPrefetcher::read_files()
+{
+    while (true) {
+        unique_lock<mutex> lock(m_mutex);
+        m_read_cv.wait(lock, [this] {
+            return m_stop || m_next_file >= (int)m_lnafnames.size() || can_read_next();
+        });
+        if (m_stop || m_next_file >= (int)m_lnafnames.size()) return;
+        int file_idx = m_next_file++;
+        lock.unlock();
+
+        // Errors are passed to the thread getting the file
+        LnaBuffer *buffer = nullptr;
+        string error;
+        try {
+            buffer = new LnaBuffer();
+            buffer->read_lna_file(m_lnafnames[file_idx]);
+        } catch (string &e) {
+            error = e;
+        } catch (exception &e) {
+            error = "Problem reading LNA file " + m_lnafnames[file_idx] + ": " + e.what();
+        }
+        if (error.length() > 0) {
+            delete buffer;
+            buffer = nullptr;
+        }
+
+        lock.lock();
+        m_buffers[file_idx] = buffer;
+        m_errors[file_idx] = error;
+        m_ready[file_idx] = true;
+        if (buffer != nullptr)
+            m_bytes_in_use += buffer->size_in_bytes();
+        m_ready_cv.notify_all();
+    }
+}
+
+
+LnaBuffer
+LnaPrefetcher::get(int file_idx, double &wait_time)
+{
+    auto start_time = chrono::steady_clock::now();
+    unique_lock<mutex> lock(m_mutex);
+    if (file_idx > m_max_requested) {
+        m_max_requested = file_idx;
+        m_read_cv.notify_all();
+    }
+    m_ready_cv.wait(lock, [this, file_idx] { return m_ready[file_idx]; });
+    wait_time = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    if (m_errors[file_idx].length() > 0) {
+        release_locked(file_idx);
+        throw m_errors[file_idx];
+    }
+    return *m_buffers[file_idx];
+}
+
+
+void
+LnaPrefetcher::release(int file_idx)
+{
+    lock_guard<mutex> lock(m_mutex);
+    release_locked(file_idx);
+}
+
+
+void
+LnaPrefetcher::release_locked(int file_idx)
+{
+    if (--m_use_counts[file_idx] > 0) return;
+    if (m_buffers[file_idx] != nullptr)
+        m_bytes_in_use -= m_buffers[file_idx]->size_in_bytes();
+    delete m_buffers[file_idx];
+    m_buffers[file_idx] = nullptr;
+    m_read_cv.notify_all();
+}
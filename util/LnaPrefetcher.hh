@@ -0,0 +1,83 @@
+#ifndef LNAPREFETCHER_HH
+#define LNAPREFETCHER_HH
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Acoustics.hh"
+
+
+// All frames of one LNA file converted in memory.
+// Copies share the frame data, but have their own frame position.
+class LnaBuffer : public Acoustics {
+public:
+    LnaBuffer() : m_num_frames(0) { }
+    void read_lna_file(std::string lnafname);
+    virtual bool go_to(int frame);
+    int num_frames() const { return m_num_frames; }
+    long long int size_in_bytes() const {
+        return m_log_probs ? m_log_probs->size() * sizeof(float) : 0;
+    }
+
+private:
+    std::shared_ptr<const std::vector<float> > m_log_probs;
+    int m_num_frames;
+};
+
+
+// Reads LNA files of a list in background threads ahead of
+// the decoding threads. At most max_files files are read ahead and
+// reading pauses when the buffers in use exceed the memory budget.
+// A file requested by a decoding thread is always read.
+// Each file is freed after it has been released use_count times.
+class LnaPrefetcher {
+public:
+    LnaPrefetcher(const std::vector<std::string> &lnafnames,
+                  int max_files,
+                  long long int memory_budget,
+                  int num_threads=1);
+    LnaPrefetcher(const std::vector<std::string> &lnafnames,
+                  const std::vector<int> &use_counts,
+                  int max_files,
+                  long long int memory_budget,
+                  int num_threads=1);
+    ~LnaPrefetcher();
+
+    // Blocks until the file is read, wait_time is set to the waiting time in seconds.
+    // Throws if reading the file failed, the use of the file is then released.
+    LnaBuffer get(int file_idx, double &wait_time);
+    void release(int file_idx);
+
+private:
+    LnaPrefetcher(const LnaPrefetcher&);
+    LnaPrefetcher& operator=(const LnaPrefetcher&);
+
+    void start(int num_threads);
+    void read_files();
+    bool can_read_next() const;
+    void release_locked(int file_idx);
+
+    std::vector<std::string> m_lnafnames;
+    std::vector<int> m_use_counts;
+    int m_max_files;
+    long long int m_memory_budget;
+
+    std::vector<LnaBuffer*> m_buffers;
+    std::vector<bool> m_ready;
+    std::vector<std::string> m_errors;
+    int m_next_file;            // Next file to be read
+    int m_max_requested;        // Largest requested file index
+    long long int m_bytes_in_use;
+    bool m_stop;
+
+    std::vector<std::thread*> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_read_cv;
+    std::condition_variable m_ready_cv;
+};
+
+#endif /* LNAPREFETCHER_HH */
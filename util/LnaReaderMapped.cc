@@ -0,0 +1,183 @@
+#include <sys/stat.h>
+#include <cstring>
+#include <algorithm>
+
+#include "LnaArchive.hh"
+#include "LnaReaderMapped.hh"
+
+using namespace std;
+
+
+static const int lna_header_size = 5;
+
+
+LnaReaderMapped::LnaReaderMapped()
+    : m_data(nullptr),
+      m_file(nullptr),
+      m_lna_bytes(1),
+      m_frame_size(0),
+      m_num_frames(-1),
+      m_eof_frame(-1),
+      m_block_size(0),
+      m_block_start(0),
+      m_block_end(0)
+{
+}
+
+
+LnaReaderMapped::~LnaReaderMapped()
+{
+    close();
+}
+
+
+void
+LnaReaderMapped::open_file(string lnafname, int block_size)
+{
+    close();
+    m_fname = lnafname;
+
+    string archive_fname, id;
+    struct stat st;
+    if (LnaArchive::split_entry_name(lnafname, archive_fname, id)) {
+        const LnaArchive &archive = LnaArchive::get_shared(archive_fname);
+        const LnaArchive::Entry *entry = archive.find(id);
+        if (entry == nullptr)
+            throw string("Utterance " + id + " not found in LNA archive: " + archive_fname);
+        m_num_models = entry->num_models;
+        m_lna_bytes = entry->lna_bytes;
+        m_frame_size = m_num_models * m_lna_bytes;
+        m_data = archive.frame_data(*entry);
+        m_num_frames = entry->num_frames;
+        m_eof_frame = m_num_frames;
+    }
+    else if (stat(lnafname.c_str(), &st) == -1)
+        throw string("Problem opening file: " + lnafname);
+    else if (S_ISREG(st.st_mode)) {
+        m_mapped_file.open(lnafname);
+        if (m_mapped_file.size() < (size_t)lna_header_size)
+            throw string("Problem reading LNA header: " + lnafname);
+        read_header((const unsigned char*)m_mapped_file.data());
+        m_data = (const unsigned char*)m_mapped_file.data() + lna_header_size;
+        m_num_frames = (m_mapped_file.size() - lna_header_size) / m_frame_size;
+        m_eof_frame = m_num_frames;
+    }
+    else {
+        m_file = fopen(lnafname.c_str(), "rb");
+        if (m_file == nullptr)
+            throw string("Problem opening file: " + lnafname);
+        unsigned char header[lna_header_size];
+        if (fread(header, lna_header_size, 1, m_file) != 1)
+            throw string("Problem reading LNA header: " + lnafname);
+        read_header(header);
+        m_num_frames = -1;
+        m_eof_frame = -1;
+    }
+
+    m_block_size = max(1, block_size);
+    m_block_start = 0;
+    m_block_end = 0;
+    m_log_prob_buffer.resize((size_t)m_block_size * m_num_models);
+    if (m_file != nullptr)
+        m_read_buffer.resize((size_t)m_block_size * m_frame_size);
+}
+
+
+void
+LnaReaderMapped::close()
+{
+    m_mapped_file.close();
+    m_data = nullptr;
+    if (m_file != nullptr)
+        fclose(m_file);
+    m_file = nullptr;
+    m_log_prob = nullptr;
+    m_block_start = 0;
+    m_block_end = 0;
+}
+
+
+void
+LnaReaderMapped::read_header(const unsigned char *header)
+{
+    m_num_models = (header[0] << 24) + (header[1] << 16) + (header[2] << 8) + header[3];
+    if (m_num_models <= 0)
+        throw string("Invalid number of states in LNA file: " + m_fname);
+
+    m_lna_bytes = header[4];
+    if (m_lna_bytes != 1 && m_lna_bytes != 2 && m_lna_bytes != 4)
+        throw string("Invalid LNA byte number in file: " + m_fname);
+    m_frame_size = m_num_models * m_lna_bytes;
+}
+
+
+// The loops are kept free of branches and buffer wrapping
+// so that the compiler vectorizes them.
+// The conversions give exactly the same values as LnaReaderCircular.
+void
+LnaReaderMapped::convert_frames(const unsigned char *src,
+                                float *dest,
+                                int num_frames) const
+{
+    size_t count = (size_t)num_frames * m_num_models;
+    if (m_lna_bytes == 4)
+        memcpy(dest, src, count * sizeof(float));
+    else if (m_lna_bytes == 2) {
+        for (size_t i=0; i<count; i++)
+            dest[i] = (src[2*i] * 256 + src[2*i+1]) / -1820.0;
+    }
+    else {
+        for (size_t i=0; i<count; i++)
+            dest[i] = src[i] / -24.0;
+    }
+}
+
+
+bool
+LnaReaderMapped::read_block(int frame)
+{
+    if (m_data != nullptr) {
+        m_block_start = frame - frame % m_block_size;
+        m_block_end = min(m_block_start + m_block_size, m_num_frames);
+        convert_frames(m_data + (size_t)m_block_start * m_frame_size,
+                       m_log_prob_buffer.data(),
+                       m_block_end - m_block_start);
+        return true;
+    }
+
+    if (frame < m_block_start)
+        throw string("Can not go back to frame " + to_string(frame)
+                     + " in non-seekable LNA file: " + m_fname);
+
+    while (frame >= m_block_end) {
+        if (m_eof_frame >= 0) return false;
+        size_t frames_read = fread(m_read_buffer.data(), m_frame_size, m_block_size, m_file);
+        if (frames_read == 0) {
+            if (ferror(m_file))
+                throw string("Problem reading LNA file: " + m_fname);
+            m_eof_frame = m_block_end;
+            return false;
+        }
+        convert_frames(m_read_buffer.data(), m_log_prob_buffer.data(), frames_read);
+        m_block_start = m_block_end;
+        m_block_end += frames_read;
+    }
+    return true;
+}
+
+
+bool
+LnaReaderMapped::go_to(int frame)
+{
+    if (m_data == nullptr && m_file == nullptr)
+        throw string("LnaReaderMapped::go_to(): file not opened yet");
+
+    if (frame < 0 || (m_eof_frame >= 0 && frame >= m_eof_frame))
+        return false;
+
+    if (frame < m_block_start || frame >= m_block_end)
+        if (!read_block(frame)) return false;
+
+    m_log_prob = &m_log_prob_buffer[(size_t)(frame - m_block_start) * m_num_models];
+    return true;
+}
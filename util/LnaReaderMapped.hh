@@ -0,0 +1,56 @@
+#ifndef LNAREADERMAPPED_HH
+#define LNAREADERMAPPED_HH
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Acoustics.hh"
+#include "MappedFile.hh"
+
+
+// LNA reader converting blocks of frames at a time.
+// Regular files and utterances in LNA archives (archive.lnar:uttid)
+// are memory mapped and support random access,
+// other files (pipes) are read sequentially in blocks.
+// Frames in the current block are contiguous, so log_prob()
+// reads directly from the converted block without a circular copy.
+class LnaReaderMapped : public Acoustics {
+public:
+    LnaReaderMapped();
+    ~LnaReaderMapped();
+    void open_file(std::string fname, int block_size);
+    void close();
+
+    // Returns false if frame is past end of file.
+    // Throws if a non-seekable file is asked for a frame
+    // before the current block.
+    virtual bool go_to(int frame);
+
+    // Frames in the file, -1 if not known (pipe)
+    int num_frames() const { return m_num_frames; }
+
+private:
+    void read_header(const unsigned char *header);
+    void convert_frames(const unsigned char *src, float *dest, int num_frames) const;
+    bool read_block(int frame);
+
+    MappedFile m_mapped_file;
+    // Frame data of a mapped file or archive entry
+    const unsigned char *m_data;
+    FILE *m_file;
+    std::string m_fname;
+
+    int m_lna_bytes;
+    int m_frame_size;   // Size of a frame in bytes
+    int m_num_frames;
+    int m_eof_frame;
+
+    int m_block_size;   // Size of a block in frames
+    int m_block_start;  // First frame in the block
+    int m_block_end;    // One past the last frame in the block
+    std::vector<float> m_log_prob_buffer;
+    std::vector<unsigned char> m_read_buffer;
+};
+
+#endif /* LNAREADERMAPPED_HH */
@@ -0,0 +1,77 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+
+#include "MappedFile.hh"
+
+using namespace std;
+
+
+MappedFile::MappedFile()
+    : m_data(nullptr),
+      m_size(0)
+{
+}
+
+
+MappedFile::MappedFile(string fname)
+    : m_data(nullptr),
+      m_size(0)
+{
+    open(fname);
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+void
+MappedFile::open(string fname)
+{
+    close();
+
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd == -1) throw string("Problem opening file: " + fname);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ::close(fd);
+        throw string("Problem reading file size: " + fname);
+    }
+    m_size = st.st_size;
+    if (m_size == 0) {
+        ::close(fd);
+        throw string("Empty file: " + fname);
+    }
+
+    void *addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        m_size = 0;
+        throw string("Problem memory mapping file: " + fname);
+    }
+    m_data = static_cast<const char*>(addr);
+}
+
+
+void
+MappedFile::close()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+
+void
+MappedFile::swap(MappedFile &other)
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+}
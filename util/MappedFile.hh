@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_HH
+#define MAPPED_FILE_HH
+
+#include <string>
+
+
+// Read-only memory mapped file
+class MappedFile {
+public:
+    MappedFile();
+    MappedFile(std::string fname);
+    ~MappedFile();
+    void open(std::string fname);
+    void close();
+    void swap(MappedFile &other);
+    bool is_open() const { return m_data != nullptr; }
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char *m_data;
+    size_t m_size;
+};
+
+#endif /* MAPPED_FILE_HH */
@@ -58,7 +58,7 @@ Ngram::score(int node_idx, int word, float &score) const
 void
 Ngram::get_reverse_bigrams(map<int, vector<int> > &reverse_bigrams)
 {
-    if (order() != 2) throw string("Error, not a bigram model.");
+    if (order() < 2) throw string("Error, no bigrams in the model.");
 
     Node &root_nd = nodes[root_node];
     for (int i=root_nd.first_arc; i<=root_nd.last_arc; i++) {
@@ -30,7 +30,7 @@ public:
         unk_symbol_idx(-1),
         unk_symbol("<unk>"),
         max_order(-1) { };
-    ~Ngram() {};
+    virtual ~Ngram() {};
     virtual void read_arpa(std::string arpafname);
     virtual void write_arpa(std::string arpafname);
     int score(int node_idx, int word, double &score) const;
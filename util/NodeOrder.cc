@@ -0,0 +1,81 @@
+#include <string>
+
+#include "defs.hh"
+#include "NodeOrder.hh"
+
+using namespace std;
+
+
+// Places the unplaced nodes reachable from the start node in preorder.
+// Successors are pushed in reverse so the first arc target is placed
+// next, a node with one successor is thus followed by it.
+static void
+place_depth_first(int start_node,
+                  const vector<int> &arc_offsets,
+                  const vector<int> &arc_targets,
+                  const vector<int> &flags,
+                  int required_flags,
+                  vector<bool> &placed,
+                  vector<int> &order)
+{
+    vector<int> stack(1, start_node);
+    while (stack.size()) {
+        int node_idx = stack.back();
+        stack.pop_back();
+        if (placed[node_idx]) continue;
+        placed[node_idx] = true;
+        order.push_back(node_idx);
+
+        for (int a=arc_offsets[node_idx+1]-1; a>=arc_offsets[node_idx]; a--) {
+            int target_node = arc_targets[a];
+            if (placed[target_node]) continue;
+            if ((flags[target_node] & required_flags) != required_flags) continue;
+            stack.push_back(target_node);
+        }
+    }
+}
+
+
+vector<int>
+locality_node_order(const vector<int> &arc_offsets,
+                    const vector<int> &arc_targets,
+                    const vector<int> &flags)
+{
+    int node_count = flags.size();
+    if ((int)arc_offsets.size() != node_count+1)
+        throw string("Problem in node arc offsets.");
+    if (node_count <= END_NODE) throw string("Graph without start and end nodes.");
+
+    vector<bool> placed(node_count, false);
+    vector<int> order;
+    order.reserve(node_count);
+    placed[START_NODE] = true;
+    order.push_back(START_NODE);
+    placed[END_NODE] = true;
+    order.push_back(END_NODE);
+
+    // Cross-word nodes are active at every word boundary
+    for (int i=0; i<node_count; i++)
+        if (!placed[i] && flags[i] & NODE_CW)
+            place_depth_first(i, arc_offsets, arc_targets, flags, NODE_CW, placed, order);
+
+    for (int i=arc_offsets[START_NODE]; i<arc_offsets[START_NODE+1]; i++)
+        place_depth_first(arc_targets[i], arc_offsets, arc_targets, flags, 0, placed, order);
+    for (int i=arc_offsets[END_NODE]; i<arc_offsets[END_NODE+1]; i++)
+        place_depth_first(arc_targets[i], arc_offsets, arc_targets, flags, 0, placed, order);
+
+    for (int i=0; i<node_count; i++)
+        if (!placed[i]) order.push_back(i);
+
+    return order;
+}
+
+
+vector<int>
+invert_node_order(const vector<int> &order)
+{
+    vector<int> new_indices(order.size(), -1);
+    for (int i=0; i<(int)order.size(); i++)
+        new_indices[order[i]] = i;
+    return new_indices;
+}
@@ -0,0 +1,21 @@
+#ifndef NODE_ORDER_HH
+#define NODE_ORDER_HH
+
+#include <vector>
+
+
+// Node order for memory locality in token propagation.
+// The arcs of node i are the targets between arc_offsets[i] and arc_offsets[i+1].
+// START_NODE and END_NODE keep their indices. The cross-word nodes (NODE_CW)
+// are clustered right after them in depth-first order, the rest of the graph
+// follows in depth-first order from START_NODE and END_NODE so that the HMM
+// state chains stay contiguous. Unreachable nodes keep their relative order.
+// Returns the old index of each new node.
+std::vector<int> locality_node_order(const std::vector<int> &arc_offsets,
+                                     const std::vector<int> &arc_targets,
+                                     const std::vector<int> &flags);
+
+// New index of each old node
+std::vector<int> invert_node_order(const std::vector<int> &order);
+
+#endif /* NODE_ORDER_HH */
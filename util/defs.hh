@@ -3,7 +3,7 @@
 
 #include <sstream>
 #include <string>
-#ifndef nullptr
+#if __cplusplus < 201103L
 #include <cstdlib>
 #define nullptr NULL
 #endif